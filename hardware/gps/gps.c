@@ -17,10 +17,12 @@
 */
 
 #include <errno.h>
+#include <stdlib.h>
 #include <pthread.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
+#include <poll.h>
 #include <math.h>
 #include <time.h>
 #include <semaphore.h>
@@ -34,6 +36,9 @@
 #include <cutils/properties.h>
 #include <hardware_legacy/gps.h>
 
+#include "nmea.h"
+#include "ubx.h"
+
 #define  GPS_DEBUG  0
 
 #define  DFR(...)   LOGD(__VA_ARGS__)
@@ -52,9 +57,6 @@
     DFR("gps status callback: 0x%x", _s); \
   }
 
-/* Nmea Parser stuff */
-#define  NMEA_MAX_SIZE  83
-
 enum {
   STATE_QUIT  = 0,
   STATE_INIT  = 1,
@@ -62,8 +64,7 @@ enum {
 };
 
 typedef struct {
-    int     pos;
-    int     overflow;
+    NmeaScanner  scanner;
     int     utc_year;
     int     utc_mon;
     int     utc_day;
@@ -71,9 +72,22 @@ typedef struct {
     GpsLocation  fix;
     GpsSvStatus  sv_status;
     int     sv_status_changed;
-    char    in[ NMEA_MAX_SIZE+1 ];
+    int     epoch_mask;          /* EPOCH_xxx sentences of the current epoch */
+    char    epoch_time[16];      /* their UTC time field, as received */
+    GpsUtcTime  last_fix_time;   /* timestamp of the last delivered fix */
+    UbxScanner  ubx;
+    int     ubx_mode;            /* fixes come from NAV-PVT, NMEA is ignored */
+    int     ack_cls;             /* last CFG message the receiver answered */
+    int     ack_id;
+    int     ack;                 /* 1 ACK, -1 NAK, 0 no answer yet */
 } NmeaReader;
 
+/* a fix is delivered as soon as these have been received for one epoch */
+#define EPOCH_GGA       0x01
+#define EPOCH_RMC       0x02
+#define EPOCH_GSA       0x04
+#define EPOCH_COMPLETE  (EPOCH_GGA | EPOCH_RMC | EPOCH_GSA)
+
 /* Since NMEA parser requires lcoks */
 #define GPS_STATE_LOCK_FIX(_s)         \
 {                                      \
@@ -91,9 +105,13 @@ typedef struct {
     int                     fd;
     GpsCallbacks            callbacks;
     pthread_t               thread;
-    pthread_t               tmr_thread;
     int                     control[2];
-    int                     fix_freq;
+    int                     fix_interval;   /* ms between fixes, 0: every epoch */
+    int                     single_fix;     /* 1: one fix asked for, 2: delivered */
+    int                     ubx_rate_hz;    /* NAV-PVT rate, 0: NMEA only */
+    int                     ubx_rate_auto;  /* rate follows the fix interval */
+    int                     ubx_baud;
+    speed_t                 tty_speed;      /* as found at open */
     sem_t                   fix_sem;
     int                     first_fix;
     NmeaReader              reader;
@@ -108,142 +126,28 @@ static GpsState *gps_state = _gps_state;
 #define GPS_DEV_SLOW_UPDATE_RATE (10)
 #define GPS_DEV_HIGH_UPDATE_RATE (1)
 
+/* overrides the framework's whole second fix interval, in ms */
+#define GPS_FIX_INTERVAL_PROPERTY "debug.gps.fix_interval_ms"
+
 #define GPS_DEV_LOW_BAUD  (B9600)
 #define GPS_DEV_HIGH_BAUD (B19200)
 
+/* "ubx" switches the receiver to binary NAV-PVT/NAV-SVINFO output */
+#define GPS_PROTOCOL_PROPERTY "gps.protocol"
+#define GPS_UBX_RATE_PROPERTY "gps.ubx.rate_hz"
+#define GPS_UBX_BAUD_PROPERTY "gps.ubx.baud"
+
+#define GPS_UBX_MAX_RATE      (10)
+#define GPS_UBX_DEFAULT_BAUD  (115200)
+#define GPS_UBX_ACK_TIMEOUT   (1000)  /* ms */
+
 static void gps_dev_init(int fd);
 static void gps_dev_deinit(int fd);
 static void gps_dev_start(int fd);
 static void gps_dev_stop(int fd);
-static void *gps_timer_thread( void*  arg );
-
-/*****************************************************************/
-/*****************************************************************/
-/*****                                                       *****/
-/*****       N M E A   T O K E N I Z E R                     *****/
-/*****                                                       *****/
-/*****************************************************************/
-/*****************************************************************/
-
-typedef struct {
-    const char*  p;
-    const char*  end;
-} Token;
-
-#define  MAX_NMEA_TOKENS  32
-
-typedef struct {
-    int     count;
-    Token   tokens[ MAX_NMEA_TOKENS ];
-} NmeaTokenizer;
-
-static int
-nmea_tokenizer_init( NmeaTokenizer*  t, const char*  p, const char*  end )
-{
-    int    count = 0;
-    char*  q;
-
-    // the initial '$' is optional
-    if (p < end && p[0] == '$')
-        p += 1;
-
-    // remove trailing newline
-    if (end > p && end[-1] == '\n') {
-        end -= 1;
-        if (end > p && end[-1] == '\r')
-            end -= 1;
-    }
-
-    // get rid of checksum at the end of the sentecne
-    if (end >= p+3 && end[-3] == '*') {
-        end -= 3;
-    }
-
-    while (p < end) {
-        const char*  q = p;
-
-        q = memchr(p, ',', end-p);
-        if (q == NULL)
-            q = end;
-
-        if (count < MAX_NMEA_TOKENS) {
-            t->tokens[count].p   = p;
-            t->tokens[count].end = q;
-            count += 1;
-        }
-
-        if (q < end)
-            q += 1;
-
-        p = q;
-    }
-
-    t->count = count;
-    return count;
-}
-
-static Token
-nmea_tokenizer_get( NmeaTokenizer*  t, int  index )
-{
-    Token  tok;
-    static const char*  dummy = "";
-
-    if (index < 0 || index >= t->count) {
-        tok.p = tok.end = dummy;
-    } else
-        tok = t->tokens[index];
-
-    return tok;
-}
-
-
-static int
-str2int( const char*  p, const char*  end )
-{
-    int   result = 0;
-    int   len    = end - p;
-
-    if (len == 0) {
-      return -1;
-    }
-
-    for ( ; len > 0; len--, p++ )
-    {
-        int  c;
-
-        if (p >= end)
-            goto Fail;
-
-        c = *p - '0';
-        if ((unsigned)c >= 10)
-            goto Fail;
-
-        result = result*10 + c;
-    }
-    return  result;
-
-Fail:
-    return -1;
-}
-
-static double
-str2float( const char*  p, const char*  end )
-{
-    int   result = 0;
-    int   len    = end - p;
-    char  temp[16];
-
-    if (len == 0) {
-      return -1.0;
-    }
-
-    if (len >= (int)sizeof(temp))
-        return 0.;
-
-    memcpy( temp, p, len );
-    temp[len] = 0;
-    return strtod( temp, NULL );
-}
+static int  gps_dev_start_ubx(GpsState *s);
+static void gps_dev_stop_ubx(GpsState *s);
+static void gps_dev_restore_baud(GpsState *s);
 
 /*****************************************************************/
 /*****************************************************************/
@@ -276,8 +180,8 @@ nmea_reader_init( NmeaReader*  r )
 {
     memset( r, 0, sizeof(*r) );
 
-    r->pos      = 0;
-    r->overflow = 0;
+    nmea_scanner_init( &r->scanner );
+    ubx_scanner_init( &r->ubx );
     r->utc_year = -1;
     r->utc_mon  = -1;
     r->utc_day  = -1;
@@ -325,7 +229,9 @@ nmea_reader_update_time( NmeaReader*  r, Token  tok )
     // update time zone offset - it may have changed
     nmea_reader_update_utc_diff( r );
     fix_time = mktime( &tm ) + r->utc_diff;
-    r->fix.timestamp = (long long)fix_time * 1000;
+    // keep the fraction, receivers running faster than 1 Hz need it
+    r->fix.timestamp = (long long)fix_time * 1000 +
+                       (long long)((seconds - tm.tm_sec) * 1000 + 0.5);
     return 0;
 }
 
@@ -372,17 +278,6 @@ nmea_reader_update_date( NmeaReader*  r, Token  date, Token  time )
 }
 
 
-static double
-convert_from_hhmm( Token  tok )
-{
-    double  val     = str2float(tok.p, tok.end);
-    int     degrees = (int)(floor(val) / 100);
-    double  minutes = val - degrees*100.;
-    double  dcoord  = degrees + minutes / 60.0;
-    return dcoord;
-}
-
-
 static int
 nmea_reader_update_latlong( NmeaReader*  r,
                             Token        latitude,
@@ -398,7 +293,10 @@ nmea_reader_update_latlong( NmeaReader*  r,
         D("latitude is too short: '%.*s'", tok.end-tok.p, tok.p);
         return -1;
     }
-    lat = convert_from_hhmm(tok);
+    if (nmea_coord(tok.p, tok.end, &lat) < 0) {
+        D("latitude is malformed: '%.*s'", tok.end-tok.p, tok.p);
+        return -1;
+    }
     if (latitudeHemi == 'S')
         lat = -lat;
 
@@ -407,7 +305,10 @@ nmea_reader_update_latlong( NmeaReader*  r,
         D("longitude is too short: '%.*s'", tok.end-tok.p, tok.p);
         return -1;
     }
-    lon = convert_from_hhmm(tok);
+    if (nmea_coord(tok.p, tok.end, &lon) < 0) {
+        D("longitude is malformed: '%.*s'", tok.end-tok.p, tok.p);
+        return -1;
+    }
     if (longitudeHemi == 'W')
         lon = -lon;
 
@@ -487,22 +388,97 @@ nmea_reader_update_speed( NmeaReader*  r,
 
 
 static void
-nmea_reader_parse( NmeaReader*  r )
+nmea_reader_report_sv( NmeaReader*  r )
+{
+    if (r->sv_status_changed && gps_state->init == STATE_START &&
+        gps_state->callbacks.sv_status_cb) {
+        gps_state->callbacks.sv_status_cb( &r->sv_status );
+        r->sv_status_changed = 0;
+    }
+}
+
+/* hand the fix of the current epoch to the framework, at most once per
+ * fix interval of receiver time */
+static void
+nmea_reader_deliver( NmeaReader*  r )
+{
+    GpsState*  s = gps_state;
+
+    if (!(r->fix.flags & GPS_LOCATION_HAS_LAT_LONG) || s->init != STATE_START)
+        return;
+
+    if (s->single_fix == 2)
+        return;
+
+    /* receiver time going backwards (a week rollover, a bad epoch) would
+     * hold fixes back until it catches up: deliver and start over from it */
+    if (r->last_fix_time && r->fix.timestamp >= r->last_fix_time &&
+        r->fix.timestamp - r->last_fix_time < (GpsUtcTime)s->fix_interval) {
+        D("fix at %lld skipped, interval %d ms", r->fix.timestamp, s->fix_interval);
+        return;
+    }
+
+    D("gps fix cb: 0x%x", r->fix.flags);
+    if (s->callbacks.location_cb) {
+        s->callbacks.location_cb( &r->fix );
+        r->fix.flags = 0;
+        r->last_fix_time = r->fix.timestamp;
+        s->first_fix = 1;
+        if (s->single_fix)
+            s->single_fix = 2;
+    }
+    nmea_reader_report_sv( r );
+}
+
+/* GGA and RMC carry the UTC time of their epoch: a new time closes the
+ * previous epoch, delivered now if the receiver never completed it */
+static void
+nmea_reader_start_epoch( NmeaReader*  r, Token  tok_time )
+{
+    int  len = tok_time.end - tok_time.p;
+
+    if (len <= 0 || len >= (int)sizeof(r->epoch_time))
+        return;
+    if (!memcmp(r->epoch_time, tok_time.p, len) && r->epoch_time[len] == '\0')
+        return;
+
+    if (r->epoch_mask && r->epoch_mask != EPOCH_COMPLETE)
+        nmea_reader_deliver( r );
+
+    memcpy(r->epoch_time, tok_time.p, len);
+    r->epoch_time[len] = '\0';
+    r->epoch_mask = 0;
+    r->fix.flags  = 0;
+}
+
+static void
+nmea_reader_end_sentence( NmeaReader*  r, int  sentence )
+{
+    if (r->epoch_mask == EPOCH_COMPLETE)
+        return;     /* already delivered */
+    r->epoch_mask |= sentence;
+    if (r->epoch_mask == EPOCH_COMPLETE)
+        nmea_reader_deliver( r );
+}
+
+static void
+nmea_reader_parse( void*  opaque, const char*  p, const char*  end )
 {
    /* we received a complete sentence, now parse it to generate
     * a new GPS fix...
     */
+    NmeaReader*    r = opaque;
     NmeaTokenizer  tzer[1];
     Token          tok;
 
-    D("Received: '%.*s'", r->pos, r->in);
+    D("Received: '%.*s'", end-p, p);
 
-    if (r->pos < 9) {
+    if (end - p < 9) {
         D("Too short. discarded.");
         return;
     }
 
-    nmea_tokenizer_init(tzer, r->in, r->in + r->pos);
+    nmea_tokenizer_init(tzer, p, end);
 #if GPS_DEBUG
     {
         int  n;
@@ -538,12 +514,14 @@ nmea_reader_parse( NmeaReader*  r )
           Token  tok_altitude      = nmea_tokenizer_get(tzer,9);
           Token  tok_altitudeUnits = nmea_tokenizer_get(tzer,10);
 
+          nmea_reader_start_epoch(r, tok_time);
           nmea_reader_update_time(r, tok_time);
           nmea_reader_update_latlong(r, tok_latitude,
                                         tok_latitudeHemi.p[0],
                                         tok_longitude,
                                         tok_longitudeHemi.p[0]);
           nmea_reader_update_altitude(r, tok_altitude, tok_altitudeUnits);
+          nmea_reader_end_sentence(r, EPOCH_GGA);
         }
 
     } else if ( !memcmp(tok.p, "GLL", 3) ) {
@@ -591,6 +569,7 @@ nmea_reader_parse( NmeaReader*  r )
 
           }
 
+          nmea_reader_end_sentence(r, EPOCH_GSA);
         }
 
     } else if ( !memcmp(tok.p, "GSV", 3) ) {
@@ -638,6 +617,7 @@ nmea_reader_parse( NmeaReader*  r )
 
           if (sentence == totalSentences) {
               r->sv_status_changed = 1;
+              nmea_reader_report_sv(r);
           }
 
           D("%s: GSV message with total satellites %d", __FUNCTION__, noSatellites);   
@@ -659,6 +639,7 @@ nmea_reader_parse( NmeaReader*  r )
           Token  tok_bearing       = nmea_tokenizer_get(tzer,8);
           Token  tok_date          = nmea_tokenizer_get(tzer,9);
 
+            nmea_reader_start_epoch( r, tok_time );
             nmea_reader_update_date( r, tok_date, tok_time );
 
             nmea_reader_update_latlong( r, tok_latitude,
@@ -668,6 +649,7 @@ nmea_reader_parse( NmeaReader*  r )
 
             nmea_reader_update_bearing( r, tok_bearing );
             nmea_reader_update_speed  ( r, tok_speed );
+            nmea_reader_end_sentence( r, EPOCH_RMC );
         }
 
     } else if ( !memcmp(tok.p, "VTG", 3) ) {
@@ -718,6 +700,8 @@ nmea_reader_parse( NmeaReader*  r )
         if (gps_state->callbacks.location_cb) {
             gps_state->callbacks.location_cb( &r->fix );
             r->fix.flags = 0;
+            if (gps_state->single_fix)
+                gps_state->single_fix = 2;
         }
 
         gps_state->first_fix = 1;
@@ -763,29 +747,163 @@ nmea_reader_parse( NmeaReader*  r )
 }
 
 
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       U B X   P A R S E R                             *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+/* UTC time of a NAV-PVT solution, in ms since the epoch */
+static GpsUtcTime
+ubx_reader_time( const UbxNavPvt*  pvt )
+{
+    /* days since 1970-01-01 in the proleptic Gregorian calendar */
+    int        y   = pvt->year - (pvt->month <= 2);
+    int        era = (y >= 0 ? y : y - 399) / 400;
+    int        yoe = y - era * 400;
+    int        doy = (153 * (pvt->month + (pvt->month > 2 ? -3 : 9)) + 2) / 5
+                     + pvt->day - 1;
+    long long  days = era * 146097LL + yoe * 365 + yoe / 4 - yoe / 100 + doy
+                      - 719468;
+    long long  secs = ((days * 24 + pvt->hour) * 60 + pvt->min) * 60 + pvt->sec;
+
+    /* nano may be negative, round towards the past */
+    return secs * 1000 + (pvt->nano >= 0 ? pvt->nano / 1000000
+                                         : -((999999 - pvt->nano) / 1000000));
+}
+
+/* NAV-PVT is a whole epoch on its own */
 static void
-nmea_reader_addc( NmeaReader*  r, int  c )
+ubx_reader_nav_pvt( NmeaReader*  r, const uint8_t*  payload, int  len )
 {
-    if (r->overflow) {
-        r->overflow = (c != '\n');
+    UbxNavPvt  pvt;
+
+    if (ubx_nav_pvt( payload, len, &pvt ) < 0) {
+        D("NAV-PVT too short: %d bytes", len);
         return;
     }
+    if ((pvt.valid & 0x03) != 0x03) {
+        D("NAV-PVT without valid date and time");
+        return;
+    }
+
+    r->fix.flags     = 0;
+    r->fix.timestamp = ubx_reader_time( &pvt );
 
-    if (r->pos >= (int) sizeof(r->in)-1 ) {
-        r->overflow = 1;
-        r->pos      = 0;
+    // 2D, 3D or GNSS + dead reckoning
+    if (!pvt.fix_ok || pvt.fix_type < 2 || pvt.fix_type > 4)
         return;
+
+    r->fix.flags    |= GPS_LOCATION_HAS_LAT_LONG;
+    r->fix.latitude  = pvt.lat / 1e7;
+    r->fix.longitude = pvt.lon / 1e7;
+
+    if (pvt.fix_type >= 3) {
+        r->fix.flags   |= GPS_LOCATION_HAS_ALTITUDE;
+        r->fix.altitude = pvt.h_msl / 1e3;
     }
 
-    r->in[r->pos] = (char)c;
-    r->pos       += 1;
+    r->fix.flags   |= GPS_LOCATION_HAS_SPEED | GPS_LOCATION_HAS_BEARING;
+    r->fix.speed    = pvt.g_speed / 1e3f;
+    r->fix.bearing  = pvt.head_mot / 1e5f;
+
+    r->fix.flags   |= GPS_LOCATION_HAS_ACCURACY;
+    r->fix.accuracy = pvt.h_acc / 1e3f;
+
+    nmea_reader_deliver( r );
+}
 
-    if (c == '\n') {
-        GPS_STATE_LOCK_FIX(gps_state);
-        nmea_reader_parse( r );
-        GPS_STATE_UNLOCK_FIX(gps_state);
-        r->pos = 0;
+static void
+ubx_reader_nav_svinfo( NmeaReader*  r, const uint8_t*  payload, int  len )
+{
+    int        count = ubx_nav_svinfo_count( payload, len );
+    int        i;
+    UbxSvInfo  sv;
+
+    if (count < 0) {
+        D("NAV-SVINFO malformed: %d bytes", len);
+        return;
     }
+
+    r->sv_status.num_svs          = 0;
+    r->sv_status.ephemeris_mask   = 0;
+    r->sv_status.almanac_mask     = 0;
+    r->sv_status.used_in_fix_mask = 0;
+
+    for (i = 0; i < count && r->sv_status.num_svs < GPS_MAX_SVS; i++) {
+        GpsSvInfo*  info = &r->sv_status.sv_list[r->sv_status.num_svs];
+
+        ubx_nav_svinfo_get( payload, i, &sv );
+        if (sv.svid == 0)
+            continue;   /* idle channel */
+
+        info->prn       = sv.svid;
+        info->snr       = sv.cno;
+        info->elevation = sv.elev;
+        info->azimuth   = sv.azim;
+        r->sv_status.num_svs += 1;
+
+        // same bit order as the GSA path
+        if (sv.svid <= 32) {
+            uint32_t  bit = 1ul << (32 - sv.svid);
+            if (sv.flags & UBX_SV_USED)
+                r->sv_status.used_in_fix_mask |= bit;
+            if (sv.flags & UBX_SV_EPHEMERIS)
+                r->sv_status.ephemeris_mask   |= bit;
+            if (sv.flags & UBX_SV_ALMANAC)
+                r->sv_status.almanac_mask     |= bit;
+        }
+    }
+
+    r->sv_status_changed = 1;
+    nmea_reader_report_sv( r );
+}
+
+static void
+ubx_reader_frame( void*  opaque, int  cls, int  id, const uint8_t*  payload, int  len )
+{
+    NmeaReader*  r = opaque;
+
+    if (cls == UBX_CLASS_NAV && id == UBX_NAV_PVT) {
+        if (r->ubx_mode)
+            ubx_reader_nav_pvt( r, payload, len );
+    }
+    else if (cls == UBX_CLASS_NAV && id == UBX_NAV_SVINFO) {
+        if (r->ubx_mode)
+            ubx_reader_nav_svinfo( r, payload, len );
+    }
+    else if (cls == UBX_CLASS_ACK && len >= 2) {
+        r->ack_cls = payload[0];
+        r->ack_id  = payload[1];
+        r->ack     = (id == UBX_ACK_ACK) ? 1 : -1;
+        D("UBX %s for 0x%02x 0x%02x", (r->ack > 0) ? "ACK" : "NAK",
+          r->ack_cls, r->ack_id);
+    }
+}
+
+/* whatever is not a UBX frame */
+static void
+ubx_reader_text( void*  opaque, const char*  p, int  len )
+{
+    NmeaReader*  r = opaque;
+
+    // the sentences still in flight when the receiver switched over
+    if (r->ubx_mode)
+        return;
+    nmea_scanner_feed( &r->scanner, p, len, nmea_reader_parse, r );
+}
+
+
+/* parse what one read() returned, typically a whole epoch, under a single
+ * hold of the fix lock */
+static void
+nmea_reader_addbuf( NmeaReader*  r, const char*  buf, int  len )
+{
+    GPS_STATE_LOCK_FIX(gps_state);
+    ubx_scanner_feed( &r->ubx, buf, len, ubx_reader_frame, ubx_reader_text, r );
+    GPS_STATE_UNLOCK_FIX(gps_state);
 }
 
 /*****************************************************************/
@@ -804,15 +922,35 @@ enum {
 };
 
 
-static void gps_state_update_fix_freq(GpsState *s, int fix_freq)
+static void
+gps_state_set_fix_interval( GpsState*  s, int  interval_ms )
 {
+    char  prop[PROPERTY_VALUE_MAX];
 
-  s->fix_freq = fix_freq;
-  return;
-
+    if (property_get(GPS_FIX_INTERVAL_PROPERTY, prop, "") > 0)
+        interval_ms = atoi(prop);
+    s->fix_interval = (interval_ms < 0) ? 0 : interval_ms;
+    D("gps fix interval set to %d ms", s->fix_interval);
 }
 
 
+/* navigation rate matching the fix interval: a faster receiver only burns
+ * power on epochs nmea_reader_deliver() throws away */
+static int
+gps_state_ubx_rate( GpsState*  s )
+{
+    int  rate;
+
+    if (s->fix_interval <= 0)
+        return GPS_UBX_MAX_RATE;
+    rate = 1000 / s->fix_interval;
+    if (rate < 1)
+        rate = 1;
+    if (rate > GPS_UBX_MAX_RATE)
+        rate = GPS_UBX_MAX_RATE;
+    return rate;
+}
+
 static void
 gps_state_done( GpsState*  s )
 {
@@ -830,9 +968,7 @@ gps_state_done( GpsState*  s )
 
     pthread_join(s->thread, &dummy);
 
-    /* Timer thread depends on this state check */
     s->init = STATE_QUIT;
-    s->fix_freq = -1;
 
     // close the control socket pair
     close( s->control[0] ); s->control[0] = -1;
@@ -974,32 +1110,36 @@ gps_state_thread( void*  arg )
                             D("gps thread starting  location_cb=%p", state->callbacks.location_cb);
                             started = 1;
 
-                            gps_dev_start(gps_fd);
+                            // an unanswered UBX setup is not retried
+                            if (state->ubx_rate_hz && state->ubx_rate_auto)
+                                state->ubx_rate_hz = gps_state_ubx_rate(state);
+                            if (state->ubx_rate_hz && gps_dev_start_ubx(state) < 0)
+                                state->ubx_rate_hz = 0;
+                            if (!reader->ubx_mode)
+                                gps_dev_start(gps_fd);
 
                             GPS_STATUS_CB(state->callbacks, GPS_STATUS_SESSION_BEGIN);
 
+                            /* fixes now go out from the parser as each
+                             * epoch completes */
+                            GPS_STATE_LOCK_FIX(state);
+                            reader->last_fix_time = 0;
                             state->init = STATE_START;
-
-                            if ( pthread_create( &state->tmr_thread, NULL, gps_timer_thread, state ) != 0 ) {
-                                LOGE("could not create gps timer thread: %s", strerror(errno));
-                                started = 0;
-                                state->init = STATE_INIT;
-                                goto Exit;
-                            }
-
+                            GPS_STATE_UNLOCK_FIX(state);
                         }
                     }
                     else if (cmd == CMD_STOP) {
                         if (started) {
-                            void *dummy;
                             D("gps thread stopping");
                             started = 0;
 
+                            if (reader->ubx_mode)
+                                gps_dev_stop_ubx(state);
                             gps_dev_stop(gps_fd);
 
+                            GPS_STATE_LOCK_FIX(state);
                             state->init = STATE_INIT;
-
-                            pthread_join(state->tmr_thread, &dummy);
+                            GPS_STATE_UNLOCK_FIX(state);
 
                             GPS_STATUS_CB(state->callbacks, GPS_STATUS_SESSION_END);
 
@@ -1009,15 +1149,14 @@ gps_state_thread( void*  arg )
                 else if (fd == gps_fd)
                 {
                     char buf[512];
-                    int  nn, ret;
+                    int  ret;
 
                     do {
                         ret = read( fd, buf, sizeof(buf) );
                     } while (ret < 0 && errno == EINTR);
 
                     if (ret > 0)
-                        for (nn = 0; nn < ret; nn++)
-                            nmea_reader_addc( reader, buf[nn] );
+                        nmea_reader_addbuf( reader, buf, ret );
                     D("gps fd event end");
                 }
                 else
@@ -1029,63 +1168,12 @@ gps_state_thread( void*  arg )
     }
 Exit:
     GPS_STATUS_CB(state->callbacks, GPS_STATUS_ENGINE_OFF);
+    gps_dev_restore_baud(state);
     gps_dev_deinit(gps_fd);
 
     return NULL;
 }
 
-static void*
-gps_timer_thread( void*  arg )
-{
-
-  GpsState *state = (GpsState *)arg;
-
-  DFR("gps entered timer thread");
-
-  do {
-
-    DFR ("gps timer exp");
-
-    GPS_STATE_LOCK_FIX(state);
-
-    if (state->reader.fix.flags != 0) {
-
-      D("gps fix cb: 0x%x", state->reader.fix.flags);
-
-      if (state->callbacks.location_cb) {
-          state->callbacks.location_cb( &state->reader.fix );
-          state->reader.fix.flags = 0;
-          state->first_fix = 1;
-      }
-
-      if (state->fix_freq == 0) {
-        state->fix_freq = -1;
-      }
-
-    }
-
-    if (state->reader.sv_status_changed != 0) {
-
-      D("gps sv status callback");
-
-      if (state->callbacks.sv_status_cb) {
-          state->callbacks.sv_status_cb( &state->reader.sv_status );
-          state->reader.sv_status_changed = 0;
-      }
-
-    }
-
-    GPS_STATE_UNLOCK_FIX(state);
-    sleep(state->fix_freq);
-
-  } while(state->init == STATE_START);
-
-  DFR("gps timer thread destroyed");
-
-  return NULL;
-
-}
-
 static void
 gps_state_init( GpsState*  state )
 {
@@ -1100,8 +1188,26 @@ gps_state_init( GpsState*  state )
     state->control[0] = -1;
     state->control[1] = -1;
     state->fd         = -1;
-    state->fix_freq   = -1;
     state->first_fix  = 0;
+    gps_state_set_fix_interval(state, 1000);
+
+    state->ubx_rate_hz = 0;
+    if (property_get(GPS_PROTOCOL_PROPERTY, prop, "nmea") > 0 &&
+        !strcmp(prop, "ubx")) {
+        /* unset, the receiver computes no more epochs than the framework
+         * asks fixes for, see gps_state_ubx_rate() */
+        property_get(GPS_UBX_RATE_PROPERTY, prop, "");
+        state->ubx_rate_auto = !prop[0];
+        state->ubx_rate_hz = prop[0] ? atoi(prop) : 1;
+        if (state->ubx_rate_hz < 1)
+            state->ubx_rate_hz = 1;
+        if (state->ubx_rate_hz > GPS_UBX_MAX_RATE)
+            state->ubx_rate_hz = GPS_UBX_MAX_RATE;
+
+        property_get(GPS_UBX_BAUD_PROPERTY, prop, "");
+        state->ubx_baud = prop[0] ? atoi(prop) : GPS_UBX_DEFAULT_BAUD;
+        D("gps will try UBX at %d Hz, %d baud", state->ubx_rate_hz, state->ubx_baud);
+    }
 
     if (sem_init(&state->fix_sem, 0, 1) != 0) {
       D("gps semaphore initialization failed! errno = %d", errno);
@@ -1135,10 +1241,14 @@ gps_state_init( GpsState*  state )
     if ( isatty( state->fd ) ) {
         struct termios  ios;
         tcgetattr( state->fd, &ios );
+        state->tty_speed = cfgetospeed( &ios );
         ios.c_lflag = 0;  /* disable ECHO, ICANON, etc... */
         ios.c_oflag &= (~ONLCR); /* Stop \n -> \r\n translation on output */
         ios.c_iflag &= (~(ICRNL | INLCR)); /* Stop \r -> \n & \n -> \r translation on input */
-        ios.c_iflag |= (IGNCR | IXOFF);  /* Ignore \r & XON/XOFF on input */
+        /* raw input for UBX: IGNCR would drop 0x0d bytes, IXON/IXOFF take
+         * 0x11/0x13 as flow control and ISTRIP clears bit 7, each of which
+         * breaks a binary frame's checksum. The NMEA scanner copes with \r. */
+        ios.c_iflag &= (~(IGNCR | ISTRIP | IXON | IXOFF));
         tcsetattr( state->fd, TCSANOW, &ios );
     }
 
@@ -1240,9 +1350,10 @@ freerunner_gps_set_fix_frequency(int freq)
 
     D("%s: called", __FUNCTION__);
 
-    s->fix_freq = (freq <= 0) ? 1 : freq;
-
-    D("gps fix frquency set to %d secs", freq);
+    GPS_STATE_LOCK_FIX(s);
+    s->single_fix = 0;
+    gps_state_set_fix_interval(s, ((freq <= 0) ? 1 : freq) * 1000);
+    GPS_STATE_UNLOCK_FIX(s);
 }
 
 static int
@@ -1269,9 +1380,12 @@ static int freerunner_gps_set_position_mode(GpsPositionMode mode, int fix_freque
         return -1;
     }
 
-    s->fix_freq = fix_frequency;
-
-    D("gps fix frquency set to %d secs", fix_frequency);
+    /* 0 asks for a single fix, the session then stays quiet until the
+     * mode is set again */
+    GPS_STATE_LOCK_FIX(s);
+    s->single_fix = (fix_frequency == 0);
+    gps_state_set_fix_interval(s, fix_frequency * 1000);
+    GPS_STATE_UNLOCK_FIX(s);
 
     return 0;
 }
@@ -1346,30 +1460,38 @@ static void gps_dev_power(int state)
 
 }
 
-static void gps_dev_send(int fd, char *msg)
+static void gps_dev_write(int fd, const void *buf, int len)
 {
-  int i, n, ret;
-
-  i = strlen(msg);
+  int n, ret;
 
   n = 0;
 
   do {
 
-    ret = write(fd, msg + n, i - n);
+    ret = write(fd, (const char *)buf + n, len - n);
 
     if (ret < 0 && errno == EINTR) {
       continue;
     }
 
+    if (ret < 0) {
+      LOGE("gps write failed: %s", strerror(errno));
+      return;
+    }
+
     n += ret;
 
-  } while (n < i);
+  } while (n < len);
 
   return;
 
 }
 
+static void gps_dev_send(int fd, char *msg)
+{
+  gps_dev_write(fd, msg, strlen(msg));
+}
+
 static unsigned char gps_dev_calc_nmea_csum(char *msg)
 {
   unsigned char csum = 0;
@@ -1482,3 +1604,232 @@ static void gps_dev_stop(int fd)
   D("gps dev stop initiated");
 
 }
+
+/* u-blox binary protocol */
+
+static const struct {
+  int     baud;
+  speed_t speed;
+} gps_dev_bauds[] = {
+  {   4800,   B4800 },
+  {   9600,   B9600 },
+  {  19200,  B19200 },
+  {  38400,  B38400 },
+  {  57600,  B57600 },
+  { 115200, B115200 },
+};
+
+static speed_t gps_dev_baud_to_speed(int baud)
+{
+  unsigned int i;
+
+  for (i = 0; i < sizeof(gps_dev_bauds)/sizeof(gps_dev_bauds[0]); ++i) {
+    if (gps_dev_bauds[i].baud == baud)
+      return gps_dev_bauds[i].speed;
+  }
+
+  return 0;
+}
+
+static int gps_dev_speed_to_baud(speed_t speed)
+{
+  unsigned int i;
+
+  for (i = 0; i < sizeof(gps_dev_bauds)/sizeof(gps_dev_bauds[0]); ++i) {
+    if (gps_dev_bauds[i].speed == speed)
+      return gps_dev_bauds[i].baud;
+  }
+
+  return 0;
+}
+
+static speed_t gps_dev_get_tty_speed(int fd)
+{
+  struct termios ios;
+
+  if (tcgetattr(fd, &ios) < 0)
+    return 0;
+
+  return cfgetospeed(&ios);
+}
+
+static void gps_dev_set_tty_speed(int fd, speed_t speed)
+{
+  struct termios ios;
+
+  // let the command asking for the change go out at the old rate
+  tcdrain(fd);
+
+  tcgetattr(fd, &ios);
+  cfsetispeed(&ios, speed);
+  cfsetospeed(&ios, speed);
+  tcsetattr(fd, TCSANOW, &ios);
+
+  D("gps tty speed set to %d", gps_dev_speed_to_baud(speed));
+}
+
+static void gps_dev_send_ubx(int fd, int cls, int id, const uint8_t *payload, int len)
+{
+  uint8_t buff[UBX_OVERHEAD + 16];
+
+  len = ubx_build(buff, cls, id, payload, len);
+
+  gps_dev_write(fd, buff, len);
+
+  D("gps sent UBX 0x%02x 0x%02x, %d bytes", cls, id, len);
+}
+
+static void gps_dev_set_ubx_message_rate(int fd, int id, int rate)
+{
+  // CFG-MSG for the current port: class, id, rate in navigation epochs
+  uint8_t msg[3] = { UBX_CLASS_NAV, id, rate };
+
+  gps_dev_send_ubx(fd, UBX_CLASS_CFG, UBX_CFG_MSG, msg, sizeof(msg));
+}
+
+static void gps_dev_set_ubx_nav_rate(int fd, int ms)
+{
+  // CFG-RATE: measurement period, one solution per measurement, GPS time
+  uint8_t rate[6] = { ms & 0xff, ms >> 8, 1, 0, 1, 0 };
+
+  gps_dev_send_ubx(fd, UBX_CLASS_CFG, UBX_CFG_RATE, rate, sizeof(rate));
+}
+
+/* reads and parses until the receiver answers the CFG message id; 0 on
+ * ACK, -1 on NAK or timeout */
+static int gps_dev_wait_ack(GpsState *s, int id)
+{
+  NmeaReader *r = &s->reader;
+  struct timespec now;
+  long long deadline;
+  int ack;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  deadline = now.tv_sec * 1000LL + now.tv_nsec / 1000000 + GPS_UBX_ACK_TIMEOUT;
+
+  for (;;) {
+    struct pollfd pfd;
+    char buf[512];
+    int ret, timeout;
+
+    GPS_STATE_LOCK_FIX(s);
+    ack = (r->ack_cls == UBX_CLASS_CFG && r->ack_id == id) ? r->ack : 0;
+    GPS_STATE_UNLOCK_FIX(s);
+
+    if (ack)
+      return (ack > 0) ? 0 : -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timeout = deadline - (now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+    if (timeout <= 0) {
+      D("gps UBX 0x%02x not answered", id);
+      return -1;
+    }
+
+    pfd.fd = s->fd;
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, timeout);
+    if (ret <= 0)
+      continue;
+
+    do {
+      ret = read(s->fd, buf, sizeof(buf));
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret > 0)
+      nmea_reader_addbuf(r, buf, ret);
+  }
+}
+
+static int gps_dev_ubx_command(GpsState *s, int id)
+{
+  GPS_STATE_LOCK_FIX(s);
+  s->reader.ack = 0;
+  s->reader.ack_cls = -1;
+  GPS_STATE_UNLOCK_FIX(s);
+
+  return gps_dev_wait_ack(s, id);
+}
+
+/* switch the receiver to NAV-PVT and NAV-SVINFO output at ubx_rate_hz.
+ * Returns -1, with the receiver left on NMEA, if it does not acknowledge */
+static int gps_dev_start_ubx(GpsState *s)
+{
+  int fd = s->fd;
+  speed_t speed = gps_dev_baud_to_speed(s->ubx_baud);
+  int old_baud = gps_dev_speed_to_baud(s->tty_speed);
+  int switched = 0;
+
+  if (isatty(fd) && speed && old_baud && speed != gps_dev_get_tty_speed(fd)) {
+    // PUBX,41 keeps both protocols on the port, the ACKs are UBX
+    gps_dev_set_baud_rate(fd, s->ubx_baud);
+    gps_dev_set_tty_speed(fd, speed);
+    switched = 1;
+  }
+
+  // receivers without NAV-PVT NAK it
+  gps_dev_set_ubx_message_rate(fd, UBX_NAV_PVT, 1);
+  if (gps_dev_ubx_command(s, UBX_CFG_MSG) < 0)
+    goto Fail;
+
+  gps_dev_set_ubx_nav_rate(fd, 1000 / s->ubx_rate_hz);
+  if (gps_dev_ubx_command(s, UBX_CFG_RATE) < 0)
+    goto Fail;
+
+  // the sky view is only needed once a second
+  gps_dev_set_ubx_message_rate(fd, UBX_NAV_SVINFO, s->ubx_rate_hz);
+  if (gps_dev_ubx_command(s, UBX_CFG_MSG) < 0)
+    LOGE("gps receiver refused NAV-SVINFO, no satellite status");
+
+  gps_dev_set_message_rate(fd, 0);
+
+  GPS_STATE_LOCK_FIX(s);
+  s->reader.ubx_mode = 1;
+  GPS_STATE_UNLOCK_FIX(s);
+
+  DFR("gps using UBX at %d Hz, %d baud", s->ubx_rate_hz,
+      gps_dev_speed_to_baud(gps_dev_get_tty_speed(fd)));
+
+  return 0;
+
+Fail:
+  LOGE("gps receiver did not acknowledge UBX setup, staying on NMEA");
+
+  gps_dev_set_ubx_message_rate(fd, UBX_NAV_PVT, 0);
+  gps_dev_set_ubx_nav_rate(fd, 1000);
+
+  if (switched) {
+    gps_dev_set_baud_rate(fd, old_baud);
+    gps_dev_set_tty_speed(fd, s->tty_speed);
+  }
+
+  return -1;
+}
+
+static void gps_dev_stop_ubx(GpsState *s)
+{
+  int fd = s->fd;
+
+  gps_dev_set_ubx_message_rate(fd, UBX_NAV_PVT, 0);
+  gps_dev_set_ubx_message_rate(fd, UBX_NAV_SVINFO, 0);
+  gps_dev_set_ubx_nav_rate(fd, 1000);
+
+  GPS_STATE_LOCK_FIX(s);
+  s->reader.ubx_mode = 0;
+  GPS_STATE_UNLOCK_FIX(s);
+
+  D("gps UBX output stopped");
+}
+
+/* back to the rate the port had at open, for the next power up */
+static void gps_dev_restore_baud(GpsState *s)
+{
+  int fd = s->fd;
+  int old_baud = gps_dev_speed_to_baud(s->tty_speed);
+
+  if (!isatty(fd) || !old_baud || gps_dev_get_tty_speed(fd) == s->tty_speed)
+    return;
+
+  gps_dev_set_baud_rate(fd, old_baud);
+  gps_dev_set_tty_speed(fd, s->tty_speed);
+}
@@ -0,0 +1,373 @@
+/*
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Runs the GPS HAL against the receiver simulator.
+ *
+ * usage: gps_bench [-d seconds] [-f log.nmea] [scenario...]
+ *
+ * gps.c is built into this program with property_get() redirected to
+ * gps_bench_property_get(), which points ro.kernel.android.gps at the
+ * simulator's pseudo-terminal and sets the protocol properties of each
+ * scenario.  For every scenario the HAL is initialized, started for the
+ * given time, stopped and cleaned up through its GpsInterface, and the
+ * following is reported:
+ *  - fixes delivered against epochs the receiver computed;
+ *  - time from start() to the first fix;
+ *  - latency from the first byte of an epoch on the line to the location
+ *    callback, and from its last byte (negative when the fix is complete
+ *    before the epoch's trailing sentences).  Only epochs that went out
+ *    after the first fix count: the ones before wait in the pty while the
+ *    HAL powers the receiver up;
+ *  - CPU time per fix of the HAL, the simulator thread excluded;
+ *  - what the simulated receiver dropped or the line damaged.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <hardware_legacy/gps.h>
+
+#include "gpssim.h"
+
+typedef struct {
+    const char*  name;
+    const char*  protocol;      /* gps.protocol */
+    int          ubx_rate_hz;   /* gps.ubx.rate_hz, -1: unset */
+    int          baud;          /* receiver's rate at power on */
+    int          rate_hz;       /* receiver's navigation rate at power on */
+    int          ubx_pvt;
+    int          corrupt_ppm;
+    int          noise_ppm;
+    int          fix_ms;        /* debug.gps.fix_interval_ms */
+} Scenario;
+
+static const Scenario  sScenarios[] = {
+    { "nmea-1hz",      "nmea",  0, 9600, 1, 1,    0,    0 },
+    /* 5 Hz of NMEA does not fit 9600 baud */
+    { "nmea-5hz-9600", "nmea",  0, 9600, 5, 1,    0,    0 },
+    { "nmea-5hz",      "nmea",  0, 57600, 5, 1,   0,    0 },
+    { "nmea-noisy",    "nmea",  0, 9600, 1, 1,  500,  500 },
+    { "ubx-5hz",       "ubx",   5, 9600, 1, 1,    0,    0 },
+    { "ubx-10hz",      "ubx",  10, 9600, 1, 1,    0,    0 },
+    { "ubx-noisy",     "ubx",  10, 9600, 1, 1,  500,  500 },
+    /* a receiver without NAV-PVT: the HAL stays on NMEA */
+    { "ubx-fallback",  "ubx",   5, 9600, 1, 0,    0,    0 },
+    /* no rate set: the receiver runs at the fix interval */
+    { "ubx-auto",      "ubx",  -1, 9600, 1, 1,    0,    0 },
+    { "ubx-auto-1s",   "ubx",  -1, 9600, 1, 1,    0,    0, 1000 },
+};
+
+#define  SCENARIO_COUNT  (int)(sizeof(sScenarios) / sizeof(sScenarios[0]))
+#define  MAX_FIXES       100000
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       P R O P E R T I E S                             *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+static struct {
+    const char*  key;
+    char         value[PROPERTY_VALUE_MAX];
+} sProps[] = {
+    { "ro.kernel.android.gps", "" },
+    { "gps.power_on",          "/dev/null" },
+    { "gps.protocol",          "" },
+    { "gps.ubx.rate_hz",       "" },
+    { "gps.ubx.baud",          "115200" },
+    { "debug.gps.fix_interval_ms", "" },
+};
+
+static void
+bench_set_property( const char*  key, const char*  value )
+{
+    unsigned  i;
+
+    for (i = 0; i < sizeof(sProps) / sizeof(sProps[0]); i++) {
+        if (!strcmp(sProps[i].key, key))
+            snprintf(sProps[i].value, sizeof(sProps[i].value), "%s", value);
+    }
+}
+
+/* property_get() of gps.c, see Android.mk */
+int
+gps_bench_property_get( const char*  key, char*  value, const char*  default_value )
+{
+    const char*  v = default_value;
+    unsigned     i;
+
+    for (i = 0; i < sizeof(sProps) / sizeof(sProps[0]); i++) {
+        if (!strcmp(sProps[i].key, key) && sProps[i].value[0])
+            v = sProps[i].value;
+    }
+    if (!v) {
+        value[0] = 0;
+        return 0;
+    }
+    snprintf(value, PROPERTY_VALUE_MAX, "%s", v);
+    return strlen(value);
+}
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       C A L L B A C K S                               *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+static pthread_mutex_t  sLock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    int        tod_ms;
+    long long  t;
+} sFix[MAX_FIXES];
+static double           sFromFirst[MAX_FIXES];
+static double           sFromLast[MAX_FIXES];
+static int              sFixes;
+static int              sSvReports;
+
+static long long
+now_ns( int  clock )
+{
+    struct timespec  ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* matched to the simulator's epochs once the run is over, when the last
+ * byte of every epoch has gone out */
+static void
+location_cb( GpsLocation*  location )
+{
+    long long  t = now_ns(CLOCK_MONOTONIC);
+
+    pthread_mutex_lock(&sLock);
+    if (sFixes < MAX_FIXES) {
+        sFix[sFixes].tod_ms = (int)(location->timestamp % 86400000);
+        sFix[sFixes].t      = t;
+        sFixes += 1;
+    }
+    pthread_mutex_unlock(&sLock);
+}
+
+static void
+status_cb( GpsStatus*  status )
+{
+    (void)status;
+}
+
+static void
+sv_status_cb( GpsSvStatus*  sv_info )
+{
+    (void)sv_info;
+    pthread_mutex_lock(&sLock);
+    sSvReports += 1;
+    pthread_mutex_unlock(&sLock);
+}
+
+static void
+nmea_cb( GpsUtcTime  timestamp, const char*  nmea, int  length )
+{
+    (void)timestamp; (void)nmea; (void)length;
+}
+
+static GpsCallbacks  sCallbacks = {
+    location_cb,
+    status_cb,
+    sv_status_cb,
+    nmea_cb,
+};
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       R U N S                                         *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+static int
+compare_double( const void*  a, const void*  b )
+{
+    double  x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double
+percentile( double*  v, int  n, int  pct )
+{
+    if (n <= 0)
+        return 0;
+    return v[(n - 1) * pct / 100];
+}
+
+static int
+run_scenario( const Scenario*  sc, int  seconds, const char*  log )
+{
+    GpsSimConfig         config;
+    GpsSimStats          stats, end;
+    const GpsInterface*  gps = gps_get_hardware_interface();
+    long long            cpu0, cpu1, sim0, sim1, t0, ttff = -1;
+    char                 rate[16];
+    GpsSim*              sim;
+    long long            first, last;
+    int                  i, n = 0, late = 0;
+
+    gps_sim_config_init(&config);
+    config.baud        = sc->baud;
+    config.rate_hz     = sc->rate_hz;
+    config.ubx_pvt     = sc->ubx_pvt;
+    config.corrupt_ppm = sc->corrupt_ppm;
+    config.noise_ppm   = sc->noise_ppm;
+    config.log         = log;
+
+    sim = gps_sim_open(&config);
+    if (!sim || gps_sim_start(sim) < 0) {
+        fprintf(stderr, "%s: could not start the simulator\n", sc->name);
+        return -1;
+    }
+
+    // the HAL opens "/dev/" + ro.kernel.android.gps
+    bench_set_property("ro.kernel.android.gps", gps_sim_device(sim) + 5);
+    bench_set_property("gps.protocol", sc->protocol);
+    if (sc->ubx_rate_hz < 0)
+        rate[0] = 0;
+    else
+        snprintf(rate, sizeof(rate), "%d", sc->ubx_rate_hz);
+    bench_set_property("gps.ubx.rate_hz", rate);
+    snprintf(rate, sizeof(rate), "%d", sc->fix_ms);
+    bench_set_property("debug.gps.fix_interval_ms", rate);
+
+    pthread_mutex_lock(&sLock);
+    sFixes = sSvReports = 0;
+    pthread_mutex_unlock(&sLock);
+
+    if (gps->init(&sCallbacks) < 0) {
+        fprintf(stderr, "%s: HAL init failed\n", sc->name);
+        gps_sim_close(sim);
+        return -1;
+    }
+    // the interval comes from debug.gps.fix_interval_ms, every epoch
+    // unless the scenario says otherwise: 0 here would ask for one fix
+    gps->set_position_mode(GPS_POSITION_MODE_STANDALONE, 1);
+
+    cpu0 = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    sim0 = gps_sim_cpu_ns(sim);
+    t0   = now_ns(CLOCK_MONOTONIC);
+    gps->start();
+    sleep(seconds);
+    // line rate and navigation rate as the session left them
+    gps_sim_get_stats(sim, &stats);
+    gps->stop();
+    cpu1 = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    sim1 = gps_sim_cpu_ns(sim);
+    gps->cleanup();
+
+    gps_sim_get_stats(sim, &end);
+    stats.epochs    = end.epochs;
+    stats.messages  = end.messages;
+    stats.dropped   = end.dropped;
+    stats.corrupted = end.corrupted;
+
+    pthread_mutex_lock(&sLock);
+    if (sFixes > 0)
+        ttff = sFix[0].t - t0;
+    for (i = 0; i < sFixes; i++) {
+        if (gps_sim_epoch_sent(sim, sFix[i].tod_ms, &first, &last) < 0 ||
+            first < sFix[0].t)
+            continue;
+        sFromFirst[n] = (sFix[i].t - first) / 1e6;
+        if (last >= 0)
+            sFromLast[n - late] = (sFix[i].t - last) / 1e6;
+        else
+            late += 1;
+        n += 1;
+    }
+    pthread_mutex_unlock(&sLock);
+
+    gps_sim_close(sim);
+
+    qsort(sFromFirst, n, sizeof(double), compare_double);
+    qsort(sFromLast, n - late, sizeof(double), compare_double);
+
+    printf("%-14s %5d/%-5u %6.0f %6.1f %6.1f %6.1f %7.1f %7.1f %7.1f %6.0f %5u/%-5u %4u %6d %4d\n",
+           sc->name, sFixes, stats.epochs, ttff / 1e6,
+           percentile(sFromFirst, n, 50), percentile(sFromFirst, n, 90),
+           percentile(sFromFirst, n, 99), percentile(sFromFirst, n, 100),
+           percentile(sFromLast, n - late, 50), percentile(sFromLast, n - late, 99),
+           sFixes ? ((cpu1 - cpu0) - (sim1 - sim0)) / 1e3 / sFixes : 0.,
+           stats.dropped, stats.messages, stats.corrupted, stats.baud,
+           stats.rate_hz);
+
+    return 0;
+}
+
+int
+main( int  argc, char**  argv )
+{
+    const char*  log = NULL;
+    int          seconds = 10, i, k, ran = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-d") && i + 1 < argc)
+            seconds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+            log = argv[++i];
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [-d seconds] [-f log.nmea] [scenario...]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%-14s %-11s %6s %-27s %-15s %6s %-11s %4s %6s %4s\n",
+           "", "", "", "from first byte, ms", "after last, ms", "", "receiver",
+           "line", "", "");
+    printf("%-14s %11s %6s %6s %6s %6s %7s %7s %7s %6s %11s %4s %6s %4s\n",
+           "scenario", "fixes/epoch", "ttff", "p50", "p90", "p99", "max", "p50", "p99",
+           "us/fix", "dropped/msg", "bad", "baud", "Hz");
+
+    for (k = 0; k < SCENARIO_COUNT; k++) {
+        int  wanted = 1;
+
+        for (i = 1; i < argc; i++) {
+            if (argv[i][0] == '-') {
+                i += 1;
+                continue;
+            }
+            wanted = 0;
+        }
+        for (i = 1; i < argc && !wanted; i++) {
+            if (!strcmp(argv[i], sScenarios[k].name))
+                wanted = 1;
+        }
+        if (!wanted)
+            continue;
+        run_scenario(&sScenarios[k], seconds, log);
+        ran += 1;
+    }
+    if (!ran) {
+        fprintf(stderr, "scenarios:");
+        for (k = 0; k < SCENARIO_COUNT; k++)
+            fprintf(stderr, " %s", sScenarios[k].name);
+        fprintf(stderr, "\n");
+        return 2;
+    }
+    return 0;
+}
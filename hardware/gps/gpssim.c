@@ -0,0 +1,833 @@
+/*
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define  LOG_TAG  "gpssim"
+
+#include <cutils/log.h>
+
+#include "gpssim.h"
+#include "nmea.h"
+#include "ubx.h"
+
+/* NMEA sentences the receiver can output, in u-blox order */
+enum {
+    SIM_RMC = 0,
+    SIM_VTG,
+    SIM_GGA,
+    SIM_GSA,
+    SIM_GSV,
+    SIM_GLL,
+    SIM_ZDA,
+    SIM_NMEA_COUNT
+};
+
+static const char*  sSentenceIds[SIM_NMEA_COUNT] = {
+    "RMC", "VTG", "GGA", "GSA", "GSV", "GLL", "ZDA"
+};
+
+/* power-on output of a u-blox receiver, in navigation epochs */
+static const int  sDefaultRates[SIM_NMEA_COUNT] = { 1, 1, 1, 1, 1, 1, 0 };
+
+#define  SIM_EPOCHS      4096
+/* the UART hands received bytes over by FIFO trigger level */
+#define  SIM_FIFO        16
+#define  SIM_SATELLITES  8
+
+/* 2010-10-19, a Tuesday */
+#define  SIM_DATE        "191010"
+#define  SIM_START_TOD   (12*3600*1000)
+
+typedef struct {
+    int                 tod_ms;
+    unsigned long long  first;      /* byte offsets in the output stream */
+    unsigned long long  last;
+    long long           first_ns;
+    long long           last_ns;
+} SimEpoch;
+
+struct GpsSim {
+    GpsSimConfig        config;
+    int                 master;
+    char                device[64];
+    int                 control[2];
+    pthread_t           thread;
+    int                 started;
+    pthread_mutex_t     lock;       /* stats and epochs */
+    GpsSimStats         stats;
+
+    /* receiver configuration */
+    int                 nmea_rate[SIM_NMEA_COUNT];
+    int                 pvt_rate;
+    int                 svinfo_rate;
+    int                 out_proto;  /* bit 0 UBX, bit 1 NMEA */
+    int                 period_ms;
+    int                 baud;
+
+    /* output */
+    char*               txq;
+    int                 tx_len;
+    unsigned long long  queued;
+    unsigned long long  sent;
+    double              credit;
+    long long           credit_ns;
+    SimEpoch            epochs[SIM_EPOCHS];
+    unsigned            epoch_count;
+    long long           epoch_index;
+    int                 tod_ms;     /* UTC time of day of the next epoch */
+    long long           next_epoch_ns;
+
+    /* replayed log */
+    char*               log;
+    int                 log_len;
+    int                 log_pos;
+
+    /* commands */
+    UbxScanner          ubx_in;
+    NmeaScanner         nmea_in;
+
+    unsigned            seed;
+};
+
+static long long
+sim_now( void )
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned
+sim_rand( GpsSim*  sim, unsigned  n )
+{
+    sim->seed = sim->seed * 1103515245 + 12345;
+    return n ? (sim->seed >> 8) % n : 0;
+}
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       O U T P U T                                     *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+/* a message goes out whole or not at all, like from the receiver's TX
+ * buffer; the line damages it on the way */
+static void
+sim_queue( GpsSim*  sim, const void*  msg, int  len )
+{
+    const unsigned char*  p = msg;
+    int                   room = sim->config.tx_size - sim->tx_len;
+    int                   i;
+
+    pthread_mutex_lock(&sim->lock);
+    sim->stats.messages += 1;
+    if (len > room) {
+        sim->stats.dropped += 1;
+        pthread_mutex_unlock(&sim->lock);
+        return;
+    }
+
+    for (i = 0; i < len; i++) {
+        unsigned char  c = p[i];
+
+        if (sim->config.noise_ppm && sim->tx_len < sim->config.tx_size - (len - i) &&
+            sim_rand(sim, 1000000) < (unsigned)sim->config.noise_ppm) {
+            sim->txq[sim->tx_len++] = (char)sim_rand(sim, 256);
+            sim->queued += 1;
+            sim->stats.corrupted += 1;
+        }
+        if (sim->config.corrupt_ppm &&
+            sim_rand(sim, 1000000) < (unsigned)sim->config.corrupt_ppm) {
+            c ^= 1 << sim_rand(sim, 8);
+            sim->stats.corrupted += 1;
+        }
+        sim->txq[sim->tx_len++] = (char)c;
+    }
+    sim->queued += len;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+static void
+sim_queue_nmea( GpsSim*  sim, const char*  body )
+{
+    char           msg[NMEA_MAX_SIZE + 16];
+    unsigned char  sum = 0;
+    const char*    p;
+    int            len;
+
+    for (p = body; *p; p++)
+        sum ^= (unsigned char)*p;
+    len = snprintf(msg, sizeof(msg), "$%s*%02X\r\n", body, sum);
+    if (len >= (int)sizeof(msg))
+        return;
+    sim_queue(sim, msg, len);
+}
+
+static void
+sim_queue_ubx( GpsSim*  sim, int  cls, int  id, const uint8_t*  payload, int  len )
+{
+    uint8_t  frame[UBX_MAX_PAYLOAD + UBX_OVERHEAD];
+
+    sim_queue(sim, frame, ubx_build(frame, cls, id, payload, len));
+}
+
+/* write what the line rate allows */
+static void
+sim_transmit( GpsSim*  sim, long long  now )
+{
+    int  n, ret, i;
+
+    if (sim->tx_len == 0) {
+        // an idle line does not save up for later
+        sim->credit    = 0;
+        sim->credit_ns = now;
+        return;
+    }
+
+    if (sim->baud > 0) {
+        double  cap = sim->baud / 10. / 100;     /* 10 ms of line time */
+
+        if (cap < 16)
+            cap = 16;
+        sim->credit += (now - sim->credit_ns) * (sim->baud / 10.) / 1e9;
+        if (sim->credit > cap)
+            sim->credit = cap;
+        n = (int)sim->credit;
+    } else
+        n = sim->tx_len;
+    sim->credit_ns = now;
+
+    if (n > sim->tx_len)
+        n = sim->tx_len;
+    if (n <= 0 || (n < SIM_FIFO && n < sim->tx_len))
+        return;
+
+    ret = write(sim->master, sim->txq, n);
+    if (ret <= 0)
+        return;     /* the HAL is behind, the pty is full */
+
+    pthread_mutex_lock(&sim->lock);
+    memmove(sim->txq, sim->txq + ret, sim->tx_len - ret);
+    sim->tx_len -= ret;
+    sim->credit -= ret;
+    sim->sent   += ret;
+    sim->stats.bytes += ret;
+
+    for (i = 0; i < SIM_EPOCHS; i++) {
+        SimEpoch*  e = &sim->epochs[i];
+        if (e->last == e->first)
+            continue;
+        if (e->first_ns < 0 && sim->sent > e->first)
+            e->first_ns = now;
+        if (e->last_ns < 0 && sim->sent >= e->last)
+            e->last_ns = now;
+    }
+    pthread_mutex_unlock(&sim->lock);
+}
+
+/* nobody has the line open: what the receiver sends is lost */
+static void
+sim_discard( GpsSim*  sim )
+{
+    pthread_mutex_lock(&sim->lock);
+    sim->sent  += sim->tx_len;
+    sim->tx_len = 0;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       E P O C H S                                     *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+static int
+sim_due( GpsSim*  sim, int  rate )
+{
+    return rate > 0 && (sim->epoch_index % rate) == 0;
+}
+
+static void
+sim_format_coord( char*  out, int  size, double  deg, int  width )
+{
+    int     d = (int)deg;
+    double  m = (deg - d) * 60;
+
+    snprintf(out, size, "%0*d%08.5f", width, d, m);
+}
+
+static void
+sim_synthetic_epoch( GpsSim*  sim, int  tod )
+{
+    char    body[128];
+    char    t[16], lat_s[20], lon_s[20];
+    double  secs = (tod - SIM_START_TOD) / 1000.;
+    /* 10 m/s around a 500 m circle */
+    double  a    = secs * 10 / 500;
+    double  lat  = 48.1173 + 500 * sin(a) / 111320.;
+    double  lon  = 11.5167 + 500 * cos(a) / (111320. * cos(48.1173 * M_PI / 180));
+    double  course = fmod(360 - a * 180 / M_PI, 360);
+    int     nmea = (sim->out_proto & 0x02) != 0;
+    int     i;
+
+    snprintf(t, sizeof(t), "%02d%02d%02d.%02d", tod / 3600000, tod / 60000 % 60,
+             tod / 1000 % 60, tod / 10 % 100);
+    sim_format_coord(lat_s, sizeof(lat_s), lat, 2);
+    sim_format_coord(lon_s, sizeof(lon_s), lon, 3);
+
+    if (nmea && sim_due(sim, sim->nmea_rate[SIM_RMC])) {
+        snprintf(body, sizeof(body), "GPRMC,%s,A,%s,N,%s,E,19.438,%.2f,%s,,,A",
+                 t, lat_s, lon_s, course, SIM_DATE);
+        sim_queue_nmea(sim, body);
+    }
+    if (nmea && sim_due(sim, sim->nmea_rate[SIM_VTG])) {
+        snprintf(body, sizeof(body), "GPVTG,%.2f,T,,M,19.438,N,36.000,K,A", course);
+        sim_queue_nmea(sim, body);
+    }
+    if (nmea && sim_due(sim, sim->nmea_rate[SIM_GGA])) {
+        snprintf(body, sizeof(body), "GPGGA,%s,%s,N,%s,E,1,08,1.01,545.4,M,46.9,M,,",
+                 t, lat_s, lon_s);
+        sim_queue_nmea(sim, body);
+    }
+    if (nmea && sim_due(sim, sim->nmea_rate[SIM_GSA]))
+        sim_queue_nmea(sim, "GPGSA,A,3,01,04,07,10,13,16,19,22,,,,,1.80,1.01,1.49");
+    if (nmea && sim_due(sim, sim->nmea_rate[SIM_GSV])) {
+        for (i = 0; i < SIM_SATELLITES; i += 4) {
+            int  k;
+            int  n = snprintf(body, sizeof(body), "GPGSV,%d,%d,%02d",
+                              SIM_SATELLITES / 4, i / 4 + 1, SIM_SATELLITES);
+            for (k = i; k < i + 4; k++)
+                n += snprintf(body + n, sizeof(body) - n, ",%02d,%02d,%03d,%02d",
+                              1 + 3*k, 20 + 5*k, 45*k, 30 + k);
+            sim_queue_nmea(sim, body);
+        }
+    }
+    if (nmea && sim_due(sim, sim->nmea_rate[SIM_GLL])) {
+        snprintf(body, sizeof(body), "GPGLL,%s,N,%s,E,%s,A,A", lat_s, lon_s, t);
+        sim_queue_nmea(sim, body);
+    }
+    if (nmea && sim_due(sim, sim->nmea_rate[SIM_ZDA])) {
+        snprintf(body, sizeof(body), "GPZDA,%s,19,10,2010,00,00", t);
+        sim_queue_nmea(sim, body);
+    }
+
+    if (!(sim->out_proto & 0x01))
+        return;
+
+    if (sim_due(sim, sim->pvt_rate)) {
+        uint8_t  p[92];
+        int32_t  v;
+        int      nano = (tod % 1000) * 1000000;
+
+        memset(p, 0, sizeof(p));
+        p[4] = 2010 & 0xff; p[5] = 2010 >> 8; p[6] = 10; p[7] = 19;
+        p[8] = tod / 3600000; p[9] = tod / 60000 % 60; p[10] = tod / 1000 % 60;
+        p[11] = 0x03;
+        memcpy(p + 16, &nano, 4);
+        p[20] = 3; p[21] = 0x01; p[23] = SIM_SATELLITES;
+        v = (int32_t)lrint(lon * 1e7);     memcpy(p + 24, &v, 4);
+        v = (int32_t)lrint(lat * 1e7);     memcpy(p + 28, &v, 4);
+        v = 592300;                        memcpy(p + 32, &v, 4);
+        v = 545400;                        memcpy(p + 36, &v, 4);
+        v = 2500;                          memcpy(p + 40, &v, 4);
+        v = 10000;                         memcpy(p + 60, &v, 4);
+        v = (int32_t)lrint(course * 1e5);  memcpy(p + 64, &v, 4);
+        sim_queue_ubx(sim, UBX_CLASS_NAV, UBX_NAV_PVT, p, sizeof(p));
+    }
+    if (sim_due(sim, sim->svinfo_rate)) {
+        uint8_t  p[8 + 12*SIM_SATELLITES];
+
+        memset(p, 0, sizeof(p));
+        p[4] = SIM_SATELLITES;
+        for (i = 0; i < SIM_SATELLITES; i++) {
+            uint8_t*  ch = p + 8 + 12*i;
+            ch[0] = i;
+            ch[1] = 1 + 3*i;
+            ch[2] = 0x0d;       /* used, orbit, ephemeris */
+            ch[4] = 30 + i;
+            ch[5] = 20 + 5*i;
+            ch[6] = (45*i) & 0xff;
+            ch[7] = (45*i) >> 8;
+        }
+        sim_queue_ubx(sim, UBX_CLASS_NAV, UBX_NAV_SVINFO, p, sizeof(p));
+    }
+}
+
+/* "hhmmss.ss" to ms, -1 if it is not a time */
+static int
+sim_parse_tod( Token  tok )
+{
+    long long  v;
+
+    if (tok.end - tok.p < 6 || str2fixed(tok.p, tok.end, 3, &v) < 0)
+        return -1;
+    return (int)(v / 10000000) * 3600000 + (int)(v / 100000 % 100) * 60000 +
+           (int)(v % 100000);
+}
+
+/* one epoch of the log: the lines up to the next GGA or RMC with another
+ * time, filtered by the configured rates */
+static int
+sim_log_epoch( GpsSim*  sim )
+{
+    int  tod = -1, wrapped = 0;
+
+    if (!(sim->out_proto & 0x02))
+        return -1;
+
+    for (;;) {
+        const char*    p = sim->log + sim->log_pos;
+        const char*    nl;
+        const char*    end;
+        NmeaTokenizer  tzer[1];
+        Token          tok;
+        int            i;
+
+        if (sim->log_pos >= sim->log_len) {
+            sim->log_pos = 0;       /* loop the log */
+            if (tod >= 0 || wrapped++)
+                return tod;
+            p = sim->log;
+        }
+        nl  = memchr(p, '\n', sim->log + sim->log_len - p);
+        end = nl ? nl + 1 : sim->log + sim->log_len;
+
+        nmea_tokenizer_init(tzer, p, end);
+        tok = nmea_tokenizer_get(tzer, 0);
+        if (tok.end - tok.p >= 5 && p[0] == '$') {
+            int  line_tod = -1;
+
+            if (!memcmp(tok.p + 2, "GGA", 3))
+                line_tod = sim_parse_tod(nmea_tokenizer_get(tzer, 1));
+            else if (!memcmp(tok.p + 2, "RMC", 3))
+                line_tod = sim_parse_tod(nmea_tokenizer_get(tzer, 1));
+
+            if (line_tod >= 0 && tod >= 0 && line_tod != tod)
+                return tod;     /* next epoch, starts with this line */
+            if (line_tod >= 0)
+                tod = line_tod;
+
+            for (i = 0; i < SIM_NMEA_COUNT; i++) {
+                if (!memcmp(tok.p + 2, sSentenceIds[i], 3))
+                    break;
+            }
+            if (i == SIM_NMEA_COUNT || sim_due(sim, sim->nmea_rate[i]))
+                sim_queue(sim, p, end - p);
+        }
+        sim->log_pos = end - sim->log;
+    }
+}
+
+static void
+sim_epoch( GpsSim*  sim )
+{
+    unsigned long long  first = sim->queued;
+    int                 tod;
+    SimEpoch*           e;
+
+    if (sim->log) {
+        tod = sim_log_epoch(sim);
+    } else {
+        tod = sim->tod_ms;
+        sim->tod_ms = (sim->tod_ms + sim->period_ms) % 86400000;
+        sim_synthetic_epoch(sim, tod);
+    }
+
+    pthread_mutex_lock(&sim->lock);
+    e = &sim->epochs[sim->epoch_count++ % SIM_EPOCHS];
+    e->tod_ms   = tod;
+    e->first    = first;
+    e->last     = sim->queued;
+    e->first_ns = -1;
+    e->last_ns  = -1;
+    sim->stats.epochs += 1;
+    pthread_mutex_unlock(&sim->lock);
+
+    sim->epoch_index += 1;
+}
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       C O M M A N D S                                 *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+static void
+sim_ack( GpsSim*  sim, int  id, int  ok )
+{
+    uint8_t  p[2] = { UBX_CLASS_CFG, id };
+
+    sim_queue_ubx(sim, UBX_CLASS_ACK, ok ? UBX_ACK_ACK : UBX_ACK_NAK, p, 2);
+    pthread_mutex_lock(&sim->lock);
+    if (ok)
+        sim->stats.acks += 1;
+    else
+        sim->stats.naks += 1;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+static void
+sim_command_frame( void*  opaque, int  cls, int  id, const uint8_t*  p, int  len )
+{
+    GpsSim*  sim = opaque;
+    int      ok = 1;
+
+    if (cls != UBX_CLASS_CFG)
+        return;
+    pthread_mutex_lock(&sim->lock);
+    sim->stats.commands += 1;
+    pthread_mutex_unlock(&sim->lock);
+
+    if (id == UBX_CFG_MSG && (len == 3 || len == 8)) {
+        // the 8 byte form has a rate per port, UART1 is the second
+        int  rate = (len == 3) ? p[2] : p[3];
+
+        if (p[0] == UBX_CLASS_NAV && p[1] == UBX_NAV_PVT) {
+            if (sim->config.ubx_pvt)
+                sim->pvt_rate = rate;
+            else
+                ok = 0;
+        } else if (p[0] == UBX_CLASS_NAV && p[1] == UBX_NAV_SVINFO)
+            sim->svinfo_rate = rate;
+    }
+    else if (id == UBX_CFG_RATE && len >= 6) {
+        int  ms = p[0] | (p[1] << 8);
+
+        if (ms >= 50) {
+            sim->period_ms = ms;
+            pthread_mutex_lock(&sim->lock);
+            sim->stats.rate_hz = 1000 / ms;
+            pthread_mutex_unlock(&sim->lock);
+        } else
+            ok = 0;
+    }
+    sim_ack(sim, id, ok);
+}
+
+static void
+sim_command_sentence( void*  opaque, const char*  p, const char*  end )
+{
+    GpsSim*        sim = opaque;
+    NmeaTokenizer  tzer[1];
+    Token          tok;
+    int            i;
+
+    nmea_tokenizer_init(tzer, p, end);
+    tok = nmea_tokenizer_get(tzer, 0);
+    if (tok.end - tok.p != 4 || memcmp(tok.p, "PUBX", 4))
+        return;
+    tok = nmea_tokenizer_get(tzer, 1);
+    pthread_mutex_lock(&sim->lock);
+    sim->stats.commands += 1;
+    pthread_mutex_unlock(&sim->lock);
+
+    if (tok.end - tok.p == 2 && !memcmp(tok.p, "40", 2)) {
+        // $PUBX,40,msg,ddc,uart1,uart2,usb,spi
+        Token  msg  = nmea_tokenizer_get(tzer, 2);
+        Token  rate = nmea_tokenizer_get(tzer, 4);
+
+        for (i = 0; i < SIM_NMEA_COUNT; i++) {
+            if (msg.end - msg.p == 3 && !memcmp(msg.p, sSentenceIds[i], 3)) {
+                int  r = str2int(rate.p, rate.end);
+                sim->nmea_rate[i] = (r < 0) ? 0 : r;
+            }
+        }
+    }
+    else if (tok.end - tok.p == 2 && !memcmp(tok.p, "41", 2)) {
+        // $PUBX,41,port,in,out,baud,autobaud
+        Token  port = nmea_tokenizer_get(tzer, 2);
+        Token  out  = nmea_tokenizer_get(tzer, 4);
+        Token  baud = nmea_tokenizer_get(tzer, 5);
+        int    b    = str2int(baud.p, baud.end);
+
+        if (str2int(port.p, port.end) != 1)
+            return;
+        sim->out_proto = (int)strtol(out.p, NULL, 16) & 0x03;
+        if (b > 0) {
+            // the rest of the queue goes out at the new rate
+            sim->baud = b;
+            pthread_mutex_lock(&sim->lock);
+            sim->stats.baud = b;
+            pthread_mutex_unlock(&sim->lock);
+        }
+    }
+}
+
+static void
+sim_command_text( void*  opaque, const char*  p, int  len )
+{
+    GpsSim*  sim = opaque;
+
+    nmea_scanner_feed(&sim->nmea_in, p, len, sim_command_sentence, sim);
+}
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       T H R E A D                                     *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+static void*
+sim_thread( void*  arg )
+{
+    GpsSim*  sim = arg;
+
+    sim->next_epoch_ns = sim_now();
+    sim->credit_ns     = sim->next_epoch_ns;
+
+    for (;;) {
+        struct pollfd  fds[2];
+        long long      now = sim_now();
+        int            timeout, ret;
+
+        while (now >= sim->next_epoch_ns) {
+            sim_epoch(sim);
+            sim->next_epoch_ns += sim->period_ms * 1000000LL;
+        }
+
+        timeout = (int)((sim->next_epoch_ns - now + 999999) / 1000000);
+        if (sim->tx_len > 0 && timeout > 1)
+            timeout = 1;
+
+        fds[0].fd     = sim->master;
+        fds[0].events = POLLIN;
+        fds[1].fd     = sim->control[0];
+        fds[1].events = POLLIN;
+        ret = poll(fds, 2, timeout);
+        if (ret < 0 && errno != EINTR) {
+            LOGE("poll: %s", strerror(errno));
+            break;
+        }
+        if (ret > 0 && (fds[1].revents & POLLIN))
+            break;
+
+        now = sim_now();
+        if (ret > 0 && (fds[0].revents & POLLHUP)) {
+            // no slave open; don't spin on the hangup
+            sim_discard(sim);
+            sim->credit_ns = now;
+            if (sim->next_epoch_ns > now)
+                usleep((sim->next_epoch_ns - now) / 1000);
+            continue;
+        }
+        if (ret > 0 && (fds[0].revents & POLLIN)) {
+            char  buf[512];
+            int   n = read(sim->master, buf, sizeof(buf));
+            if (n > 0)
+                ubx_scanner_feed(&sim->ubx_in, buf, n, sim_command_frame,
+                                 sim_command_text, sim);
+        }
+        sim_transmit(sim, now);
+    }
+    return NULL;
+}
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       I N T E R F A C E                               *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+void
+gps_sim_config_init( GpsSimConfig*  config )
+{
+    memset(config, 0, sizeof(*config));
+    config->baud    = 9600;
+    config->rate_hz = 1;
+    config->ubx_pvt = 1;
+    config->tx_size = 4096;
+    config->seed    = 1;
+}
+
+static int
+sim_load_log( GpsSim*  sim, const char*  path )
+{
+    FILE*  f = fopen(path, "rb");
+    long   size;
+
+    if (!f) {
+        LOGE("could not open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    sim->log = malloc(size + 1);
+    if (!sim->log || size <= 0 || fread(sim->log, 1, size, f) != (size_t)size) {
+        LOGE("could not read %s", path);
+        fclose(f);
+        return -1;
+    }
+    sim->log_len = size;
+    fclose(f);
+    return 0;
+}
+
+GpsSim*
+gps_sim_open( const GpsSimConfig*  config )
+{
+    GpsSim*         sim = calloc(1, sizeof(*sim));
+    struct termios  ios;
+    int             i;
+
+    if (!sim)
+        return NULL;
+
+    sim->config     = *config;
+    sim->master     = -1;
+    sim->control[0] = sim->control[1] = -1;
+    pthread_mutex_init(&sim->lock, NULL);
+
+    if (sim->config.rate_hz <= 0)
+        sim->config.rate_hz = 1;
+    if (sim->config.tx_size <= 0)
+        sim->config.tx_size = 4096;
+
+    for (i = 0; i < SIM_NMEA_COUNT; i++)
+        sim->nmea_rate[i] = sDefaultRates[i];
+    sim->out_proto = 0x03;
+    sim->period_ms = 1000 / sim->config.rate_hz;
+    sim->tod_ms    = SIM_START_TOD;
+    sim->baud      = sim->config.baud;
+    sim->seed      = sim->config.seed;
+    sim->stats.baud    = sim->baud;
+    sim->stats.rate_hz = 1000 / sim->period_ms;
+    ubx_scanner_init(&sim->ubx_in);
+    nmea_scanner_init(&sim->nmea_in);
+
+    sim->txq = malloc(sim->config.tx_size);
+    if (!sim->txq)
+        goto Fail;
+    if (sim->config.log && sim_load_log(sim, sim->config.log) < 0)
+        goto Fail;
+
+    sim->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (sim->master < 0 || grantpt(sim->master) < 0 || unlockpt(sim->master) < 0) {
+        LOGE("could not create pseudo-terminal: %s", strerror(errno));
+        goto Fail;
+    }
+    snprintf(sim->device, sizeof(sim->device), "%s", ptsname(sim->master));
+
+    // raw bytes both ways, whatever the HAL does on its side
+    tcgetattr(sim->master, &ios);
+    cfmakeraw(&ios);
+    tcsetattr(sim->master, TCSANOW, &ios);
+    fcntl(sim->master, F_SETFL, fcntl(sim->master, F_GETFL) | O_NONBLOCK);
+
+    if (pipe(sim->control) < 0)
+        goto Fail;
+
+    return sim;
+
+Fail:
+    gps_sim_close(sim);
+    return NULL;
+}
+
+const char*
+gps_sim_device( GpsSim*  sim )
+{
+    return sim->device;
+}
+
+int
+gps_sim_start( GpsSim*  sim )
+{
+    if (pthread_create(&sim->thread, NULL, sim_thread, sim) != 0)
+        return -1;
+    sim->started = 1;
+    return 0;
+}
+
+void
+gps_sim_stop( GpsSim*  sim )
+{
+    char  cmd = 0;
+
+    if (!sim->started)
+        return;
+    write(sim->control[1], &cmd, 1);
+    pthread_join(sim->thread, NULL);
+    sim->started = 0;
+}
+
+void
+gps_sim_close( GpsSim*  sim )
+{
+    gps_sim_stop(sim);
+    if (sim->master >= 0)
+        close(sim->master);
+    if (sim->control[0] >= 0) {
+        close(sim->control[0]);
+        close(sim->control[1]);
+    }
+    pthread_mutex_destroy(&sim->lock);
+    free(sim->txq);
+    free(sim->log);
+    free(sim);
+}
+
+void
+gps_sim_get_stats( GpsSim*  sim, GpsSimStats*  stats )
+{
+    pthread_mutex_lock(&sim->lock);
+    *stats = sim->stats;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+long long
+gps_sim_cpu_ns( GpsSim*  sim )
+{
+    clockid_t        clock;
+    struct timespec  ts;
+
+    if (!sim->started || pthread_getcpuclockid(sim->thread, &clock) != 0 ||
+        clock_gettime(clock, &ts) < 0)
+        return 0;
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int
+gps_sim_epoch_sent( GpsSim*  sim, int  tod_ms, long long*  first_ns, long long*  last_ns )
+{
+    int  i, ret = -1;
+
+    pthread_mutex_lock(&sim->lock);
+    for (i = 0; i < SIM_EPOCHS; i++) {
+        SimEpoch*  e = &sim->epochs[i];
+        if (e->tod_ms == tod_ms && e->last > e->first && e->first_ns >= 0) {
+            *first_ns = e->first_ns;
+            *last_ns  = e->last_ns;
+            ret = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sim->lock);
+    return ret;
+}
@@ -0,0 +1,77 @@
+/*
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef _GPSSIM_H
+#define _GPSSIM_H
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/* A u-blox like receiver behind a pseudo-terminal.  It streams synthetic
+ * or recorded NMEA, and NAV-PVT/NAV-SVINFO once enabled, at the serial
+ * rate it is set to, and answers $PUBX,40/41, CFG-MSG and CFG-RATE the
+ * way the HAL expects. */
+
+typedef struct {
+    int          baud;          /* serial rate paced on the line, 0: unpaced */
+    int          rate_hz;       /* navigation epochs per second */
+    int          ubx_pvt;       /* 0 NAKs NAV-PVT, as receivers before it did */
+    const char*  log;           /* NMEA log replayed instead of synthetic data */
+    int          corrupt_ppm;   /* output bytes with a bit flipped, per million */
+    int          noise_ppm;     /* garbage bytes inserted, per million */
+    int          tx_size;       /* receiver TX buffer, what does not fit is lost */
+    unsigned     seed;
+} GpsSimConfig;
+
+typedef struct {
+    unsigned  epochs;           /* navigation epochs computed */
+    unsigned  messages;         /* messages queued for output */
+    unsigned  dropped;          /* messages lost, TX buffer full */
+    unsigned  bytes;            /* bytes written to the line */
+    unsigned  corrupted;        /* bytes damaged or inserted */
+    unsigned  commands;         /* configuration commands received */
+    unsigned  acks;
+    unsigned  naks;
+    int       baud;             /* current line rate */
+    int       rate_hz;          /* current navigation rate */
+} GpsSimStats;
+
+typedef struct GpsSim  GpsSim;
+
+void  gps_sim_config_init( GpsSimConfig*  config );
+
+/* creates the pseudo-terminal, NULL on error */
+GpsSim*      gps_sim_open( const GpsSimConfig*  config );
+/* the slave side, for the HAL to open */
+const char*  gps_sim_device( GpsSim*  sim );
+int   gps_sim_start( GpsSim*  sim );
+void  gps_sim_stop( GpsSim*  sim );
+void  gps_sim_close( GpsSim*  sim );
+
+void  gps_sim_get_stats( GpsSim*  sim, GpsSimStats*  stats );
+/* CPU time used by the simulator thread, in ns */
+long long  gps_sim_cpu_ns( GpsSim*  sim );
+
+/* when the first and the last byte of the epoch with this UTC time of
+ * day went out on the line, CLOCK_MONOTONIC ns; -1 if unknown or not
+ * sent yet */
+int   gps_sim_epoch_sent( GpsSim*  sim, int  tod_ms,
+                          long long*  first_ns, long long*  last_ns );
+
+__END_DECLS
+
+#endif /* _GPSSIM_H */
@@ -0,0 +1,303 @@
+/*
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <string.h>
+
+#include "nmea.h"
+
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       N M E A   S C A N N E R                         *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+static int
+hex2int( int  c )
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+int
+nmea_checksum_ok( const char*  p, const char*  end )
+{
+    unsigned char  sum = 0;
+    int            hi, lo;
+
+    while (end > p && (end[-1] == '\n' || end[-1] == '\r'))
+        end -= 1;
+
+    if (p < end && p[0] == '$')
+        p += 1;
+
+    if (end - p < 3 || end[-3] != '*')
+        return 0;
+
+    hi = hex2int(end[-2]);
+    lo = hex2int(end[-1]);
+    if (hi < 0 || lo < 0)
+        return 0;
+
+    for (end -= 3; p < end; p++)
+        sum ^= (unsigned char)*p;
+
+    return sum == ((hi << 4) | lo);
+}
+
+void
+nmea_scanner_init( NmeaScanner*  s )
+{
+    memset( s, 0, sizeof(*s) );
+}
+
+static int
+nmea_scanner_emit( NmeaScanner*  s, const char*  p, const char*  end,
+                   NmeaSentenceFunc  func, void*  opaque )
+{
+    // resynchronize on the last '$': garbage before it is line noise
+    const char*  q = end;
+
+    while (q > p && q[-1] != '$')
+        q--;
+    if (q == p) {
+        s->bad_checksum += 1;
+        return 0;
+    }
+    p = q - 1;
+
+    if (!nmea_checksum_ok(p, end)) {
+        s->bad_checksum += 1;
+        return 0;
+    }
+    s->sentences += 1;
+    func( opaque, p, end );
+    return 1;
+}
+
+int
+nmea_scanner_feed( NmeaScanner*  s, const char*  buf, int  len,
+                   NmeaSentenceFunc  func, void*  opaque )
+{
+    const char*  end = buf + len;
+    int          count = 0;
+
+    while (buf < end) {
+        const char*  nl = memchr( buf, '\n', end - buf );
+        const char*  next = nl ? nl + 1 : end;
+        int          n = next - buf;
+
+        if (s->overflow) {
+            // drop the rest of an overlong sentence
+            s->overflow = (nl == NULL);
+        }
+        else if (s->pos == 0 && nl) {
+            // the whole sentence is in this chunk: no copy
+            if (n > NMEA_MAX_SIZE)
+                s->overflows += 1;
+            else
+                count += nmea_scanner_emit( s, buf, next, func, opaque );
+        }
+        else if (s->pos + n > NMEA_MAX_SIZE) {
+            s->overflows += 1;
+            s->overflow = (nl == NULL);
+            s->pos = 0;
+        }
+        else {
+            memcpy( s->in + s->pos, buf, n );
+            s->pos += n;
+            if (nl) {
+                count += nmea_scanner_emit( s, s->in, s->in + s->pos, func, opaque );
+                s->pos = 0;
+            }
+        }
+        buf = next;
+    }
+    return count;
+}
+
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       N M E A   T O K E N I Z E R                     *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+int
+nmea_tokenizer_init( NmeaTokenizer*  t, const char*  p, const char*  end )
+{
+    int    count = 0;
+
+    // the initial '$' is optional
+    if (p < end && p[0] == '$')
+        p += 1;
+
+    // remove trailing newline
+    if (end > p && end[-1] == '\n') {
+        end -= 1;
+        if (end > p && end[-1] == '\r')
+            end -= 1;
+    }
+
+    // get rid of checksum at the end of the sentecne
+    if (end >= p+3 && end[-3] == '*') {
+        end -= 3;
+    }
+
+    while (p < end) {
+        const char*  q = p;
+
+        q = memchr(p, ',', end-p);
+        if (q == NULL)
+            q = end;
+
+        if (count < MAX_NMEA_TOKENS) {
+            t->tokens[count].p   = p;
+            t->tokens[count].end = q;
+            count += 1;
+        }
+
+        if (q < end)
+            q += 1;
+
+        p = q;
+    }
+
+    t->count = count;
+    return count;
+}
+
+Token
+nmea_tokenizer_get( NmeaTokenizer*  t, int  index )
+{
+    Token  tok;
+    static const char*  dummy = "";
+
+    if (index < 0 || index >= t->count) {
+        tok.p = tok.end = dummy;
+    } else
+        tok = t->tokens[index];
+
+    return tok;
+}
+
+int
+str2int( const char*  p, const char*  end )
+{
+    int   result = 0;
+    int   len    = end - p;
+
+    if (len == 0) {
+      return -1;
+    }
+
+    for ( ; len > 0; len--, p++ )
+    {
+        int  c;
+
+        if (p >= end)
+            goto Fail;
+
+        c = *p - '0';
+        if ((unsigned)c >= 10)
+            goto Fail;
+
+        result = result*10 + c;
+    }
+    return  result;
+
+Fail:
+    return -1;
+}
+
+int
+str2fixed( const char*  p, const char*  end, int  decimals, long long*  out )
+{
+    long long  value = 0;
+    int        neg = 0, digits = 0, frac = -1;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    for ( ; p < end; p++) {
+        int  c = *p - '0';
+
+        if (*p == '.' && frac < 0) {
+            frac = 0;
+            continue;
+        }
+        if ((unsigned)c >= 10)
+            return -1;
+        if (frac >= 0) {
+            if (frac == decimals)
+                continue;       /* beyond the precision asked for */
+            frac++;
+        }
+        value = value*10 + c;
+        // 18 digits fit a long long
+        if (++digits > 18)
+            return -1;
+    }
+    if (!digits)
+        return -1;
+
+    for (frac = (frac < 0) ? 0 : frac; frac < decimals; frac++) {
+        if (++digits > 18)
+            return -1;
+        value *= 10;
+    }
+
+    *out = neg ? -value : value;
+    return 0;
+}
+
+double
+str2float( const char*  p, const char*  end )
+{
+    long long  value;
+
+    if (p == end) {
+      return -1.0;
+    }
+
+    if (str2fixed( p, end, 6, &value ) < 0)
+        return 0.;
+    return value / 1e6;
+}
+
+int
+nmea_coord( const char*  p, const char*  end, double*  out )
+{
+    long long  value, degrees, minutes;
+
+    // ddmm.mmmmmmm: 1e-7 minute is well below the receiver's resolution
+    if (str2fixed( p, end, 7, &value ) < 0 || value < 0)
+        return -1;
+
+    degrees = value / 1000000000LL;
+    minutes = value % 1000000000LL;
+    *out = degrees + minutes / 600000000.;
+    return 0;
+}
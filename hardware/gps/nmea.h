@@ -0,0 +1,93 @@
+/*
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef _NMEA_H
+#define _NMEA_H
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       N M E A   S C A N N E R                         *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+/* longest sentence allowed by NMEA 0183, '$' to '\n' included */
+#define  NMEA_MAX_SIZE  83
+
+/* called for every complete sentence whose checksum is valid, with the
+ * sentence from '$' up to and including '\n' */
+typedef void (*NmeaSentenceFunc)( void*  opaque, const char*  p, const char*  end );
+
+typedef struct {
+    int       pos;
+    int       overflow;
+    unsigned  sentences;        /* passed to the callback */
+    unsigned  bad_checksum;     /* dropped: checksum missing or wrong */
+    unsigned  overflows;        /* dropped: longer than NMEA_MAX_SIZE */
+    char      in[ NMEA_MAX_SIZE+1 ];
+} NmeaScanner;
+
+void  nmea_scanner_init( NmeaScanner*  s );
+
+/* splits a chunk read from the receiver into sentences.  Sentences that
+ * lie entirely in the chunk are handed out in place, only the ones that
+ * straddle two reads are copied.  Returns the number of sentences passed
+ * to func. */
+int   nmea_scanner_feed( NmeaScanner*  s, const char*  buf, int  len,
+                         NmeaSentenceFunc  func, void*  opaque );
+
+/* checks the trailing "*hh" against the XOR of the characters between
+ * '$' and '*', line endings are ignored */
+int   nmea_checksum_ok( const char*  p, const char*  end );
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       N M E A   T O K E N I Z E R                     *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+typedef struct {
+    const char*  p;
+    const char*  end;
+} Token;
+
+#define  MAX_NMEA_TOKENS  32
+
+typedef struct {
+    int     count;
+    Token   tokens[ MAX_NMEA_TOKENS ];
+} NmeaTokenizer;
+
+int    nmea_tokenizer_init( NmeaTokenizer*  t, const char*  p, const char*  end );
+Token  nmea_tokenizer_get( NmeaTokenizer*  t, int  index );
+
+/* field decoding, without strtod: numbers are read as integers scaled by
+ * a power of ten */
+int     str2int( const char*  p, const char*  end );
+/* -1 for an empty field, 0 if it is not a number */
+double  str2float( const char*  p, const char*  end );
+/* value * 10^decimals in *out, extra decimals are truncated; -1 if the
+ * field is empty or not a number */
+int     str2fixed( const char*  p, const char*  end, int  decimals, long long*  out );
+/* "dddmm.mmmm" to degrees, -1 if malformed */
+int     nmea_coord( const char*  p, const char*  end, double*  out );
+
+__END_DECLS
+
+#endif /* _NMEA_H */
@@ -0,0 +1,377 @@
+/*
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * NMEA parsing throughput.
+ *
+ * usage: nmea_bench [-c chunk] [-m megabytes] [log.nmea]
+ *
+ * Feeds a recorded log (or a synthetic 1 Hz GGA/GSA/GSV/RMC stream) in
+ * read()-sized chunks through the scanner, the tokenizer and the decoding
+ * of the GGA and RMC fields, and reports MB/s and sentences/s.  The old
+ * path, which copied every byte through nmea_reader_addc() and decoded
+ * numbers with strtod(), is run on the same data for comparison, and so
+ * is a UBX stream carrying the same fixes (NAV-PVT every epoch, NAV-SVINFO
+ * once a second).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nmea.h"
+#include "ubx.h"
+
+static double
+now( void )
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* sink for the decoded values, so that nothing is optimized away */
+static volatile double  sSink;
+
+static void
+decode( NmeaTokenizer*  tzer, int  legacy );
+
+/*****************************************************************/
+/*****       C U R R E N T   P A T H                         *****/
+/*****************************************************************/
+
+static void
+on_sentence( void*  opaque, const char*  p, const char*  end )
+{
+    NmeaTokenizer  tzer[1];
+
+    (void)opaque;
+    nmea_tokenizer_init(tzer, p, end);
+    decode(tzer, 0);
+}
+
+static unsigned
+run_scanner( const char*  buf, int  len, int  chunk )
+{
+    NmeaScanner  s;
+    int          pos;
+
+    nmea_scanner_init(&s);
+    for (pos = 0; pos < len; pos += chunk) {
+        int  n = (len - pos < chunk) ? len - pos : chunk;
+        nmea_scanner_feed(&s, buf + pos, n, on_sentence, NULL);
+    }
+    return s.sentences;
+}
+
+/*****************************************************************/
+/*****       L E G A C Y   P A T H                           *****/
+/*****************************************************************/
+
+/* what gps.c did before the scanner: one call per byte, a copy of every
+ * sentence, no checksum, strtod for the numbers */
+typedef struct {
+    int       pos;
+    int       overflow;
+    unsigned  sentences;
+    char      in[ NMEA_MAX_SIZE+1 ];
+} LegacyReader;
+
+static double
+legacy_str2float( const char*  p, const char*  end )
+{
+    char  temp[16];
+    int   len = end - p;
+
+    if (len == 0 || len >= (int)sizeof(temp))
+        return 0.;
+    memcpy(temp, p, len);
+    temp[len] = 0;
+    return strtod(temp, NULL);
+}
+
+static double
+legacy_coord( const char*  p, const char*  end )
+{
+    double  val     = legacy_str2float(p, end);
+    int     degrees = (int)(val / 100);
+    double  minutes = val - degrees*100.;
+    return degrees + minutes / 60.0;
+}
+
+static void
+legacy_addc( LegacyReader*  r, int  c )
+{
+    if (r->overflow) {
+        r->overflow = (c != '\n');
+        return;
+    }
+    if (r->pos >= (int)sizeof(r->in)-1) {
+        r->overflow = 1;
+        r->pos      = 0;
+        return;
+    }
+    r->in[r->pos] = (char)c;
+    r->pos       += 1;
+    if (c == '\n') {
+        NmeaTokenizer  tzer[1];
+        nmea_tokenizer_init(tzer, r->in, r->in + r->pos);
+        decode(tzer, 1);
+        r->sentences += 1;
+        r->pos = 0;
+    }
+}
+
+static unsigned
+run_legacy( const char*  buf, int  len, int  chunk )
+{
+    LegacyReader  r;
+    int           pos, i;
+
+    memset(&r, 0, sizeof(r));
+    for (pos = 0; pos < len; pos += chunk) {
+        int  n = (len - pos < chunk) ? len - pos : chunk;
+        for (i = 0; i < n; i++)
+            legacy_addc(&r, buf[pos + i]);
+    }
+    return r.sentences;
+}
+
+/*****************************************************************/
+/*****       U B X   P A T H                                 *****/
+/*****************************************************************/
+
+static void
+on_frame( void*  opaque, int  cls, int  id, const uint8_t*  payload, int  len )
+{
+    UbxNavPvt  pvt;
+    UbxSvInfo  sv;
+    int        i, n;
+
+    (void)opaque;
+    if (cls != UBX_CLASS_NAV)
+        return;
+    if (id == UBX_NAV_PVT && ubx_nav_pvt(payload, len, &pvt) == 0) {
+        sSink += pvt.lat / 1e7 + pvt.lon / 1e7 + pvt.h_msl / 1e3 +
+                 pvt.g_speed / 1e3 + pvt.head_mot / 1e5 + pvt.h_acc / 1e3;
+    } else if (id == UBX_NAV_SVINFO) {
+        n = ubx_nav_svinfo_count(payload, len);
+        for (i = 0; i < n; i++) {
+            ubx_nav_svinfo_get(payload, i, &sv);
+            sSink += sv.cno + sv.elev + sv.azim;
+        }
+    }
+}
+
+static unsigned
+run_ubx( const char*  buf, int  len, int  chunk )
+{
+    UbxScanner  s;
+    int         pos;
+
+    ubx_scanner_init(&s);
+    for (pos = 0; pos < len; pos += chunk) {
+        int  n = (len - pos < chunk) ? len - pos : chunk;
+        ubx_scanner_feed(&s, buf + pos, n, on_frame, NULL, NULL);
+    }
+    return s.frames;
+}
+
+static int
+synth_ubx_epoch( char*  buf, int  sec )
+{
+    uint8_t  pvt[92], svinfo[8 + 8*12];
+    int      len = 0, i;
+    int32_t  lat = (int32_t)((48 + 7.038 / 60 + (sec % 1000) * 1e-4 / 60) * 1e7);
+    int32_t  lon = (int32_t)((11 + 31.0 / 60 + (sec % 1000) * 2e-4 / 60) * 1e7);
+
+    memset(pvt, 0, sizeof(pvt));
+    pvt[4] = 2010 & 0xff; pvt[5] = 2010 >> 8;
+    pvt[6] = 10; pvt[7] = 19;
+    pvt[8] = (sec / 3600) % 24; pvt[9] = (sec / 60) % 60; pvt[10] = sec % 60;
+    pvt[11] = 0x03; pvt[20] = 3; pvt[21] = 0x01; pvt[23] = 8;
+    memcpy(pvt + 24, &lon, 4);
+    memcpy(pvt + 28, &lat, 4);
+    len += ubx_build((uint8_t*)buf + len, UBX_CLASS_NAV, UBX_NAV_PVT, pvt, sizeof(pvt));
+
+    memset(svinfo, 0, sizeof(svinfo));
+    svinfo[4] = 8;
+    for (i = 0; i < 8; i++) {
+        uint8_t*  ch = svinfo + 8 + 12*i;
+        ch[1] = 1 + i*3; ch[2] = 0x0d; ch[4] = 40; ch[5] = 30; ch[6] = 20*i;
+    }
+    len += ubx_build((uint8_t*)buf + len, UBX_CLASS_NAV, UBX_NAV_SVINFO,
+                     svinfo, sizeof(svinfo));
+    return len;
+}
+
+/*****************************************************************/
+
+static void
+decode( NmeaTokenizer*  tzer, int  legacy )
+{
+    Token   tok = nmea_tokenizer_get(tzer, 0);
+    double  sum = 0, v;
+    int     lat, lon, i;
+    static const int  gga_floats[] = { 8, 9, 11 };
+    static const int  rmc_floats[] = { 7, 8 };
+    const int*  floats;
+    int         nfloats;
+
+    if (tok.end - tok.p < 5)
+        return;
+    if (!memcmp(tok.p + 2, "GGA", 3)) {
+        lat = 2; lon = 4;
+        floats = gga_floats; nfloats = 3;
+    } else if (!memcmp(tok.p + 2, "RMC", 3)) {
+        lat = 3; lon = 5;
+        floats = rmc_floats; nfloats = 2;
+    } else
+        return;
+
+    for (i = 0; i < 2; i++) {
+        tok = nmea_tokenizer_get(tzer, i ? lon : lat);
+        if (legacy)
+            v = legacy_coord(tok.p, tok.end);
+        else if (nmea_coord(tok.p, tok.end, &v) < 0)
+            v = 0;
+        sum += v;
+    }
+    for (i = 0; i < nfloats; i++) {
+        tok = nmea_tokenizer_get(tzer, floats[i]);
+        sum += legacy ? legacy_str2float(tok.p, tok.end)
+                      : str2float(tok.p, tok.end);
+    }
+    sSink += sum;
+}
+
+static int
+nmea_append( char*  buf, const char*  body )
+{
+    unsigned char  sum = 0;
+    const char*    p;
+
+    for (p = body; *p; p++)
+        sum ^= (unsigned char)*p;
+    return sprintf(buf, "$%s*%02X\r\n", body, sum);
+}
+
+/* one second of a typical receiver output */
+static int
+synth_epoch( char*  buf, int  sec )
+{
+    char  body[NMEA_MAX_SIZE];
+    int   len = 0, hh = (sec / 3600) % 24, mm = (sec / 60) % 60, ss = sec % 60;
+    double  lat = 4807.038 + (sec % 1000) * 0.0001;
+    double  lon = 1131.000 + (sec % 1000) * 0.0002;
+
+    snprintf(body, sizeof(body),
+             "GPGGA,%02d%02d%02d.00,%.4f,N,%09.4f,E,1,08,0.9,545.4,M,46.9,M,,",
+             hh, mm, ss, lat, lon);
+    len += nmea_append(buf + len, body);
+    len += nmea_append(buf + len, "GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1");
+    len += nmea_append(buf + len,
+             "GPGSV,2,1,08,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45");
+    len += nmea_append(buf + len,
+             "GPGSV,2,2,08,15,10,036,30,18,63,142,44,21,30,270,40,22,45,060,42");
+    snprintf(body, sizeof(body),
+             "GPRMC,%02d%02d%02d.00,A,%.4f,N,%09.4f,E,022.4,084.4,230394,003.1,W",
+             hh, mm, ss, lat, lon);
+    len += nmea_append(buf + len, body);
+    return len;
+}
+
+int
+main( int  argc, char**  argv )
+{
+    char*     buf;
+    int       len = 0, chunk = 512, i;
+    double    megabytes = 64;
+    const char*  path = NULL;
+    char*     ubx;
+    int       ubx_len = 0, epochs = 0;
+    double    t0, t1, t2, t3;
+    unsigned  n_new = 0, n_old = 0, n_ubx = 0;
+    long long total = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc)
+            chunk = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            megabytes = atof(argv[++i]);
+        else
+            path = argv[i];
+    }
+    if (chunk <= 0)
+        chunk = 512;
+
+    buf = malloc(1 << 20);
+    if (path) {
+        FILE*  f = fopen(path, "rb");
+        if (!f) {
+            perror(path);
+            return 2;
+        }
+        len = fread(buf, 1, 1 << 20, f);
+        fclose(f);
+    } else {
+        for (i = 0; len < (1 << 20) - 512; i++)
+            len += synth_epoch(buf + len, i);
+    }
+    /* the same number of fixes in UBX */
+    for (i = 0; i < len - 6; i++)
+        if (!memcmp(buf + i, "GPGGA", 5))
+            epochs++;
+    ubx = malloc(epochs * 256 + 1);
+    for (i = 0; i < epochs; i++)
+        ubx_len += synth_ubx_epoch(ubx + ubx_len, i);
+    if (len <= 0) {
+        fprintf(stderr, "no data\n");
+        return 2;
+    }
+
+    t0 = now();
+    for (total = 0; total < megabytes * 1e6; total += len)
+        n_new += run_scanner(buf, len, chunk);
+    t1 = now();
+    for (total = 0; total < megabytes * 1e6; total += len)
+        n_old += run_legacy(buf, len, chunk);
+    t2 = now();
+    for (total = 0; total < megabytes * 1e6; total += len)
+        n_ubx += run_ubx(ubx, ubx_len, chunk);
+    t3 = now();
+
+    printf("%d byte log, %d byte reads, %.0f MB each\n", len, chunk, total / 1e6);
+    printf("scanner: %8.1f MB/s %10.0f sentences/s\n",
+           total / 1e6 / (t1 - t0), n_new / (t1 - t0));
+    printf("legacy:  %8.1f MB/s %10.0f sentences/s\n",
+           total / 1e6 / (t2 - t1), n_old / (t2 - t1));
+    if (epochs) {
+        double  runs = (double)n_ubx / (2 * epochs);
+        printf("%d fixes: NMEA %d bytes/fix, UBX %d bytes/fix\n", epochs,
+               len / epochs, ubx_len / epochs);
+        printf("fixes/s: scanner %.0f, legacy %.0f, ubx %.0f\n",
+               epochs * (total / (double)len) / (t1 - t0),
+               epochs * (total / (double)len) / (t2 - t1),
+               epochs * runs / (t3 - t2));
+    }
+    if (n_new != n_old)
+        printf("note: %u sentences rejected by the checksum\n", n_old - n_new);
+    free(ubx);
+    free(buf);
+    return 0;
+}
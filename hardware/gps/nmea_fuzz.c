@@ -0,0 +1,370 @@
+/*
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Fuzz test of the NMEA scanner, tokenizer and field decoders.
+ *
+ * usage: nmea_fuzz [-n iterations] [-s seed] [log.nmea]
+ *
+ * Streams built from a recorded log (or a built-in set of sentences) are
+ * mutated (bit flips, inserted, dropped and duplicated bytes, truncated and
+ * overlong lines) and fed in random chunks.  Checked for every stream:
+ *  - each sentence handed out is at most NMEA_MAX_SIZE long, starts with
+ *    '$', ends with '\n' and carries a correct checksum;
+ *  - the sentences do not depend on how the stream was chunked;
+ *  - the unmutated stream loses no sentence;
+ *  - the decoders agree with strtod on every numeric field.
+ * The same is done with UBX frames mixed into the stream: every frame
+ * handed out has a correct checksum, and neither the frames nor the text
+ * between them depend on the chunking.
+ * Build it with -fsanitize=address to catch out of bounds accesses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "nmea.h"
+#include "ubx.h"
+
+static const char*  sCorpus[] = {
+    "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n",
+    "$GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1*39\r\n",
+    "$GPGSV,2,1,08,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45*75\r\n",
+    "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n",
+    "$GPVTG,054.7,T,034.4,M,005.5,N,010.2,K*48\r\n",
+    "$GPZDA,201530.00,04,07,2002,00,00*60\r\n",
+    "$GPGLL,4916.45,N,12311.12,W,225444,A,*1D\r\n",
+};
+
+static unsigned  sSeed = 1;
+
+static unsigned
+rnd( unsigned  n )
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return n ? (sSeed >> 8) % n : 0;
+}
+
+static int  sFailures;
+
+#define  CHECK(c, ...)                                           \
+    do { if (!(c)) {                                             \
+        fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);     \
+        fprintf(stderr, __VA_ARGS__);                            \
+        fputc('\n', stderr);                                     \
+        sFailures++;                                             \
+    } } while (0)
+
+/* what came out of one pass over a stream */
+typedef struct {
+    unsigned       count;
+    unsigned long  hash;
+} Output;
+
+static int
+checksum_ref( const char*  p, const char*  end )
+{
+    const char*    star;
+    unsigned char  sum = 0;
+    unsigned       want;
+
+    while (end > p && (end[-1] == '\n' || end[-1] == '\r'))
+        end--;
+    if (end - p < 4 || p[0] != '$' || end[-3] != '*')
+        return 0;
+    if (sscanf(end - 2, "%2x", &want) != 1)
+        return 0;
+    for (star = end - 3, p++; p < star; p++)
+        sum ^= (unsigned char)*p;
+    return sum == want;
+}
+
+static void
+check_number( Token  tok )
+{
+    char       temp[64];
+    char*      e;
+    long long  fixed;
+    double     ref, coord;
+    int        len = tok.end - tok.p;
+
+    if (len <= 0 || len >= (int)sizeof(temp))
+        return;
+    memcpy(temp, tok.p, len);
+    temp[len] = 0;
+    ref = strtod(temp, &e);
+    if (*e != 0 || strchr(temp, 'e') || strchr(temp, 'E') ||
+        strchr(temp, 'x') || strchr(temp, 'X') || strchr(temp, 'n') ||
+        strchr(temp, 'N') || strchr(temp, 'i') || strchr(temp, 'I'))
+        return;     /* not a plain decimal, strtod's extensions */
+
+    if (str2fixed(tok.p, tok.end, 6, &fixed) == 0) {
+        CHECK(fabs(fixed / 1e6 - ref) <= 1e-6 + fabs(ref) * 1e-15,
+              "str2fixed('%s') = %lld, strtod %f", temp, fixed, ref);
+        CHECK(fabs(str2float(tok.p, tok.end) - ref) <= 1e-6 + fabs(ref) * 1e-15,
+              "str2float('%s') = %f, strtod %f", temp, str2float(tok.p, tok.end), ref);
+    }
+    if (ref >= 0 && ref < 1e9 && nmea_coord(tok.p, tok.end, &coord) == 0) {
+        int     degrees = (int)(floor(ref) / 100);
+        double  want = degrees + (ref - degrees * 100.) / 60.;
+        CHECK(fabs(coord - want) < 1e-8, "nmea_coord('%s') = %.10f, want %.10f",
+              temp, coord, want);
+    }
+}
+
+static void
+on_sentence( void*  opaque, const char*  p, const char*  end )
+{
+    Output*        out = opaque;
+    NmeaTokenizer  tzer[1];
+    const char*    q;
+    int            i, n;
+
+    CHECK(end - p <= NMEA_MAX_SIZE, "sentence of %d bytes", (int)(end - p));
+    CHECK(end > p && end[-1] == '\n', "sentence without newline");
+    CHECK(p[0] == '$', "sentence without '$'");
+    CHECK(checksum_ref(p, end), "bad checksum accepted: '%.*s'", (int)(end - p), p);
+
+    out->count++;
+    for (q = p; q < end; q++)
+        out->hash = out->hash * 31 + (unsigned char)*q;
+
+    n = nmea_tokenizer_init(tzer, p, end);
+    for (i = 0; i < n; i++)
+        check_number(nmea_tokenizer_get(tzer, i));
+}
+
+static void
+feed_chunks( const char*  buf, int  len, int  chunked, Output*  out )
+{
+    NmeaScanner  s;
+    int          pos = 0;
+
+    nmea_scanner_init(&s);
+    memset(out, 0, sizeof(*out));
+    while (pos < len) {
+        int  n = chunked ? 1 + (int)rnd(chunked) : len;
+        if (n > len - pos)
+            n = len - pos;
+        nmea_scanner_feed(&s, buf + pos, n, on_sentence, out);
+        pos += n;
+    }
+    CHECK(s.sentences == out->count, "scanner counted %u, callback %u",
+          s.sentences, out->count);
+}
+
+/* UBX frames and text between them, hashed */
+typedef struct {
+    unsigned       frames;
+    unsigned long  hash;
+    unsigned long  text;
+} UbxOutput;
+
+static void
+on_frame( void*  opaque, int  cls, int  id, const uint8_t*  payload, int  len )
+{
+    UbxOutput*  out = opaque;
+    uint8_t     frame[UBX_MAX_PAYLOAD + UBX_OVERHEAD];
+    int         i;
+
+    CHECK(len <= UBX_MAX_PAYLOAD, "UBX frame of %d bytes", len);
+    /* ubx_build() recomputes the checksum the scanner has checked */
+    ubx_build(frame, cls, id, payload, len);
+    CHECK(frame[len + 6] == payload[len] && frame[len + 7] == payload[len + 1],
+          "UBX frame with bad checksum accepted");
+
+    out->frames++;
+    out->hash = out->hash * 31 + (cls << 8 | id);
+    for (i = 0; i < len; i++)
+        out->hash = out->hash * 31 + payload[i];
+}
+
+static void
+on_text( void*  opaque, const char*  p, int  len )
+{
+    UbxOutput*  out = opaque;
+
+    for ( ; len > 0; len--, p++)
+        out->text = out->text * 31 + (unsigned char)*p;
+}
+
+static void
+feed_ubx( const char*  buf, int  len, int  chunked, UbxOutput*  out )
+{
+    UbxScanner  s;
+    int         pos = 0;
+
+    ubx_scanner_init(&s);
+    memset(out, 0, sizeof(*out));
+    while (pos < len) {
+        int  n = chunked ? 1 + (int)rnd(chunked) : len;
+        if (n > len - pos)
+            n = len - pos;
+        ubx_scanner_feed(&s, buf + pos, n, on_frame, on_text, out);
+        pos += n;
+    }
+    CHECK(s.frames == out->frames, "scanner counted %u frames, callback %u",
+          s.frames, out->frames);
+}
+
+/* NMEA with a UBX frame after every few sentences */
+static int
+mix_ubx( const char*  nmea, int  len, char*  out )
+{
+    uint8_t  payload[UBX_MAX_PAYLOAD];
+    int      pos = 0, n = 0, i, plen;
+
+    for (i = 0; i < len; i++) {
+        out[n++] = nmea[i];
+        if (nmea[i] == '\n' && rnd(3) == 0) {
+            plen = rnd(4) ? rnd(100) : rnd(UBX_MAX_PAYLOAD + 1);
+            for (pos = 0; pos < plen; pos++)
+                payload[pos] = rnd(256);
+            n += ubx_build((uint8_t*)out + n, rnd(256), rnd(256), payload, plen);
+        }
+    }
+    return n;
+}
+
+static void
+mutate( char*  buf, int*  len, int  max )
+{
+    int  i, n = 1 + rnd(8);
+
+    for (i = 0; i < n && *len > 0; i++) {
+        int  at = rnd(*len);
+        switch (rnd(6)) {
+        case 0:     /* bit flip */
+            buf[at] ^= 1 << rnd(8);
+            break;
+        case 1:     /* drop a byte */
+            memmove(buf + at, buf + at + 1, *len - at - 1);
+            *len -= 1;
+            break;
+        case 2:     /* insert a random byte */
+            if (*len < max) {
+                memmove(buf + at + 1, buf + at, *len - at);
+                buf[at] = rnd(256);
+                *len += 1;
+            }
+            break;
+        case 3:     /* duplicate a span, makes overlong lines */
+            {
+                int  span = 1 + rnd(120);
+                if (at + span <= *len && *len + span <= max) {
+                    memmove(buf + at + span, buf + at, *len - at);
+                    *len += span;
+                }
+            }
+            break;
+        case 4:     /* lose a newline or add one */
+            buf[at] = (buf[at] == '\n') ? ',' : '\n';
+            break;
+        case 5:     /* truncate */
+            *len = at;
+            break;
+        }
+    }
+}
+
+int
+main( int  argc, char**  argv )
+{
+    static char  stream[65536], fuzzed[65536 + 4096];
+    static char  mixed[65536 * 8];
+    int          len = 0, mlen, iterations = 200000, i;
+    Output       whole, chunked;
+    UbxOutput    uwhole, uchunked;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            sSeed = strtoul(argv[++i], NULL, 0);
+        else {
+            FILE*  f = fopen(argv[i], "rb");
+            if (!f) {
+                perror(argv[i]);
+                return 2;
+            }
+            len = fread(stream, 1, sizeof(stream), f);
+            fclose(f);
+        }
+    }
+    if (!len) {
+        for (i = 0; i < 64; i++) {
+            const char*  s = sCorpus[rnd(sizeof(sCorpus) / sizeof(sCorpus[0]))];
+            memcpy(stream + len, s, strlen(s));
+            len += strlen(s);
+        }
+    }
+
+    /* the clean stream: every sentence comes out, however it is chunked */
+    feed_chunks(stream, len, 0, &whole);
+    feed_chunks(stream, len, 97, &chunked);
+    CHECK(whole.count == chunked.count && whole.hash == chunked.hash,
+          "chunking changed the output of the clean stream");
+    printf("clean stream: %d bytes, %u sentences\n", len, whole.count);
+
+    for (i = 0; i < iterations && sFailures < 20; i++) {
+        int  flen;
+
+        /* a window of the stream, so lines start cut in the middle too */
+        int  from = rnd(len), n = 1 + rnd(2048);
+        if (n > len - from)
+            n = len - from;
+        memcpy(fuzzed, stream + from, n);
+        flen = n;
+        mutate(fuzzed, &flen, sizeof(fuzzed));
+
+        feed_chunks(fuzzed, flen, 0, &whole);
+        feed_chunks(fuzzed, flen, 1 + rnd(600), &chunked);
+        CHECK(whole.count == chunked.count && whole.hash == chunked.hash,
+              "iteration %d: chunking changed the output (%u vs %u sentences)",
+              i, whole.count, chunked.count);
+    }
+
+    printf("nmea: %d iterations\n", i);
+
+    /* the text around the frames still carries every sentence */
+    mlen = mix_ubx(stream, len, mixed);
+    feed_ubx(mixed, mlen, 97, &uchunked);
+    feed_ubx(stream, len, 0, &uwhole);
+    CHECK(uchunked.text == uwhole.text, "UBX frames changed the text around them");
+
+    for (i = 0; i < iterations && sFailures < 20; i++) {
+        int  flen, from = rnd(mlen), n = 1 + rnd(4096);
+
+        if (n > mlen - from)
+            n = mlen - from;
+        if (n > (int)sizeof(fuzzed) - 4096)
+            n = sizeof(fuzzed) - 4096;
+        memcpy(fuzzed, mixed + from, n);
+        flen = n;
+        mutate(fuzzed, &flen, sizeof(fuzzed));
+
+        feed_ubx(fuzzed, flen, 0, &uwhole);
+        feed_ubx(fuzzed, flen, 1 + rnd(600), &uchunked);
+        CHECK(uwhole.frames == uchunked.frames && uwhole.hash == uchunked.hash &&
+              uwhole.text == uchunked.text,
+              "iteration %d: chunking changed the UBX output (%u vs %u frames)",
+              i, uwhole.frames, uchunked.frames);
+    }
+    printf("ubx: %d iterations, %s\n", i, sFailures ? "FAIL" : "PASS");
+    return sFailures ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+/*
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <string.h>
+
+#include "ubx.h"
+
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       U B X   S C A N N E R                           *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+enum {
+    UBX_STATE_TEXT = 0,     /* outside of a frame */
+    UBX_STATE_SYNC,         /* got UBX_SYNC1 */
+    UBX_STATE_HEAD,         /* class, id, length */
+    UBX_STATE_BODY          /* payload and checksum */
+};
+
+static void
+ubx_checksum( const uint8_t*  p, int  len, uint8_t*  ck_a, uint8_t*  ck_b )
+{
+    uint8_t  a = *ck_a, b = *ck_b;
+
+    for ( ; len > 0; len--, p++) {
+        a += *p;
+        b += a;
+    }
+    *ck_a = a;
+    *ck_b = b;
+}
+
+void
+ubx_scanner_init( UbxScanner*  s )
+{
+    memset( s, 0, sizeof(*s) );
+}
+
+int
+ubx_scanner_feed( UbxScanner*  s, const char*  buf, int  len,
+                  UbxFrameFunc  frame, UbxTextFunc  text, void*  opaque )
+{
+    const char*  end = buf + len;
+    int          count = 0;
+
+    while (buf < end) {
+        switch (s->state) {
+        case UBX_STATE_TEXT: {
+            // NMEA is 7-bit: the sync byte never shows up in it
+            const char*  q = memchr( buf, UBX_SYNC1, end - buf );
+            const char*  stop = q ? q : end;
+
+            if (stop > buf && text)
+                text( opaque, buf, stop - buf );
+            if (q == NULL)
+                return count;
+            buf = q + 1;
+            s->state = UBX_STATE_SYNC;
+            break;
+        }
+        case UBX_STATE_SYNC:
+            if ((uint8_t)*buf == UBX_SYNC2) {
+                buf += 1;
+                s->state = UBX_STATE_HEAD;
+                s->pos   = 0;
+            } else {
+                // a stray sync byte, look at this one again as text
+                s->state = UBX_STATE_TEXT;
+            }
+            break;
+
+        case UBX_STATE_HEAD:
+            s->head[s->pos++] = (uint8_t)*buf++;
+            if (s->pos == 4) {
+                s->cls = s->head[0];
+                s->id  = s->head[1];
+                s->len = s->head[2] | (s->head[3] << 8);
+                s->pos = 0;
+                if (s->len > UBX_MAX_PAYLOAD) {
+                    s->overflows += 1;
+                    s->state = UBX_STATE_TEXT;
+                } else
+                    s->state = UBX_STATE_BODY;
+            }
+            break;
+
+        case UBX_STATE_BODY: {
+            int  n = s->len + 2 - s->pos;
+            uint8_t  ck_a = 0, ck_b = 0;
+
+            if (n > end - buf)
+                n = end - buf;
+            memcpy( s->payload + s->pos, buf, n );
+            s->pos += n;
+            buf    += n;
+            if (s->pos < s->len + 2)
+                break;
+
+            s->state = UBX_STATE_TEXT;
+            ubx_checksum( s->head, 4, &ck_a, &ck_b );
+            ubx_checksum( s->payload, s->len, &ck_a, &ck_b );
+            if (ck_a != s->payload[s->len] || ck_b != s->payload[s->len+1]) {
+                s->bad_checksum += 1;
+                break;
+            }
+            s->frames += 1;
+            count     += 1;
+            if (frame)
+                frame( opaque, s->cls, s->id, s->payload, s->len );
+            break;
+        }
+        }
+    }
+    return count;
+}
+
+int
+ubx_build( uint8_t*  out, int  cls, int  id, const uint8_t*  payload, int  len )
+{
+    uint8_t  ck_a = 0, ck_b = 0;
+
+    out[0] = UBX_SYNC1;
+    out[1] = UBX_SYNC2;
+    out[2] = (uint8_t)cls;
+    out[3] = (uint8_t)id;
+    out[4] = (uint8_t)len;
+    out[5] = (uint8_t)(len >> 8);
+    if (len > 0)
+        memcpy( out + 6, payload, len );
+    ubx_checksum( out + 2, len + 4, &ck_a, &ck_b );
+    out[len + 6] = ck_a;
+    out[len + 7] = ck_b;
+    return len + UBX_OVERHEAD;
+}
+
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       U B X   M E S S A G E S                         *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+/* payloads are little endian and unaligned */
+static uint32_t
+get_u4( const uint8_t*  p )
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int
+get_u2( const uint8_t*  p )
+{
+    return p[0] | (p[1] << 8);
+}
+
+int
+ubx_nav_pvt( const uint8_t*  p, int  len, UbxNavPvt*  pvt )
+{
+    // 84 bytes up to protocol 14, 92 since; the tail is not used
+    if (len < 84)
+        return -1;
+
+    pvt->year     = get_u2(p + 4);
+    pvt->month    = p[6];
+    pvt->day      = p[7];
+    pvt->hour     = p[8];
+    pvt->min      = p[9];
+    pvt->sec      = p[10];
+    pvt->valid    = p[11];
+    pvt->nano     = (int32_t)get_u4(p + 16);
+    pvt->fix_type = p[20];
+    pvt->fix_ok   = p[21] & 0x01;
+    pvt->num_sv   = p[23];
+    pvt->lon      = (int32_t)get_u4(p + 24);
+    pvt->lat      = (int32_t)get_u4(p + 28);
+    pvt->h_msl    = (int32_t)get_u4(p + 36);
+    pvt->h_acc    = get_u4(p + 40);
+    pvt->g_speed  = (int32_t)get_u4(p + 60);
+    pvt->head_mot = (int32_t)get_u4(p + 64);
+    return 0;
+}
+
+int
+ubx_nav_svinfo_count( const uint8_t*  p, int  len )
+{
+    int  count;
+
+    if (len < 8)
+        return -1;
+    count = p[4];
+    if (len < 8 + 12*count)
+        return -1;
+    return count;
+}
+
+void
+ubx_nav_svinfo_get( const uint8_t*  p, int  index, UbxSvInfo*  sv )
+{
+    p += 8 + 12*index;
+    sv->svid  = p[1];
+    sv->flags = p[2];
+    sv->cno   = p[4];
+    sv->elev  = (int8_t)p[5];
+    sv->azim  = (int16_t)get_u2(p + 6);
+}
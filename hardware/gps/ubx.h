@@ -0,0 +1,123 @@
+/*
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef _UBX_H
+#define _UBX_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       U B X   F R A M I N G                           *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+/* 0xB5 0x62 class id length(le16) payload ck_a ck_b */
+#define  UBX_SYNC1          0xB5
+#define  UBX_SYNC2          0x62
+#define  UBX_OVERHEAD       8
+/* NAV-SVINFO for 32 channels is 392 bytes */
+#define  UBX_MAX_PAYLOAD    512
+
+#define  UBX_CLASS_NAV      0x01
+#define  UBX_CLASS_ACK      0x05
+#define  UBX_CLASS_CFG      0x06
+
+#define  UBX_NAV_PVT        0x07
+#define  UBX_NAV_SVINFO     0x30
+#define  UBX_ACK_NAK        0x00
+#define  UBX_ACK_ACK        0x01
+#define  UBX_CFG_MSG        0x01
+#define  UBX_CFG_RATE       0x08
+
+/* called for every frame whose checksum is valid */
+typedef void (*UbxFrameFunc)( void*  opaque, int  cls, int  id,
+                              const uint8_t*  payload, int  len );
+/* called with the bytes found between frames, NMEA normally */
+typedef void (*UbxTextFunc)( void*  opaque, const char*  p, int  len );
+
+typedef struct {
+    int       state;
+    int       cls;
+    int       id;
+    int       len;
+    int       pos;
+    unsigned  frames;           /* passed to the frame callback */
+    unsigned  bad_checksum;     /* dropped: checksum wrong */
+    unsigned  overflows;        /* dropped: longer than UBX_MAX_PAYLOAD */
+    uint8_t   head[4];
+    uint8_t   payload[ UBX_MAX_PAYLOAD+2 ];
+} UbxScanner;
+
+void  ubx_scanner_init( UbxScanner*  s );
+
+/* splits a chunk read from the receiver into UBX frames and the text
+ * around them; a frame may straddle any number of reads.  Returns the
+ * number of frames passed to frame. */
+int   ubx_scanner_feed( UbxScanner*  s, const char*  buf, int  len,
+                        UbxFrameFunc  frame, UbxTextFunc  text, void*  opaque );
+
+/* builds a frame in out, which needs len + UBX_OVERHEAD bytes; returns
+ * the frame size */
+int   ubx_build( uint8_t*  out, int  cls, int  id, const uint8_t*  payload, int  len );
+
+/*****************************************************************/
+/*****                                                       *****/
+/*****       U B X   M E S S A G E S                         *****/
+/*****                                                       *****/
+/*****************************************************************/
+
+/* NAV-PVT, units as on the wire */
+typedef struct {
+    int       year, month, day, hour, min, sec;
+    int       valid;            /* bit 0: date valid, bit 1: time valid */
+    int32_t   nano;             /* ns, -1e9..1e9, added to the time */
+    int       fix_type;         /* 0 none, 2 2D, 3 3D, ... */
+    int       fix_ok;           /* within the accuracy masks */
+    int       num_sv;
+    int32_t   lon, lat;         /* 1e-7 deg */
+    int32_t   h_msl;            /* mm above mean sea level */
+    uint32_t  h_acc;            /* mm */
+    int32_t   g_speed;          /* mm/s */
+    int32_t   head_mot;         /* 1e-5 deg */
+} UbxNavPvt;
+
+/* -1 if the payload is too short */
+int   ubx_nav_pvt( const uint8_t*  payload, int  len, UbxNavPvt*  pvt );
+
+/* NAV-SVINFO channel */
+typedef struct {
+    int  svid;
+    int  flags;                 /* UBX_SV_xxx */
+    int  cno;                   /* dBHz */
+    int  elev;                  /* deg */
+    int  azim;                  /* deg */
+} UbxSvInfo;
+
+#define  UBX_SV_USED        0x01
+#define  UBX_SV_EPHEMERIS   0x08
+#define  UBX_SV_ALMANAC     0x20
+
+/* number of channels in the payload, -1 if malformed */
+int   ubx_nav_svinfo_count( const uint8_t*  payload, int  len );
+void  ubx_nav_svinfo_get( const uint8_t*  payload, int  index, UbxSvInfo*  sv );
+
+__END_DECLS
+
+#endif /* _UBX_H */
@@ -23,8 +23,16 @@ LOCAL_SHARED_LIBRARIES := libc libcutils
 LOCAL_MODULE_TAGS:= debug
 include $(BUILD_EXECUTABLE)
 
+# same check on the device, where the NEON kernels are built
 include $(CLEAR_VARS)
-LOCAL_SRC_FILES:= AudioHardware.cpp alsa_mixer.c alsa_pcm.c
+LOCAL_SRC_FILES:= audio_convert_test.c audio_convert.c
+LOCAL_MODULE:= audio_convert_test
+LOCAL_SHARED_LIBRARIES:= libc libcutils
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= AudioHardware.cpp alsa_mixer.c alsa_pcm.c audio_convert.c
 LOCAL_MODULE:= libaudio
 LOCAL_STATIC_LIBRARIES:= libaudiointerface
 LOCAL_SHARED_LIBRARIES:= libc libcutils libutils libmedia libhardware_legacy
@@ -54,4 +62,27 @@ ifeq ($(BOARD_HAVE_BLUETOOTH),true)
 endif
 include $(BUILD_SHARED_LIBRARY)
 
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= alsa_loopback.c
+LOCAL_MODULE:= libalsa_loopback
+LOCAL_LDLIBS:= -ldl -lpthread -lrt
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= abench.c alsa_loopback.c alsa_pcm.c alsa_mixer.c audio_convert.c
+LOCAL_MODULE:= abench
+LOCAL_STATIC_LIBRARIES:= libcutils liblog
+LOCAL_LDLIBS:= -ldl -lpthread -lrt -lm
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= audio_convert_test.c audio_convert.c
+LOCAL_MODULE:= audio_convert_test
+LOCAL_STATIC_LIBRARIES:= libcutils liblog
+LOCAL_LDLIBS:= -lpthread
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_HOST_EXECUTABLE)
+
 endif
@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/resource.h>
+#include <sched.h>
 #include <dlfcn.h>
 #include <fcntl.h>
 
@@ -38,6 +39,7 @@
 
 extern "C" {
 #include "alsa_audio.h"
+#include "audio_convert.h"
 }
 
 #ifdef HAVE_FM_RADIO
@@ -66,7 +68,8 @@ enum {
     DRV_MIXER_OPEN,
     DRV_MIXER_CLOSE,
     DRV_MIXER_GET,
-    DRV_MIXER_SEL
+    DRV_MIXER_SEL,
+    DRV_MIXER_REFRESH
 };
 
 #ifdef DRIVER_TRACE
@@ -85,8 +88,11 @@ AudioHardware::AudioHardware() :
     mPcm(NULL),
     mMixer(NULL),
     mPcmOpenCnt(0),
+    mPcmFrames(0),
     mMixerOpenCnt(0),
+    mFastMixerCnt(0),
     mInCallAudioMode(false),
+    mDuplexReopen(true),
     mVoiceVol(1.0f),
     mInputSource(AUDIO_SOURCE_DEFAULT),
     mBluetoothNrec(true),
@@ -97,15 +103,38 @@ AudioHardware::AudioHardware() :
 #endif
     mDriverOp(DRV_NONE)
 {
+    struct mixer *mixer = mixer_open();
+
+    if (mixer != NULL) {
+        mDuplexReopen = !independentPcms(mixer_card_driver(mixer));
+        mixer_close(mixer);
+    }
+    LOGD("AudioHardware %s the other pcm on standby exit",
+         mDuplexReopen ? "reopens" : "keeps");
     mInit = true;
 }
 
+// Whether a stream can leave standby without closing and reopening the pcm of
+// the other direction. Codecs that tie playback and capture together want the
+// output opened first, so that the input is configured after it. The TWL4030
+// only holds the second substream to the rate and sample size of the first
+// (twl4030_constraints() in its ASoC driver), and both directions open at
+// the same rate and format here, so the order does not matter on it. Any
+// other codec keeps the reopen.
+bool AudioHardware::independentPcms(const char *driver)
+{
+    return AUDIO_HW_IN_SAMPLERATE == AUDIO_HW_OUT_SAMPLERATE &&
+           AUDIO_HW_IN_FORMAT == AUDIO_HW_OUT_FORMAT &&
+           strcmp(driver, "TWL4030") == 0;
+}
+
 AudioHardware::~AudioHardware()
 {
     for (size_t index = 0; index < mInputs.size(); index++) {
         closeInputStream(mInputs[index].get());
     }
     mInputs.clear();
+    closeOutputStream((AudioStreamOut*)mFastOutput.get());
     closeOutputStream((AudioStreamOut*)mOutput.get());
 
     if (mMixer) {
@@ -133,50 +162,71 @@ AudioStreamOut* AudioHardware::openOutputStream(
     uint32_t *sampleRate, status_t *status)
 {
     sp <AudioStreamOutALSA> out;
+    sp <AudioStreamOutFast> fastOut;
     status_t rc;
 
     { // scope for the lock
         Mutex::Autolock lock(mLock);
 
-        // only one output stream allowed
-        if (mOutput != 0) {
+        // the first output is the main one, a second one (direct output
+        // opened by the policy manager) gets the low latency path
+        if (mOutput == 0) {
+            out = new AudioStreamOutALSA();
+
+            rc = out->set(this, devices, format, channels, sampleRate);
+            if (rc == NO_ERROR) {
+                mOutput = out;
+            }
+        } else if (mFastOutput == 0) {
+            fastOut = new AudioStreamOutFast();
+
+            rc = fastOut->set(this, devices, format, channels, sampleRate);
+            if (rc == NO_ERROR) {
+                mFastOutput = fastOut;
+            }
+        } else {
             if (status) {
                 *status = INVALID_OPERATION;
             }
             return NULL;
         }
-
-        out = new AudioStreamOutALSA();
-
-        rc = out->set(this, devices, format, channels, sampleRate);
-        if (rc == NO_ERROR) {
-            mOutput = out;
-        }
     }
 
     if (rc != NO_ERROR) {
         if (out != 0) {
             out.clear();
         }
+        if (fastOut != 0) {
+            fastOut.clear();
+        }
     }
     if (status) {
         *status = rc;
     }
 
+    if (fastOut != 0) {
+        return fastOut.get();
+    }
     return out.get();
 }
 
 void AudioHardware::closeOutputStream(AudioStreamOut* out) {
     sp <AudioStreamOutALSA> spOut;
+    sp <AudioStreamOutFast> spFastOut;
     {
         Mutex::Autolock lock(mLock);
-        if (mOutput == 0 || mOutput.get() != out) {
+        if (mFastOutput != 0 && mFastOutput.get() == out) {
+            spFastOut = mFastOutput;
+            mFastOutput.clear();
+        } else if (mOutput != 0 && mOutput.get() == out) {
+            spOut = mOutput;
+            mOutput.clear();
+        } else {
             LOGW("Attempt to close invalid output stream");
             return;
         }
-        spOut = mOutput;
-        mOutput.clear();
     }
+    spFastOut.clear();
     spOut.clear();
 }
 
@@ -244,6 +294,8 @@ status_t AudioHardware::setMode(int mode)
     sp<AudioStreamInALSA> spIn;
     status_t status;
 
+    nsecs_t start = systemTime();
+
     // Mutex acquisition order is always out -> in -> hw
     AutoMutex lock(mLock);
 
@@ -328,6 +380,9 @@ status_t AudioHardware::setMode(int mode)
             mInCallAudioMode = false;
         }
 
+        if (mMode != prevMode) {
+            mModeStats.add(systemTime() - start);
+        }
     }
 
     if (spIn != 0) {
@@ -451,7 +506,7 @@ void AudioHardware::setOutputVolume(uint32_t device, uint32_t volume)
 
     LOGD("### setOutputVolume: device= %d, volume= %d", device, volume);
 
-    if (mMixer) {
+    if (mixerActive_l()) {
         ctl = mixer_get_control(mMixer, name, 0);
         if (ctl)
             mixer_ctl_set(ctl, volume);
@@ -523,6 +578,31 @@ static bool tryLock(Mutex& mutex)
     return locked;
 }
 
+// upper bound for a stream to wait for the thread that called prepareLock()
+static const nsecs_t kSleepReqTimeout = milliseconds(20);
+
+void AudioHardware::TransitionStats::add(nsecs_t duration)
+{
+    count++;
+    total += duration;
+    last = duration;
+    if (duration > max) {
+        max = duration;
+    }
+}
+
+void AudioHardware::TransitionStats::dump(String8& result, const char *name)
+{
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+
+    snprintf(buffer, SIZE, "%s: count %u avg %lld us max %lld us last %lld us\n",
+             name, count,
+             count ? (long long)ns2us(total / count) : 0LL,
+             (long long)ns2us(max), (long long)ns2us(last));
+    result.append(buffer);
+}
+
 status_t AudioHardware::dump(int fd, const Vector<String16>& args)
 {
     const size_t SIZE = 256;
@@ -554,6 +634,7 @@ status_t AudioHardware::dump(int fd, const Vector<String16>& args)
     result.append(buffer);
     snprintf(buffer, SIZE, "\tmDriverOp: %d\n", mDriverOp);
     result.append(buffer);
+    mModeStats.dump(result, "\tMode switch");
 
     snprintf(buffer, SIZE, "\n\tmOutput %p dump:\n", mOutput.get());
     result.append(buffer);
@@ -562,6 +643,12 @@ status_t AudioHardware::dump(int fd, const Vector<String16>& args)
         mOutput->dump(fd, args);
     }
 
+    snprintf(buffer, SIZE, "\n\tmFastOutput %p dump:\n", mFastOutput.get());
+    write(fd, buffer, strlen(buffer));
+    if (mFastOutput != 0) {
+        mFastOutput->dump(fd, args);
+    }
+
     snprintf(buffer, SIZE, "\n\t%d inputs opened:\n", mInputs.size());
     write(fd, buffer, strlen(buffer));
     for (size_t i = 0; i < mInputs.size(); i++) {
@@ -579,7 +666,7 @@ status_t AudioHardware::setIncallPath_l(uint32_t device)
 
     if (mMode == AudioSystem::MODE_IN_CALL) {
         LOGD("### incall mode route (%d)", device);
-        if (mMixer != NULL) {
+        if (mixerActive_l()) {
              setInputRoute(mInputSource, device);
              setOutputRoute(ROUTE_OUT_VOICECALL, device);            
              setVoiceVolume_l(mVoiceVol);
@@ -606,7 +693,7 @@ status_t AudioHardware::setOutputRoute( AudioHardware::RouteType path, uint32_t
     char *twlAudioPath;
     const char *ampEnable;
  
-    if (mMixer != NULL)
+    if (mixerActive_l())
     {
         LOGV("setOutputRoute() mixer is open");
 
@@ -673,7 +760,7 @@ void AudioHardware::enableFMRadio() {
         openMixer_l();
         //setInputSource_l(AUDIO_SOURCE_DEFAULT);
 
-        if (mMixer != NULL) {
+        if (mixerActive_l()) {
             LOGV("AudioHardware::enableFMRadio() FM Radio is ON, calling setFMRadioPath_l()");
             setFMRadioPath_l(mOutput->device());
         }
@@ -690,7 +777,7 @@ void AudioHardware::disableFMRadio() {
     LOGV("AudioHardware::disableFMRadio() Turning FM Radio OFF");
 
 
-    if (mMixer != NULL) {
+    if (mixerActive_l()) {
         // Disable FM radio flag to allow the codec to be turned off
         // (the flag is automatically set by the kernel driver when FM is enabled)
         // No need to turn off the FM Radio path as the kernel driver will handle that
@@ -740,7 +827,7 @@ status_t AudioHardware::setFMRadioPath_l(uint32_t device)
 }
 #endif
 
-struct pcm *AudioHardware::openPcmOut_l()
+struct pcm *AudioHardware::openPcmOut_l(uint32_t periodMult, uint32_t periodCnt)
 {
     LOGD("openPcmOut_l() mPcmOpenCnt: %d", mPcmOpenCnt);
     if (mPcmOpenCnt++ == 0) {
@@ -751,12 +838,13 @@ struct pcm *AudioHardware::openPcmOut_l()
         }
         unsigned flags = PCM_OUT;
 
-        flags |= (AUDIO_HW_OUT_PERIOD_MULT - 1) << PCM_PERIOD_SZ_SHIFT;
-        flags |= (AUDIO_HW_OUT_PERIOD_CNT - PCM_PERIOD_CNT_MIN) << PCM_PERIOD_CNT_SHIFT;
+        flags |= (periodMult - 1) << PCM_PERIOD_SZ_SHIFT;
+        flags |= (periodCnt - PCM_PERIOD_CNT_MIN) << PCM_PERIOD_CNT_SHIFT;
 
         TRACE_DRIVER_IN(DRV_PCM_OPEN)
         mPcm = pcm_open(flags);
         TRACE_DRIVER_OUT
+        mPcmFrames = PCM_PERIOD_SZ_MIN * periodMult * periodCnt;
         if (!pcm_ready(mPcm)) {
             LOGE("openPcmOut_l() cannot open pcm_out driver: %s\n", pcm_error(mPcm));
             TRACE_DRIVER_IN(DRV_PCM_CLOSE)
@@ -785,24 +873,137 @@ void AudioHardware::closePcmOut_l()
     }
 }
 
+// While the fast output exists the pcm is opened once with short periods and
+// the main output writes through the fast mixer as well, so fast clients
+// starting and stopping never reopen it.  Only a main output that was already
+// playing on its own pcm when the fast output was opened has to hand it over,
+// once.  If the pcm is already held (in call) the mixer uses it as configured.
+// Mutex acquisition order is fast out -> out -> hw.
+sp <AudioHardware::FastMixer> AudioHardware::startFastMixer(uint32_t devices)
+{
+    sp <AudioStreamOutALSA> spOut;
+    sp <FastMixer> mixer;
+
+    {
+        AutoMutex lock(mLock);
+        spOut = mOutput;
+    }
+    if (spOut != 0) {
+        spOut->prepareLock();
+        spOut->lock();
+    }
+
+    {
+        AutoMutex lock(mLock);
+
+        if (mFastMixer == 0 && spOut != 0) {
+            // not attached: the main output is in standby or on its own pcm
+            spOut->doStandby_l();
+            devices = spOut->device();
+        }
+        mixer = attachFastMixer_l(devices);
+    }
+
+    if (spOut != 0) {
+        spOut->unlock();
+    }
+    return mixer;
+}
+
+void AudioHardware::stopFastMixer()
+{
+    AutoMutex lock(mLock);
+
+    // the main output, if attached, keeps the mixer and its pcm running
+    detachFastMixer_l();
+}
+
+sp <AudioHardware::FastMixer> AudioHardware::attachFastMixer_l(uint32_t devices)
+{
+    if (mFastMixer == 0) {
+        struct pcm *pcm = openPcmOut_l(AUDIO_HW_FAST_PERIOD_MULT, AUDIO_HW_FAST_PERIOD_CNT);
+        if (pcm == NULL) {
+            return 0;
+        }
+        sp <FastMixer> mixer = new FastMixer(pcm, mPcmFrames);
+        if (mixer->initCheck() != NO_ERROR ||
+                mixer->run("AudioFastMixer", ANDROID_PRIORITY_URGENT_AUDIO) != NO_ERROR) {
+            LOGE("attachFastMixer_l() cannot start mixer thread");
+            closePcmOut_l();
+            return 0;
+        }
+        mFastMixer = mixer;
+
+        openMixer_l();
+        if (mMode != AudioSystem::MODE_IN_CALL) {
+            setOutputRoute(ROUTE_OUT_PLAYBACK, devices);
+        }
+    }
+    mFastMixerCnt++;
+    return mFastMixer;
+}
+
+void AudioHardware::detachFastMixer_l()
+{
+    LOGV("detachFastMixer_l() mFastMixerCnt: %d", mFastMixerCnt);
+    if (mFastMixerCnt == 0) {
+        LOGE("detachFastMixer_l() mFastMixerCnt == 0");
+        return;
+    }
+    if (--mFastMixerCnt != 0) {
+        return;
+    }
+
+    mFastMixer->requestExitAndWait();
+    mFastMixer.clear();
+    closePcmOut_l();
+
+    if (mMode != AudioSystem::MODE_IN_CALL && mMixer != NULL) {
+        // powerdown MAX9877
+        TRACE_DRIVER_IN(DRV_MIXER_GET)
+        struct mixer_ctl *ctl= mixer_get_control(mMixer, "Amp Enable", 0);
+        TRACE_DRIVER_OUT
+        if (ctl) {
+            TRACE_DRIVER_IN(DRV_MIXER_SEL)
+            mixer_ctl_select(ctl, "OFF");
+            TRACE_DRIVER_OUT
+        }
+    }
+    closeMixer_l();
+}
+
+// The mixer handle is opened on first use and then kept for the lifetime of
+// AudioHardware: leaving standby only drains pending control events and
+// re-reads the control table if the driver reported a structural change.
+// Streams cache mMixer and control handles while they hold a count, so the
+// table is only refreshed, or the handle replaced, once nobody holds it.
 struct mixer *AudioHardware::openMixer_l()
 {
     LOGV("openMixer_l() mMixerOpenCnt: %d", mMixerOpenCnt);
-    if (mMixerOpenCnt++ == 0) {
-        if (mMixer != NULL) {
-            LOGE("openMixer_l() mMixerOpenCnt == 0 and mMixer == %p\n", mMixer);
-            mMixerOpenCnt--;
-            return NULL;
+    if (mMixer != NULL && mMixerOpenCnt == 0) {
+        TRACE_DRIVER_IN(DRV_MIXER_REFRESH)
+        int ret = mixer_refresh(mMixer);
+        TRACE_DRIVER_OUT
+        if (ret < 0) {
+            LOGW("openMixer_l() mixer refresh failed, reopening");
+            TRACE_DRIVER_IN(DRV_MIXER_CLOSE)
+            mixer_close(mMixer);
+            TRACE_DRIVER_OUT
+            mMixer = NULL;
+        } else if (ret > 0) {
+            LOGD("openMixer_l() mixer controls changed, table refreshed");
         }
+    }
+    if (mMixer == NULL) {
         TRACE_DRIVER_IN(DRV_MIXER_OPEN)
         mMixer = mixer_open();
         TRACE_DRIVER_OUT
         if (mMixer == NULL) {
             LOGE("openMixer_l() cannot open mixer");
-            mMixerOpenCnt--;
             return NULL;
         }
     }
+    mMixerOpenCnt++;
     return mMixer;
 }
 
@@ -814,12 +1015,8 @@ void AudioHardware::closeMixer_l()
         return;
     }
 
-    if (--mMixerOpenCnt == 0) {
-        TRACE_DRIVER_IN(DRV_MIXER_CLOSE)
-        mixer_close(mMixer);
-        TRACE_DRIVER_OUT
-        mMixer = NULL;
-    }
+    // the handle itself stays open, see openMixer_l()
+    mMixerOpenCnt--;
 }
 const char *AudioHardware::getFmOutputRouteFromDevice(uint32_t device)
 {
@@ -963,7 +1160,7 @@ status_t AudioHardware::setInputRoute(audio_source source, uint32_t device)
     LOGV("setInputSource_l(%d)", source);
     if (source != mInputSource) {
         if ((source == AUDIO_SOURCE_DEFAULT) || (mMode != AudioSystem::MODE_IN_CALL)) {
-            if (mMixer)
+            if (mixerActive_l())
             {
                 const char* sourceName;
                 switch (source) {
@@ -1010,7 +1207,9 @@ AudioHardware::AudioStreamOutALSA::AudioStreamOutALSA() :
     mHardware(0), mPcm(0), mMixer(0), mRouteCtl(0),
     mStandby(true), mDevices(0), mChannels(AUDIO_HW_OUT_CHANNELS),
     mSampleRate(AUDIO_HW_OUT_SAMPLERATE), mBufferSize(AUDIO_HW_OUT_PERIOD_BYTES),
-    mDriverOp(DRV_NONE), mStandbyCnt(0), mSleepReq(false)
+    mDriverOp(DRV_NONE), mStandbyCnt(0), mSleepReq(false),
+    mLatency((1000 * AUDIO_HW_OUT_PERIOD_CNT * AUDIO_HW_OUT_PERIOD_SZ) /
+             AUDIO_HW_OUT_SAMPLERATE + AUDIO_HW_OUT_LATENCY_MS)
 {
 }
 
@@ -1065,23 +1264,24 @@ ssize_t AudioHardware::AudioStreamOutALSA::write(const void* buffer, size_t byte
 
     if (mHardware == NULL) return NO_INIT;
 
-    if (mSleepReq) {
-        // 10ms are always shorter than the time to reconfigure the audio path
-        // which is the only condition when mSleepReq would be true.
-        usleep(10000);
-    }
-
     { // scope for the lock
 
         AutoMutex lock(mLock);
 
+        waitSleepReq_l();
+
         if (mStandby) {
+            nsecs_t start = systemTime();
             AutoMutex hwLock(mHardware->lock());
 
             LOGD("AudioHardware pcm playback is exiting standby.");
             acquire_wake_lock (PARTIAL_WAKE_LOCK, "AudioOutLock");
 
-            sp<AudioStreamInALSA> spIn = mHardware->getActiveInput_l();
+            // an active input is reopened after the output, see independentPcms()
+            sp<AudioStreamInALSA> spIn;
+            if (mHardware->duplexReopen()) {
+                spIn = mHardware->getActiveInput_l();
+            }
             while (spIn != 0) {
                 int cnt = spIn->prepareLock();
                 mHardware->lock().unlock();
@@ -1111,11 +1311,19 @@ ssize_t AudioHardware::AudioStreamOutALSA::write(const void* buffer, size_t byte
                 }
                 spIn->unlock();
             }
-            if (mPcm == NULL) {
+
+            if (mPcm == NULL && mFastMixer == 0) {
                 release_wake_lock("AudioOutLock");
                 goto Error;
             }
             mStandby = false;
+            mExitStats.add(systemTime() - start);
+        }
+
+        if (mFastMixer != 0) {
+            // writeMain() may drop mLock, standby() may clear mFastMixer then
+            sp <FastMixer> mixer = mFastMixer;
+            return mixer->writeMain(mLock, mStandby, p, bytes);
         }
 
         TRACE_DRIVER_IN(DRV_PCM_WRITE)
@@ -1171,9 +1379,14 @@ void AudioHardware::AudioStreamOutALSA::close_l()
 
 LOGD("--------AudioHardware::AudioStreamOutALSA::close_l().");
 
+    if (mFastMixer != 0) {
+        mFastMixer.clear();
+        mHardware->detachFastMixer_l();
+    }
     if (mMixer) {
 #if 1 //me change 
-    if (mHardware->mode() != AudioSystem::MODE_IN_CALL)//me ok
+    // the amplifier stays on for the fast output, detachFastMixer_l() powers it down
+    if (mHardware->mode() != AudioSystem::MODE_IN_CALL && mHardware->fastMixer_l() == 0)//me ok
         {
 #endif
 LOGD("in MODE_RINGTONE amp enable off.-------------------------1");
@@ -1208,9 +1421,20 @@ LOGD("in MODE_RINGTONE amp enable off.-------------------------1");
 status_t AudioHardware::AudioStreamOutALSA::open_l()
 {
     LOGV("open pcm_out driver");
-    mPcm = mHardware->openPcmOut_l();
-    if (mPcm == NULL) {
-        return NO_INIT;
+    if (mHardware->fastPathOpen_l()) {
+        mFastMixer = mHardware->attachFastMixer_l(mDevices);
+        if (mFastMixer == 0) {
+            return NO_INIT;
+        }
+        mLatency = (1000 * mFastMixer->mainLatencyFrames()) / sampleRate() +
+                AUDIO_HW_OUT_LATENCY_MS;
+    } else {
+        mPcm = mHardware->openPcmOut_l();
+        if (mPcm == NULL) {
+            return NO_INIT;
+        }
+        mLatency = (1000 * AUDIO_HW_OUT_PERIOD_CNT * (bufferSize()/frameSize())) /
+                sampleRate() + AUDIO_HW_OUT_LATENCY_MS;
     }
 
     mMixer = mHardware->openMixer_l();
@@ -1256,6 +1480,11 @@ status_t AudioHardware::AudioStreamOutALSA::dump(int fd, const Vector<String16>&
     result.append(buffer);
     snprintf(buffer, SIZE, "\t\tmDriverOp: %d\n", mDriverOp);
     result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tmFastMixer: %p\n", mFastMixer.get());
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tLatency: %d ms\n", latency());
+    result.append(buffer);
+    mExitStats.dump(result, "\t\tStandby exit");
 
     ::write(fd, result.string(), result.size());
 
@@ -1329,8 +1558,8 @@ status_t AudioHardware::AudioStreamOutALSA::getRenderPosition(uint32_t *dspFrame
 
 int AudioHardware::AudioStreamOutALSA::prepareLock()
 {
-    // request sleep next time write() is called so that caller can acquire
-    // mLock
+    // request write() to yield mLock next time it is called so that caller
+    // can acquire it
     mSleepReq = true;
     return mStandbyCnt;
 }
@@ -1342,9 +1571,417 @@ void AudioHardware::AudioStreamOutALSA::lock()
 }
 
 void AudioHardware::AudioStreamOutALSA::unlock() {
+    mSleepCond.broadcast();
     mLock.unlock();
 }
 
+// must be called with mLock held: releases it until the thread that called
+// prepareLock() is done with the stream.
+void AudioHardware::AudioStreamOutALSA::waitSleepReq_l()
+{
+    while (mSleepReq) {
+        if (mSleepCond.waitRelative(mLock, kSleepReqTimeout) != NO_ERROR) {
+            break;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+//  FrameRing
+//------------------------------------------------------------------------------
+
+AudioHardware::FrameRing::FrameRing(size_t frames) :
+    mData(new int16_t[frames * 2]), mFrames(frames), mFront(0), mRear(0)
+{
+}
+
+AudioHardware::FrameRing::~FrameRing()
+{
+    delete[] mData;
+}
+
+size_t AudioHardware::FrameRing::framesReady() const
+{
+    return mRear - mFront;
+}
+
+size_t AudioHardware::FrameRing::framesFree() const
+{
+    return mFrames - (mRear - mFront);
+}
+
+size_t AudioHardware::FrameRing::write(const int16_t *in, size_t frames,
+                                       uint32_t channelCount)
+{
+    uint32_t rear = mRear;
+    size_t avail = mFrames - (rear - mFront);
+    size_t done = 0;
+
+    if (frames > avail) {
+        frames = avail;
+    }
+    // slots released by the consumer must not be overwritten early
+    __sync_synchronize();
+    while (done < frames) {
+        size_t pos = (rear + done) & (mFrames - 1);
+        size_t n = mFrames - pos;
+        if (n > frames - done) {
+            n = frames - done;
+        }
+        if (channelCount == 1) {
+            audio_interleave(in + done, in + done, mData + pos * 2, n);
+        } else {
+            memcpy(mData + pos * 2, in + done * 2, n * 2 * sizeof(int16_t));
+        }
+        done += n;
+    }
+    // publish the frames before the index
+    __sync_synchronize();
+    mRear = rear + frames;
+    return frames;
+}
+
+size_t AudioHardware::FrameRing::read(int16_t *out, size_t frames)
+{
+    uint32_t front = mFront;
+    size_t ready = mRear - front;
+    size_t done = 0;
+
+    if (frames > ready) {
+        frames = ready;
+    }
+    __sync_synchronize();
+    while (done < frames) {
+        size_t pos = (front + done) & (mFrames - 1);
+        size_t n = mFrames - pos;
+        if (n > frames - done) {
+            n = frames - done;
+        }
+        memcpy(out + done * 2, mData + pos * 2, n * 2 * sizeof(int16_t));
+        done += n;
+    }
+    __sync_synchronize();
+    mFront = front + frames;
+    return frames;
+}
+
+//------------------------------------------------------------------------------
+//  FastMixer
+//------------------------------------------------------------------------------
+
+AudioHardware::FastMixer::FastMixer(struct pcm *pcm, uint32_t pcmFrames) :
+    Thread(false),
+    mPcm(pcm),
+    mPcmFrames(pcmFrames),
+    // same queueing as the main output has on its own pcm
+    mMainRing(AUDIO_HW_OUT_PERIOD_SZ * AUDIO_HW_OUT_PERIOD_CNT),
+    mFastRing(AUDIO_HW_FAST_PERIOD_SZ * AUDIO_HW_FAST_RING_PERIODS),
+    mMixBuffer(new int16_t[AUDIO_HW_FAST_PERIOD_SZ * 2]),
+    mMainBuffer(new int16_t[AUDIO_HW_FAST_PERIOD_SZ * 2]),
+    mFifo(false), mCycles(0), mFastUnderruns(0), mWriteErrors(0), mMaxCycle(0)
+{
+    audio_convert_init();
+}
+
+AudioHardware::FastMixer::~FastMixer()
+{
+    delete[] mMixBuffer;
+    delete[] mMainBuffer;
+}
+
+status_t AudioHardware::FastMixer::initCheck()
+{
+    if (mMainRing.initCheck() != NO_ERROR || mFastRing.initCheck() != NO_ERROR ||
+            mMixBuffer == NULL || mMainBuffer == NULL) {
+        return NO_MEMORY;
+    }
+    return NO_ERROR;
+}
+
+status_t AudioHardware::FastMixer::readyToRun()
+{
+    struct sched_param param;
+
+    param.sched_priority = AUDIO_HW_FAST_FIFO_PRIORITY;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) == 0) {
+        mFifo = true;
+    } else {
+        // no RLIMIT_RTPRIO for this process: stay at urgent audio priority
+        LOGW("FastMixer cannot use SCHED_FIFO: %s", strerror(errno));
+    }
+    return NO_ERROR;
+}
+
+bool AudioHardware::FastMixer::threadLoop()
+{
+    const size_t frames = AUDIO_HW_FAST_PERIOD_SZ;
+    nsecs_t start = systemTime();
+    size_t n;
+
+    n = mFastRing.read(mMixBuffer, frames);
+    if (n < frames) {
+        // an empty ring is an idle client, a partial one a late client
+        if (n != 0) {
+            mFastUnderruns++;
+        }
+        memset(mMixBuffer + n * 2, 0, (frames - n) * 2 * sizeof(int16_t));
+    }
+    n = mMainRing.read(mMainBuffer, frames);
+    mRoomCond.broadcast();
+    if (n != 0) {
+        audio_mix(mMixBuffer, mMainBuffer, n * 2);
+    }
+
+    nsecs_t cycle = systemTime() - start;
+    if (cycle > mMaxCycle) {
+        mMaxCycle = cycle;
+    }
+    mCycles++;
+
+    if (pcm_write(mPcm, mMixBuffer, frames * 2 * sizeof(int16_t)) != 0) {
+        LOGW("FastMixer write error: %d", errno);
+        mWriteErrors++;
+        // keep the producers paced
+        usleep((frames * 1000000) / AUDIO_HW_OUT_SAMPLERATE);
+    }
+    return true;
+}
+
+// Called by the stream that owns the ring with its own lock held. Waits for
+// the mixer thread to make room, at most one fast period at a time, with that
+// lock released so that standby(), setParameters() or dump() of the stream are
+// not held up behind a full ring. The caller keeps a reference to the mixer
+// for the duration. Stops early if the stream went to standby or the mixer is
+// being stopped meanwhile.
+void AudioHardware::FastMixer::push(Mutex& lock, const bool& standby, FrameRing& ring,
+                                    const int16_t *in, size_t frames, uint32_t channelCount)
+{
+    while (frames && !standby && !exitPending()) {
+        size_t n = ring.write(in, frames, channelCount);
+        in += n * channelCount;
+        frames -= n;
+        if (frames) {
+            size_t wait = frames < AUDIO_HW_FAST_PERIOD_SZ ? frames : AUDIO_HW_FAST_PERIOD_SZ;
+            mRoomCond.waitRelative(lock, (wait * 1000000000LL) / AUDIO_HW_OUT_SAMPLERATE);
+        }
+    }
+}
+
+ssize_t AudioHardware::FastMixer::writeMain(Mutex& lock, const bool& standby,
+                                            const void *buffer, size_t bytes)
+{
+    push(lock, standby, mMainRing, static_cast<const int16_t *>(buffer),
+         bytes / (2 * sizeof(int16_t)), 2);
+    return bytes;
+}
+
+ssize_t AudioHardware::FastMixer::writeFast(Mutex& lock, const bool& standby,
+                                            const void *buffer, size_t bytes,
+                                            uint32_t channelCount)
+{
+    push(lock, standby, mFastRing, static_cast<const int16_t *>(buffer),
+         bytes / (channelCount * sizeof(int16_t)), channelCount);
+    return bytes;
+}
+
+void AudioHardware::FastMixer::dump(String8& result)
+{
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+
+    snprintf(buffer, SIZE, "\t\tFast mixer: %s cycles %u fast underruns %u write errors %u\n",
+             mFifo ? "SCHED_FIFO" : "SCHED_OTHER", mCycles, mFastUnderruns, mWriteErrors);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tFast mixer: max mix %lld us, main ring %u/%u fast ring %u/%u\n",
+             (long long)ns2us(mMaxCycle),
+             mMainRing.framesReady(), mMainRing.capacity(),
+             mFastRing.framesReady(), mFastRing.capacity());
+    result.append(buffer);
+}
+
+//------------------------------------------------------------------------------
+//  AudioStreamOutFast
+//------------------------------------------------------------------------------
+
+AudioHardware::AudioStreamOutFast::AudioStreamOutFast() :
+    mHardware(0), mStandby(true), mDevices(0), mChannels(AUDIO_HW_OUT_CHANNELS),
+    mChannelCount(2), mBufferSize(AUDIO_HW_FAST_PERIOD_SZ * 2 * sizeof(int16_t)),
+    mStandbyCnt(0)
+{
+}
+
+status_t AudioHardware::AudioStreamOutFast::set(
+    AudioHardware* hw, uint32_t devices, int *pFormat,
+    uint32_t *pChannels, uint32_t *pRate)
+{
+    int lFormat = pFormat ? *pFormat : 0;
+    uint32_t lChannels = pChannels ? *pChannels : 0;
+    uint32_t lRate = pRate ? *pRate : 0;
+
+    mHardware = hw;
+    mDevices = devices;
+
+    // fix up defaults
+    if (lFormat == 0) lFormat = format();
+    if (lChannels == 0) lChannels = channels();
+    if (lRate == 0) lRate = sampleRate();
+
+    // check values, mono is expanded to stereo by the mixer
+    if ((lFormat != format()) ||
+        (lChannels != AudioSystem::CHANNEL_OUT_STEREO &&
+         lChannels != AudioSystem::CHANNEL_OUT_MONO) ||
+        (lRate != sampleRate())) {
+        if (pFormat) *pFormat = format();
+        if (pChannels) *pChannels = channels();
+        if (pRate) *pRate = sampleRate();
+        return BAD_VALUE;
+    }
+
+    if (pFormat) *pFormat = lFormat;
+    if (pChannels) *pChannels = lChannels;
+    if (pRate) *pRate = lRate;
+
+    mChannels = lChannels;
+    mChannelCount = AudioSystem::popCount(lChannels);
+    mBufferSize = AUDIO_HW_FAST_PERIOD_SZ * mChannelCount * sizeof(int16_t);
+
+    return NO_ERROR;
+}
+
+AudioHardware::AudioStreamOutFast::~AudioStreamOutFast()
+{
+    standby();
+}
+
+ssize_t AudioHardware::AudioStreamOutFast::write(const void* buffer, size_t bytes)
+{
+    status_t status = NO_INIT;
+
+    if (mHardware == NULL) return NO_INIT;
+
+    { // scope for the lock
+
+        AutoMutex lock(mLock);
+
+        if (mStandby) {
+            nsecs_t start = systemTime();
+
+            LOGD("AudioHardware fast playback is exiting standby.");
+            acquire_wake_lock (PARTIAL_WAKE_LOCK, "AudioFastOutLock");
+
+            mFastMixer = mHardware->startFastMixer(mDevices);
+            if (mFastMixer == 0) {
+                release_wake_lock("AudioFastOutLock");
+                goto Error;
+            }
+            mStandby = false;
+            mExitStats.add(systemTime() - start);
+        }
+
+        // writeFast() may drop mLock, standby() may clear mFastMixer then
+        sp <FastMixer> mixer = mFastMixer;
+        return mixer->writeFast(mLock, mStandby, buffer, bytes, mChannelCount);
+    }
+Error:
+
+    // Simulate audio output timing in case of error
+    usleep((((bytes * 1000) / frameSize()) * 1000) / sampleRate());
+
+    return status;
+}
+
+status_t AudioHardware::AudioStreamOutFast::standby()
+{
+    if (mHardware == NULL) return NO_INIT;
+
+    AutoMutex lock(mLock);
+
+    mStandbyCnt++;
+    if (!mStandby) {
+        LOGD("AudioHardware fast playback is going to standby.");
+        mFastMixer.clear();
+        mHardware->stopFastMixer();
+        release_wake_lock("AudioFastOutLock");
+        mStandby = true;
+    }
+
+    return NO_ERROR;
+}
+
+status_t AudioHardware::AudioStreamOutFast::dump(int fd, const Vector<String16>& args)
+{
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    String8 result;
+
+    sp <FastMixer> mixer;
+    bool locked = tryLock(mLock);
+    if (!locked) {
+        snprintf(buffer, SIZE, "\n\t\tAudioStreamOutFast maybe deadlocked\n");
+    } else {
+        mixer = mFastMixer;
+        mLock.unlock();
+    }
+
+    snprintf(buffer, SIZE, "\t\tmHardware: %p\n", mHardware);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tStandby %s\n", (mStandby) ? "ON" : "OFF");
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tmDevices: 0x%08x\n", mDevices);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tmChannels: 0x%08x\n", mChannels);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tmBufferSize: %d\n", mBufferSize);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tLatency: %d ms\n", latency());
+    result.append(buffer);
+    mExitStats.dump(result, "\t\tStandby exit");
+    if (mixer != 0) {
+        mixer->dump(result);
+    }
+
+    ::write(fd, result.string(), result.size());
+
+    return NO_ERROR;
+}
+
+status_t AudioHardware::AudioStreamOutFast::setParameters(const String8& keyValuePairs)
+{
+    AudioParameter param = AudioParameter(keyValuePairs);
+    int device;
+
+    LOGD("AudioStreamOutFast::setParameters() %s", keyValuePairs.string());
+
+    // the route is driven by the main output while both are active, the
+    // device is only used when the fast output starts the pcm on its own
+    if (param.getInt(String8(AudioParameter::keyRouting), device) == NO_ERROR) {
+        AutoMutex lock(mLock);
+        if (device != 0) {
+            mDevices = (uint32_t)device;
+        }
+        param.remove(String8(AudioParameter::keyRouting));
+    }
+
+    if (param.size()) {
+        return BAD_VALUE;
+    }
+    return NO_ERROR;
+}
+
+String8 AudioHardware::AudioStreamOutFast::getParameters(const String8& keys)
+{
+    AudioParameter param = AudioParameter(keys);
+    String8 value;
+    String8 key = String8(AudioParameter::keyRouting);
+
+    if (param.get(key, value) == NO_ERROR) {
+        param.addInt(key, (int)mDevices);
+    }
+
+    LOGV("AudioStreamOutFast::getParameters() %s", param.toString().string());
+    return param.toString();
+}
+
 //------------------------------------------------------------------------------
 //  AudioStreamInALSA
 //------------------------------------------------------------------------------
@@ -1389,46 +2026,44 @@ status_t AudioHardware::AudioStreamInALSA::set(
     mHardware = hw;
 
     LOGV("AudioStreamInALSA::set(%d, %d, %u)", *pFormat, *pChannels, *pRate);
-    BufferProvider *bufferProvider = this;
     mDevices = devices;
     mInputChannels = AUDIO_HW_IN_CHANNELS;
     mInputChannelCount = 2;
     mChannels = *pChannels;
     mChannelCount = AudioSystem::popCount(mChannels);
-    delete mChannelMixer;
-    mChannelMixer = NULL;
-    if (mChannels != AUDIO_HW_IN_CHANNELS) {
-        mChannelMixer = new AudioHardware::ChannelMixer(mChannelCount,
-                                    mInputChannelCount, AUDIO_HW_IN_PERIOD_SZ, this);
-        status_t status = mChannelMixer->initCheck();
-        if (status != NO_ERROR) {
-            delete mChannelMixer;
-            LOGW("AudioStreamInALSA::set() channel mixer init failed: %d", status);
-            return status;
-        }
-
-        bufferProvider = mChannelMixer;
-        if (!mPcmIn)
-            mPcmIn = new int16_t[AUDIO_HW_IN_PERIOD_SZ * mInputChannelCount];
-        if (!mPcmIn)
-            return NO_MEMORY;
-    }
     mBufferSize = getBufferSize(rate, mChannelCount);
     mSampleRate = rate;
+    delete mChannelMixer;
+    mChannelMixer = NULL;
     delete mDownSampler;
     mDownSampler = NULL;
     if (mSampleRate != AUDIO_HW_IN_SAMPLERATE) {
+        // the downsampler also performs the channel mix while deinterleaving
         mDownSampler = new AudioHardware::DownSampler(mSampleRate,
                                                   mChannelCount,
+                                                  mInputChannelCount,
                                                   AUDIO_HW_IN_PERIOD_SZ,
-                                                  bufferProvider);
+                                                  this);
         status_t status = mDownSampler->initCheck();
         if (status != NO_ERROR) {
             delete mDownSampler;
+            mDownSampler = NULL;
             LOGW("AudioStreamInALSA::set() downsampler init failed: %d", status);
             return status;
         }
+    } else if (mChannels != AUDIO_HW_IN_CHANNELS) {
+        mChannelMixer = new AudioHardware::ChannelMixer(mChannelCount,
+                                    mInputChannelCount, AUDIO_HW_IN_PERIOD_SZ, this);
+        status_t status = mChannelMixer->initCheck();
+        if (status != NO_ERROR) {
+            delete mChannelMixer;
+            mChannelMixer = NULL;
+            LOGW("AudioStreamInALSA::set() channel mixer init failed: %d", status);
+            return status;
+        }
+    }
 
+    if (mDownSampler != NULL || mChannelMixer != NULL) {
         if (!mPcmIn)
             mPcmIn = new int16_t[AUDIO_HW_IN_PERIOD_SZ * mInputChannelCount];
         if (!mPcmIn)
@@ -1456,22 +2091,23 @@ ssize_t AudioHardware::AudioStreamInALSA::read(void* buffer, ssize_t bytes)
 
     if (mHardware == NULL) return NO_INIT;
 
-    if (mSleepReq) {
-        // 10ms are always shorter than the time to reconfigure the audio path
-        // which is the only condition when mSleepReq would be true.
-        usleep(10000);
-    }
-
     { // scope for the lock
         AutoMutex lock(mLock);
 
+        waitSleepReq_l();
+
         if (mStandby) {
+            nsecs_t start = systemTime();
             AutoMutex hwLock(mHardware->lock());
 
             LOGD("AudioHardware pcm capture is exiting standby.");
             acquire_wake_lock (PARTIAL_WAKE_LOCK, "AudioInLock");
 
-            sp<AudioStreamOutALSA> spOut = mHardware->output();
+            // an active output is reopened before the input, see independentPcms()
+            sp<AudioStreamOutALSA> spOut;
+            if (mHardware->duplexReopen()) {
+                spOut = mHardware->output();
+            }
             while (spOut != 0) {
                 if (!spOut->checkStandby()) {
                     int cnt = spOut->prepareLock();
@@ -1512,6 +2148,7 @@ ssize_t AudioHardware::AudioStreamInALSA::read(void* buffer, ssize_t bytes)
                 goto Error;
             }
             mStandby = false;
+            mExitStats.add(systemTime() - start);
         }
 
 
@@ -1689,6 +2326,7 @@ status_t AudioHardware::AudioStreamInALSA::dump(int fd, const Vector<String16>&
     result.append(buffer);
     snprintf(buffer, SIZE, "\t\tmDriverOp: %d\n", mDriverOp);
     result.append(buffer);
+    mExitStats.dump(result, "\t\tStandby exit");
     write(fd, result.string(), result.size());
 
     return NO_ERROR;
@@ -1820,8 +2458,8 @@ size_t AudioHardware::AudioStreamInALSA::getBufferSize(uint32_t sampleRate, int
 
 int AudioHardware::AudioStreamInALSA::prepareLock()
 {
-    // request sleep next time read() is called so that caller can acquire
-    // mLock
+    // request read() to yield mLock next time it is called so that caller
+    // can acquire it
     mSleepReq = true;
     return mStandbyCnt;
 }
@@ -1833,206 +2471,79 @@ void AudioHardware::AudioStreamInALSA::lock()
 }
 
 void AudioHardware::AudioStreamInALSA::unlock() {
+    mSleepCond.broadcast();
     mLock.unlock();
 }
 
-//------------------------------------------------------------------------------
-//  DownSampler
-//------------------------------------------------------------------------------
-
-/*
- * 2.30 fixed point FIR filter coefficients for conversion 44100 -> 22050.
- * (Works equivalently for 22010 -> 11025 or any other halving, of course.)
- *
- * Transition band from about 18 kHz, passband ripple < 0.1 dB,
- * stopband ripple at about -55 dB, linear phase.
- *
- * Design and display in MATLAB or Octave using:
- *
- * filter = fir1(19, 0.5); filter = round(filter * 2**30); freqz(filter * 2**-30);
- */
-static const int32_t filter_22khz_coeff[] = {
-    2089257, 2898328, -5820678, -10484531,
-    19038724, 30542725, -50469415, -81505260,
-    152544464, 478517512, 478517512, 152544464,
-    -81505260, -50469415, 30542725, 19038724,
-    -10484531, -5820678, 2898328, 2089257,
-};
-#define NUM_COEFF_22KHZ (sizeof(filter_22khz_coeff) / sizeof(filter_22khz_coeff[0]))
-#define OVERLAP_22KHZ (NUM_COEFF_22KHZ - 2)
-
-/*
- * Convolution of signals A and reverse(B). (In our case, the filter response
- * is symmetric, so the reversing doesn't matter.)
- * A is taken to be in 0.16 fixed-point, and B is taken to be in 2.30 fixed-point.
- * The answer will be in 16.16 fixed-point, unclipped.
- *
- * This function would probably be the prime candidate for SIMD conversion if
- * you want more speed.
- */
-int32_t fir_convolve(const int16_t* a, const int32_t* b, int num_samples)
-{
-        int32_t sum = 1 << 13;
-        for (int i = 0; i < num_samples; ++i) {
-                sum += a[i] * (b[i] >> 16);
-        }
-        return sum >> 14;
-}
-
-/* Clip from 16.16 fixed-point to 0.16 fixed-point. */
-int16_t clip(int32_t x)
-{
-    if (x < -32768) {
-        return -32768;
-    } else if (x > 32767) {
-        return 32767;
-    } else {
-        return x;
-    }
-}
-
-/*
- * Convert a chunk from 44 kHz to 22 kHz. Will update num_samples_in and num_samples_out
- * accordingly, since it may leave input samples in the buffer due to overlap.
- *
- * Input and output are taken to be in 0.16 fixed-point.
- */
-void resample_2_1(int16_t* input, int16_t* output, int* num_samples_in, int* num_samples_out)
-{
-    if (*num_samples_in < (int)NUM_COEFF_22KHZ) {
-        *num_samples_out = 0;
-        return;
-    }
-
-    int odd_smp = *num_samples_in & 0x1;
-    int num_samples = *num_samples_in - odd_smp - OVERLAP_22KHZ;
-
-    for (int i = 0; i < num_samples; i += 2) {
-            output[i / 2] = clip(fir_convolve(input + i, filter_22khz_coeff, NUM_COEFF_22KHZ));
-    }
-
-    memmove(input, input + num_samples, (OVERLAP_22KHZ + odd_smp) * sizeof(*input));
-    *num_samples_out = num_samples / 2;
-    *num_samples_in = OVERLAP_22KHZ + odd_smp;
-}
-
-/*
- * 2.30 fixed point FIR filter coefficients for conversion 22050 -> 16000,
- * or 11025 -> 8000.
- *
- * Transition band from about 14 kHz, passband ripple < 0.1 dB,
- * stopband ripple at about -50 dB, linear phase.
- *
- * Design and display in MATLAB or Octave using:
- *
- * filter = fir1(23, 16000 / 22050); filter = round(filter * 2**30); freqz(filter * 2**-30);
- */
-static const int32_t filter_16khz_coeff[] = {
-    2057290, -2973608, 1880478, 4362037,
-    -14639744, 18523609, -1609189, -38502470,
-    78073125, -68353935, -59103896, 617555440,
-    617555440, -59103896, -68353935, 78073125,
-    -38502470, -1609189, 18523609, -14639744,
-    4362037, 1880478, -2973608, 2057290,
-};
-#define NUM_COEFF_16KHZ (sizeof(filter_16khz_coeff) / sizeof(filter_16khz_coeff[0]))
-#define OVERLAP_16KHZ (NUM_COEFF_16KHZ - 1)
-
-/*
- * Convert a chunk from 22 kHz to 16 kHz. Will update num_samples_in and
- * num_samples_out accordingly, since it may leave input samples in the buffer
- * due to overlap.
- *
- * This implementation is rather ad-hoc; it first low-pass filters the data
- * into a temporary buffer, and then converts chunks of 441 input samples at a
- * time into 320 output samples by simple linear interpolation. A better
- * implementation would use a polyphase filter bank to do these two operations
- * in one step.
- *
- * Input and output are taken to be in 0.16 fixed-point.
- */
-
-#define RESAMPLE_16KHZ_SAMPLES_IN 441
-#define RESAMPLE_16KHZ_SAMPLES_OUT 320
-
-void resample_441_320(int16_t* input, int16_t* output, int* num_samples_in, int* num_samples_out)
-{
-    const int num_blocks = (*num_samples_in - OVERLAP_16KHZ) / RESAMPLE_16KHZ_SAMPLES_IN;
-    if (num_blocks < 1) {
-        *num_samples_out = 0;
-        return;
-    }
-
-    for (int i = 0; i < num_blocks; ++i) {
-        uint32_t tmp[RESAMPLE_16KHZ_SAMPLES_IN];
-        for (int j = 0; j < RESAMPLE_16KHZ_SAMPLES_IN; ++j) {
-            tmp[j] = fir_convolve(input + i * RESAMPLE_16KHZ_SAMPLES_IN + j,
-                          filter_16khz_coeff,
-                          NUM_COEFF_16KHZ);
-        }
-
-        const float step_float = (float)RESAMPLE_16KHZ_SAMPLES_IN / (float)RESAMPLE_16KHZ_SAMPLES_OUT;
-        const uint32_t step = (uint32_t)(step_float * 32768.0f + 0.5f);  // 17.15 fixed point
-
-        uint32_t in_sample_num = 0;   // 17.15 fixed point
-        for (int j = 0; j < RESAMPLE_16KHZ_SAMPLES_OUT; ++j, in_sample_num += step) {
-            const uint32_t whole = in_sample_num >> 15;
-            const uint32_t frac = (in_sample_num & 0x7fff);  // 0.15 fixed point
-            const int32_t s1 = tmp[whole];
-            const int32_t s2 = tmp[whole + 1];
-            *output++ = clip(s1 + (((s2 - s1) * (int32_t)frac) >> 15));
+// see AudioStreamOutALSA::waitSleepReq_l()
+void AudioHardware::AudioStreamInALSA::waitSleepReq_l()
+{
+    while (mSleepReq) {
+        if (mSleepCond.waitRelative(mLock, kSleepReqTimeout) != NO_ERROR) {
+            break;
         }
-
     }
-
-    const int samples_consumed = num_blocks * RESAMPLE_16KHZ_SAMPLES_IN;
-    memmove(input, input + samples_consumed, (*num_samples_in - samples_consumed) * sizeof(*input));
-    *num_samples_in -= samples_consumed;
-    *num_samples_out = RESAMPLE_16KHZ_SAMPLES_OUT * num_blocks;
 }
 
+//------------------------------------------------------------------------------
+//  DownSampler
+//------------------------------------------------------------------------------
+
+// Capture conversion runs in stages over each buffer: samples pulled from the
+// pcm are deinterleaved (and downmixed to mono if needed) straight into the
+// first filter stage, each plane then goes through the FIR stages on its own,
+// and the result is interleaved straight into the caller's buffer. The
+// kernels live in audio_convert.c; all planes share one scratch allocation.
 
 AudioHardware::DownSampler::DownSampler(uint32_t outSampleRate,
                                     uint32_t channelCount,
+                                    uint32_t inChannelCount,
                                     uint32_t frameCount,
                                     AudioHardware::BufferProvider* provider)
     :  mStatus(NO_INIT), mProvider(provider), mSampleRate(outSampleRate),
-       mChannelCount(channelCount), mFrameCount(frameCount),
+       mChannelCount(channelCount), mInChannelCount(inChannelCount),
+       mFrameCount(frameCount), mScratch(NULL),
        mInLeft(NULL), mInRight(NULL), mTmpLeft(NULL), mTmpRight(NULL),
        mTmp2Left(NULL), mTmp2Right(NULL), mOutLeft(NULL), mOutRight(NULL)
 
 {
-    LOGV("AudioHardware::DownSampler() cstor %p SR %d channels %d frames %d",
-         this, mSampleRate, mChannelCount, mFrameCount);
+    LOGV("AudioHardware::DownSampler() cstor %p SR %d channels %d -> %d frames %d",
+         this, mSampleRate, mInChannelCount, mChannelCount, mFrameCount);
 
     if (mSampleRate != 8000 && mSampleRate != 11025 && mSampleRate != 16000 &&
             mSampleRate != 22050) {
         LOGW("AudioHardware::DownSampler cstor: bad sampling rate: %d", mSampleRate);
         return;
     }
+    if (mChannelCount > mInChannelCount || mInChannelCount > 2) {
+        LOGW("AudioHardware::DownSampler cstor: bad conversion: %d => %d",
+             mInChannelCount, mChannelCount);
+        return;
+    }
+
+    audio_convert_init();
 
-    mInLeft = new int16_t[mFrameCount];
-    mInRight = new int16_t[mFrameCount];
-    mTmpLeft = new int16_t[mFrameCount];
-    mTmpRight = new int16_t[mFrameCount];
-    mTmp2Left = new int16_t[mFrameCount];
-    mTmp2Right = new int16_t[mFrameCount];
-    mOutLeft = new int16_t[mFrameCount];
-    mOutRight = new int16_t[mFrameCount];
+    // 4 stages, one plane per output channel each
+    mScratch = new int16_t[4 * mChannelCount * mFrameCount];
+    int16_t *plane = mScratch;
+    mInLeft = plane; plane += mFrameCount;
+    mTmpLeft = plane; plane += mFrameCount;
+    mTmp2Left = plane; plane += mFrameCount;
+    mOutLeft = plane; plane += mFrameCount;
+    if (mChannelCount == 2) {
+        mInRight = plane; plane += mFrameCount;
+        mTmpRight = plane; plane += mFrameCount;
+        mTmp2Right = plane; plane += mFrameCount;
+        mOutRight = plane;
+    }
 
+    reset();
     mStatus = NO_ERROR;
 }
 
 AudioHardware::DownSampler::~DownSampler()
 {
-    if (mInLeft) delete[] mInLeft;
-    if (mInRight) delete[] mInRight;
-    if (mTmpLeft) delete[] mTmpLeft;
-    if (mTmpRight) delete[] mTmpRight;
-    if (mTmp2Left) delete[] mTmp2Left;
-    if (mTmp2Right) delete[] mTmp2Right;
-    if (mOutLeft) delete[] mOutLeft;
-    if (mOutRight) delete[] mOutRight;
+    if (mScratch) delete[] mScratch;
 }
 
 void AudioHardware::DownSampler::reset()
@@ -2044,6 +2555,16 @@ void AudioHardware::DownSampler::reset()
     mInOutBuf = 0;
 }
 
+// copy frames from the output planes to the interleaved destination
+void AudioHardware::DownSampler::output(int16_t *out, const int16_t *left,
+                                        const int16_t *right, size_t frames)
+{
+    if (mChannelCount == 2) {
+        audio_interleave(left, right, out, frames);
+    } else {
+        memcpy(out, left, frames * sizeof(int16_t));
+    }
+}
 
 int AudioHardware::DownSampler::resample(int16_t* out, size_t *outFrameCount)
 {
@@ -2056,7 +2577,7 @@ int AudioHardware::DownSampler::resample(int16_t* out, size_t *outFrameCount)
     }
 
     int16_t *outLeft = mTmp2Left;
-    int16_t *outRight = mTmp2Left;
+    int16_t *outRight = mTmp2Right;
     if (mSampleRate == 22050) {
         outLeft = mTmpLeft;
         outRight = mTmpRight;
@@ -2071,15 +2592,8 @@ int AudioHardware::DownSampler::resample(int16_t* out, size_t *outFrameCount)
     if (mInOutBuf) {
         int frames = (remaingFrames > mInOutBuf) ? mInOutBuf : remaingFrames;
 
-        for (int i = 0; i < frames; ++i) {
-            out[i] = outLeft[mOutBufPos + i];
-        }
-        if (mChannelCount == 2) {
-            for (int i = 0; i < frames; ++i) {
-                out[i * 2] = outLeft[mOutBufPos + i];
-                out[i * 2 + 1] = outRight[mOutBufPos + i];
-            }
-        }
+        output(out, outLeft + mOutBufPos,
+               outRight ? outRight + mOutBufPos : NULL, frames);
         remaingFrames -= frames;
         mInOutBuf -= frames;
         mOutBufPos += frames;
@@ -2097,14 +2611,13 @@ int AudioHardware::DownSampler::resample(int16_t* out, size_t *outFrameCount)
             return ret;
         }
 
-        for (size_t i = 0; i < buf.frameCount; ++i) {
-            mInLeft[i + mInInBuf] = buf.i16[i];
-        }
-        if (mChannelCount == 2) {
-            for (size_t i = 0; i < buf.frameCount; ++i) {
-                mInLeft[i + mInInBuf] = buf.i16[i * 2];
-                mInRight[i + mInInBuf] = buf.i16[i * 2 + 1];
-            }
+        if (mInChannelCount == 1) {
+            memcpy(mInLeft + mInInBuf, buf.i16, buf.frameCount * sizeof(int16_t));
+        } else if (mChannelCount == 1) {
+            audio_downmix(buf.i16, mInLeft + mInInBuf, buf.frameCount);
+        } else {
+            audio_deinterleave(buf.i16, mInLeft + mInInBuf, mInRight + mInInBuf,
+                               buf.frameCount);
         }
         mInInBuf += buf.frameCount;
         mProvider->releaseBuffer(&buf);
@@ -2181,15 +2694,7 @@ int AudioHardware::DownSampler::resample(int16_t* out, size_t *outFrameCount)
 
         int frames = (remaingFrames > mInOutBuf) ? mInOutBuf : remaingFrames;
 
-        for (int i = 0; i < frames; ++i) {
-            out[outFrames + i] = outLeft[i];
-        }
-        if (mChannelCount == 2) {
-            for (int i = 0; i < frames; ++i) {
-                out[(outFrames + i) * 2] = outLeft[i];
-                out[(outFrames + i) * 2 + 1] = outRight[i];
-            }
-        }
+        output(out + outFrames * mChannelCount, outLeft, outRight, frames);
         remaingFrames -= frames;
         outFrames += frames;
         mOutBufPos = frames;
@@ -2219,6 +2724,8 @@ AudioHardware::ChannelMixer::ChannelMixer(uint32_t outChannelCount,
         return;
     }
 
+    audio_convert_init();
+
     mStatus = NO_ERROR;
 }
 
@@ -2237,10 +2744,7 @@ status_t AudioHardware::ChannelMixer::getNextBuffer(AudioHardware::BufferProvide
     if (!buffer->raw)
         return NO_ERROR;
 
-    short *in = buffer->i16;
-    short *out = buffer->i16;
-    for (unsigned int i = 0; i < buffer->frameCount; ++i, ++out, in += 2)
-        out[0] = (in[0] + in[1]) / 2;
+    audio_downmix(buffer->i16, buffer->i16, buffer->frameCount);
 
     return NO_ERROR;
 }
@@ -2274,13 +2778,8 @@ int AudioHardware::ChannelMixer::mix(int16_t* out, size_t *outFrameCount)
 
         remaingFrames -= buf.frameCount;
 
-        int framesRead = buf.frameCount;
-        int16_t *inBuf = buf.i16;
-        while (framesRead--) {
-            out[0] = (int16_t)(((int32_t)inBuf[0] + (int32_t)inBuf[1]) / 2);
-            out += 1;
-            inBuf += 2;
-        }
+        audio_downmix(buf.i16, out, buf.frameCount);
+        out += buf.frameCount;
 
         mProvider->releaseBuffer(&buf);
     }
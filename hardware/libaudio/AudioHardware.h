@@ -21,6 +21,7 @@
 #include <sys/types.h>
 
 #include <utils/threads.h>
+#include <utils/Timers.h>
 #include <utils/SortedVector.h>
 
 #include <hardware_legacy/AudioHardwareBase.h>
@@ -51,6 +52,15 @@ namespace android {
 // Default audio output buffer size in bytes
 #define AUDIO_HW_OUT_PERIOD_BYTES (AUDIO_HW_OUT_PERIOD_SZ * 2 * sizeof(int16_t))
 
+// Kernel pcm out period while the fast mixer owns the pcm
+#define AUDIO_HW_FAST_PERIOD_MULT 2 // (2 * 128 = 256 frames)
+#define AUDIO_HW_FAST_PERIOD_SZ (PCM_PERIOD_SZ_MIN * AUDIO_HW_FAST_PERIOD_MULT)
+#define AUDIO_HW_FAST_PERIOD_CNT 3
+// Fast output ring depth in periods
+#define AUDIO_HW_FAST_RING_PERIODS 2
+// SCHED_FIFO priority of the fast mixer thread
+#define AUDIO_HW_FAST_FIFO_PRIORITY 2
+
 // Default audio input sample rate
 #define AUDIO_HW_IN_SAMPLERATE 44100
 // Default audio input channel mask
@@ -67,9 +77,22 @@ namespace android {
 class AudioHardware : public AudioHardwareBase
 {
     class AudioStreamOutALSA;
+    class AudioStreamOutFast;
     class AudioStreamInALSA;
+    class FastMixer;
 public:
 
+    // duration of standby exits and mode switches, reported by dump()
+    struct TransitionStats {
+        TransitionStats() : count(0), total(0), max(0), last(0) {}
+        void add(nsecs_t duration);
+        void dump(String8& result, const char *name);
+        uint32_t count;
+        nsecs_t total;
+        nsecs_t max;
+        nsecs_t last;
+    };
+
     // input path names used to translate from input sources to driver paths
     static const char *inputPathNameDefault;
     static const char *inputPathNameCamcorder;
@@ -131,13 +154,26 @@ public:
 
            Mutex& lock() { return mLock; }
 
-           struct pcm *openPcmOut_l();
+           struct pcm *openPcmOut_l(uint32_t periodMult = AUDIO_HW_OUT_PERIOD_MULT,
+                                    uint32_t periodCnt = AUDIO_HW_OUT_PERIOD_CNT);
            void closePcmOut_l();
 
+           sp <FastMixer> startFastMixer(uint32_t devices);
+           void stopFastMixer();
+           sp <FastMixer> fastMixer_l() { return mFastMixer; }
+           // the main output goes through the fast mixer while this is true
+           bool fastPathOpen_l() { return mFastOutput != 0 || mFastMixer != 0; }
+           sp <FastMixer> attachFastMixer_l(uint32_t devices);
+           void detachFastMixer_l();
+
            struct mixer *openMixer_l();
            void closeMixer_l();
+           // true while at least one user holds the mixer open
+           bool mixerActive_l() { return mMixerOpenCnt != 0; }
 
            sp <AudioStreamOutALSA>  output() { return mOutput; }
+           // leaving standby closes and reopens the pcm of the other direction
+           bool duplexReopen() { return mDuplexReopen; }
 
 protected:
     virtual status_t dump(int fd, const Vector<String16>& args);
@@ -179,17 +215,25 @@ private:
 
 
     status_t setOutputRoute( AudioHardware::RouteType path, uint32_t device);
+    static bool independentPcms(const char *driver);
 
     bool            mInit;
     bool            mMicMute;
     sp <AudioStreamOutALSA>                 mOutput;
+    sp <AudioStreamOutFast>                 mFastOutput;
+    sp <FastMixer>                          mFastMixer;
     SortedVector < sp<AudioStreamInALSA> >   mInputs;
     Mutex           mLock;
     struct pcm*     mPcm;
     struct mixer*   mMixer;
     uint32_t        mPcmOpenCnt;
+    // kernel buffer of mPcm in frames, as configured by whoever opened it
+    uint32_t        mPcmFrames;
     uint32_t        mMixerOpenCnt;
+    // users of mFastMixer: the fast output and the main output
+    uint32_t        mFastMixerCnt;
     bool            mInCallAudioMode;
+    bool            mDuplexReopen;
     float           mVoiceVol;
 
     audio_source    mInputSource;
@@ -204,6 +248,7 @@ private:
 
     //  trace driver operations for dump
     int             mDriverOp;
+    TransitionStats mModeStats;
 
     void setOutputVolume(uint32_t device, uint32_t volume);
     static uint32_t         checkInputSampleRate(uint32_t sampleRate);
@@ -227,10 +272,10 @@ private:
             const { return mChannels; }
         virtual int format()
             const { return AUDIO_HW_OUT_FORMAT; }
+        // set by open_l(): through the fast mixer the main ring sits in
+        // front of the pcm
         virtual uint32_t latency()
-            const { return (1000 * AUDIO_HW_OUT_PERIOD_CNT *
-                            (bufferSize()/frameSize()))/sampleRate() +
-                AUDIO_HW_OUT_LATENCY_MS; }
+            const { return mLatency; }
         virtual status_t setVolume(float left, float right)
         { return INVALID_OPERATION; }
         virtual ssize_t write(const void* buffer, size_t bytes);
@@ -253,8 +298,10 @@ private:
                 void unlock();
 
     private:
+                void waitSleepReq_l();
 
         Mutex mLock;
+        Condition mSleepCond;
         AudioHardware* mHardware;
         struct pcm *mPcm;
         struct mixer *mMixer;
@@ -269,6 +316,126 @@ private:
         int mDriverOp;
         int mStandbyCnt;
         bool mSleepReq;
+        TransitionStats mExitStats;
+        // set instead of mPcm while the fast mixer owns the pcm
+        sp <FastMixer> mFastMixer;
+        uint32_t mLatency;
+    };
+
+    // Single producer, single consumer ring of stereo frames.  Each index is
+    // free running and only written by its own side, so neither side takes
+    // a lock.
+    class FrameRing {
+    public:
+        FrameRing(size_t frames); // power of 2
+        ~FrameRing();
+
+        status_t initCheck() { return mData ? NO_ERROR : NO_MEMORY; }
+        size_t capacity() const { return mFrames; }
+        size_t framesReady() const;
+        size_t framesFree() const;
+        // producer side, mono input is duplicated to both channels
+        size_t write(const int16_t *in, size_t frames, uint32_t channelCount);
+        // consumer side
+        size_t read(int16_t *out, size_t frames);
+
+    private:
+        int16_t *mData;
+        size_t mFrames;
+        volatile uint32_t mFront;
+        volatile uint32_t mRear;
+    };
+
+    // Owns the pcm while the fast output exists: every short period it mixes
+    // the fast output ring with whatever the main output queued and writes
+    // the result.  Producers never block the mixer thread, they wait for
+    // room in their ring.
+    class FastMixer : public Thread {
+    public:
+        FastMixer(struct pcm *pcm, uint32_t pcmFrames);
+        virtual ~FastMixer();
+
+        status_t initCheck();
+        // frames between writeMain() and the DAC: main ring plus pcm buffer
+        uint32_t mainLatencyFrames() const
+            { return mMainRing.capacity() + mPcmFrames; }
+        // lock and standby are the calling stream's: the lock is released
+        // while waiting for room, and what is left is dropped if the stream
+        // went to standby meanwhile
+        ssize_t writeMain(Mutex& lock, const bool& standby,
+                          const void *buffer, size_t bytes);
+        ssize_t writeFast(Mutex& lock, const bool& standby,
+                          const void *buffer, size_t bytes, uint32_t channelCount);
+        void dump(String8& result);
+
+    private:
+        virtual status_t readyToRun();
+        virtual bool threadLoop();
+        void push(Mutex& lock, const bool& standby, FrameRing& ring,
+                  const int16_t *in, size_t frames, uint32_t channelCount);
+
+        struct pcm *mPcm;
+        uint32_t mPcmFrames;
+        FrameRing mMainRing;
+        FrameRing mFastRing;
+        // signalled each cycle, once the rings have been read
+        Condition mRoomCond;
+        int16_t *mMixBuffer;
+        int16_t *mMainBuffer;
+        // written by the mixer thread only
+        bool mFifo;
+        uint32_t mCycles;
+        uint32_t mFastUnderruns;
+        uint32_t mWriteErrors;
+        nsecs_t mMaxCycle;
+    };
+
+    // Low latency output: short buffers, mixed into the pcm of the main
+    // output by the FastMixer thread.
+    class AudioStreamOutFast : public AudioStreamOut, public RefBase
+    {
+    public:
+        AudioStreamOutFast();
+        virtual ~AudioStreamOutFast();
+        status_t set(AudioHardware* mHardware,
+                     uint32_t devices,
+                     int *pFormat,
+                     uint32_t *pChannels,
+                     uint32_t *pRate);
+        virtual uint32_t sampleRate()
+            const { return AUDIO_HW_OUT_SAMPLERATE; }
+        virtual size_t bufferSize()
+            const { return mBufferSize; }
+        virtual uint32_t channels()
+            const { return mChannels; }
+        virtual int format()
+            const { return AUDIO_HW_OUT_FORMAT; }
+        virtual uint32_t latency()
+            const { return (1000 * (AUDIO_HW_FAST_PERIOD_CNT + AUDIO_HW_FAST_RING_PERIODS) *
+                            AUDIO_HW_FAST_PERIOD_SZ)/sampleRate() +
+                AUDIO_HW_OUT_LATENCY_MS; }
+        virtual status_t setVolume(float left, float right)
+        { return INVALID_OPERATION; }
+        virtual ssize_t write(const void* buffer, size_t bytes);
+        virtual status_t standby();
+
+        virtual status_t dump(int fd, const Vector<String16>& args);
+        virtual status_t setParameters(const String8& keyValuePairs);
+        virtual String8 getParameters(const String8& keys);
+        virtual status_t getRenderPosition(uint32_t *dspFrames)
+        { return INVALID_OPERATION; }
+
+    private:
+        Mutex mLock;
+        AudioHardware* mHardware;
+        sp <FastMixer> mFastMixer;
+        bool mStandby;
+        uint32_t mDevices;
+        uint32_t mChannels;
+        uint32_t mChannelCount;
+        size_t mBufferSize;
+        int mStandbyCnt;
+        TransitionStats mExitStats;
     };
 
     class DownSampler;
@@ -318,6 +485,7 @@ private:
     public:
         DownSampler(uint32_t outSampleRate,
                   uint32_t channelCount,
+                  uint32_t inChannelCount,
                   uint32_t frameCount,
                   BufferProvider* provider);
 
@@ -328,11 +496,17 @@ private:
                 int resample(int16_t* out, size_t *outFrameCount);
 
     private:
+                void output(int16_t *out, const int16_t *left,
+                            const int16_t *right, size_t frames);
+
         status_t    mStatus;
         BufferProvider* mProvider;
         uint32_t mSampleRate;
         uint32_t mChannelCount;
+        uint32_t mInChannelCount;
         uint32_t mFrameCount;
+        // single allocation backing all the planes below
+        int16_t *mScratch;
         int16_t *mInLeft;
         int16_t *mInRight;
         int16_t *mTmpLeft;
@@ -390,7 +564,10 @@ private:
         void unlock();
 
     private:
+        void waitSleepReq_l();
+
         Mutex mLock;
+        Condition mSleepCond;
         AudioHardware* mHardware;
         struct pcm *mPcm;
         struct mixer *mMixer;
@@ -413,6 +590,7 @@ private:
         int mDriverOp;
         int mStandbyCnt;
         bool mSleepReq;
+        TransitionStats mExitStats;
     };
 
 };
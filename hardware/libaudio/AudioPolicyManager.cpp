@@ -42,5 +42,24 @@ extern "C" void destroyAudioPolicyManager(AudioPolicyInterface *interface)
     delete interface;
 }
 
+audio_io_handle_t AudioPolicyManager::getOutput(AudioSystem::stream_type stream,
+                                                uint32_t samplingRate,
+                                                uint32_t format,
+                                                uint32_t channels,
+                                                AudioSystem::output_flags flags)
+{
+    if (stream == AudioSystem::DTMF && mPhoneState != AudioSystem::MODE_IN_CALL &&
+        !(flags & AudioSystem::OUTPUT_FLAG_DIRECT)) {
+        audio_io_handle_t output = AudioPolicyManagerBase::getOutput(stream,
+                samplingRate, format, channels,
+                (AudioSystem::output_flags)(flags | AudioSystem::OUTPUT_FLAG_DIRECT));
+        if (output != 0) {
+            return output;
+        }
+        LOGV("getOutput() low latency output busy, using mixer output");
+    }
+    return AudioPolicyManagerBase::getOutput(stream, samplingRate, format, channels, flags);
+}
+
 
 }; // namespace android
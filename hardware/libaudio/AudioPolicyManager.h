@@ -34,6 +34,15 @@ public:
 
         virtual ~AudioPolicyManager() {}
 
+        // DTMF tones go to a direct output, which the audio HAL serves on its
+        // low latency path, and fall back to the mixer output when it is busy
+        virtual audio_io_handle_t getOutput(AudioSystem::stream_type stream,
+                                            uint32_t samplingRate = 0,
+                                            uint32_t format = AudioSystem::FORMAT_DEFAULT,
+                                            uint32_t channels = 0,
+                                            AudioSystem::output_flags flags =
+                                                    AudioSystem::OUTPUT_FLAG_INDIRECT);
+
 protected:
         // true is current platform implements a back microphone
         virtual bool hasBackMicrophone() const { return false; }
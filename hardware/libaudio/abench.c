@@ -0,0 +1,439 @@
+/*
+** Copyright 2010, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/* Audio HAL benchmark for the host build, on top of alsa_loopback.c.
+ *
+ * usage: abench [-t seconds] [-l load threads] [-w work us] [test...]
+ *   tests: latency xrun resample route (default: all)
+ *
+ * Results are printed one per line as "<test>.<metric> <value>" so that
+ * runs can be diffed or graphed before and after a change.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "alsa_audio.h"
+#include "alsa_loopback.h"
+#include "audio_convert.h"
+
+/* same configuration as AudioHardware::openPcmOut_l() */
+#define OUT_PERIOD_MULT 8
+#define OUT_PERIOD_CNT  4
+#define OUT_PERIOD_SZ   (PCM_PERIOD_SZ_MIN * OUT_PERIOD_MULT)
+#define OUT_RATE        44100
+
+static int duration = 5;
+static int load_threads = -1;
+static int work_us = 2000;
+static volatile int load_stop;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* print count, average and percentiles of a sample set, in microseconds */
+static void report(const char *name, int64_t *ns, unsigned n)
+{
+    int64_t sum = 0;
+    unsigned i;
+
+    if (!n) {
+        printf("%s.count 0\n", name);
+        return;
+    }
+    qsort(ns, n, sizeof(*ns), cmp_i64);
+    for (i = 0; i < n; i++)
+        sum += ns[i];
+    printf("%s.count %u\n", name, n);
+    printf("%s.avg_us %.1f\n", name, sum / 1000.0 / n);
+    printf("%s.p50_us %.1f\n", name, ns[n / 2] / 1000.0);
+    printf("%s.p99_us %.1f\n", name, ns[(n * 99) / 100] / 1000.0);
+    printf("%s.max_us %.1f\n", name, ns[n - 1] / 1000.0);
+}
+
+static struct pcm *open_out(void)
+{
+    unsigned flags = PCM_OUT;
+    struct pcm *pcm;
+
+    flags |= (OUT_PERIOD_MULT - 1) << PCM_PERIOD_SZ_SHIFT;
+    flags |= (OUT_PERIOD_CNT - PCM_PERIOD_CNT_MIN) << PCM_PERIOD_CNT_SHIFT;
+    pcm = pcm_open(flags);
+    if (!pcm_ready(pcm)) {
+        fprintf(stderr, "abench: cannot open pcm: %s\n", pcm_error(pcm));
+        pcm_close(pcm);
+        return NULL;
+    }
+    return pcm;
+}
+
+static void busy_wait_us(int us)
+{
+    int64_t end = now_ns() + (int64_t)us * 1000;
+    while (now_ns() < end)
+        ;
+}
+
+/* write-to-DMA latency: how long a frame sits in the ring once written */
+
+static int test_latency(void)
+{
+    int16_t buf[OUT_PERIOD_SZ * 2];
+    unsigned max = duration * OUT_RATE / OUT_PERIOD_SZ + 16;
+    int64_t *delay = calloc(max, sizeof(int64_t));
+    int64_t *call = calloc(max, sizeof(int64_t));
+    int64_t t0, end;
+    unsigned n = 0;
+    struct pcm *pcm;
+
+    if (!delay || !call)
+        return -1;
+    pcm = open_out();
+    if (!pcm)
+        return -1;
+
+    memset(buf, 0, sizeof(buf));
+    end = now_ns() + (int64_t)duration * 1000000000LL;
+    while (now_ns() < end && n < max) {
+        long queued;
+        t0 = now_ns();
+        if (pcm_write(pcm, buf, sizeof(buf))) {
+            fprintf(stderr, "abench: write failed: %s\n", pcm_error(pcm));
+            break;
+        }
+        call[n] = now_ns() - t0;
+        queued = alsa_loopback_playback_delay();
+        delay[n] = queued < 0 ? 0 : (int64_t)queued * 1000000000LL / OUT_RATE;
+        n++;
+    }
+    pcm_close(pcm);
+
+    report("latency.write_to_dma", delay, n);
+    report("latency.pcm_write_call", call, n);
+    free(delay);
+    free(call);
+    return 0;
+}
+
+/* xrun rate with the writer competing against busy threads */
+
+static void *load_thread(void *arg)
+{
+    volatile unsigned x = 0;
+    (void)arg;
+    while (!load_stop)
+        x++;
+    return NULL;
+}
+
+static int test_xrun(void)
+{
+    int16_t buf[OUT_PERIOD_SZ * 2];
+    struct alsa_loopback_stats st;
+    pthread_t *threads;
+    unsigned writes = 0;
+    int nload = load_threads;
+    int64_t start, end;
+    struct pcm *pcm;
+    int i;
+
+    if (nload < 0)
+        nload = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+    threads = calloc(nload ? nload : 1, sizeof(pthread_t));
+    if (!threads)
+        return -1;
+
+    pcm = open_out();
+    if (!pcm) {
+        free(threads);
+        return -1;
+    }
+
+    load_stop = 0;
+    for (i = 0; i < nload; i++)
+        pthread_create(&threads[i], NULL, load_thread, NULL);
+
+    alsa_loopback_reset_stats();
+    memset(buf, 0, sizeof(buf));
+    start = now_ns();
+    end = start + (int64_t)duration * 1000000000LL;
+    while (now_ns() < end) {
+        /* stand-in for AudioFlinger mixing the next period */
+        busy_wait_us(work_us);
+        if (pcm_write(pcm, buf, sizeof(buf)))
+            break;
+        writes++;
+    }
+    end = now_ns();
+
+    load_stop = 1;
+    for (i = 0; i < nload; i++)
+        pthread_join(threads[i], NULL);
+    pcm_close(pcm);
+    free(threads);
+
+    alsa_loopback_get_stats(&st);
+    printf("xrun.load_threads %d\n", nload);
+    printf("xrun.work_us %d\n", work_us);
+    printf("xrun.periods %u\n", writes);
+    printf("xrun.count %u\n", st.playback_xruns);
+    printf("xrun.per_minute %.2f\n",
+           st.playback_xruns * 60e9 / (double)(end - start));
+    return 0;
+}
+
+/* resampler throughput, 44.1 kHz stereo capture to the supported rates */
+
+static double run_pipeline(const int16_t *in, unsigned frames, unsigned rate,
+                           int stereo)
+{
+    const unsigned chunk = 1024;
+    unsigned nch = stereo ? 2 : 1;
+    int16_t *plane[2][4];
+    int16_t *out;
+    int fill[2][3];
+    unsigned pos, c, k;
+    int64_t t0;
+
+    for (c = 0; c < 2; c++) {
+        for (k = 0; k < 4; k++)
+            plane[c][k] = calloc(chunk * 2, sizeof(int16_t));
+    }
+    out = calloc(chunk * 2, sizeof(int16_t));
+    memset(fill, 0, sizeof(fill));
+
+    /* same stage layout as DownSampler::resample() */
+    t0 = now_ns();
+    for (pos = 0; pos + chunk <= frames; pos += chunk) {
+        int16_t *final[2] = { NULL, NULL };
+        int produced = 0;
+
+        if (stereo)
+            audio_deinterleave(in + pos * 2, plane[0][0] + fill[0][0],
+                               plane[1][0] + fill[1][0], chunk);
+        else
+            audio_downmix(in + pos * 2, plane[0][0] + fill[0][0], chunk);
+
+        for (c = 0; c < nch; c++) {
+            int n, o;
+
+            fill[c][0] += chunk;
+            n = fill[c][0];
+            resample_2_1(plane[c][0], plane[c][1] + fill[c][1], &n, &o);
+            fill[c][0] = n;
+            fill[c][1] += o;
+            final[c] = plane[c][1];
+            produced = fill[c][1];
+            if (rate == 22050) {
+                fill[c][1] = 0;
+                continue;
+            }
+            n = fill[c][1];
+            if (rate == 16000) {
+                resample_441_320(plane[c][1], plane[c][3], &n, &o);
+                fill[c][1] = n;
+                final[c] = plane[c][3];
+                produced = o;
+                continue;
+            }
+            resample_2_1(plane[c][1], plane[c][2] + fill[c][2], &n, &o);
+            fill[c][1] = n;
+            fill[c][2] += o;
+            final[c] = plane[c][2];
+            produced = fill[c][2];
+            if (rate == 11025) {
+                fill[c][2] = 0;
+                continue;
+            }
+            n = fill[c][2];
+            resample_441_320(plane[c][2], plane[c][3], &n, &o);
+            fill[c][2] = n;
+            final[c] = plane[c][3];
+            produced = o;
+        }
+        if (stereo)
+            audio_interleave(final[0], final[1], out, produced);
+    }
+    t0 = now_ns() - t0;
+
+    for (c = 0; c < 2; c++) {
+        for (k = 0; k < 4; k++)
+            free(plane[c][k]);
+    }
+    free(out);
+    /* input frames per second of cpu time */
+    return frames * 1e9 / (double)t0;
+}
+
+static int test_resample(void)
+{
+    static const unsigned rates[] = { 22050, 16000, 11025, 8000 };
+    unsigned frames = OUT_RATE * 10;
+    int16_t *in = malloc(frames * 2 * sizeof(int16_t));
+    unsigned i, r;
+    int stereo, ref;
+
+    if (!in)
+        return -1;
+    for (i = 0; i < frames; i++) {
+        in[i * 2] = (int16_t)(12000 * sin(2 * M_PI * 440 * i / OUT_RATE));
+        in[i * 2 + 1] = (int16_t)(12000 * sin(2 * M_PI * 1000 * i / OUT_RATE));
+    }
+
+    printf("resample.vector_kernels %d\n", audio_convert_init());
+    for (ref = 1; ref >= 0; ref--) {
+        audio_convert_use_reference(ref);
+        for (stereo = 0; stereo <= 1; stereo++) {
+            for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+                double fps = run_pipeline(in, frames, rates[r], stereo);
+                printf("resample.%s.%s.%u.realtime_x %.1f\n",
+                       ref ? "reference" : "vector",
+                       stereo ? "stereo" : "mono", rates[r], fps / OUT_RATE);
+            }
+        }
+    }
+    audio_convert_use_reference(0);
+    free(in);
+    return 0;
+}
+
+/* route switch: the mixer sequence of AudioHardware::setOutputRoute() */
+
+static int select_ctl(struct mixer *mixer, const char *name, const char *val)
+{
+    struct mixer_ctl *ctl = mixer_get_control(mixer, name, 0);
+    if (!ctl)
+        return -1;
+    return mixer_ctl_select(ctl, val);
+}
+
+static int test_route(void)
+{
+    static const char *routes[][2] = {
+        { "SPK", "INA -> SPK" },
+        { "HP", "INB -> HP" },
+        { "SPK_HP", "INA -> SPK and HP" },
+    };
+    struct alsa_loopback_stats st;
+    unsigned iterations = 200 * duration;
+    int64_t *t = calloc(iterations, sizeof(int64_t));
+    struct mixer *mixer;
+    int64_t t0;
+    unsigned i;
+
+    if (!t)
+        return -1;
+
+    alsa_loopback_reset_stats();
+    t0 = now_ns();
+    mixer = mixer_open();
+    if (!mixer) {
+        fprintf(stderr, "abench: cannot open mixer\n");
+        free(t);
+        return -1;
+    }
+    printf("route.mixer_open_us %.1f\n", (now_ns() - t0) / 1000.0);
+    alsa_loopback_get_stats(&st);
+    printf("route.mixer_open_ioctls %u\n", st.ctl_ioctls);
+
+    for (i = 0; i < iterations; i++) {
+        const char **r = routes[i % 3];
+        t0 = now_ns();
+        mixer_refresh(mixer);
+        select_ctl(mixer, "Amp Enable", "OFF");
+        select_ctl(mixer, "Playback Path", r[0]);
+        select_ctl(mixer, "MAX9877 Output Mode", r[1]);
+        select_ctl(mixer, "Amp Enable", "ON");
+        t[i] = now_ns() - t0;
+    }
+    report("route.switch", t, iterations);
+
+    /* cost of picking up a driver side control change */
+    alsa_loopback_ctl_changed();
+    t0 = now_ns();
+    printf("route.refresh_changed %d\n", mixer_refresh(mixer));
+    printf("route.refresh_changed_us %.1f\n", (now_ns() - t0) / 1000.0);
+
+    mixer_close(mixer);
+    free(t);
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: abench [-t seconds] [-l load threads] [-w work us] "
+            "[latency] [xrun] [resample] [route]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int all, ret = 0;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "t:l:w:h")) != -1) {
+        switch (opt) {
+        case 't': duration = atoi(optarg); break;
+        case 'l': load_threads = atoi(optarg); break;
+        case 'w': work_us = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if (duration < 1)
+        duration = 1;
+
+    all = (optind == argc);
+    for (i = optind; i < argc; i++) {
+        if (strcmp(argv[i], "latency") && strcmp(argv[i], "xrun") &&
+            strcmp(argv[i], "resample") && strcmp(argv[i], "route"))
+            usage();
+    }
+
+    for (i = 0; i < 4; i++) {
+        static const char *tests[] = { "latency", "xrun", "resample", "route" };
+        int j, run = all;
+        for (j = optind; j < argc; j++)
+            run |= !strcmp(argv[j], tests[i]);
+        if (!run)
+            continue;
+        switch (i) {
+        case 0: ret |= test_latency(); break;
+        case 1: ret |= test_xrun(); break;
+        case 2: ret |= test_resample(); break;
+        case 3: ret |= test_route(); break;
+        }
+        fflush(stdout);
+    }
+    return ret ? 1 : 0;
+}
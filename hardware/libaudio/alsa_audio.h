@@ -65,6 +65,15 @@ struct mixer_ctl;
 struct mixer *mixer_open(void);
 void mixer_close(struct mixer *mixer);
 void mixer_dump(struct mixer *mixer);
+/* driver name of the card, "" if the driver did not say */
+const char *mixer_card_driver(struct mixer *mixer);
+
+/* Drain pending control events and re-read the control table if the driver
+ * added, removed or reshaped controls.  Previously returned mixer_ctl
+ * pointers are invalid after a refresh.
+ * Returns 1 if the table was rebuilt, 0 if unchanged, -1 on error.
+ */
+int mixer_refresh(struct mixer *mixer);
 
 struct mixer_ctl *mixer_get_control(struct mixer *mixer,
                                     const char *name, unsigned index);
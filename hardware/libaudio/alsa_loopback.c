@@ -0,0 +1,848 @@
+/*
+** Copyright 2010, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/* Host-only ALSA stand-in, see alsa_loopback.h. */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include <sys/ioctl.h>
+
+#include <linux/ioctl.h>
+#define __force
+#define __bitwise
+#define __user
+#include "asound.h"
+
+#include "alsa_loopback.h"
+
+#define LB_MAX_FD       1024
+#define LB_MAX_CTLS     64
+#define LB_MAX_ITEMS    16
+#define LB_MAX_EVENTS   64
+#define LB_TONE_HZ      1000
+
+enum {
+    LB_PCM_OUT,
+    LB_PCM_IN,
+    LB_CTL
+};
+
+enum {
+    LB_OPEN,
+    LB_SETUP,
+    LB_PREPARED,
+    LB_RUNNING,
+    LB_XRUN
+};
+
+struct lb_ctl {
+    char name[44];
+    snd_ctl_elem_type_t type;
+    unsigned count;
+    long min, max;
+    unsigned items;
+    char item[LB_MAX_ITEMS][64];
+    long value[2];
+};
+
+struct lb_file {
+    int kind;
+    /* pcm */
+    int state;
+    unsigned channels;
+    unsigned rate;
+    unsigned period_size;
+    unsigned periods;
+    unsigned buffer_size;
+    unsigned long start_threshold;
+    unsigned long stop_threshold;
+    unsigned long avail_min;
+    uint64_t appl_ptr;
+    uint64_t hw_base;
+    int64_t t_start;
+    int16_t *ring;
+    uint64_t tone_pos;
+    /* control */
+    int subscribed;
+    unsigned nevents;
+    struct snd_ctl_event events[LB_MAX_EVENTS];
+};
+
+static pthread_mutex_t lb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t lb_once = PTHREAD_ONCE_INIT;
+static struct lb_file *lb_files[LB_MAX_FD];
+static struct lb_ctl lb_ctls[LB_MAX_CTLS];
+static unsigned lb_nctls;
+static unsigned lb_ctl_us;
+static unsigned lb_params_us;
+static struct alsa_loopback_stats lb_stats;
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_close)(int);
+static ssize_t (*real_read)(int, void *, size_t);
+static int (*real_ioctl)(int, unsigned long, ...);
+
+/* control table */
+
+static const char *lb_default_controls[] = {
+    "ENUM|Playback Path|OFF|RCV|SPK|HP|SPK_HP|BT",
+    "ENUM|Voice Call Path|OFF|RCV|SPK|3HP|4HP|BT",
+    "ENUM|FM Radio Path|OFF|SPK|HP",
+    "ENUM|Memo Path|off|MAIN|HP|BT",
+    "ENUM|Calling Memo Path|off|MAIN|HP|BT",
+    "ENUM|MAX9877 Output Mode|INA -> SPK|INB -> HP|INA -> SPK and HP",
+    "ENUM|Amp Enable|OFF|ON",
+    "ENUM|Codec Operation Mode|Option 2 (voice/audio)|Option 1 (audio)",
+    "INT|DAC Voice Digital Downlink Volume|1|0|63",
+    "INT|DAC1 Digital Fine Playback Volume|2|0|63",
+    "INT|DAC1 Digital Coarse Playback Volume|2|0|2",
+    "INT|DAC1 Analog Playback Volume|2|0|18",
+    "INT|Headset Playback Volume|2|0|3",
+    "INT|Earpiece Playback Volume|1|0|3",
+    "INT|PreDriv Playback Volume|2|0|3",
+    "INT|TX1 Digital Capture Volume|2|0|31",
+    "INT|Analog Capture Volume|2|0|5",
+    "BOOL|Analog Left Main Mic Capture Switch|1",
+    "BOOL|Analog Right Sub Mic Capture Switch|1",
+    "BOOL|HandsfreeL Switch|1",
+    "BOOL|HandsfreeR Switch|1",
+    NULL
+};
+
+static void lb_add_control(char *line)
+{
+    struct lb_ctl *c;
+    char *save = NULL;
+    char *kind, *tok;
+
+    kind = strtok_r(line, "|\n", &save);
+    if (!kind || kind[0] == '#' || lb_nctls >= LB_MAX_CTLS)
+        return;
+
+    c = &lb_ctls[lb_nctls];
+    memset(c, 0, sizeof(*c));
+    tok = strtok_r(NULL, "|\n", &save);
+    if (!tok)
+        return;
+    strncpy(c->name, tok, sizeof(c->name) - 1);
+
+    if (!strcmp(kind, "ENUM")) {
+        c->type = SNDRV_CTL_ELEM_TYPE_ENUMERATED;
+        c->count = 1;
+        while ((tok = strtok_r(NULL, "|\n", &save)) && c->items < LB_MAX_ITEMS)
+            strncpy(c->item[c->items++], tok, 63);
+        if (!c->items)
+            return;
+    } else if (!strcmp(kind, "INT")) {
+        c->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+        tok = strtok_r(NULL, "|\n", &save);
+        c->count = tok ? atoi(tok) : 1;
+        tok = strtok_r(NULL, "|\n", &save);
+        c->min = tok ? atol(tok) : 0;
+        tok = strtok_r(NULL, "|\n", &save);
+        c->max = tok ? atol(tok) : 100;
+    } else if (!strcmp(kind, "BOOL")) {
+        c->type = SNDRV_CTL_ELEM_TYPE_BOOLEAN;
+        tok = strtok_r(NULL, "|\n", &save);
+        c->count = tok ? atoi(tok) : 1;
+        c->max = 1;
+    } else {
+        return;
+    }
+    if (c->count < 1 || c->count > 2)
+        c->count = 1;
+    lb_nctls++;
+}
+
+static void lb_init(void)
+{
+    const char *path = getenv("ALSA_LOOPBACK_CONTROLS");
+    const char *env;
+    char line[512];
+    unsigned n;
+
+    real_open = dlsym(RTLD_NEXT, "open");
+    real_close = dlsym(RTLD_NEXT, "close");
+    real_read = dlsym(RTLD_NEXT, "read");
+    real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+
+    if ((env = getenv("ALSA_LOOPBACK_CTL_US")))
+        lb_ctl_us = atoi(env);
+    if ((env = getenv("ALSA_LOOPBACK_PARAMS_US")))
+        lb_params_us = atoi(env);
+
+    if (path) {
+        FILE *f = fopen(path, "r");
+        if (f) {
+            while (fgets(line, sizeof(line), f))
+                lb_add_control(line);
+            fclose(f);
+        } else {
+            fprintf(stderr, "alsa_loopback: cannot read %s: %s\n",
+                    path, strerror(errno));
+        }
+    }
+    if (!lb_nctls) {
+        for (n = 0; lb_default_controls[n]; n++) {
+            strncpy(line, lb_default_controls[n], sizeof(line) - 1);
+            line[sizeof(line) - 1] = 0;
+            lb_add_control(line);
+        }
+    }
+}
+
+/* clock */
+
+static int64_t lb_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* driver time an ioctl costs, slept off by the caller once lb_lock is released */
+static unsigned lb_ioctl_us(struct lb_file *f, unsigned long req)
+{
+    if (f->kind == LB_CTL)
+        return lb_ctl_us;
+    if (req == SNDRV_PCM_IOCTL_HW_PARAMS)
+        return lb_params_us;
+    return 0;
+}
+
+static void lb_sleep_until(int64_t deadline)
+{
+    struct timespec ts;
+
+    ts.tv_sec = deadline / 1000000000LL;
+    ts.tv_nsec = deadline % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static void lb_sleep_frames(struct lb_file *f, uint64_t frames)
+{
+    uint64_t ns = frames * 1000000000ULL / f->rate;
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    pthread_mutex_unlock(&lb_lock);
+    nanosleep(&ts, NULL);
+    pthread_mutex_lock(&lb_lock);
+}
+
+/* position of the simulated DMA, checks for xruns */
+static uint64_t lb_hw_ptr(struct lb_file *f)
+{
+    uint64_t hw;
+
+    if (f->state != LB_RUNNING)
+        return f->hw_base;
+
+    hw = f->hw_base + (uint64_t)(lb_now() - f->t_start) * f->rate / 1000000000ULL;
+    if (f->kind == LB_PCM_OUT) {
+        int64_t avail = (int64_t)f->buffer_size + (int64_t)(hw - f->appl_ptr);
+        if (avail >= (int64_t)f->stop_threshold) {
+            /* DMA caught up with the application: underrun */
+            f->state = LB_XRUN;
+            f->hw_base = f->appl_ptr;
+            lb_stats.playback_xruns++;
+            return f->hw_base;
+        }
+    } else if (hw - f->appl_ptr > f->buffer_size) {
+        f->state = LB_XRUN;
+        f->hw_base = f->appl_ptr + f->buffer_size;
+        lb_stats.capture_xruns++;
+        return f->hw_base;
+    }
+    return hw;
+}
+
+static void lb_start(struct lb_file *f)
+{
+    f->state = LB_RUNNING;
+    f->t_start = lb_now();
+}
+
+/* pcm ioctls */
+
+static struct snd_interval *lb_interval(struct snd_pcm_hw_params *p, int n)
+{
+    return &p->intervals[n - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+}
+
+static unsigned lb_pick(struct snd_pcm_hw_params *p, int n, unsigned def)
+{
+    struct snd_interval *i = lb_interval(p, n);
+    unsigned v = i->min ? i->min : def;
+    i->min = i->max = v;
+    i->integer = 1;
+    return v;
+}
+
+static int lb_hw_params(struct lb_file *f, struct snd_pcm_hw_params *p)
+{
+    f->channels = lb_pick(p, SNDRV_PCM_HW_PARAM_CHANNELS, 2);
+    f->rate = lb_pick(p, SNDRV_PCM_HW_PARAM_RATE, 44100);
+    f->period_size = lb_pick(p, SNDRV_PCM_HW_PARAM_PERIOD_SIZE, 1024);
+    f->periods = lb_pick(p, SNDRV_PCM_HW_PARAM_PERIODS, 4);
+    if (f->channels < 1 || f->channels > 2 || !f->rate)
+        return -EINVAL;
+    f->buffer_size = f->period_size * f->periods;
+    lb_interval(p, SNDRV_PCM_HW_PARAM_BUFFER_SIZE)->min = f->buffer_size;
+    lb_interval(p, SNDRV_PCM_HW_PARAM_BUFFER_SIZE)->max = f->buffer_size;
+    p->rate_num = f->rate;
+    p->rate_den = 1;
+    p->fifo_size = 0;
+
+    free(f->ring);
+    f->ring = calloc(f->buffer_size, f->channels * sizeof(int16_t));
+    if (!f->ring)
+        return -ENOMEM;
+
+    f->start_threshold = 1;
+    f->stop_threshold = f->buffer_size;
+    f->avail_min = f->period_size;
+    f->state = LB_SETUP;
+    lb_stats.hw_params++;
+    return 0;
+}
+
+static int lb_write(struct lb_file *f, struct snd_xferi *x)
+{
+    const int16_t *src = x->buf;
+    unsigned long left = x->frames;
+    unsigned frame_sz = f->channels;
+
+    if (f->kind != LB_PCM_OUT)
+        return -EINVAL;
+
+    while (left) {
+        uint64_t hw, queued, space, n, pos;
+
+        if (f->state == LB_XRUN)
+            return -EPIPE;
+        if (f->state != LB_PREPARED && f->state != LB_RUNNING)
+            return -EBADFD;
+
+        hw = lb_hw_ptr(f);
+        if (f->state == LB_XRUN)
+            return -EPIPE;
+
+        queued = f->appl_ptr - hw;
+        space = f->buffer_size - queued;
+        if (!space) {
+            uint64_t want = left < f->avail_min ? left : f->avail_min;
+            lb_sleep_frames(f, want);
+            continue;
+        }
+
+        n = left < space ? left : space;
+        pos = f->appl_ptr % f->buffer_size;
+        if (pos + n > f->buffer_size)
+            n = f->buffer_size - pos;
+        memcpy(f->ring + pos * frame_sz, src, n * frame_sz * sizeof(int16_t));
+        src += n * frame_sz;
+        left -= n;
+        f->appl_ptr += n;
+        lb_stats.frames_written += n;
+
+        if (f->state == LB_PREPARED &&
+            f->appl_ptr - f->hw_base >= f->start_threshold)
+            lb_start(f);
+    }
+    x->result = x->frames;
+    return 0;
+}
+
+static int lb_read(struct lb_file *f, struct snd_xferi *x)
+{
+    int16_t *dst = x->buf;
+    unsigned long left = x->frames;
+
+    if (f->kind != LB_PCM_IN)
+        return -EINVAL;
+
+    while (left) {
+        uint64_t hw, avail, n, i;
+        unsigned c;
+
+        if (f->state == LB_XRUN)
+            return -EPIPE;
+        if (f->state == LB_PREPARED)
+            lb_start(f);
+        if (f->state != LB_RUNNING)
+            return -EBADFD;
+
+        hw = lb_hw_ptr(f);
+        if (f->state == LB_XRUN)
+            return -EPIPE;
+
+        avail = hw - f->appl_ptr;
+        if (!avail) {
+            uint64_t want = left < f->avail_min ? left : f->avail_min;
+            lb_sleep_frames(f, want);
+            continue;
+        }
+
+        n = left < avail ? left : avail;
+        for (i = 0; i < n; i++, f->tone_pos++) {
+            int16_t s = (int16_t)(16384 * sin(2 * M_PI * LB_TONE_HZ *
+                                              (double)f->tone_pos / f->rate));
+            for (c = 0; c < f->channels; c++)
+                *dst++ = s;
+        }
+        left -= n;
+        f->appl_ptr += n;
+        lb_stats.frames_read += n;
+    }
+    x->result = x->frames;
+    return 0;
+}
+
+static int lb_pcm_ioctl(struct lb_file *f, unsigned long req, void *arg)
+{
+    switch (req) {
+    case SNDRV_PCM_IOCTL_PVERSION:
+        *(int *)arg = SNDRV_PCM_VERSION;
+        return 0;
+    case SNDRV_PCM_IOCTL_INFO: {
+        struct snd_pcm_info *info = arg;
+        memset(info, 0, sizeof(*info));
+        info->stream = (f->kind == LB_PCM_IN) ? SNDRV_PCM_STREAM_CAPTURE :
+                                                SNDRV_PCM_STREAM_PLAYBACK;
+        strcpy((char *)info->id, "TWL4030");
+        strcpy((char *)info->name, "loopback stand-in");
+        info->subdevices_count = 1;
+        info->subdevices_avail = 1;
+        return 0;
+    }
+    case SNDRV_PCM_IOCTL_HW_REFINE:
+        return 0;
+    case SNDRV_PCM_IOCTL_HW_PARAMS:
+        return lb_hw_params(f, arg);
+    case SNDRV_PCM_IOCTL_HW_FREE:
+        f->state = LB_OPEN;
+        return 0;
+    case SNDRV_PCM_IOCTL_SW_PARAMS: {
+        struct snd_pcm_sw_params *sp = arg;
+        if (f->state == LB_OPEN)
+            return -EBADFD;
+        f->start_threshold = sp->start_threshold ? sp->start_threshold : 1;
+        f->stop_threshold = sp->stop_threshold ? sp->stop_threshold : f->buffer_size;
+        f->avail_min = sp->avail_min ? sp->avail_min : 1;
+        sp->boundary = f->buffer_size;
+        while (sp->boundary * 2 <= (snd_pcm_uframes_t)(LONG_MAX - f->buffer_size))
+            sp->boundary *= 2;
+        return 0;
+    }
+    case SNDRV_PCM_IOCTL_PREPARE:
+    case SNDRV_PCM_IOCTL_RESET:
+        if (f->state == LB_OPEN)
+            return -EBADFD;
+        f->state = LB_PREPARED;
+        f->hw_base = f->appl_ptr;
+        return 0;
+    case SNDRV_PCM_IOCTL_START:
+        if (f->state != LB_PREPARED)
+            return -EBADFD;
+        lb_start(f);
+        return 0;
+    case SNDRV_PCM_IOCTL_DROP:
+    case SNDRV_PCM_IOCTL_DRAIN:
+        if (f->state != LB_OPEN)
+            f->state = LB_SETUP;
+        return 0;
+    case SNDRV_PCM_IOCTL_DELAY:
+        *(snd_pcm_sframes_t *)arg = (f->kind == LB_PCM_OUT) ?
+                (snd_pcm_sframes_t)(f->appl_ptr - lb_hw_ptr(f)) :
+                (snd_pcm_sframes_t)(lb_hw_ptr(f) - f->appl_ptr);
+        return 0;
+    case SNDRV_PCM_IOCTL_HWSYNC:
+        lb_hw_ptr(f);
+        return 0;
+    case SNDRV_PCM_IOCTL_WRITEI_FRAMES:
+        return lb_write(f, arg);
+    case SNDRV_PCM_IOCTL_READI_FRAMES:
+        return lb_read(f, arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+/* control ioctls */
+
+static struct lb_ctl *lb_ctl_by_id(struct snd_ctl_elem_id *id)
+{
+    unsigned n;
+
+    if (id->numid) {
+        if (id->numid > lb_nctls)
+            return NULL;
+        return &lb_ctls[id->numid - 1];
+    }
+    for (n = 0; n < lb_nctls; n++) {
+        if (!strcmp((char *)id->name, lb_ctls[n].name) && id->index == 0)
+            return &lb_ctls[n];
+    }
+    return NULL;
+}
+
+static void lb_fill_id(struct snd_ctl_elem_id *id, unsigned n)
+{
+    memset(id, 0, sizeof(*id));
+    id->numid = n + 1;
+    id->iface = SNDRV_CTL_ELEM_IFACE_MIXER;
+    strncpy((char *)id->name, lb_ctls[n].name, sizeof(id->name) - 1);
+}
+
+static void lb_queue_event(unsigned numid, unsigned mask)
+{
+    unsigned fd, n;
+
+    for (fd = 0; fd < LB_MAX_FD; fd++) {
+        struct lb_file *f = lb_files[fd];
+        if (!f || f->kind != LB_CTL || !f->subscribed)
+            continue;
+        /* like the kernel, merge with a pending event for the same element */
+        for (n = 0; n < f->nevents; n++) {
+            if (f->events[n].data.elem.id.numid == numid) {
+                f->events[n].data.elem.mask |= mask;
+                break;
+            }
+        }
+        if (n == f->nevents && f->nevents < LB_MAX_EVENTS) {
+            struct snd_ctl_event *ev = &f->events[f->nevents++];
+            memset(ev, 0, sizeof(*ev));
+            ev->type = SNDRV_CTL_EVENT_ELEM;
+            ev->data.elem.mask = mask;
+            lb_fill_id(&ev->data.elem.id, numid - 1);
+        }
+    }
+}
+
+static int lb_ctl_ioctl(struct lb_file *f, unsigned long req, void *arg)
+{
+    struct lb_ctl *c;
+    unsigned n;
+
+    lb_stats.ctl_ioctls++;
+
+    switch (req) {
+    case SNDRV_CTL_IOCTL_PVERSION:
+        *(int *)arg = SNDRV_CTL_VERSION;
+        return 0;
+    case SNDRV_CTL_IOCTL_CARD_INFO: {
+        struct snd_ctl_card_info *ci = arg;
+        memset(ci, 0, sizeof(*ci));
+        strcpy((char *)ci->id, "TWL4030");
+        strcpy((char *)ci->driver, "TWL4030");
+        strcpy((char *)ci->name, "loopback stand-in");
+        return 0;
+    }
+    case SNDRV_CTL_IOCTL_SUBSCRIBE_EVENTS:
+        f->subscribed = *(int *)arg;
+        return 0;
+    case SNDRV_CTL_IOCTL_ELEM_LIST: {
+        struct snd_ctl_elem_list *l = arg;
+        l->count = lb_nctls;
+        l->used = 0;
+        if (l->pids) {
+            for (n = l->offset; n < lb_nctls && l->used < l->space; n++)
+                lb_fill_id(&l->pids[l->used++], n);
+        }
+        return 0;
+    }
+    case SNDRV_CTL_IOCTL_ELEM_INFO: {
+        struct snd_ctl_elem_info *ei = arg;
+        unsigned item = ei->value.enumerated.item;
+        if (!(c = lb_ctl_by_id(&ei->id)))
+            return -ENOENT;
+        n = c - lb_ctls;
+        memset(ei, 0, sizeof(*ei));
+        lb_fill_id(&ei->id, n);
+        ei->type = c->type;
+        ei->access = SNDRV_CTL_ELEM_ACCESS_READWRITE;
+        ei->count = c->count;
+        if (c->type == SNDRV_CTL_ELEM_TYPE_ENUMERATED) {
+            ei->value.enumerated.items = c->items;
+            if (item >= c->items)
+                item = c->items - 1;
+            ei->value.enumerated.item = item;
+            strncpy(ei->value.enumerated.name, c->item[item], 63);
+        } else {
+            ei->value.integer.min = c->min;
+            ei->value.integer.max = c->max;
+        }
+        return 0;
+    }
+    case SNDRV_CTL_IOCTL_ELEM_READ: {
+        struct snd_ctl_elem_value *ev = arg;
+        if (!(c = lb_ctl_by_id(&ev->id)))
+            return -ENOENT;
+        for (n = 0; n < c->count; n++) {
+            if (c->type == SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+                ev->value.enumerated.item[n] = c->value[n];
+            else
+                ev->value.integer.value[n] = c->value[n];
+        }
+        return 0;
+    }
+    case SNDRV_CTL_IOCTL_ELEM_WRITE: {
+        struct snd_ctl_elem_value *ev = arg;
+        int changed = 0;
+        if (!(c = lb_ctl_by_id(&ev->id)))
+            return -ENOENT;
+        for (n = 0; n < c->count; n++) {
+            long v;
+            if (c->type == SNDRV_CTL_ELEM_TYPE_ENUMERATED) {
+                v = ev->value.enumerated.item[n];
+                if (v < 0 || v >= (long)c->items)
+                    return -EINVAL;
+            } else {
+                v = ev->value.integer.value[n];
+                if (v < c->min || v > c->max)
+                    return -EINVAL;
+            }
+            changed |= (c->value[n] != v);
+            c->value[n] = v;
+        }
+        lb_stats.ctl_writes++;
+        if (changed)
+            lb_queue_event(c - lb_ctls + 1, SNDRV_CTL_EVENT_MASK_VALUE);
+        return 0;
+    }
+    default:
+        return -ENOTTY;
+    }
+}
+
+/* libc overrides */
+
+static int lb_kind(const char *path)
+{
+    if (!strcmp(path, "/dev/snd/pcmC0D0p"))
+        return LB_PCM_OUT;
+    if (!strcmp(path, "/dev/snd/pcmC0D0c"))
+        return LB_PCM_IN;
+    if (!strcmp(path, "/dev/snd/controlC0"))
+        return LB_CTL;
+    return -1;
+}
+
+static int lb_open(const char *path, int flags, mode_t mode)
+{
+    struct lb_file *f;
+    int kind, fd;
+
+    pthread_once(&lb_once, lb_init);
+
+    kind = lb_kind(path);
+    if (kind < 0)
+        return real_open(path, flags, mode);
+
+    /* back each device with a real descriptor so fd numbers stay unique */
+    fd = real_open("/dev/null", O_RDWR);
+    if (fd < 0)
+        return fd;
+    if (fd >= LB_MAX_FD) {
+        real_close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+
+    f = calloc(1, sizeof(*f));
+    if (!f) {
+        real_close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    f->kind = kind;
+    f->state = LB_OPEN;
+
+    pthread_mutex_lock(&lb_lock);
+    lb_files[fd] = f;
+    if (kind != LB_CTL)
+        lb_stats.pcm_opens++;
+    pthread_mutex_unlock(&lb_lock);
+    return fd;
+}
+
+int open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    return lb_open(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    return lb_open(path, flags | O_LARGEFILE, mode);
+}
+
+int close(int fd)
+{
+    pthread_once(&lb_once, lb_init);
+
+    if (fd >= 0 && fd < LB_MAX_FD) {
+        pthread_mutex_lock(&lb_lock);
+        if (lb_files[fd]) {
+            free(lb_files[fd]->ring);
+            free(lb_files[fd]);
+            lb_files[fd] = NULL;
+        }
+        pthread_mutex_unlock(&lb_lock);
+    }
+    return real_close(fd);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+    struct lb_file *f;
+    ssize_t ret = 0;
+
+    pthread_once(&lb_once, lb_init);
+
+    if (fd < 0 || fd >= LB_MAX_FD || !lb_files[fd])
+        return real_read(fd, buf, count);
+
+    pthread_mutex_lock(&lb_lock);
+    f = lb_files[fd];
+    if (f->kind != LB_CTL) {
+        errno = EINVAL;
+        ret = -1;
+    } else if (!f->nevents) {
+        errno = EAGAIN;
+        ret = -1;
+    } else {
+        while (f->nevents && count - ret >= sizeof(struct snd_ctl_event)) {
+            memcpy((char *)buf + ret, &f->events[0], sizeof(struct snd_ctl_event));
+            memmove(&f->events[0], &f->events[1],
+                    --f->nevents * sizeof(struct snd_ctl_event));
+            ret += sizeof(struct snd_ctl_event);
+        }
+    }
+    pthread_mutex_unlock(&lb_lock);
+    return ret;
+}
+
+int ioctl(int fd, unsigned long req, ...)
+{
+    struct lb_file *f;
+    void *arg;
+    va_list ap;
+    unsigned us;
+    int64_t deadline;
+    int ret;
+
+    pthread_once(&lb_once, lb_init);
+
+    va_start(ap, req);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    if (fd < 0 || fd >= LB_MAX_FD || !lb_files[fd])
+        return real_ioctl(fd, req, arg);
+
+    pthread_mutex_lock(&lb_lock);
+    f = lb_files[fd];
+    us = lb_ioctl_us(f, req);
+    deadline = lb_now() + us * 1000LL;
+    if (f->kind == LB_CTL)
+        ret = lb_ctl_ioctl(f, req, arg);
+    else
+        ret = lb_pcm_ioctl(f, req, arg);
+    pthread_mutex_unlock(&lb_lock);
+
+    /* a slow driver holds up its caller, not every other stream */
+    if (us)
+        lb_sleep_until(deadline);
+
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    return ret;
+}
+
+/* test API */
+
+void alsa_loopback_get_stats(struct alsa_loopback_stats *stats)
+{
+    pthread_mutex_lock(&lb_lock);
+    *stats = lb_stats;
+    pthread_mutex_unlock(&lb_lock);
+}
+
+void alsa_loopback_reset_stats(void)
+{
+    pthread_mutex_lock(&lb_lock);
+    memset(&lb_stats, 0, sizeof(lb_stats));
+    pthread_mutex_unlock(&lb_lock);
+}
+
+long alsa_loopback_playback_delay(void)
+{
+    long delay = -1;
+    unsigned fd;
+
+    pthread_mutex_lock(&lb_lock);
+    for (fd = 0; fd < LB_MAX_FD; fd++) {
+        struct lb_file *f = lb_files[fd];
+        if (f && f->kind == LB_PCM_OUT && f->state >= LB_PREPARED) {
+            delay = (long)(f->appl_ptr - lb_hw_ptr(f));
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lb_lock);
+    return delay;
+}
+
+void alsa_loopback_ctl_changed(void)
+{
+    pthread_once(&lb_once, lb_init);
+
+    pthread_mutex_lock(&lb_lock);
+    if (lb_nctls)
+        lb_queue_event(1, SNDRV_CTL_EVENT_MASK_INFO);
+    pthread_mutex_unlock(&lb_lock);
+}
@@ -0,0 +1,62 @@
+/*
+** Copyright 2010, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef _ALSA_LOOPBACK_H_
+#define _ALSA_LOOPBACK_H_
+
+/* Host-side stand-in for /dev/snd/pcmC0D0p, pcmC0D0c and controlC0.
+ *
+ * alsa_loopback.c overrides open/close/read/ioctl: either LD_PRELOAD the
+ * host libalsa_loopback.so under an unmodified alsa_pcm.c/alsa_mixer.c
+ * client, or link it straight into a host binary.  The PCM devices are
+ * backed by a ring whose DMA pointer advances with CLOCK_MONOTONIC at the
+ * configured rate; capture returns a 1 kHz tone.
+ *
+ * Environment:
+ *   ALSA_LOOPBACK_CONTROLS     control table file replacing the built-in
+ *                              TWL4030 table, one control per line:
+ *                                ENUM|<name>|<item>|<item>...
+ *                                INT|<name>|<count>|<min>|<max>
+ *                                BOOL|<name>|<count>
+ *   ALSA_LOOPBACK_CTL_US       simulated driver cost of each control ioctl
+ *   ALSA_LOOPBACK_PARAMS_US    simulated cost of HW_PARAMS (codec power up)
+ */
+
+struct alsa_loopback_stats {
+    unsigned pcm_opens;
+    unsigned hw_params;
+    unsigned playback_xruns;
+    unsigned capture_xruns;
+    unsigned ctl_ioctls;
+    unsigned ctl_writes;
+    unsigned long long frames_written;
+    unsigned long long frames_read;
+};
+
+void alsa_loopback_get_stats(struct alsa_loopback_stats *stats);
+void alsa_loopback_reset_stats(void);
+
+/* Frames queued ahead of the simulated DMA on the open playback stream,
+ * or -1 if there is none.
+ */
+long alsa_loopback_playback_delay(void);
+
+/* Pretend the driver reshaped its controls: queue an INFO event on every
+ * subscribed control fd, as a codec driver would after a DAPM widget change.
+ */
+void alsa_loopback_ctl_changed(void);
+
+#endif
@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <ctype.h>
 
+#include <sys/ioctl.h>
 #include <linux/ioctl.h>
 #define __force
 #define __bitwise
@@ -65,111 +66,210 @@ struct mixer_ctl {
     char **ename;
 };
 
+/* The control table is captured in three allocations: the element infos,
+ * the ctl handles and one block holding every enum item name (pointer
+ * table followed by the packed strings).  It is only rebuilt when the
+ * driver reports that controls were added, removed or changed shape.
+ */
 struct mixer {
     int fd;
+    int subscribed;
+    char driver[17];    /* snd_ctl_card_info.driver, terminated */
     struct snd_ctl_elem_info *info;
     struct mixer_ctl *ctl;
+    char **enames;
     unsigned count;
 };
 
-void mixer_close(struct mixer *mixer)
+static void mixer_free_controls(struct mixer *mixer)
 {
-    unsigned n,m;
-
-    if (mixer->fd >= 0)
-        close(mixer->fd);
-
-    if (mixer->ctl) {
-        for (n = 0; n < mixer->count; n++) {
-            if (mixer->ctl[n].ename) {
-                unsigned max = mixer->ctl[n].info->value.enumerated.items;
-                for (m = 0; m < max; m++)
-                    free(mixer->ctl[n].ename[m]);
-                free(mixer->ctl[n].ename);
-            }
-        }
-        free(mixer->ctl);
-    }
-
-    if (mixer->info)
-        free(mixer->info);
-
-    free(mixer);
+    free(mixer->ctl);
+    free(mixer->info);
+    free(mixer->enames);
+    mixer->ctl = NULL;
+    mixer->info = NULL;
+    mixer->enames = NULL;
+    mixer->count = 0;
 }
 
-struct mixer *mixer_open(void)
+static int mixer_enumerate(struct mixer *mixer)
 {
     struct snd_ctl_elem_list elist;
     struct snd_ctl_elem_info tmp;
     struct snd_ctl_elem_id *eid = NULL;
-    struct mixer *mixer = NULL;
+    char *pool = NULL;
+    size_t pool_sz = 0, pool_len = 0;
+    unsigned items = 0, item = 0;
     unsigned n, m;
-    int fd;
-
-    fd = open("/dev/snd/controlC0", O_RDWR);
-    if (fd < 0)
-        return 0;
 
     memset(&elist, 0, sizeof(elist));
-    if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_LIST, &elist) < 0)
-        goto fail;
-
-    mixer = calloc(1, sizeof(*mixer));
-    if (!mixer)
-        goto fail;
+    if (ioctl(mixer->fd, SNDRV_CTL_IOCTL_ELEM_LIST, &elist) < 0)
+        return -1;
 
     mixer->ctl = calloc(elist.count, sizeof(struct mixer_ctl));
     mixer->info = calloc(elist.count, sizeof(struct snd_ctl_elem_info));
-    if (!mixer->ctl || !mixer->info)
-        goto fail;
-
     eid = calloc(elist.count, sizeof(struct snd_ctl_elem_id));
-    if (!eid)
+    if (!mixer->ctl || !mixer->info || !eid)
         goto fail;
 
     mixer->count = elist.count;
-    mixer->fd = fd;
     elist.space = mixer->count;
     elist.pids = eid;
-    if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_LIST, &elist) < 0)
+    if (ioctl(mixer->fd, SNDRV_CTL_IOCTL_ELEM_LIST, &elist) < 0)
         goto fail;
 
     for (n = 0; n < mixer->count; n++) {
         struct snd_ctl_elem_info *ei = mixer->info + n;
         ei->id.numid = eid[n].numid;
-        if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_INFO, ei) < 0)
+        if (ioctl(mixer->fd, SNDRV_CTL_IOCTL_ELEM_INFO, ei) < 0)
             goto fail;
         mixer->ctl[n].info = ei;
         mixer->ctl[n].mixer = mixer;
-        if (ei->type == SNDRV_CTL_ELEM_TYPE_ENUMERATED) {
-            char **enames = calloc(ei->value.enumerated.items, sizeof(char*));
-            if (!enames)
-                goto fail;
-            mixer->ctl[n].ename = enames;
-            for (m = 0; m < ei->value.enumerated.items; m++) {
+        if (ei->type == SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+            items += ei->value.enumerated.items;
+    }
+
+    /* enum item names are first packed into a growing pool and stored as
+     * offsets, then moved behind the pointer table in a single block */
+    {
+        size_t *offs = calloc(items ? items : 1, sizeof(size_t));
+        if (!offs)
+            goto fail;
+        for (n = 0; n < mixer->count; n++) {
+            struct snd_ctl_elem_info *ei = mixer->info + n;
+            if (ei->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+                continue;
+            for (m = 0; m < ei->value.enumerated.items; m++, item++) {
+                size_t len;
                 memset(&tmp, 0, sizeof(tmp));
                 tmp.id.numid = ei->id.numid;
                 tmp.value.enumerated.item = m;
-                if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_INFO, &tmp) < 0)
-                    goto fail;
-                enames[m] = strdup(tmp.value.enumerated.name);
-                if (!enames[m])
+                if (ioctl(mixer->fd, SNDRV_CTL_IOCTL_ELEM_INFO, &tmp) < 0) {
+                    free(offs);
                     goto fail;
+                }
+                len = strnlen(tmp.value.enumerated.name,
+                              sizeof(tmp.value.enumerated.name)) + 1;
+                if (pool_len + len > pool_sz) {
+                    char *p;
+                    pool_sz = (pool_sz + len) * 2;
+                    p = realloc(pool, pool_sz);
+                    if (!p) {
+                        free(offs);
+                        goto fail;
+                    }
+                    pool = p;
+                }
+                memcpy(pool + pool_len, tmp.value.enumerated.name, len - 1);
+                pool[pool_len + len - 1] = 0;
+                offs[item] = pool_len;
+                pool_len += len;
             }
         }
+
+        mixer->enames = malloc(items * sizeof(char *) + pool_len + 1);
+        if (!mixer->enames) {
+            free(offs);
+            goto fail;
+        }
+        {
+            char *names = (char *)(mixer->enames + items);
+            if (pool_len)
+                memcpy(names, pool, pool_len);
+            for (item = 0; item < items; item++)
+                mixer->enames[item] = names + offs[item];
+        }
+        free(offs);
+    }
+
+    item = 0;
+    for (n = 0; n < mixer->count; n++) {
+        struct snd_ctl_elem_info *ei = mixer->info + n;
+        if (ei->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+            continue;
+        mixer->ctl[n].ename = mixer->enames + item;
+        item += ei->value.enumerated.items;
     }
 
+    free(pool);
     free(eid);
-    return mixer;
+    return 0;
 
 fail:
-    if (eid)
-        free(eid);
-    if (mixer)
-        mixer_close(mixer);
-    else if (fd >= 0)
+    free(pool);
+    free(eid);
+    mixer_free_controls(mixer);
+    return -1;
+}
+
+void mixer_close(struct mixer *mixer)
+{
+    if (mixer->fd >= 0)
+        close(mixer->fd);
+
+    mixer_free_controls(mixer);
+    free(mixer);
+}
+
+struct mixer *mixer_open(void)
+{
+    struct snd_ctl_card_info info;
+    struct mixer *mixer;
+    int subscribe = 1;
+    int fd;
+
+    fd = open("/dev/snd/controlC0", O_RDWR | O_NONBLOCK);
+    if (fd < 0)
+        return 0;
+
+    mixer = calloc(1, sizeof(*mixer));
+    if (!mixer) {
         close(fd);
-    return 0;
+        return 0;
+    }
+    mixer->fd = fd;
+
+    if (ioctl(fd, SNDRV_CTL_IOCTL_CARD_INFO, &info) == 0)
+        strncpy(mixer->driver, (char *)info.driver, sizeof(mixer->driver) - 1);
+
+    /* subscribe before enumerating so that no change can slip in between */
+    if (ioctl(fd, SNDRV_CTL_IOCTL_SUBSCRIBE_EVENTS, &subscribe) == 0)
+        mixer->subscribed = 1;
+
+    if (mixer_enumerate(mixer) < 0) {
+        mixer_close(mixer);
+        return 0;
+    }
+    return mixer;
+}
+
+const char *mixer_card_driver(struct mixer *mixer)
+{
+    return mixer->driver;
+}
+
+int mixer_refresh(struct mixer *mixer)
+{
+    struct snd_ctl_event ev;
+    int changed = 0;
+
+    if (!mixer->subscribed)
+        return 0;
+
+    /* value and TLV changes don't alter the table, only structural ones do */
+    while (read(mixer->fd, &ev, sizeof(ev)) == sizeof(ev)) {
+        if (ev.type == SNDRV_CTL_EVENT_ELEM &&
+            (ev.data.elem.mask & ~(SNDRV_CTL_EVENT_MASK_VALUE |
+                                   SNDRV_CTL_EVENT_MASK_TLV)))
+            changed = 1;
+    }
+    if (!changed)
+        return 0;
+
+    mixer_free_controls(mixer);
+    if (mixer_enumerate(mixer) < 0)
+        return -1;
+    return 1;
 }
 
 void mixer_dump(struct mixer *mixer)
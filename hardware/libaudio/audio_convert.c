@@ -0,0 +1,447 @@
+/*
+** Copyright 2010, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#define LOG_TAG "audio_convert"
+#include <cutils/log.h>
+
+#include <string.h>
+#include <pthread.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "audio_convert.h"
+
+/*
+ * 2.30 fixed point FIR filter coefficients for conversion 44100 -> 22050.
+ * (Works equivalently for 22010 -> 11025 or any other halving, of course.)
+ *
+ * Transition band from about 18 kHz, passband ripple < 0.1 dB,
+ * stopband ripple at about -55 dB, linear phase.
+ *
+ * Design and display in MATLAB or Octave using:
+ *
+ * filter = fir1(19, 0.5); filter = round(filter * 2**30); freqz(filter * 2**-30);
+ */
+static const int32_t filter_22khz_coeff[] = {
+    2089257, 2898328, -5820678, -10484531,
+    19038724, 30542725, -50469415, -81505260,
+    152544464, 478517512, 478517512, 152544464,
+    -81505260, -50469415, 30542725, 19038724,
+    -10484531, -5820678, 2898328, 2089257,
+};
+#define NUM_COEFF_22KHZ (sizeof(filter_22khz_coeff) / sizeof(filter_22khz_coeff[0]))
+#define OVERLAP_22KHZ (NUM_COEFF_22KHZ - 2)
+
+/*
+ * 2.30 fixed point FIR filter coefficients for conversion 22050 -> 16000,
+ * or 11025 -> 8000.
+ *
+ * Transition band from about 14 kHz, passband ripple < 0.1 dB,
+ * stopband ripple at about -50 dB, linear phase.
+ *
+ * Design and display in MATLAB or Octave using:
+ *
+ * filter = fir1(23, 16000 / 22050); filter = round(filter * 2**30); freqz(filter * 2**-30);
+ */
+static const int32_t filter_16khz_coeff[] = {
+    2057290, -2973608, 1880478, 4362037,
+    -14639744, 18523609, -1609189, -38502470,
+    78073125, -68353935, -59103896, 617555440,
+    617555440, -59103896, -68353935, 78073125,
+    -38502470, -1609189, 18523609, -14639744,
+    4362037, 1880478, -2973608, 2057290,
+};
+#define NUM_COEFF_16KHZ (sizeof(filter_16khz_coeff) / sizeof(filter_16khz_coeff[0]))
+#define OVERLAP_16KHZ (NUM_COEFF_16KHZ - 1)
+
+/* The convolution only ever uses the top 16 bits of each coefficient
+ * (2.14 fixed point), so the vector path works on these narrowed copies.
+ */
+static int16_t filter_22khz_coeff16[NUM_COEFF_22KHZ];
+static int16_t filter_16khz_coeff16[NUM_COEFF_16KHZ];
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static int use_vector;
+
+/* scalar reference kernels */
+
+/*
+ * Convolution of signals A and reverse(B). (In our case, the filter response
+ * is symmetric, so the reversing doesn't matter.)
+ * A is taken to be in 0.16 fixed-point, and B is taken to be in 2.30 fixed-point.
+ * The answer will be in 16.16 fixed-point, unclipped.
+ */
+static int32_t fir_convolve_ref(const int16_t *a, const int32_t *b, int num_samples)
+{
+    int32_t sum = 1 << 13;
+    int i;
+    for (i = 0; i < num_samples; ++i) {
+        sum += a[i] * (b[i] >> 16);
+    }
+    return sum >> 14;
+}
+
+static void deinterleave_ref(const int16_t *in, int16_t *left, int16_t *right,
+                             size_t frames)
+{
+    size_t i;
+    for (i = 0; i < frames; ++i) {
+        left[i] = in[i * 2];
+        right[i] = in[i * 2 + 1];
+    }
+}
+
+static void downmix_ref(const int16_t *in, int16_t *out, size_t frames)
+{
+    size_t i;
+    for (i = 0; i < frames; ++i) {
+        out[i] = (int16_t)(((int32_t)in[i * 2] + (int32_t)in[i * 2 + 1]) >> 1);
+    }
+}
+
+static void interleave_ref(const int16_t *left, const int16_t *right,
+                           int16_t *out, size_t frames)
+{
+    size_t i;
+    for (i = 0; i < frames; ++i) {
+        out[i * 2] = left[i];
+        out[i * 2 + 1] = right[i];
+    }
+}
+
+static void mix_ref(int16_t *dst, const int16_t *src, size_t samples)
+{
+    size_t i;
+    for (i = 0; i < samples; ++i) {
+        int32_t v = dst[i] + src[i];
+        dst[i] = v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+    }
+}
+
+/* vector kernels */
+
+#ifdef __ARM_NEON__
+static int32_t fir_convolve_vec(const int16_t *a, const int16_t *b, int num_samples)
+{
+    int32x4_t acc = vdupq_n_s32(0);
+    int32x2_t sum2;
+    int32_t sum;
+    int i = 0;
+
+    for (; i + 8 <= num_samples; i += 8) {
+        acc = vmlal_s16(acc, vld1_s16(a + i), vld1_s16(b + i));
+        acc = vmlal_s16(acc, vld1_s16(a + i + 4), vld1_s16(b + i + 4));
+    }
+    for (; i + 4 <= num_samples; i += 4) {
+        acc = vmlal_s16(acc, vld1_s16(a + i), vld1_s16(b + i));
+    }
+    sum2 = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    sum = vget_lane_s32(vpadd_s32(sum2, sum2), 0) + (1 << 13);
+    for (; i < num_samples; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum >> 14;
+}
+
+static void deinterleave_vec(const int16_t *in, int16_t *left, int16_t *right,
+                             size_t frames)
+{
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v = vld2q_s16(in + i * 2);
+        vst1q_s16(left + i, v.val[0]);
+        vst1q_s16(right + i, v.val[1]);
+    }
+    deinterleave_ref(in + i * 2, left + i, right + i, frames - i);
+}
+
+static void downmix_vec(const int16_t *in, int16_t *out, size_t frames)
+{
+    size_t i = 0;
+    /* vhadd computes (a + b) >> 1 without intermediate overflow; the store
+     * never overtakes the loads, so in-place use is safe */
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v = vld2q_s16(in + i * 2);
+        vst1q_s16(out + i, vhaddq_s16(v.val[0], v.val[1]));
+    }
+    downmix_ref(in + i * 2, out + i, frames - i);
+}
+
+static void interleave_vec(const int16_t *left, const int16_t *right,
+                           int16_t *out, size_t frames)
+{
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v;
+        v.val[0] = vld1q_s16(left + i);
+        v.val[1] = vld1q_s16(right + i);
+        vst2q_s16(out + i * 2, v);
+    }
+    interleave_ref(left + i, right + i, out + i * 2, frames - i);
+}
+
+static void mix_vec(int16_t *dst, const int16_t *src, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+    }
+    mix_ref(dst + i, src + i, samples - i);
+}
+#else
+/* no SIMD unit: portable 16-bit coefficient loop, still checked below */
+static int32_t fir_convolve_vec(const int16_t *a, const int16_t *b, int num_samples)
+{
+    int32_t sum = 1 << 13;
+    int i;
+    for (i = 0; i < num_samples; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum >> 14;
+}
+#define deinterleave_vec deinterleave_ref
+#define downmix_vec downmix_ref
+#define mix_vec mix_ref
+#define interleave_vec interleave_ref
+#endif
+
+/* Clip from 16.16 fixed-point to 0.16 fixed-point. */
+static inline int16_t clip(int32_t x)
+{
+    if (x < -32768) {
+        return -32768;
+    } else if (x > 32767) {
+        return 32767;
+    } else {
+        return x;
+    }
+}
+
+static inline int32_t fir_22khz(const int16_t *a)
+{
+    if (use_vector)
+        return fir_convolve_vec(a, filter_22khz_coeff16, NUM_COEFF_22KHZ);
+    return fir_convolve_ref(a, filter_22khz_coeff, NUM_COEFF_22KHZ);
+}
+
+static inline int32_t fir_16khz(const int16_t *a)
+{
+    if (use_vector)
+        return fir_convolve_vec(a, filter_16khz_coeff16, NUM_COEFF_16KHZ);
+    return fir_convolve_ref(a, filter_16khz_coeff, NUM_COEFF_16KHZ);
+}
+
+void audio_deinterleave(const int16_t *in, int16_t *left, int16_t *right,
+                        size_t frames)
+{
+    if (use_vector)
+        deinterleave_vec(in, left, right, frames);
+    else
+        deinterleave_ref(in, left, right, frames);
+}
+
+void audio_downmix(const int16_t *in, int16_t *out, size_t frames)
+{
+    if (use_vector)
+        downmix_vec(in, out, frames);
+    else
+        downmix_ref(in, out, frames);
+}
+
+void audio_interleave(const int16_t *left, const int16_t *right, int16_t *out,
+                      size_t frames)
+{
+    if (use_vector)
+        interleave_vec(left, right, out, frames);
+    else
+        interleave_ref(left, right, out, frames);
+}
+
+void audio_mix(int16_t *dst, const int16_t *src, size_t samples)
+{
+    if (use_vector)
+        mix_vec(dst, src, samples);
+    else
+        mix_ref(dst, src, samples);
+}
+
+/*
+ * Convert a chunk from 44 kHz to 22 kHz. Will update num_samples_in and num_samples_out
+ * accordingly, since it may leave input samples in the buffer due to overlap.
+ *
+ * Input and output are taken to be in 0.16 fixed-point.
+ */
+void resample_2_1(int16_t *input, int16_t *output, int *num_samples_in, int *num_samples_out)
+{
+    int odd_smp, num_samples, i;
+
+    if (*num_samples_in < (int)NUM_COEFF_22KHZ) {
+        *num_samples_out = 0;
+        return;
+    }
+
+    odd_smp = *num_samples_in & 0x1;
+    num_samples = *num_samples_in - odd_smp - OVERLAP_22KHZ;
+
+    for (i = 0; i < num_samples; i += 2) {
+        output[i / 2] = clip(fir_22khz(input + i));
+    }
+
+    memmove(input, input + num_samples, (OVERLAP_22KHZ + odd_smp) * sizeof(*input));
+    *num_samples_out = num_samples / 2;
+    *num_samples_in = OVERLAP_22KHZ + odd_smp;
+}
+
+/*
+ * Convert a chunk from 22 kHz to 16 kHz. Will update num_samples_in and
+ * num_samples_out accordingly, since it may leave input samples in the buffer
+ * due to overlap.
+ *
+ * This implementation is rather ad-hoc; it first low-pass filters the data
+ * into a temporary buffer, and then converts chunks of 441 input samples at a
+ * time into 320 output samples by simple linear interpolation. A better
+ * implementation would use a polyphase filter bank to do these two operations
+ * in one step.
+ *
+ * Input and output are taken to be in 0.16 fixed-point.
+ */
+
+#define RESAMPLE_16KHZ_SAMPLES_IN 441
+#define RESAMPLE_16KHZ_SAMPLES_OUT 320
+
+void resample_441_320(int16_t *input, int16_t *output, int *num_samples_in, int *num_samples_out)
+{
+    const int num_blocks = (*num_samples_in - (int)OVERLAP_16KHZ) / RESAMPLE_16KHZ_SAMPLES_IN;
+    /* 17.15 fixed point step, 441/320 */
+    const uint32_t step = (uint32_t)(((float)RESAMPLE_16KHZ_SAMPLES_IN /
+                                      (float)RESAMPLE_16KHZ_SAMPLES_OUT) * 32768.0f + 0.5f);
+    int samples_consumed;
+    int i, j;
+
+    if (num_blocks < 1) {
+        *num_samples_out = 0;
+        return;
+    }
+
+    for (i = 0; i < num_blocks; ++i) {
+        int32_t tmp[RESAMPLE_16KHZ_SAMPLES_IN];
+        uint32_t in_sample_num = 0;   /* 17.15 fixed point */
+
+        for (j = 0; j < RESAMPLE_16KHZ_SAMPLES_IN; ++j) {
+            tmp[j] = fir_16khz(input + i * RESAMPLE_16KHZ_SAMPLES_IN + j);
+        }
+
+        for (j = 0; j < RESAMPLE_16KHZ_SAMPLES_OUT; ++j, in_sample_num += step) {
+            const uint32_t whole = in_sample_num >> 15;
+            const uint32_t frac = (in_sample_num & 0x7fff);  /* 0.15 fixed point */
+            const int32_t s1 = tmp[whole];
+            const int32_t s2 = tmp[whole + 1];
+            *output++ = clip(s1 + (((s2 - s1) * (int32_t)frac) >> 15));
+        }
+    }
+
+    samples_consumed = num_blocks * RESAMPLE_16KHZ_SAMPLES_IN;
+    memmove(input, input + samples_consumed, (*num_samples_in - samples_consumed) * sizeof(*input));
+    *num_samples_in -= samples_consumed;
+    *num_samples_out = RESAMPLE_16KHZ_SAMPLES_OUT * num_blocks;
+}
+
+/* verification against the scalar reference */
+
+#define CHECK_FRAMES 1031   /* odd on purpose, exercises the scalar tails */
+
+static int check_vector_kernels(void)
+{
+    static int16_t in[CHECK_FRAMES * 2];
+    static int16_t a[CHECK_FRAMES], b[CHECK_FRAMES];
+    static int16_t ra[CHECK_FRAMES], rb[CHECK_FRAMES];
+    static int16_t out[CHECK_FRAMES * 2], rout[CHECK_FRAMES * 2];
+    uint32_t seed = 0x12345678;
+    int i;
+
+    /* full scale pseudo random signal, including the extremes */
+    for (i = 0; i < CHECK_FRAMES * 2; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = (int16_t)(seed >> 16);
+    }
+    in[0] = in[1] = -32768;
+    in[2] = in[3] = 32767;
+
+    deinterleave_vec(in, a, b, CHECK_FRAMES);
+    deinterleave_ref(in, ra, rb, CHECK_FRAMES);
+    if (memcmp(a, ra, sizeof(a)) || memcmp(b, rb, sizeof(b)))
+        return 0;
+
+    interleave_vec(a, b, out, CHECK_FRAMES);
+    interleave_ref(ra, rb, rout, CHECK_FRAMES);
+    if (memcmp(out, rout, sizeof(out)))
+        return 0;
+
+    downmix_vec(in, a, CHECK_FRAMES);
+    downmix_ref(in, ra, CHECK_FRAMES);
+    if (memcmp(a, ra, sizeof(a)))
+        return 0;
+
+    memcpy(out, in, sizeof(out));
+    memcpy(rout, in, sizeof(rout));
+    mix_vec(out, in + 1, CHECK_FRAMES * 2 - 1);
+    mix_ref(rout, in + 1, CHECK_FRAMES * 2 - 1);
+    if (memcmp(out, rout, sizeof(out)))
+        return 0;
+
+    for (i = 0; i + (int)NUM_COEFF_16KHZ < CHECK_FRAMES; i++) {
+        if (fir_convolve_vec(in + i, filter_22khz_coeff16, NUM_COEFF_22KHZ) !=
+                fir_convolve_ref(in + i, filter_22khz_coeff, NUM_COEFF_22KHZ))
+            return 0;
+        if (fir_convolve_vec(in + i, filter_16khz_coeff16, NUM_COEFF_16KHZ) !=
+                fir_convolve_ref(in + i, filter_16khz_coeff, NUM_COEFF_16KHZ))
+            return 0;
+    }
+    return 1;
+}
+
+static void audio_convert_once(void)
+{
+    unsigned i;
+
+    for (i = 0; i < NUM_COEFF_22KHZ; i++)
+        filter_22khz_coeff16[i] = (int16_t)(filter_22khz_coeff[i] >> 16);
+    for (i = 0; i < NUM_COEFF_16KHZ; i++)
+        filter_16khz_coeff16[i] = (int16_t)(filter_16khz_coeff[i] >> 16);
+
+    use_vector = check_vector_kernels();
+    if (!use_vector)
+        LOGE("vector kernels do not match the scalar reference, using scalar code");
+    else
+        LOGV("vector kernels verified against the scalar reference");
+}
+
+int audio_convert_init(void)
+{
+    pthread_once(&once, audio_convert_once);
+    return use_vector;
+}
+
+void audio_convert_use_reference(int reference)
+{
+    pthread_once(&once, audio_convert_once);
+    if (reference)
+        use_vector = 0;
+    else
+        use_vector = check_vector_kernels();
+}
@@ -0,0 +1,63 @@
+/*
+** Copyright 2010, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef _AUDIO_CONVERT_H_
+#define _AUDIO_CONVERT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Post-processing kernels: channel split/merge, stereo to mono downmix,
+ * saturating mix and the 44.1 kHz -> 22.05/16/11.025/8 kHz FIR stages.
+ *
+ * Each kernel has a NEON implementation and a scalar reference.  The first
+ * call to audio_convert_init() runs both on a synthetic signal; if they do
+ * not match bit for bit the scalar code is used for the process lifetime.
+ */
+
+/* Verify the vector kernels against the scalar reference (once per
+ * process).  Returns non-zero if the vector kernels are in use.
+ */
+int audio_convert_init(void);
+
+/* Force the scalar reference kernels (benchmarking and verification). */
+void audio_convert_use_reference(int reference);
+
+/* stereo interleaved -> left and right planes */
+void audio_deinterleave(const int16_t *in, int16_t *left, int16_t *right,
+                        size_t frames);
+/* stereo interleaved -> mono plane, (l + r) >> 1.  in and out may alias. */
+void audio_downmix(const int16_t *in, int16_t *out, size_t frames);
+/* left and right planes -> stereo interleaved */
+void audio_interleave(const int16_t *left, const int16_t *right, int16_t *out,
+                      size_t frames);
+
+/* dst += src with saturation, over interleaved samples */
+void audio_mix(int16_t *dst, const int16_t *src, size_t samples);
+
+/* Halve the sample rate of a plane.  Will update num_samples_in and
+ * num_samples_out accordingly, since it may leave input samples in the
+ * buffer due to overlap.
+ */
+void resample_2_1(int16_t *input, int16_t *output,
+                  int *num_samples_in, int *num_samples_out);
+/* Convert a plane from 22.05 kHz to 16 kHz (or 11.025 kHz to 8 kHz), same
+ * contract as resample_2_1().
+ */
+void resample_441_320(int16_t *input, int16_t *output,
+                      int *num_samples_in, int *num_samples_out);
+
+#endif
@@ -0,0 +1,180 @@
+/*
+** Copyright 2010, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/* Checks the audio_convert.c vector kernels against the scalar reference.
+ *
+ * usage: audio_convert_test
+ *
+ * Every kernel is run once with the vector code and once with the reference
+ * on the same input, over lengths that hit the vector body and the scalar
+ * tails. The resamplers are fed a stream in irregular chunks, so the overlap
+ * carried between calls is compared as well. Prints one line per kernel and
+ * exits non-zero on the first mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "audio_convert.h"
+
+#define MAX_FRAMES      4096
+#define STREAM_SAMPLES  (44100 * 2)
+
+static const size_t lengths[] = { 0, 1, 3, 7, 8, 9, 15, 16, 17, 255, 1031, MAX_FRAMES };
+#define NUM_LENGTHS (sizeof(lengths) / sizeof(lengths[0]))
+
+static int16_t signal_in[MAX_FRAMES * 2];
+static int failures;
+
+/* full scale pseudo random signal, including the extremes */
+static void make_signal(int16_t *buf, size_t samples, uint32_t seed)
+{
+    size_t i;
+    for (i = 0; i < samples; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (int16_t)(seed >> 16);
+    }
+    buf[0] = buf[1] = -32768;
+    buf[2] = buf[3] = 32767;
+}
+
+static void result(const char *kernel, size_t frames, int ok)
+{
+    if (!ok) {
+        printf("%s frames %u: vector and reference differ\n", kernel, (unsigned)frames);
+        failures++;
+    }
+}
+
+static void test_planes(void)
+{
+    static int16_t l[MAX_FRAMES], r[MAX_FRAMES], rl[MAX_FRAMES], rr[MAX_FRAMES];
+    static int16_t out[MAX_FRAMES * 2], rout[MAX_FRAMES * 2];
+    size_t i, n;
+
+    for (i = 0; i < NUM_LENGTHS; i++) {
+        n = lengths[i];
+
+        audio_convert_use_reference(0);
+        audio_deinterleave(signal_in, l, r, n);
+        audio_convert_use_reference(1);
+        audio_deinterleave(signal_in, rl, rr, n);
+        result("deinterleave", n, !memcmp(l, rl, n * 2) && !memcmp(r, rr, n * 2));
+
+        audio_convert_use_reference(0);
+        audio_interleave(l, r, out, n);
+        audio_convert_use_reference(1);
+        audio_interleave(rl, rr, rout, n);
+        result("interleave", n, !memcmp(out, rout, n * 4));
+
+        audio_convert_use_reference(0);
+        audio_downmix(signal_in, l, n);
+        audio_convert_use_reference(1);
+        audio_downmix(signal_in, rl, n);
+        result("downmix", n, !memcmp(l, rl, n * 2));
+
+        /* in place, as DownSampler does for mono capture */
+        memcpy(out, signal_in, n * 4);
+        memcpy(rout, signal_in, n * 4);
+        audio_convert_use_reference(0);
+        audio_downmix(out, out, n);
+        audio_convert_use_reference(1);
+        audio_downmix(rout, rout, n);
+        result("downmix in place", n, !memcmp(out, rout, n * 2));
+
+        /* saturating: the offset input lines the extremes up with each other */
+        memcpy(out, signal_in, n * 4);
+        memcpy(rout, signal_in, n * 4);
+        audio_convert_use_reference(0);
+        audio_mix(out, signal_in + 2, n * 2 - (n ? 2 : 0));
+        audio_convert_use_reference(1);
+        audio_mix(rout, signal_in + 2, n * 2 - (n ? 2 : 0));
+        result("mix", n, !memcmp(out, rout, n * 4));
+    }
+}
+
+typedef void (*resampler_t)(int16_t *, int16_t *, int *, int *);
+
+/* Run a whole stream through a resampler in chunks of varying size, keeping
+ * the leftover input between calls the way DownSampler does.
+ */
+static int16_t *run_stream(resampler_t resample, const int16_t *stream,
+                           int samples, int *produced)
+{
+    int16_t *in = malloc(MAX_FRAMES * sizeof(int16_t));
+    int16_t *out = malloc(STREAM_SAMPLES * sizeof(int16_t));
+    int pos = 0, held = 0, chunk = 17;
+
+    *produced = 0;
+    while (pos < samples) {
+        int n = samples - pos;
+        int in_count, out_count;
+
+        if (n > chunk)
+            n = chunk;
+        if (n > MAX_FRAMES - held)
+            n = MAX_FRAMES - held;
+        memcpy(in + held, stream + pos, n * sizeof(int16_t));
+        pos += n;
+        held += n;
+        chunk = chunk * 7 % 1500 + 1;
+
+        in_count = held;
+        resample(in, out + *produced, &in_count, &out_count);
+        held = in_count;
+        *produced += out_count;
+    }
+    free(in);
+    return out;
+}
+
+static void test_resampler(const char *kernel, resampler_t resample)
+{
+    int16_t *stream = malloc(STREAM_SAMPLES * sizeof(int16_t));
+    int16_t *out, *rout;
+    int n, rn;
+
+    make_signal(stream, STREAM_SAMPLES, 0x2468ace0);
+
+    audio_convert_use_reference(0);
+    out = run_stream(resample, stream, STREAM_SAMPLES, &n);
+    audio_convert_use_reference(1);
+    rout = run_stream(resample, stream, STREAM_SAMPLES, &rn);
+    result(kernel, STREAM_SAMPLES, n == rn && n > 0 && !memcmp(out, rout, n * sizeof(int16_t)));
+
+    free(out);
+    free(rout);
+    free(stream);
+}
+
+int main(void)
+{
+    int vector = audio_convert_init();
+
+    printf("vector kernels: %s\n", vector ? "in use" : "rejected at init");
+    if (!vector)
+        return 1;
+
+    make_signal(signal_in, MAX_FRAMES * 2, 0x12345678);
+    test_planes();
+    test_resampler("resample_2_1", resample_2_1);
+    test_resampler("resample_441_320", resample_441_320);
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
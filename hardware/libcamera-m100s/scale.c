@@ -2,9 +2,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
 
 #include <dlfcn.h>
-#include <semaphore.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <LCML_DspCodec.h>
 #include "scale.h"
 #include <utils/Log.h>
@@ -13,7 +15,7 @@
 
 #define USN_DLL_NAME "usn.dll64P"
 #define VPP_NODE_DLL "vpp_sn.dll64P"
-#define NUM_OF_VPP_BUFFERS (1)
+#define NUM_OF_VPP_BUFFERS (3)   /* frames in flight, one descriptor pair each */
 
 #define ALIGNMENT 4096
 #define ALIGN(p)  ((void*)((((unsigned long) p + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT))
@@ -93,14 +95,30 @@ typedef struct GPPToVPPOutputFrameStatus {
 OMX_HANDLETYPE      pDllHandle;
 LCML_DSP_INTERFACE* pLCML;
 
-sem_t   semResized;
-
 //We suspect a problem with semaphores (and possibly all futex-es) so we are going to wait on a pipe
 int     pipeResized[2];
 
 #define READ_END    0
 #define WRITE_END   1
 
+/*
+ * The DSP works through the queued frames in order and ZoomCallback writes
+ * one byte to pipeResized for each input buffer it hands back, so the n-th
+ * byte read always retires the n-th frame submitted. Each frame in flight
+ * owns one of the descriptor pairs below, allocated in scale_init().
+ */
+typedef struct ScaleJob {
+    GPPToVPPInputFrameStatus*   pIpFrameStatus;
+    GPPToVPPOutputFrameStatus*  pOpYUVFrameStatus;
+    void*                       inBuffer;
+} ScaleJob;
+
+static ScaleJob         scaleJobs[NUM_OF_VPP_BUFFERS];
+static unsigned int     scaleSubmitted;     /* frames queued to the DSP */
+static unsigned int     scaleRetired;       /* tickets the DSP is done with */
+static unsigned int     scaleCallbacks;     /* only touched by ZoomCallback */
+static pthread_mutex_t  scaleLock = PTHREAD_MUTEX_INITIALIZER;
+
 /* -------------------------------------------------------------------*/
 /**
   *  GetLCMLHandle() function will be called to load LCML component 
@@ -292,6 +310,83 @@ EXIT:
 }
 
 
+/* reads one completion off the pipe, called with scaleLock held */
+static int scale_retire_one()
+{
+    char ch;
+    int n;
+
+    do {
+        n = read(pipeResized[READ_END], &ch, 1);
+    } while (n < 0 && errno == EINTR);
+
+    if (n != 1) {
+        LOGE("scale_retire_one(): read failed (%s)", strerror(errno));
+        return -1;
+    }
+    scaleRetired++;
+    return 0;
+}
+
+/* blocks until the frame with the given ticket is back, called with scaleLock held */
+static int scale_wait_locked(unsigned int ticket)
+{
+    while ((int)(ticket - scaleRetired) >= 0) {
+        if (scale_retire_one() < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* the descriptors for the next frame, once the DSP is done with them */
+static ScaleJob* scale_next_job()
+{
+    unsigned int ticket = scaleSubmitted;
+
+    if (ticket - scaleRetired >= NUM_OF_VPP_BUFFERS &&
+        scale_wait_locked(ticket - NUM_OF_VPP_BUFFERS) < 0) {
+        return NULL;
+    }
+    return &scaleJobs[ticket % NUM_OF_VPP_BUFFERS];
+}
+
+static int scale_queue_job(ScaleJob* pJob, void* inBuffer, OMX_S32 inBufferLen, OMX_S32 inBufferUsed, void* outBuffer, OMX_S32 outBufferLen)
+{
+    OMX_ERRORTYPE eError;
+
+    pJob->inBuffer = inBuffer;
+
+    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
+                              EMMCodecInputBuffer,
+                              inBuffer,
+                              inBufferLen,
+                              inBufferUsed,
+                              (void*)pJob->pIpFrameStatus,
+                              sizeof(GPPToVPPInputFrameStatus),
+                              NULL);
+    if (eError != OMX_ErrorNone) {
+        LOGE("Camera Component: Error 0x%X While sending the input buffer to Codec\n",eError);
+        return -1;
+    }
+
+    /* the input is with the DSP now and will come back, so the ticket is used */
+    scaleSubmitted++;
+
+    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
+                              EMMCodecStream3,
+                              outBuffer,
+                              outBufferLen,
+                              0,
+                              (void*)pJob->pOpYUVFrameStatus,
+                              sizeof(GPPToVPPOutputFrameStatus),  
+                              NULL);
+    if (eError != OMX_ErrorNone) {
+        LOGE("Camera Component: Error 0x%X While sending the output buffer to Codec\n",eError);
+        return -1;
+    }
+    return 0;
+}
+
 int scale_process_preview(void* inBuffer, int inWidth, int inHeight, void* outBuffer, int outWidth, int outHeight, int rotation, int fmt, float zoom)
 {
     OMX_ERRORTYPE eError = OMX_ErrorNone;
@@ -300,15 +395,21 @@ int scale_process_preview(void* inBuffer, int inWidth, int inHeight, void* outBu
     OMX_S32 inBufferLen;
     OMX_S32 outBufferLen;
 
-    char ch;
+    ScaleJob* pJob;
+    int ret;
 
     GPPToVPPInputFrameStatus*    pPrevIpFrameStatus;
     GPPToVPPOutputFrameStatus*   pPrevOpYUVFrameStatus;
 
     LOG_FUNCTION_NAME
 
-    OMX_MALLOC_SIZE_DSPALIGN(pPrevIpFrameStatus, sizeof(GPPToVPPInputFrameStatus), OMX_U8);
-    OMX_MALLOC_SIZE_DSPALIGN(pPrevOpYUVFrameStatus, sizeof(GPPToVPPOutputFrameStatus), OMX_U8);
+    pthread_mutex_lock(&scaleLock);
+
+    pJob = scale_next_job();
+    if (pJob == NULL)
+        goto OMX_CAMERA_BAIL_CMD;
+    pPrevIpFrameStatus = pJob->pIpFrameStatus;
+    pPrevOpYUVFrameStatus = pJob->pOpYUVFrameStatus;
 
     pPrevIpFrameStatus->ulInWidth             = inWidth;
     pPrevIpFrameStatus->ulInHeight            = inHeight;    
@@ -354,35 +455,15 @@ int scale_process_preview(void* inBuffer, int inWidth, int inHeight, void* outBu
         outBufferLen = (outWidth*outHeight)*2;
     }
        
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecInputBuffer,
-                              inBuffer,
-                              inBufferLen,
-                              0,
-                              (void*)pPrevIpFrameStatus,
-                              sizeof(GPPToVPPInputFrameStatus),
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGV("Camera Component: Error 0x%X While sending the input buffer to Codec\n",eError);
+    if (scale_queue_job(pJob, inBuffer, inBufferLen, 0, outBuffer, outBufferLen) < 0)
         goto OMX_CAMERA_BAIL_CMD;
-    }
 
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecStream3,
-                              outBuffer,
-                              outBufferLen,
-                              0,
-                              (void*)pPrevOpYUVFrameStatus,
-                              sizeof(GPPToVPPOutputFrameStatus),  
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGV("Camera Component: Error 0x%X While sending the output buffer to Codec\n",eError);
+    /* the rotation pass reads the crop output, the DSP runs them in order */
+    pJob = scale_next_job();
+    if (pJob == NULL)
         goto OMX_CAMERA_BAIL_CMD;
-    }
-
-    sem_wait( &semResized );
-
-    read(pipeResized[READ_END], &ch, 1);
+    pPrevIpFrameStatus = pJob->pIpFrameStatus;
+    pPrevOpYUVFrameStatus = pJob->pOpYUVFrameStatus;
 
     pPrevIpFrameStatus->ulInWidth             = outWidth;
     pPrevIpFrameStatus->ulInHeight            = outHeight;    
@@ -428,43 +509,19 @@ int scale_process_preview(void* inBuffer, int inWidth, int inHeight, void* outBu
         inBufferLen = (inWidth*inHeight)*2;
     }
        
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecInputBuffer,
-                              outBuffer,
-                              outBufferLen,
-                              0,
-                              (void*)pPrevIpFrameStatus,
-                              sizeof(GPPToVPPInputFrameStatus),
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGV("Camera Component: Error 0x%X While sending the input buffer to Codec\n",eError);
-        goto OMX_CAMERA_BAIL_CMD;
-    }
-
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecStream3,
-                              inBuffer,
-                              inBufferLen,
-                              0,
-                              (void*)pPrevOpYUVFrameStatus,
-                              sizeof(GPPToVPPOutputFrameStatus),  
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGV("Camera Component: Error 0x%X While sending the output buffer to Codec\n",eError);
+    if (scale_queue_job(pJob, outBuffer, inBufferLen, 0, inBuffer, outBufferLen) < 0)
         goto OMX_CAMERA_BAIL_CMD;
-    }
-
-    sem_wait( &semResized );
 
-    read(pipeResized[READ_END], &ch, 1);    
+    ret = scale_wait_locked(scaleSubmitted - 1);
+    pthread_mutex_unlock(&scaleLock);
 
     LOG_FUNCTION_NAME_EXIT
         
-    return 0;
+    return ret;
 
     
 OMX_CAMERA_BAIL_CMD:
-EXIT:
+    pthread_mutex_unlock(&scaleLock);
     return -1;
 }
 
@@ -476,15 +533,21 @@ int scale_process_capture(void* inBuffer, int inWidth, int inHeight, void* outBu
     OMX_S32 inBufferLen;
     OMX_S32 outBufferLen;
     
-    char ch;
+    ScaleJob* pJob;
+    int ret;
 
     GPPToVPPInputFrameStatus*    pPrevIpFrameStatus;
     GPPToVPPOutputFrameStatus*   pPrevOpYUVFrameStatus;
 
     LOG_FUNCTION_NAME
 
-    OMX_MALLOC_SIZE_DSPALIGN(pPrevIpFrameStatus, sizeof(GPPToVPPInputFrameStatus), OMX_U8);
-    OMX_MALLOC_SIZE_DSPALIGN(pPrevOpYUVFrameStatus, sizeof(GPPToVPPOutputFrameStatus), OMX_U8);
+    pthread_mutex_lock(&scaleLock);
+
+    pJob = scale_next_job();
+    if (pJob == NULL)
+        goto OMX_CAMERA_BAIL_CMD;
+    pPrevIpFrameStatus = pJob->pIpFrameStatus;
+    pPrevOpYUVFrameStatus = pJob->pOpYUVFrameStatus;
 
     pPrevIpFrameStatus->ulInWidth             = inWidth;
     pPrevIpFrameStatus->ulInHeight            = inHeight;    
@@ -530,35 +593,15 @@ int scale_process_capture(void* inBuffer, int inWidth, int inHeight, void* outBu
         outBufferLen = (outWidth*outHeight)*2;
     }
        
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecInputBuffer,
-                              inBuffer,
-                              inBufferLen,
-                              0,
-                              (void*)pPrevIpFrameStatus,
-                              sizeof(GPPToVPPInputFrameStatus),
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGV("Camera Component: Error 0x%X While sending the input buffer to Codec\n",eError);
+    if (scale_queue_job(pJob, inBuffer, inBufferLen, 0, outBuffer, outBufferLen) < 0)
         goto OMX_CAMERA_BAIL_CMD;
-    }
 
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecStream3,
-                              outBuffer,
-                              outBufferLen,
-                              0,
-                              (void*)pPrevOpYUVFrameStatus,
-                              sizeof(GPPToVPPOutputFrameStatus),  
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGV("Camera Component: Error 0x%X While sending the output buffer to Codec\n",eError);
+    /* the rotation pass reads the crop output, the DSP runs them in order */
+    pJob = scale_next_job();
+    if (pJob == NULL)
         goto OMX_CAMERA_BAIL_CMD;
-    }
-
-    sem_wait( &semResized );
-
-    read(pipeResized[READ_END], &ch, 1);
+    pPrevIpFrameStatus = pJob->pIpFrameStatus;
+    pPrevOpYUVFrameStatus = pJob->pOpYUVFrameStatus;
 
     pPrevIpFrameStatus->ulInWidth             = outWidth;
     pPrevIpFrameStatus->ulInHeight            = outHeight;    
@@ -604,43 +647,19 @@ int scale_process_capture(void* inBuffer, int inWidth, int inHeight, void* outBu
         outBufferLen = (inHeight*inWidth)*2;
     }
        
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecInputBuffer,
-                              outBuffer,
-                              inBufferLen,
-                              0,
-                              (void*)pPrevIpFrameStatus,
-                              sizeof(GPPToVPPInputFrameStatus),
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGV("Camera Component: Error 0x%X While sending the input buffer to Codec\n",eError);
+    if (scale_queue_job(pJob, outBuffer, inBufferLen, 0, inBuffer, outBufferLen) < 0)
         goto OMX_CAMERA_BAIL_CMD;
-    }
 
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecStream3,
-                              inBuffer,
-                              outBufferLen,
-                              0,
-                              (void*)pPrevOpYUVFrameStatus,
-                              sizeof(GPPToVPPOutputFrameStatus),  
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGV("Camera Component: Error 0x%X While sending the output buffer to Codec\n",eError);
-        goto OMX_CAMERA_BAIL_CMD;
-    }
-
-    sem_wait( &semResized );
-
-    read(pipeResized[READ_END], &ch, 1);    
+    ret = scale_wait_locked(scaleSubmitted - 1);
+    pthread_mutex_unlock(&scaleLock);
 
     LOG_FUNCTION_NAME_EXIT
         
-    return 0;
+    return ret;
 
     
 OMX_CAMERA_BAIL_CMD:
-EXIT:
+    pthread_mutex_unlock(&scaleLock);
     return -1;
 }
 
@@ -648,17 +667,49 @@ OMX_ERRORTYPE ZoomCallback (TUsnCodecEvent event,void * args [10])
 {
     if( event == EMMCodecBufferProcessed ) {
         if( (int)args[0] == EMMCodecInputBuffer ) {
-            LOGV("\n\nImage processed.\n\n\n");
+            ScaleJob* pJob = &scaleJobs[scaleCallbacks++ % NUM_OF_VPP_BUFFERS];
+
+            if (args[1] != pJob->inBuffer)
+                LOGE("ZoomCallback(): DSP returned %p, expected %p", args[1], pJob->inBuffer);
 
-            sem_post( &semResized );
-            
             write(pipeResized[WRITE_END], "Q", 1);
-            LOGV("\n\nImage processed semaphore posted.\n\n\n");            
+            LOGV("\n\nImage processed.\n\n\n");
         }
     }
     return OMX_ErrorNone;
 }
 
+static void scale_free_jobs()
+{
+    int i;
+
+    for (i = 0; i < NUM_OF_VPP_BUFFERS; i++) {
+        OMX_MEMFREE_STRUCT_DSPALIGN(scaleJobs[i].pIpFrameStatus, GPPToVPPInputFrameStatus);
+        OMX_MEMFREE_STRUCT_DSPALIGN(scaleJobs[i].pOpYUVFrameStatus, GPPToVPPOutputFrameStatus);
+        scaleJobs[i].pIpFrameStatus = NULL;
+        scaleJobs[i].pOpYUVFrameStatus = NULL;
+        scaleJobs[i].inBuffer = NULL;
+    }
+}
+
+/* the DSP-aligned descriptors, once for the life of the codec */
+static int scale_alloc_jobs()
+{
+    OMX_ERRORTYPE eError = OMX_ErrorNone;
+    int i;
+
+    for (i = 0; i < NUM_OF_VPP_BUFFERS; i++) {
+        OMX_MALLOC_SIZE_DSPALIGN(scaleJobs[i].pIpFrameStatus, sizeof(GPPToVPPInputFrameStatus), GPPToVPPInputFrameStatus);
+        OMX_MALLOC_SIZE_DSPALIGN(scaleJobs[i].pOpYUVFrameStatus, sizeof(GPPToVPPOutputFrameStatus), GPPToVPPOutputFrameStatus);
+    }
+    scaleSubmitted = scaleRetired = scaleCallbacks = 0;
+    return 0;
+
+EXIT:
+    scale_free_jobs();
+    return -1;
+}
+
 int scale_init(int inWidth, int inHeight, int outWidth, int outHeight, int inFmt, int outFmt)
 {
     LCML_CALLBACKTYPE   cb;
@@ -677,6 +728,12 @@ int scale_init(int inWidth, int inHeight, int outWidth, int outHeight, int inFmt
         return -1;
     }
 
+    if( scale_alloc_jobs() < 0 || pipe(pipeResized) < 0 ) {
+        LOGE("Cannot allocate resizer descriptors.\n");
+        scale_free_jobs();
+        return -1;
+    }
+
     cb.LCML_Callback = ZoomCallback;
 
     pLcmlDsp = pLCML->dspCodec;
@@ -699,9 +756,6 @@ int scale_init(int inWidth, int inHeight, int outWidth, int outHeight, int inFmt
         return -1;
     }
 
-    sem_init( &semResized, 0 , 0 );
-    pipe(pipeResized);
-
     LOG_FUNCTION_NAME_EXIT
 
     return err;
@@ -712,6 +766,13 @@ int scale_deinit()
     OMX_ERRORTYPE err;
 
     LOG_FUNCTION_NAME
+
+    /* the descriptors and buffers of frames still in flight belong to the DSP */
+    pthread_mutex_lock(&scaleLock);
+    if (scaleSubmitted != scaleRetired)
+        scale_wait_locked(scaleSubmitted - 1);
+    pthread_mutex_unlock(&scaleLock);
+
     err = LCML_ControlCodec( pLCML->pCodecinterfacehandle, MMCodecControlStop, NULL );
     if( err != OMX_ErrorNone ) {
         LOGE("LCML_ControlCodec(MMCodecControlStop) error=0x%08x\n", err);
@@ -723,7 +784,7 @@ int scale_deinit()
         LOGE("LCML_ControlCodec(MMCodecControlStop) error=0x%08x\n", err);
         return -1;
     }
-    sem_destroy(&semResized);
+    scale_free_jobs();
 
     close(pipeResized[READ_END]);
     close(pipeResized[WRITE_END]);   
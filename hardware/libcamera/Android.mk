@@ -9,7 +9,8 @@ LOCAL_SRC_FILES:= \
     CameraHal_Utils.cpp \
     MessageQueue.cpp \
     ExifCreator.cpp \
-    ColorConvert.cpp
+    ColorConvert.cpp \
+    scale_sw.c
     
 LOCAL_SHARED_LIBRARIES:= \
     libdl \
@@ -94,6 +95,34 @@ include $(BUILD_SHARED_LIBRARY)
 include $(LOCAL_PATH)/Neon/android.mk
 ################################################
 
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    scale_sw.c \
+    scale_sw_bench.c
+
+LOCAL_MODULE := scale_sw_bench
+
+LOCAL_MODULE_TAGS := debug
+
+LOCAL_LDLIBS += -lpthread -lrt
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    scale_sw.c \
+    scale_sw_bench.c
+
+LOCAL_MODULE := scale_sw_bench
+
+LOCAL_MODULE_TAGS := debug
+
+include $(BUILD_EXECUTABLE)
+
+################################################
+
 #ifdef HARDWARE_OMX
 
 #include $(CLEAR_VARS)
@@ -304,12 +304,22 @@ namespace android {
 		mPreviousGPSLatitude(0),
 		mPreviousGPSLongitude(0),
 		mPreviousGPSAltitude(0),
-		mPreviousGPSTimestamp(0)	
+		mPreviousGPSTimestamp(0),
+		mStartupReady(false),
+		mStartupReadyTime(0),
+		mPreviewStartTime(0),
+		mFirstPreviewFrameTime(0),
+		mOpenToFirstFrame(0),
+		mWaitFirstPreviewFrame(false)
 	{
 #if PPM_INSTRUMENTATION || PPM_INSTRUMENTATION_ABS
 		gettimeofday(&ppm_start, NULL);
 #endif
 		const char* error;
+		nsecs_t stepStart;
+
+		mOpenTime = systemTime();
+		memset(mStartupTime, 0, sizeof(mStartupTime));
 
 		isStart_Scale = false;
 		mFalsePreview = false;  //Android HAL
@@ -324,20 +334,13 @@ namespace android {
 		neon_args = NULL;
 		pTIrtn = NULL;
 
-		//Get the handle of rotation shared library.
-
-		pTIrtn = dlopen("librotation.so", RTLD_LOCAL | RTLD_LAZY);
-		if (!pTIrtn) {
-			LOGE("Open NEON Rotation Library Failed \n");
+		// Nothing the first preview frame needs: load it alongside the device open
+		if(createThread(beginStartupThread, this) == false)
+		{
+			LOGE("ERR(%s):Fail - createThread", __FUNCTION__);
+			startupThread();
 		}
 
-		Neon_Rotate = (NEON_fpo) dlsym(pTIrtn, "Neon_RotateCYCY");
-
-		if (Neon_Rotate == NULL) {
-			LOGE("Couldnot find  Neon_RotateCYCY symbol, addr= %p\n", Neon_Rotate);
-			dlclose(pTIrtn);
-			pTIrtn = NULL;
-		} 
 		if(!neon_args)
 		{
 			neon_args   = (NEON_FUNCTION_ARGS*)malloc(sizeof(NEON_FUNCTION_ARGS));
@@ -349,26 +352,84 @@ namespace android {
 			buffers_queued_to_dss[i] = 0;
 		}
 
+		stepStart = systemTime();
 		if(CameraCreate(cameraId) < 0) {
 			LOGE("ERROR CameraCreate()\n");
 		    mNotifyCb(CAMERA_MSG_ERROR,CAMERA_DEVICE_ERROR_FOR_EXIT,0,mCallbackCookie);
 		}
+		mStartupTime[STARTUP_CAMERA_OPEN] = systemTime() - stepStart;
 
+		stepStart = systemTime();
 		initDefaultParameters(cameraId);
-
-
 		ICaptureCreate();
+		mStartupTime[STARTUP_PARAMETERS] = systemTime() - stepStart;
 
+		stepStart = systemTime();
 		mPreviewThread = new PreviewThread(this, cameraId);
 		mPreviewThread->run("CameraPreviewThread", PRIORITY_URGENT_DISPLAY);
+		mStartupTime[STARTUP_PREVIEW_THREAD] = systemTime() - stepStart;
+
+		LOGD("CameraHal: open took %lld ms", (long long)ns2ms(systemTime() - mOpenTime));
 	} //end of CameraHal Constructor
 
+	int CameraHal::beginStartupThread(void *cookie)
+	{
+		CameraHal *c = (CameraHal*)cookie;
+		c->startupThread();
+		return 0;
+	}
+
+	/*
+	What only capture and the VT rotation need, loaded off the open path.
+	Users of it go through waitForStartup() first.
+	 */
+	void CameraHal::startupThread()
+	{
+		nsecs_t stepStart = systemTime();
+
+		//Get the handle of rotation shared library.
+
+		pTIrtn = dlopen("librotation.so", RTLD_LOCAL | RTLD_LAZY);
+		if (!pTIrtn) {
+			LOGE("Open NEON Rotation Library Failed \n");
+		}
+
+		Neon_Rotate = (NEON_fpo) dlsym(pTIrtn, "Neon_RotateCYCY");
+
+		if (Neon_Rotate == NULL) {
+			LOGE("Couldnot find  Neon_RotateCYCY symbol, addr= %p\n", Neon_Rotate);
+			dlclose(pTIrtn);
+			pTIrtn = NULL;
+		} 
+		mStartupTime[STARTUP_ROTATION_LIB] = systemTime() - stepStart;
+
+		stepStart = systemTime();
+		ICaptureLoad();
+		mStartupTime[STARTUP_CAPTURE_CODECS] = systemTime() - stepStart;
+
+		Mutex::Autolock lock(mStartupLock);
+		mStartupReadyTime = systemTime();
+		mStartupReady = true;
+		mStartupDone.broadcast();
+	}
+
+	void CameraHal::waitForStartup() const
+	{
+		Mutex::Autolock lock(mStartupLock);
+		while(!mStartupReady)
+		{
+			mStartupDone.wait(mStartupLock);
+		}
+	}
+
 	CameraHal::~CameraHal()
 	{
 		int err = 0;
 		LOG_FUNCTION_NAME
 		struct v4l2_control vc;
 		CLEAR(vc);
+
+		waitForStartup();
         
 		if(mPreviewThread != NULL) 
 		{
@@ -987,7 +1048,7 @@ namespace android {
 				goto exit;
 			}
 
-#if OMAP_SCALE 			
+#if OMAP_SCALE && defined(HARDWARE_OMX)
 	        if(!isStart_Scale)
 	        {
                 if ( scale_init(PREVIEW_WIDTH, PREVIEW_HEIGHT, PREVIEW_WIDTH, PREVIEW_HEIGHT, PIX_YUV422I, PIX_YUV422I) < 0 ) 
@@ -1058,7 +1119,7 @@ exit:
 			nOverlayBuffersQueued = 0;
 		}
 		
-#if OMAP_SCALE
+#if OMAP_SCALE && defined(HARDWARE_OMX)
 	    if(isStart_Scale)
 	    {
 	        err = scale_deinit();
@@ -1487,6 +1548,23 @@ fail_reqbufs:
 	} //end of CameraStop()
 
 
+	/*
+	Small frames are cheaper on the ARM than a round trip to the DSP, and the
+	ARM also takes over when the DSP resizer is not up or is behind.
+	 */
+	bool CameraHal::useDspScaler(int outWidth, int outHeight)
+	{
+#ifdef HARDWARE_OMX
+		if(!isStart_Scale)
+			return false;
+		if(outWidth * outHeight <= SCALE_SW_MAX_PIXELS)
+			return false;
+		return scale_pending() < SCALE_DSP_MAX_PENDING;
+#else
+		return false;
+#endif
+	}
+
 	/*
 	//NCB-TI
 	New nextPreview() code is to make CameraHal compatible with the Inc3.4 Overlay module. 
@@ -1506,6 +1584,9 @@ fail_reqbufs:
 		mapping_data_t* data = NULL; 
 		bool queueBufferCheck = true;
 		int error = 0;
+#if OMAP_SCALE
+		int scaleJob = -1;
+#endif
 
 
 		/* De-queue the next avaliable buffer */
@@ -1543,9 +1624,21 @@ fail_reqbufs:
 				yuv_buffer = (uint8_t*) data->ptr;
 		  //LOGE("AKMM: modify overlay address");
 		  //LOGE("AKMM: vpp_buffer is 0x%x yuv_buffer 0x%x    wid %d  ht %d",vpp_buffer,yuv_buffer , mPreviewWidth, mPreviewHeight);
-			if(scale_process(vpp_buffer, mPreviewWidth,mPreviewHeight, yuv_buffer,mPreviewWidth, mPreviewHeight  , 0, PIX_YUV422I, 1))
+			if(yuv_buffer != NULL)
 			{
-				LOGE("scale_process() failed\n");
+				if(useDspScaler(mPreviewWidth, mPreviewHeight))
+				{
+					// the DSP scales into the overlay buffer while the preview callback is converted below
+					scaleJob = scale_submit(vpp_buffer, mPreviewWidth,mPreviewHeight, yuv_buffer,mPreviewWidth, mPreviewHeight  , 0, PIX_YUV422I, 1);
+					if(scaleJob < 0)
+					{
+						LOGE("scale_submit() failed\n");
+					}
+				}
+				else if(scale_sw_process(vpp_buffer, mPreviewWidth,mPreviewHeight, yuv_buffer,mPreviewWidth, mPreviewHeight  , 0, PIX_YUV422I, 1))
+				{
+					LOGE("scale_sw_process() failed\n");
+				}
 			}
 		}
 #endif
@@ -1580,6 +1673,15 @@ fail_reqbufs:
 			}
 		}
 
+#if OMAP_SCALE
+		// the overlay buffer the DSP writes is also mVideoBuffer[index], the
+		// recorder's frame: only the preview conversion above overlaps it
+		if(scaleJob >= 0 && scale_wait(scaleJob))
+		{
+			LOGE("scale_wait() failed\n");
+		}
+#endif
+
 #if	CHECK_FRAMERATE
 		debugShowFPS();
 #endif  //#if CHECK_FRAMERATE
@@ -1610,6 +1712,7 @@ fail_reqbufs:
 						neon_args->height = mPreviewHeight;
 						neon_args->rotate = NEON_ROT90;
 						error = 0;   
+						waitForStartup();
 						if (Neon_Rotate != NULL)
 							error = (*Neon_Rotate)(neon_args);
 						else
@@ -1687,6 +1790,13 @@ fail_reqbufs:
 				}
 				else
 				{
+					if(mWaitFirstPreviewFrame)
+					{
+						mFirstPreviewFrameTime = systemTime();
+						if(!mOpenToFirstFrame)
+							mOpenToFirstFrame = mFirstPreviewFrameTime - mOpenTime;
+						mWaitFirstPreviewFrame = false;
+					}
 					nOverlayBuffersQueued++;
 					buffers_queued_to_dss[mCfilledbuffer.index] = 1; //queued
 					if (nBuffers_queued_to_dss != nOverlayBuffersQueued)
@@ -1857,6 +1967,16 @@ fail_reqbufs:
 
 		mippMode=0;
 
+#endif //of HARDWARE_OMX
+
+		LOG_FUNCTION_NAME_EXIT
+		return res;
+	}
+
+	// the JPEG codecs, from startupThread()
+	int CameraHal::ICaptureLoad(void)
+	{
+#ifdef HARDWARE_OMX
 #if JPEG
         
 		jpegEncoder = new JpegEncoder;
@@ -1867,25 +1987,7 @@ fail_reqbufs:
 #endif //of JPEG
 #endif //of HARDWARE_OMX
 
-		LOG_FUNCTION_NAME_EXIT
-		return res;
-
-fail_jpeg_buffer:
-fail_yuv_buffer:
-fail_init:
-
-#ifdef HARDWARE_OMX
-#if JPEG
-		delete jpegEncoder;
-#ifdef jpeg_decoder
-		delete jpegDecoder;
-#endif //jpeg_decoder
-#endif //JPEG    
-#endif //HARDWARE_OMX 
-
-fail_icapture:
-exit:
-		return -1;
+		return 0;
 	}
 
 
@@ -1962,6 +2064,8 @@ exit:
 	{
 		LOG_FUNCTION_NAME
 
+		mPreviewStartTime = systemTime();
+		mWaitFirstPreviewFrame = true;
 
 		if(mOverlay == NULL && mCamMode != VT_MODE)
 		{
@@ -2569,7 +2673,51 @@ DBG
 
 	status_t  CameraHal::dump(int fd, const Vector<String16>& args) const
 	{
-		return 0;
+		static const char* stepNames[STARTUP_STEP_COUNT] = {
+			"open camera device",
+			"default parameters",
+			"preview thread",
+			"rotation library (background)",
+			"JPEG codecs (background)",
+		};
+		const size_t SIZE = 256;
+		char buffer[SIZE];
+		String8 result;
+
+		snprintf(buffer, SIZE, "CameraHal startup (%s camera):\n",
+				 mCameraIndex == MAIN_CAMERA ? "main" : "front");
+		result.append(buffer);
+		{
+			Mutex::Autolock lock(mStartupLock);
+			for(int i = 0; i < STARTUP_STEP_COUNT; i++)
+			{
+				if(i >= STARTUP_ROTATION_LIB && !mStartupReady)
+					snprintf(buffer, SIZE, "  %-32s still loading\n", stepNames[i]);
+				else
+					snprintf(buffer, SIZE, "  %-32s %6.1f ms\n", stepNames[i], mStartupTime[i] / 1e6);
+				result.append(buffer);
+			}
+			if(mStartupReady)
+			{
+				snprintf(buffer, SIZE, "  %-32s %6.1f ms after open\n", "capture ready",
+						 (mStartupReadyTime - mOpenTime) / 1e6);
+				result.append(buffer);
+			}
+		}
+		if(mOpenToFirstFrame)
+		{
+			snprintf(buffer, SIZE, "  %-32s %6.1f ms after open\n", "first preview frame",
+					 mOpenToFirstFrame / 1e6);
+			result.append(buffer);
+		}
+		if(mPreviewStartTime && !mWaitFirstPreviewFrame)
+		{
+			snprintf(buffer, SIZE, "  %-32s %6.1f ms after startPreview\n", "latest first preview frame",
+					 (mFirstPreviewFrameTime - mPreviewStartTime) / 1e6);
+			result.append(buffer);
+		}
+		write(fd, result.string(), result.size());
+		return NO_ERROR;
 	}
 
 	void CameraHal::dumpFrame(void *buffer, int size, char *path)
@@ -87,7 +87,12 @@ extern "C" {
 
 //#define MAIN_CAM_CAPTURE_YUV    // use YUV,OMX jpeg encoder instead of camera ISP
 
-#define OMAP_SCALE			0	// RealCAM Preview & Capture landscpae view option for GB
+// RealCAM Preview & Capture landscpae view option for GB. Off: the VGA
+// camera previews straight into the overlay, and neither scale.c nor
+// scale_sw.c is called from the HAL (scale_sw_bench still checks scale_sw)
+#define OMAP_SCALE			0
+#define SCALE_SW_MAX_PIXELS		(320*240)	// OMAP_SCALE: outputs up to this size are scaled on the ARM
+#define SCALE_DSP_MAX_PENDING	2	// OMAP_SCALE: with this many frames queued to the DSP the ARM takes the next one
 
 #define CLEAR(x) memset (&(x), 0, sizeof (x))
 
@@ -303,6 +308,9 @@ namespace android {
 			virtual ~CameraHal();
 			void previewThread(int cameraId);
 			static int beginPictureThread(void *cookie);
+			static int beginStartupThread(void *cookie);
+			void startupThread();
+			void waitForStartup() const;
 
 			int validateSize(int w, int h);	
 			void drawRect(uint8_t *input, uint8_t color, int x1, int y1, int x2, int y2, int width, int height);
@@ -316,6 +324,7 @@ namespace android {
 			void nextPreview();
 			int ICapturePerform();
 			int ICaptureCreate(void);
+			int ICaptureLoad(void);
 			int ICaptureDestroy(void);
 			int CapturePicture();
 			
@@ -350,6 +359,7 @@ namespace android {
 
 			int isStart_VPP;
 			int isStart_Scale;
+			bool useDspScaler(int outWidth, int outHeight);
 
 			status_t setWB(const char* wb);
 			status_t setEffect(const char* effect);
@@ -461,6 +471,26 @@ namespace android {
 #endif
 			mutable Mutex mLock;
 			CameraParameters mParameters;
+
+			// open() timings, reported by dump()
+			enum StartupSteps {
+				STARTUP_CAMERA_OPEN,		// on the caller's thread, before the first preview frame
+				STARTUP_PARAMETERS,
+				STARTUP_PREVIEW_THREAD,
+				STARTUP_ROTATION_LIB,		// on startupThread(), before the first capture
+				STARTUP_CAPTURE_CODECS,
+				STARTUP_STEP_COUNT
+			};
+			mutable Mutex mStartupLock;
+			mutable Condition mStartupDone;
+			bool mStartupReady;
+			nsecs_t mOpenTime;
+			nsecs_t mStartupTime[STARTUP_STEP_COUNT];
+			nsecs_t mStartupReadyTime;
+			nsecs_t mPreviewStartTime;		// of the latest startPreview()
+			nsecs_t mFirstPreviewFrameTime;	// its first frame to the overlay
+			nsecs_t mOpenToFirstFrame;		// for the first preview after open
+			bool mWaitFirstPreviewFrame;
 			sp<MemoryHeapBase> mPictureHeap;
 			sp<MemoryHeapBase> mJPEGPictureHeap;
 			int mPictureOffset, mJPEGOffset, mJPEGLength, mPictureLength;
@@ -694,8 +724,13 @@ extern "C" {
 	int scale_init(int inWidth, int inHeight, int outWidth, int outHeight, int inFmt, int outFmt);
 	int scale_deinit();
 	int scale_process(void* inBuffer, int inWidth, int inHeight, void* outBuffer, int outWidth, int outHeight, int rotation, int fmt, float zoom);
+	int scale_submit(void* inBuffer, int inWidth, int inHeight, void* outBuffer, int outWidth, int outHeight, int rotation, int fmt, float zoom);
+	int scale_wait(int job);
+	int scale_pending();
 }
 
+#include "scale_sw.h"
+
 extern "C" {
 	int ColorConvert_Init(int , int , int);
 	int ColorConvert_Deinit();
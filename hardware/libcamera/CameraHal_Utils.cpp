@@ -377,6 +377,9 @@ s_fmt_fail:
 		ssize_t newoffset;
 		size_t newsize;
 
+		// the JPEG codecs are created in the background at open
+		waitForStartup();
+
 		mCaptureFlag = true;
 		int jpegSize;
 		void* outBuffer;
@@ -2,9 +2,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
 
 #include <dlfcn.h>
-#include <semaphore.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <OMX_TI_Common.h>
 #include <LCML_DspCodec.h>
 #include "scale.h"
@@ -12,7 +14,7 @@
 
 #define USN_DLL_NAME "usn.dll64P"
 #define VPP_NODE_DLL "vpp_sn.dll64P"
-#define NUM_OF_VPP_BUFFERS (1)
+#define NUM_OF_VPP_BUFFERS (3)   /* frames in flight, one descriptor pair each */
 
 #define ALIGNMENT 4096
 #define ALIGN(p)  ((void*)((((unsigned long) p + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT))
@@ -92,14 +94,30 @@ typedef struct GPPToVPPOutputFrameStatus {
 OMX_HANDLETYPE      pDllHandle;
 LCML_DSP_INTERFACE* pLCML;
 
-sem_t   semResized;
-
 //We suspect a problem with semaphores (and possibly all futex-es) so we are going to wait on a pipe
 int     pipeResized[2];
 
 #define READ_END    0
 #define WRITE_END   1
 
+/*
+ * The DSP works through the queued frames in order and ZoomCallback writes
+ * one byte to pipeResized for each input buffer it hands back, so the n-th
+ * byte read always retires the n-th frame submitted. Each frame in flight
+ * owns one of the descriptor pairs below, allocated in scale_init().
+ */
+typedef struct ScaleJob {
+    GPPToVPPInputFrameStatus*   pIpFrameStatus;
+    GPPToVPPOutputFrameStatus*  pOpYUVFrameStatus;
+    void*                       inBuffer;
+} ScaleJob;
+
+static ScaleJob         scaleJobs[NUM_OF_VPP_BUFFERS];
+static unsigned int     scaleSubmitted;     /* tickets handed out by scale_submit() */
+static unsigned int     scaleRetired;       /* tickets the DSP is done with */
+static unsigned int     scaleCallbacks;     /* only touched by ZoomCallback */
+static pthread_mutex_t  scaleLock = PTHREAD_MUTEX_INITIALIZER;
+
 /* -------------------------------------------------------------------*/
 /**
   *  GetLCMLHandle() function will be called to load LCML component 
@@ -294,22 +312,106 @@ EXIT:
     return eError;
 }
 
-int scale_process(void* inBuffer, int inWidth, int inHeight, void* outBuffer, int outWidth, int outHeight, int rotation, int fmt, float zoom)
+/* reads one completion off the pipe, called with scaleLock held */
+static int scale_retire_one()
 {
-    OMX_ERRORTYPE eError = OMX_ErrorNone;
-    OMX_U32 w,h,zfactor;
-    double aspect_ratio;
-	OMX_S32 bufferLen;
-
-//    GPPToVPPInputFrameStatus    PrevIpFrameStatus;
-//   GPPToVPPOutputFrameStatus   PrevOpYUVFrameStatus;
-
-    GPPToVPPInputFrameStatus*   pPrevIpFrameStatus; //= &PrevIpFrameStatus;
-    GPPToVPPOutputFrameStatus*  pPrevOpYUVFrameStatus; //= &PrevOpYUVFrameStatus;
-	
-    OMX_MALLOC_SIZE_DSPALIGN(pPrevIpFrameStatus, sizeof(GPPToVPPInputFrameStatus), OMX_U8);
-    OMX_MALLOC_SIZE_DSPALIGN(pPrevOpYUVFrameStatus, sizeof(GPPToVPPOutputFrameStatus), OMX_U8);    
-	
+    char ch;
+    int n;
+
+    do {
+        n = read(pipeResized[READ_END], &ch, 1);
+    } while (n < 0 && errno == EINTR);
+
+    if (n != 1) {
+        LOGE("scale_retire_one(): read failed (%s)", strerror(errno));
+        return -1;
+    }
+    scaleRetired++;
+    return 0;
+}
+
+/* blocks until the frame with the given ticket is back, called with scaleLock held */
+static int scale_wait_locked(unsigned int ticket)
+{
+    while ((int)(ticket - scaleRetired) >= 0) {
+        if (scale_retire_one() < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* the descriptors for the next frame, once the DSP is done with them */
+static ScaleJob* scale_next_job()
+{
+    unsigned int ticket = scaleSubmitted;
+
+    if (ticket - scaleRetired >= NUM_OF_VPP_BUFFERS &&
+        scale_wait_locked(ticket - NUM_OF_VPP_BUFFERS) < 0) {
+        return NULL;
+    }
+    return &scaleJobs[ticket % NUM_OF_VPP_BUFFERS];
+}
+
+static int scale_queue_job(ScaleJob* pJob, void* inBuffer, OMX_S32 inBufferLen, OMX_S32 inBufferUsed, void* outBuffer, OMX_S32 outBufferLen)
+{
+    OMX_ERRORTYPE eError;
+
+    pJob->inBuffer = inBuffer;
+
+    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
+                              EMMCodecInputBuffer,
+                              inBuffer,
+                              inBufferLen,
+                              inBufferUsed,
+                              (void*)pJob->pIpFrameStatus,
+                              sizeof(GPPToVPPInputFrameStatus),
+                              NULL);
+    if (eError != OMX_ErrorNone) {
+        LOGE("Camera Component: Error 0x%X While sending the input buffer to Codec\n",eError);
+        return -1;
+    }
+
+    /* the input is with the DSP now and will come back, so the ticket is used */
+    scaleSubmitted++;
+
+    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
+                              EMMCodecStream3,
+                              outBuffer,
+                              outBufferLen,
+                              0,
+                              (void*)pJob->pOpYUVFrameStatus,
+                              sizeof(GPPToVPPOutputFrameStatus),  
+                              NULL);
+    if (eError != OMX_ErrorNone) {
+        LOGE("Camera Component: Error 0x%X While sending the output buffer to Codec\n",eError);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Queues one frame to the DSP and returns at once with a ticket to pass to
+ * scale_wait(), or -1. inBuffer must not be changed and outBuffer not read
+ * until then. When NUM_OF_VPP_BUFFERS frames are already in flight this
+ * waits for the oldest one.
+ */
+int scale_submit(void* inBuffer, int inWidth, int inHeight, void* outBuffer, int outWidth, int outHeight, int rotation, int fmt, float zoom)
+{
+    OMX_S32 bufferLen;
+    unsigned int ticket;
+    ScaleJob* pJob;
+
+    GPPToVPPInputFrameStatus*   pPrevIpFrameStatus;
+    GPPToVPPOutputFrameStatus*  pPrevOpYUVFrameStatus;
+
+    pthread_mutex_lock(&scaleLock);
+
+    pJob = scale_next_job();
+    if (pJob == NULL)
+        goto OMX_CAMERA_BAIL_CMD;
+    pPrevIpFrameStatus = pJob->pIpFrameStatus;
+    pPrevOpYUVFrameStatus = pJob->pOpYUVFrameStatus;
+
     pPrevIpFrameStatus->ulInWidth             = inWidth;
     pPrevIpFrameStatus->ulInHeight            = inHeight;
     pPrevIpFrameStatus->ulCInOffset           = 0; /*w * 220;*/  /* offset of the C frame in the   *
@@ -355,47 +457,46 @@ int scale_process(void* inBuffer, int inWidth, int inHeight, void* outBuffer, in
 		bufferLen = (outWidth*outHeight)*2;
     }  
 
-
-//	LOGV("11111111111111111111111111111111111111111111111\n");
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecInputBuffer,
-                              inBuffer,
-                              inWidth * inHeight * 2,
-                              inWidth * inHeight * 2,
-                              (void*)pPrevIpFrameStatus,
-                              sizeof(GPPToVPPInputFrameStatus),
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGE("Camera Component: Error 0x%X While sending the input buffer to Codec\n",eError);
+    ticket = scaleSubmitted;
+    if (scale_queue_job(pJob, inBuffer, inWidth * inHeight * 2, inWidth * inHeight * 2, outBuffer, bufferLen) < 0)
         goto OMX_CAMERA_BAIL_CMD;
-    }
 
-//	LOGV("222222222222222222222222222222222222222222222222\n");
-    eError = LCML_QueueBuffer(pLCML->pCodecinterfacehandle,
-                              EMMCodecStream3,
-                              outBuffer,
-                              bufferLen,
-                              0,
-                              (void*)pPrevOpYUVFrameStatus,
-                              sizeof(GPPToVPPOutputFrameStatus),  
-                              NULL);
-    if (eError != OMX_ErrorNone) {
-        LOGE("Camera Component: Error 0x%X While sending the output buffer to Codec\n",eError);
-        goto OMX_CAMERA_BAIL_CMD;
-    }
+    pthread_mutex_unlock(&scaleLock);
+    return (int)(ticket & 0x7fffffff);
 
-//	LOGV("3333333333333333333333333333333333333333333333333\n");
-    sem_wait( &semResized );
+OMX_CAMERA_BAIL_CMD:
+    pthread_mutex_unlock(&scaleLock);
+    return -1;
+}
 
-    char ch;
-    read(pipeResized[READ_END], &ch, 1);
+/* waits for a frame queued by scale_submit(), 0 once outBuffer holds it */
+int scale_wait(int job)
+{
+    int ret;
 
-	LOGV("444444444444444444444444444444444444444444444444444444\n");
-    return 0;
+    if (job < 0)
+        return -1;
 
-EXIT:   
-OMX_CAMERA_BAIL_CMD:
-    return -1;
+    pthread_mutex_lock(&scaleLock);
+    /* tickets go out as their low 31 bits, find the full one behind scaleSubmitted */
+    ret = scale_wait_locked(scaleSubmitted - ((scaleSubmitted - (unsigned int)job) & 0x7fffffff));
+    pthread_mutex_unlock(&scaleLock);
+
+    return ret;
+}
+
+/*
+ * Frames queued to the DSP and not collected yet. A hint only, read
+ * without scaleLock since a waiter holds that until the DSP answers.
+ */
+int scale_pending()
+{
+    return (int)(scaleSubmitted - scaleRetired);
+}
+
+int scale_process(void* inBuffer, int inWidth, int inHeight, void* outBuffer, int outWidth, int outHeight, int rotation, int fmt, float zoom)
+{
+    return scale_wait(scale_submit(inBuffer, inWidth, inHeight, outBuffer, outWidth, outHeight, rotation, fmt, zoom));
 }
 
 
@@ -407,18 +508,49 @@ OMX_ERRORTYPE ZoomCallback (TUsnCodecEvent event,void * args [10])
     {
         if( (int)args[0] == EMMCodecInputBuffer )
         {
-            LOGV("\n\nImage processed.\n\n\n");
+            ScaleJob* pJob = &scaleJobs[scaleCallbacks++ % NUM_OF_VPP_BUFFERS];
 
+            if (args[1] != pJob->inBuffer)
+                LOGE("ZoomCallback(): DSP returned %p, expected %p", args[1], pJob->inBuffer);
 
-            sem_post( &semResized );
-            
             write(pipeResized[WRITE_END], "Q", 1);
-            LOGV("\n\nImage processed semaphore posted.\n\n\n");            
+            LOGV("\n\nImage processed.\n\n\n");
         }
     }
     return OMX_ErrorNone;
 }
 
+static void scale_free_jobs()
+{
+    int i;
+
+    for (i = 0; i < NUM_OF_VPP_BUFFERS; i++) {
+        OMX_MEMFREE_STRUCT_DSPALIGN(scaleJobs[i].pIpFrameStatus, GPPToVPPInputFrameStatus);
+        OMX_MEMFREE_STRUCT_DSPALIGN(scaleJobs[i].pOpYUVFrameStatus, GPPToVPPOutputFrameStatus);
+        scaleJobs[i].pIpFrameStatus = NULL;
+        scaleJobs[i].pOpYUVFrameStatus = NULL;
+        scaleJobs[i].inBuffer = NULL;
+    }
+}
+
+/* the DSP-aligned descriptors, once for the life of the codec */
+static int scale_alloc_jobs()
+{
+    OMX_ERRORTYPE eError = OMX_ErrorNone;
+    int i;
+
+    for (i = 0; i < NUM_OF_VPP_BUFFERS; i++) {
+        OMX_MALLOC_SIZE_DSPALIGN(scaleJobs[i].pIpFrameStatus, sizeof(GPPToVPPInputFrameStatus), GPPToVPPInputFrameStatus);
+        OMX_MALLOC_SIZE_DSPALIGN(scaleJobs[i].pOpYUVFrameStatus, sizeof(GPPToVPPOutputFrameStatus), GPPToVPPOutputFrameStatus);
+    }
+    scaleSubmitted = scaleRetired = scaleCallbacks = 0;
+    return 0;
+
+EXIT:
+    scale_free_jobs();
+    return -1;
+}
+
 int scale_init(int inWidth, int inHeight, int outWidth, int outHeight, int inFmt, int outFmt)
 {
     LCML_CALLBACKTYPE   cb;
@@ -436,6 +568,13 @@ int scale_init(int inWidth, int inHeight, int outWidth, int outHeight, int inFmt
         return -1;
     }
 
+    if( scale_alloc_jobs() < 0 || pipe(pipeResized) < 0 )
+    {
+        LOGE("Cannot allocate resizer descriptors.\n");
+        scale_free_jobs();
+        return -1;
+    }
+
     cb.LCML_Callback = ZoomCallback;
 
     pLcmlDsp = pLCML->dspCodec;
@@ -456,8 +595,6 @@ int scale_init(int inWidth, int inHeight, int outWidth, int outHeight, int inFmt
         return -1;
     }
 
-    sem_init( &semResized, 0 , 0 );
-    pipe(pipeResized);
     LOG_FUNCTION_NAME_EXIT
     return err;
 }
@@ -466,6 +603,12 @@ int scale_deinit()
 {
     OMX_ERRORTYPE err;
 
+    /* the descriptors and buffers of frames still in flight belong to the DSP */
+    pthread_mutex_lock(&scaleLock);
+    if (scaleSubmitted != scaleRetired)
+        scale_wait_locked(scaleSubmitted - 1);
+    pthread_mutex_unlock(&scaleLock);
+
     err = LCML_ControlCodec( pLCML->pCodecinterfacehandle, MMCodecControlStop, NULL );
     if( err != OMX_ErrorNone )
     {
@@ -479,8 +622,8 @@ int scale_deinit()
         LOGV("LCML_ControlCodec(MMCodecControlStop) error=0x%08x\n", err);
         return -1;
     }
-    sem_destroy(&semResized);
-    
+    scale_free_jobs();
+
     close(pipeResized[READ_END]);
     close(pipeResized[WRITE_END]);    
     return 0;
@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2011 r3d4
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "scale_sw.h"
+
+/*
+ * Every format is taken apart into Y, U and V channels, each a grid of
+ * samples some bytes apart (2 for Y in UYVY, 4 for its U and V, ...), and
+ * each channel is scaled on its own. Sample centres are lined up, so
+ * UYVY to I420 comes out as a 2:1 chroma average.
+ *
+ * The fast path is separable: two source rows are blended into a row
+ * buffer, NEON doing 16 bytes at a time, then the output row is picked
+ * from it through a table of horizontal taps. Channels that come from
+ * the same rows (all of UYVY, the VU plane of NV21) share the blend.
+ * Both passes round the same way the reference does, so the two give
+ * identical output.
+ */
+
+#define SCALE_SW_CHANNELS   3
+
+typedef struct ScaleSwChannel {
+    uint8_t*    plane;      /* row 0 */
+    int         offset;     /* byte of sample 0 within a row */
+    int         stride;     /* bytes per row */
+    int         step;       /* bytes between samples */
+    int         width;      /* in samples */
+    int         height;
+} ScaleSwChannel;
+
+typedef struct ScaleSwJob {
+    ScaleSwChannel  src;
+    ScaleSwChannel  dst;
+    int             cropX;  /* in samples of this channel */
+    int             cropY;
+    int             cropWidth;
+    int             cropHeight;
+} ScaleSwJob;
+
+/* horizontal taps of one output sample, byte offsets within a source row */
+typedef struct ScaleSwTap {
+    int         i0;
+    int         i1;
+    int         f;
+} ScaleSwTap;
+
+/* tap tables and the row buffer, kept between frames */
+static pthread_mutex_t  scaleSwLock = PTHREAD_MUTEX_INITIALIZER;
+static void*            scaleSwScratch;
+static size_t           scaleSwScratchSize;
+
+static void scale_sw_channel(ScaleSwChannel* ch, uint8_t* plane, int offset, int stride, int step, int width, int height)
+{
+    ch->plane  = plane;
+    ch->offset = offset;
+    ch->stride = stride;
+    ch->step   = step;
+    ch->width  = width;
+    ch->height = height;
+}
+
+static int scale_sw_layout(int fmt, uint8_t* base, int width, int height, ScaleSwChannel ch[SCALE_SW_CHANNELS])
+{
+    int ySize = width * height;
+    int cWidth = width / 2;
+    int cHeight = height / 2;
+
+    if (width <= 0 || height <= 0 || (width & 1))
+        return -1;
+
+    switch (fmt) {
+    case SCALE_SW_UYVY:
+        scale_sw_channel(&ch[0], base, 1, width * 2, 2, width, height);
+        scale_sw_channel(&ch[1], base, 0, width * 2, 4, cWidth, height);
+        scale_sw_channel(&ch[2], base, 2, width * 2, 4, cWidth, height);
+        return 0;
+
+    case SCALE_SW_I420:
+        if (height & 1)
+            return -1;
+        scale_sw_channel(&ch[0], base, 0, width, 1, width, height);
+        scale_sw_channel(&ch[1], base + ySize, 0, cWidth, 1, cWidth, cHeight);
+        scale_sw_channel(&ch[2], base + ySize + cWidth * cHeight, 0, cWidth, 1, cWidth, cHeight);
+        return 0;
+
+    case SCALE_SW_NV21:
+        if (height & 1)
+            return -1;
+        scale_sw_channel(&ch[0], base, 0, width, 1, width, height);
+        scale_sw_channel(&ch[1], base + ySize, 1, width, 2, cWidth, cHeight);
+        scale_sw_channel(&ch[2], base + ySize, 0, width, 2, cWidth, cHeight);
+        return 0;
+    }
+    return -1;
+}
+
+/* splits the request into one job per channel, the crop moved to even luma coordinates */
+static int scale_sw_jobs(const void* in, int inWidth, int inHeight, int inFmt,
+                         int cropX, int cropY, int cropWidth, int cropHeight,
+                         void* out, int outWidth, int outHeight, int outFmt,
+                         ScaleSwJob job[SCALE_SW_CHANNELS])
+{
+    ScaleSwChannel src[SCALE_SW_CHANNELS], dst[SCALE_SW_CHANNELS];
+    int c;
+
+    if (in == NULL || out == NULL ||
+        scale_sw_layout(inFmt, (uint8_t*)in, inWidth, inHeight, src) < 0 ||
+        scale_sw_layout(outFmt, (uint8_t*)out, outWidth, outHeight, dst) < 0) {
+        return -1;
+    }
+
+    cropX &= ~1;
+    cropY &= ~1;
+    cropWidth &= ~1;
+    cropHeight &= ~1;
+    if (cropX < 0 || cropY < 0 || cropWidth <= 0 || cropHeight <= 0 ||
+        cropX + cropWidth > inWidth || cropY + cropHeight > inHeight) {
+        return -1;
+    }
+
+    for (c = 0; c < SCALE_SW_CHANNELS; c++) {
+        int xSub = inWidth / src[c].width;
+        int ySub = inHeight / src[c].height;
+
+        job[c].src = src[c];
+        job[c].dst = dst[c];
+        job[c].cropX = cropX / xSub;
+        job[c].cropY = cropY / ySub;
+        job[c].cropWidth = cropWidth / xSub;
+        job[c].cropHeight = cropHeight / ySub;
+    }
+    return 0;
+}
+
+/* where output sample d falls between two of srcLen source samples, weight in 1/256 */
+static void scale_sw_map(int d, int srcLen, int dstLen, int* i0, int* i1, int* f)
+{
+    /* (d + 0.5) * srcLen / dstLen - 0.5, in 1/65536 */
+    long long pos = (((long long)(2 * d + 1) * srcLen) << 16) / (2 * dstLen) - 32768;
+
+    if (pos < 0)
+        pos = 0;
+    *i0 = (int)(pos >> 16);
+    *f = (int)(pos >> 8) & 0xff;
+    if (*i0 >= srcLen - 1) {
+        *i0 = srcLen - 1;
+        *f = 0;
+    }
+    *i1 = *f ? *i0 + 1 : *i0;
+}
+
+static inline int scale_sw_blend(int a, int b, int f)
+{
+    return (a * (256 - f) + b * f + 128) >> 8;
+}
+
+/* dst = r0 and r1 blended, f in 1..255 */
+static void scale_sw_blend_rows(uint8_t* dst, const uint8_t* r0, const uint8_t* r1, int n, int f)
+{
+    int i = 0;
+
+#ifdef __ARM_NEON__
+    uint8x8_t w0 = vdup_n_u8(256 - f);
+    uint8x8_t w1 = vdup_n_u8(f);
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t a = vld1q_u8(r0 + i);
+        uint8x16_t b = vld1q_u8(r1 + i);
+        uint16x8_t lo = vmull_u8(vget_low_u8(a), w0);
+        uint16x8_t hi = vmull_u8(vget_high_u8(a), w0);
+
+        lo = vmlal_u8(lo, vget_low_u8(b), w1);
+        hi = vmlal_u8(hi, vget_high_u8(b), w1);
+        /* vrshrn is the same +128 >> 8 as scale_sw_blend() */
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+    }
+#endif
+
+    for (; i < n; i++)
+        dst[i] = scale_sw_blend(r0[i], r1[i], f);
+}
+
+/* do jobs a and b read the same source rows into the same number of output rows */
+static int scale_sw_same_rows(const ScaleSwJob* a, const ScaleSwJob* b)
+{
+    return a->src.plane == b->src.plane && a->src.stride == b->src.stride &&
+           a->cropY == b->cropY && a->cropHeight == b->cropHeight &&
+           a->dst.height == b->dst.height;
+}
+
+static void scale_sw_group(const ScaleSwJob* job, int n, ScaleSwTap* taps, uint8_t* rowBuf)
+{
+    const ScaleSwChannel* src = &job[0].src;
+    ScaleSwTap* channelTaps[SCALE_SW_CHANNELS];
+    int spanStart = INT_MAX, spanEnd = 0;
+    int blendSpan;
+    int c, x, y;
+
+    for (c = 0; c < n; c++) {
+        const ScaleSwJob* j = &job[c];
+
+        channelTaps[c] = taps;
+        for (x = 0; x < j->dst.width; x++, taps++) {
+            int x0, x1, f;
+
+            scale_sw_map(x, j->cropWidth, j->dst.width, &x0, &x1, &f);
+            taps->i0 = j->src.offset + (j->cropX + x0) * j->src.step;
+            taps->i1 = j->src.offset + (j->cropX + x1) * j->src.step;
+            taps->f = f;
+            if (taps->i0 < spanStart)
+                spanStart = taps->i0;
+            if (taps->i1 >= spanEnd)
+                spanEnd = taps->i1 + 1;
+        }
+    }
+
+    /* shrinking a lot the taps touch fewer bytes than the span, blend those only */
+    blendSpan = spanEnd - spanStart <= 2 * (int)(taps - channelTaps[0]);
+
+    for (y = 0; y < job[0].dst.height; y++) {
+        const uint8_t* row;
+        int y0, y1, fy;
+
+        scale_sw_map(y, job[0].cropHeight, job[0].dst.height, &y0, &y1, &fy);
+        row = src->plane + (job[0].cropY + y0) * src->stride;
+        if (fy && !blendSpan) {
+            const uint8_t* row1 = src->plane + (job[0].cropY + y1) * src->stride;
+
+            for (c = 0; c < n; c++) {
+                const ScaleSwChannel* dst = &job[c].dst;
+                const ScaleSwTap* t = channelTaps[c];
+                uint8_t* d = dst->plane + y * dst->stride + dst->offset;
+
+                for (x = 0; x < dst->width; x++, t++, d += dst->step)
+                    *d = scale_sw_blend(scale_sw_blend(row[t->i0], row1[t->i0], fy),
+                                        scale_sw_blend(row[t->i1], row1[t->i1], fy), t->f);
+            }
+            continue;
+        }
+        if (fy) {
+            /* only the bytes the taps read */
+            scale_sw_blend_rows(rowBuf + spanStart, row + spanStart,
+                                src->plane + (job[0].cropY + y1) * src->stride + spanStart,
+                                spanEnd - spanStart, fy);
+            row = rowBuf;
+        }
+
+        for (c = 0; c < n; c++) {
+            const ScaleSwChannel* dst = &job[c].dst;
+            const ScaleSwTap* t = channelTaps[c];
+            uint8_t* d = dst->plane + y * dst->stride + dst->offset;
+
+            for (x = 0; x < dst->width; x++, t++, d += dst->step)
+                *d = scale_sw_blend(row[t->i0], row[t->i1], t->f);
+        }
+    }
+}
+
+int scale_sw_crop(const void* in, int inWidth, int inHeight, int inFmt,
+                  int cropX, int cropY, int cropWidth, int cropHeight,
+                  void* out, int outWidth, int outHeight, int outFmt)
+{
+    ScaleSwJob job[SCALE_SW_CHANNELS];
+    size_t taps = 0, rowBytes = 0, size;
+    int c, n;
+
+    if (scale_sw_jobs(in, inWidth, inHeight, inFmt, cropX, cropY, cropWidth, cropHeight,
+                      out, outWidth, outHeight, outFmt, job) < 0) {
+        return -1;
+    }
+
+    for (c = 0; c < SCALE_SW_CHANNELS; c++) {
+        taps += job[c].dst.width;
+        if ((size_t)job[c].src.stride > rowBytes)
+            rowBytes = job[c].src.stride;
+    }
+    size = taps * sizeof(ScaleSwTap) + rowBytes;
+
+    pthread_mutex_lock(&scaleSwLock);
+    if (size > scaleSwScratchSize) {
+        void* scratch = realloc(scaleSwScratch, size);
+
+        if (scratch == NULL) {
+            pthread_mutex_unlock(&scaleSwLock);
+            return -1;
+        }
+        scaleSwScratch = scratch;
+        scaleSwScratchSize = size;
+    }
+
+    for (c = 0; c < SCALE_SW_CHANNELS; c += n) {
+        for (n = 1; c + n < SCALE_SW_CHANNELS && scale_sw_same_rows(&job[c], &job[c + n]); n++)
+            ;
+        scale_sw_group(&job[c], n, (ScaleSwTap*)scaleSwScratch,
+                       (uint8_t*)scaleSwScratch + taps * sizeof(ScaleSwTap));
+    }
+    pthread_mutex_unlock(&scaleSwLock);
+
+    return 0;
+}
+
+int scale_sw_crop_ref(const void* in, int inWidth, int inHeight, int inFmt,
+                      int cropX, int cropY, int cropWidth, int cropHeight,
+                      void* out, int outWidth, int outHeight, int outFmt)
+{
+    ScaleSwJob job[SCALE_SW_CHANNELS];
+    int c, x, y;
+
+    if (scale_sw_jobs(in, inWidth, inHeight, inFmt, cropX, cropY, cropWidth, cropHeight,
+                      out, outWidth, outHeight, outFmt, job) < 0) {
+        return -1;
+    }
+
+    for (c = 0; c < SCALE_SW_CHANNELS; c++) {
+        const ScaleSwChannel* src = &job[c].src;
+        const ScaleSwChannel* dst = &job[c].dst;
+
+        for (y = 0; y < dst->height; y++) {
+            const uint8_t *r0, *r1;
+            int y0, y1, fy;
+
+            scale_sw_map(y, job[c].cropHeight, dst->height, &y0, &y1, &fy);
+            r0 = src->plane + (job[c].cropY + y0) * src->stride + src->offset;
+            r1 = src->plane + (job[c].cropY + y1) * src->stride + src->offset;
+
+            for (x = 0; x < dst->width; x++) {
+                int x0, x1, fx, v0, v1;
+
+                scale_sw_map(x, job[c].cropWidth, dst->width, &x0, &x1, &fx);
+                x0 = (job[c].cropX + x0) * src->step;
+                x1 = (job[c].cropX + x1) * src->step;
+                v0 = scale_sw_blend(r0[x0], r1[x0], fy);
+                v1 = scale_sw_blend(r0[x1], r1[x1], fy);
+                dst->plane[y * dst->stride + dst->offset + x * dst->step] = scale_sw_blend(v0, v1, fx);
+            }
+        }
+    }
+    return 0;
+}
+
+int scale_sw_process(void* inBuffer, int inWidth, int inHeight, void* outBuffer, int outWidth, int outHeight, int rotation, int fmt, float zoom)
+{
+    int cropWidth, cropHeight;
+
+    if (rotation != 0)
+        return -1;
+
+    /* what scale_process() has the DSP take: the 3:4 centre, 16 pixel aligned */
+    cropWidth = (inHeight * 3 / 4 + 15) & ~15;
+    if (cropWidth > inWidth)
+        cropWidth = inWidth;
+    cropHeight = inHeight;
+
+    if (zoom > 1.0f) {
+        cropWidth = (int)(cropWidth / zoom);
+        cropHeight = (int)(cropHeight / zoom);
+    }
+
+    return scale_sw_crop(inBuffer, inWidth, inHeight, SCALE_SW_UYVY,
+                         (inWidth - cropWidth) / 2, (inHeight - cropHeight) / 2, cropWidth, cropHeight,
+                         outBuffer, outWidth, outHeight, fmt ? SCALE_SW_I420 : SCALE_SW_UYVY);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2011 r3d4
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * ARM scaler/cropper, for when the DSP resizer in scale.c is not there or
+ * not worth the round trip. Bilinear, 8 bit fixed point weights.
+ */
+
+#ifndef _SCALE_SW_H_
+#define _SCALE_SW_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the first two match PIX_YUV422I and PIX_YUV420P, as scale_process() takes them */
+#define SCALE_SW_UYVY       0   /* 4:2:2 interleaved, U Y V Y */
+#define SCALE_SW_I420       1   /* 4:2:0 planar, Y then U then V */
+#define SCALE_SW_NV21       2   /* 4:2:0 semi-planar, Y then interleaved V U */
+
+/*
+ * Scales the cropWidth x cropHeight window at (cropX, cropY) of in to fill
+ * all of out. The window is in luma pixels and is moved to even
+ * coordinates so chroma stays aligned. Formats may differ, e.g. UYVY in
+ * and I420 out. Returns 0, or -1 for arguments it cannot handle.
+ */
+int scale_sw_crop(const void* in, int inWidth, int inHeight, int inFmt,
+                  int cropX, int cropY, int cropWidth, int cropHeight,
+                  void* out, int outWidth, int outHeight, int outFmt);
+
+/* same result, one output sample at a time without NEON, for checking */
+int scale_sw_crop_ref(const void* in, int inWidth, int inHeight, int inFmt,
+                      int cropX, int cropY, int cropWidth, int cropHeight,
+                      void* out, int outWidth, int outHeight, int outFmt);
+
+/*
+ * Drop-in for scale_process(): UYVY in, fmt selects UYVY or I420 out, the
+ * same centre crop as the DSP path narrowed further by zoom. Only
+ * rotation 0, anything else is -1 and left to the DSP.
+ */
+int scale_sw_process(void* inBuffer, int inWidth, int inHeight, void* outBuffer, int outWidth, int outHeight, int rotation, int fmt, float zoom);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCALE_SW_H_ */
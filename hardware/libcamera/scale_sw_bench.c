@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2011 r3d4
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * usage: scale_sw_bench [-n iterations] [-r random cases]
+ *
+ * Times scale_sw_crop() against scale_sw_crop_ref() on the frame sizes
+ * the HAL sees and checks the two agree byte for byte, then does the
+ * same check on random sizes, crops and formats. Runs on the host, and
+ * on the device to get the NEON numbers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "scale_sw.h"
+
+struct bench_case {
+    const char* name;
+    int inWidth, inHeight, inFmt;
+    int cropX, cropY, cropWidth, cropHeight;
+    int outWidth, outHeight, outFmt;
+};
+
+static const struct bench_case s_cases[] = {
+    { "preview 3:4 crop, as scale_process", 640, 480, SCALE_SW_UYVY, 136, 0, 368, 480, 640, 480, SCALE_SW_UYVY },
+    { "preview to QVGA I420 callback",      640, 480, SCALE_SW_UYVY,   0, 0, 640, 480, 320, 240, SCALE_SW_I420 },
+    { "720p NV21 4:3 crop to VGA",         1280, 720, SCALE_SW_NV21, 160, 0, 960, 720, 640, 480, SCALE_SW_NV21 },
+    { "QVGA I420 up to VGA",                320, 240, SCALE_SW_I420,   0, 0, 320, 240, 640, 480, SCALE_SW_I420 },
+    { "5M capture to VGA thumbnail",       2560, 1920, SCALE_SW_UYVY,  0, 0, 2560, 1920, 640, 480, SCALE_SW_UYVY },
+};
+
+static const char* s_fmtNames[] = { "UYVY", "I420", "NV21" };
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static size_t frame_size(int width, int height, int fmt)
+{
+    return fmt == SCALE_SW_UYVY ? (size_t)width * height * 2 : (size_t)width * height * 3 / 2;
+}
+
+static unsigned char* random_frame(size_t size)
+{
+    unsigned char* p = (unsigned char*)malloc(size);
+    size_t i;
+
+    for (i = 0; p && i < size; i++)
+        p[i] = rand() & 0xff;
+    return p;
+}
+
+typedef int (*scale_fn)(const void*, int, int, int, int, int, int, int, void*, int, int, int);
+
+static int run(scale_fn fn, const struct bench_case* c, const void* in, void* out)
+{
+    return fn(in, c->inWidth, c->inHeight, c->inFmt, c->cropX, c->cropY, c->cropWidth, c->cropHeight,
+              out, c->outWidth, c->outHeight, c->outFmt);
+}
+
+static double time_ms(scale_fn fn, const struct bench_case* c, const void* in, void* out, int iterations)
+{
+    double start = now_ms();
+    int i;
+
+    for (i = 0; i < iterations; i++)
+        run(fn, c, in, out);
+    return (now_ms() - start) / iterations;
+}
+
+// 0 if the fast path and the reference agree
+static int check(const struct bench_case* c, const void* in, unsigned char* out, unsigned char* ref)
+{
+    size_t size = frame_size(c->outWidth, c->outHeight, c->outFmt);
+
+    memset(out, 0x55, size);
+    memset(ref, 0xaa, size);
+    if (run(scale_sw_crop, c, in, out) < 0 || run(scale_sw_crop_ref, c, in, ref) < 0)
+        return -1;
+    return memcmp(out, ref, size) ? -1 : 0;
+}
+
+static int random_cases(int count)
+{
+    int i, bad = 0;
+
+    for (i = 0; i < count; i++) {
+        struct bench_case c;
+        unsigned char *in, *out, *ref;
+
+        c.name = "random";
+        c.inFmt = rand() % 3;
+        c.outFmt = c.inFmt == SCALE_SW_UYVY ? rand() % 3 : c.inFmt;
+        c.inWidth = 2 * (1 + rand() % 96);
+        c.inHeight = 2 * (1 + rand() % 72);
+        c.cropWidth = 2 * (1 + rand() % (c.inWidth / 2));
+        c.cropHeight = 2 * (1 + rand() % (c.inHeight / 2));
+        c.cropX = 2 * (rand() % ((c.inWidth - c.cropWidth) / 2 + 1));
+        c.cropY = 2 * (rand() % ((c.inHeight - c.cropHeight) / 2 + 1));
+        c.outWidth = 2 * (1 + rand() % 96);
+        c.outHeight = 2 * (1 + rand() % 72);
+
+        in = random_frame(frame_size(c.inWidth, c.inHeight, c.inFmt));
+        out = (unsigned char*)malloc(frame_size(c.outWidth, c.outHeight, c.outFmt));
+        ref = (unsigned char*)malloc(frame_size(c.outWidth, c.outHeight, c.outFmt));
+        if (check(&c, in, out, ref) < 0) {
+            printf("MISMATCH %s %dx%d (%d,%d %dx%d) -> %s %dx%d\n", s_fmtNames[c.inFmt],
+                   c.inWidth, c.inHeight, c.cropX, c.cropY, c.cropWidth, c.cropHeight,
+                   s_fmtNames[c.outFmt], c.outWidth, c.outHeight);
+            bad++;
+        }
+        free(in);
+        free(out);
+        free(ref);
+    }
+    return bad;
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = 50, randomCount = 500;
+    int i, opt, bad = 0;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+        case 'n': iterations = atoi(optarg); break;
+        case 'r': randomCount = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-r random cases]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iterations < 1)
+        iterations = 1;
+
+#ifdef __ARM_NEON__
+    printf("scale_sw_crop with NEON, %d iterations\n", iterations);
+#else
+    printf("scale_sw_crop without NEON, %d iterations\n", iterations);
+#endif
+    printf("%-36s %-24s %9s %9s %8s %6s\n", "case", "in -> out", "ref ms", "fast ms", "Mpix/s", "exact");
+
+    for (i = 0; i < (int)(sizeof(s_cases) / sizeof(s_cases[0])); i++) {
+        const struct bench_case* c = &s_cases[i];
+        unsigned char* in = random_frame(frame_size(c->inWidth, c->inHeight, c->inFmt));
+        unsigned char* out = (unsigned char*)malloc(frame_size(c->outWidth, c->outHeight, c->outFmt));
+        unsigned char* ref = (unsigned char*)malloc(frame_size(c->outWidth, c->outHeight, c->outFmt));
+        char sizes[64];
+        double refMs, fastMs;
+        int exact;
+
+        exact = check(c, in, out, ref) == 0;
+        bad += !exact;
+        refMs = time_ms(scale_sw_crop_ref, c, in, ref, iterations / 10 + 1);
+        fastMs = time_ms(scale_sw_crop, c, in, out, iterations);
+
+        snprintf(sizes, sizeof(sizes), "%s %dx%d->%s %dx%d", s_fmtNames[c->inFmt],
+                 c->inWidth, c->inHeight, s_fmtNames[c->outFmt], c->outWidth, c->outHeight);
+        printf("%-36s %-24s %9.2f %9.2f %8.1f %6s\n", c->name, sizes, refMs, fastMs,
+               c->outWidth * c->outHeight / fastMs / 1000.0, exact ? "yes" : "NO");
+
+        free(in);
+        free(out);
+        free(ref);
+    }
+
+    i = random_cases(randomCount);
+    printf("%d random cases, %d mismatches\n", randomCount, i);
+    bad += i;
+
+    return bad ? 1 : 0;
+}
@@ -2,8 +2,26 @@ LOCAL_PATH:= $(call my-dir)
 
 include $(CLEAR_VARS)
 LOCAL_PRELINK_MODULE := false
-LOCAL_SRC_FILES := libril-h1.c libril-h1_ipc.c
+LOCAL_SRC_FILES := libril-h1.c libril-h1_ipc.c libril-h1_trace.c libril-h1_unsol.c
 LOCAL_MODULE := libh1-ril
 LOCAL_MODULE_TAGS := optional
 LOCAL_SHARED_LIBRARIES += libdl libutils libcutils
 include $(BUILD_SHARED_LIBRARY)
+
+# host load test: ril_bench plays libril, libfake-secril stands in for
+# libsec-ril.so and the libsecril-client socket
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := fake-secril.c
+LOCAL_MODULE := libfake-secril
+LOCAL_MODULE_TAGS := debug
+LOCAL_LDLIBS += -lpthread
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := ril_bench.c libril-h1.c libril-h1_ipc.c libril-h1_trace.c libril-h1_unsol.c
+LOCAL_MODULE := ril_bench
+LOCAL_MODULE_TAGS := debug
+LOCAL_CFLAGS += -DLIBSEC_RIL_PATH=\"libfake-secril.so\"
+LOCAL_STATIC_LIBRARIES := libcutils
+LOCAL_LDLIBS += -ldl -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
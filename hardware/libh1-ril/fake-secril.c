@@ -0,0 +1,418 @@
+/* /device/samsung/nowplus/hardware/libh1-ril/fake-secril.c
+**
+** Copyright 2011, r3d4
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+** scripted stand-in for libsec-ril.so and the libsecril-client socket,
+** for load testing libh1-ril on a Linux host (see ril_bench.c)
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <telephony/ril.h>
+
+#define LOG_TAG "FAKESECRIL"
+
+#include <utils/Log.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "libril-h1.h"
+#include "fake-secril.h"
+
+/*
+ * Like the real modem, requests are served one at a time in arrival
+ * order, so a slow one holds up everything queued behind it. Service
+ * times and unsolicited rates come from the script passed as
+ * "-s <file>" in the RIL_Init arguments:
+ *
+ *   req     <request> <service ms> [jitter ms] [failures per 100]
+ *   unsol   <response> <per second> [burst]
+ *   default <service ms>
+ *
+ * Other lines (ril_bench's "load") are ignored.
+ */
+
+#define FAKE_REQ_MAX    128
+#define FAKE_UNSOL_MAX  16
+
+struct fake_req {
+    int service_ms;
+    int jitter_ms;
+    int fail_pct;
+};
+
+struct fake_unsol {
+    int id;
+    double per_s;
+    int burst;
+    long long next_us;
+};
+
+struct fake_pending {
+    int request;
+    RIL_Token t;
+    struct fake_pending *next;
+};
+
+static const struct RIL_Env *s_env;
+static struct fake_req s_req[FAKE_REQ_MAX];
+static struct fake_unsol s_unsol[FAKE_UNSOL_MAX];
+static int s_unsolCount = 0;
+static unsigned s_seed = 1;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static struct fake_pending *s_head = NULL, *s_tail = NULL;
+static struct fake_secril_stats s_stats;
+
+static long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static void sleep_until(long long us)
+{
+    long long left = us - now_us();
+    if(left > 0)
+        usleep(left);
+}
+
+static void load_script(const char *path)
+{
+    char line[256];
+    int i;
+    FILE *f;
+
+    for(i = 0; i < FAKE_REQ_MAX; i++)
+        s_req[i].service_ms = 5;
+
+    if(!path)
+        return;
+    f = fopen(path, "r");
+    if(!f)
+    {
+        LOGE("cannot open script %s (%s)", path, strerror(errno));
+        return;
+    }
+
+    while(fgets(line, sizeof(line), f))
+    {
+        char kind[16];
+        int id, a = 0, b = 0, c = 0, burst = 1;
+        double rate;
+
+        if(sscanf(line, "%15s", kind) != 1 || kind[0] == '#')
+            continue;
+
+        if(!strcmp(kind, "req") && sscanf(line, "%*s %d %d %d %d", &id, &a, &b, &c) >= 2
+                && id > 0 && id < FAKE_REQ_MAX)
+        {
+            s_req[id].service_ms = a;
+            s_req[id].jitter_ms = b;
+            s_req[id].fail_pct = c;
+        }
+        else if(!strcmp(kind, "unsol") && sscanf(line, "%*s %d %lf %d", &id, &rate, &burst) >= 2
+                && rate > 0 && s_unsolCount < FAKE_UNSOL_MAX)
+        {
+            s_unsol[s_unsolCount].id = id;
+            s_unsol[s_unsolCount].per_s = rate;
+            s_unsol[s_unsolCount].burst = burst > 0 ? burst : 1;
+            s_unsolCount++;
+        }
+        else if(!strcmp(kind, "default") && sscanf(line, "%*s %d", &a) == 1)
+        {
+            for(i = 0; i < FAKE_REQ_MAX; i++)
+                s_req[i].service_ms = a;
+        }
+    }
+    fclose(f);
+}
+
+static void *modem_thread(void *arg)
+{
+    for(;;)
+    {
+        struct fake_pending *p;
+        struct fake_req *r;
+        int ms;
+        RIL_Errno e = RIL_E_SUCCESS;
+
+        pthread_mutex_lock(&s_lock);
+        while(!s_head)
+            pthread_cond_wait(&s_cond, &s_lock);
+        p = s_head;
+        s_head = p->next;
+        if(!s_head)
+            s_tail = NULL;
+        pthread_mutex_unlock(&s_lock);
+
+        r = &s_req[p->request < FAKE_REQ_MAX ? p->request : 0];
+        ms = r->service_ms;
+        if(r->jitter_ms > 0)
+            ms += rand_r(&s_seed) % (2*r->jitter_ms + 1) - r->jitter_ms;
+        if(ms > 0)
+            usleep(ms * 1000);
+        if(r->fail_pct > 0 && (int)(rand_r(&s_seed) % 100) < r->fail_pct)
+            e = RIL_E_GENERIC_FAILURE;
+
+        s_env->OnRequestComplete(p->t, e, NULL, 0);
+        free(p);
+    }
+    return NULL;
+}
+
+// sends one response with a payload of the right shape; the payload
+// lives on the stack and is scribbled over afterwards, as libsec-ril's
+// would be
+static void send_unsol(int id, unsigned seq)
+{
+    int signal[7];
+    char apn[16], address[16];
+    RIL_Data_Call_Response call;
+    const void *data = NULL;
+    size_t datalen = 0;
+
+    if(id == RIL_UNSOL_SIGNAL_STRENGTH)
+    {
+        memset(signal, 0, sizeof(signal));
+        signal[0] = seq % 32;
+        signal[1] = 99;
+        data = signal;
+        datalen = sizeof(signal);
+    }
+    else if(id == RIL_UNSOL_DATA_CALL_LIST_CHANGED)
+    {
+        strcpy(apn, "internet");
+        snprintf(address, sizeof(address), "10.0.0.%u", seq % 250 + 1);
+        call.cid = 1;
+        call.active = 2;
+        call.type = "IP";
+        call.apn = apn;
+        call.address = address;
+        data = &call;
+        datalen = sizeof(call);
+    }
+
+    s_env->OnUnsolicitedResponse(id, data, datalen);
+
+    memset(signal, 0xff, sizeof(signal));
+    memset(apn, 'x', sizeof(apn) - 1);
+    memset(address, 'x', sizeof(address) - 1);
+}
+
+static void *unsol_thread(void *arg)
+{
+    long long now = now_us();
+    unsigned seq = 0;
+    int i;
+
+    for(i = 0; i < s_unsolCount; i++)
+        s_unsol[i].next_us = now + (long long)(1e6 / s_unsol[i].per_s);
+
+    for(;;)
+    {
+        struct fake_unsol *next = &s_unsol[0];
+
+        for(i = 1; i < s_unsolCount; i++)
+            if(s_unsol[i].next_us < next->next_us)
+                next = &s_unsol[i];
+
+        sleep_until(next->next_us);
+        next->next_us += (long long)(1e6 / next->per_s);
+
+        for(i = 0; i < next->burst; i++)
+        {
+            pthread_mutex_lock(&s_lock);
+            s_stats.unsolicited++;
+            pthread_mutex_unlock(&s_lock);
+            send_unsol(next->id, seq++);
+        }
+    }
+    return NULL;
+}
+
+// reads exactly len bytes, 0 on EOF or error
+static int read_full(int fd, unsigned char *buf, int len)
+{
+    while(len > 0)
+    {
+        int n = read(fd, buf, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return 0;
+        buf += n;
+        len -= n;
+    }
+    return 1;
+}
+
+// libsecril-client: two 12 byte headers, the second one carrying the
+// length of the command that follows in byte 2
+static void *client_thread(void *arg)
+{
+    int hServer = (int)(intptr_t)arg;
+
+    for(;;)
+    {
+        unsigned char hdr[24], data[256];
+        int hClient = accept(hServer, NULL, NULL);
+
+        if(hClient < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        pthread_mutex_lock(&s_lock);
+        s_stats.ipc_connections++;
+        pthread_mutex_unlock(&s_lock);
+
+        while(read_full(hClient, hdr, sizeof(hdr)))
+        {
+            int length = hdr[12 + 2];
+            int ok = length > 0 && read_full(hClient, data, length);
+
+            if(!ok)
+                break;
+            pthread_mutex_lock(&s_lock);
+            if(data[0] == length)
+                s_stats.ipc_frames++;
+            else
+                s_stats.ipc_bad_frames++;
+            pthread_mutex_unlock(&s_lock);
+        }
+        close(hClient);
+    }
+    close(hServer);
+    return NULL;
+}
+
+static int start_client_server()
+{
+    struct sockaddr_in addr;
+    pthread_t tid;
+    int one = 1;
+    int hServer = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if(hServer < 0)
+        return -1;
+    setsockopt(hServer, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(LIBSEC_RILC_IP);
+    addr.sin_port = htons(LIBSEC_RILC_PORT);
+    if(bind(hServer, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(hServer, 4) < 0)
+    {
+        LOGE("cannot listen on %s:%d (%s)", LIBSEC_RILC_IP, LIBSEC_RILC_PORT, strerror(errno));
+        close(hServer);
+        return -1;
+    }
+    return pthread_create(&tid, NULL, client_thread, (void *)(intptr_t)hServer);
+}
+
+// --------------- RIL_RadioFunctions --------------------
+
+static void fakeOnRequest(int request, void *data, size_t datalen, RIL_Token t)
+{
+    struct fake_pending *p = (struct fake_pending *)malloc(sizeof(*p));
+
+    p->request = request;
+    p->t = t;
+    p->next = NULL;
+
+    pthread_mutex_lock(&s_lock);
+    s_stats.requests++;
+    if(s_tail)
+        s_tail->next = p;
+    else
+        s_head = p;
+    s_tail = p;
+    pthread_cond_signal(&s_cond);
+    pthread_mutex_unlock(&s_lock);
+}
+
+static RIL_RadioState fakeCurrentState()
+{
+    return RADIO_STATE_SIM_READY;
+}
+
+static int fakeSupports(int requestCode)
+{
+    return 1;
+}
+
+static void fakeOnCancel(RIL_Token t)
+{
+}
+
+static const char *fakeGetVersion(void)
+{
+    return "fake-secril 1.0";
+}
+
+static const RIL_RadioFunctions s_callbacks = {
+    RIL_VERSION,
+    fakeOnRequest,
+    fakeCurrentState,
+    fakeSupports,
+    fakeOnCancel,
+    fakeGetVersion
+};
+
+void fake_secril_get_stats(struct fake_secril_stats *stats)
+{
+    pthread_mutex_lock(&s_lock);
+    *stats = s_stats;
+    pthread_mutex_unlock(&s_lock);
+}
+
+const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **argv)
+{
+    const char *script = NULL;
+    pthread_t tid;
+    int i;
+
+    for(i = 0; i + 1 < argc; i++)
+        if(!strcmp(argv[i], "-s"))
+            script = argv[i + 1];
+
+    s_env = env;
+    load_script(script);
+
+    if(pthread_create(&tid, NULL, modem_thread, NULL) != 0)
+        return NULL;
+    if(s_unsolCount && pthread_create(&tid, NULL, unsol_thread, NULL) != 0)
+        return NULL;
+    start_client_server();
+
+    LOGD("fake secril up, script %s, %d unsolicited sources", script ? script : "none",
+        s_unsolCount);
+    return &s_callbacks;
+}
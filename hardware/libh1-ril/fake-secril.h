@@ -0,0 +1,32 @@
+/* /device/samsung/nowplus/hardware/libh1-ril/fake-secril.h
+**
+** Copyright 2011, r3d4
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+*/
+#ifndef _FAKE_SECRIL_
+#define _FAKE_SECRIL_
+
+struct fake_secril_stats {
+    unsigned requests;          // handed to the fake modem
+    unsigned unsolicited;       // sent from the script
+    unsigned ipc_frames;        // well formed libsecril-client commands
+    unsigned ipc_bad_frames;
+    unsigned ipc_connections;
+};
+
+// looked up with dlsym() by ril_bench
+void fake_secril_get_stats(struct fake_secril_stats *stats);
+
+#endif
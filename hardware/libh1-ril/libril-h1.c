@@ -26,6 +26,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 #include <telephony/ril.h>
 
 //#define LOG_NDEBUG 0
@@ -88,10 +89,17 @@ const struct RIL_Env *secRilEnv = NULL;         //callbacks to libril
 
 static int g3GFixEnable = 1;
 static int gSmsFixEnable = 1;
+static int gVerbose = 0;
 
-struct myTrigger onCompleteTrigger;
-// static int onCompleteTrigger = NO_TRIGGER;
-// void (*onCompleteAction)();
+// every request/response passes through here, keep the string lookups
+// out unless persist.ril.h1.verbose is set
+#define VLOGV(...) do { if(gVerbose) LOGV(__VA_ARGS__); } while(0)
+
+// actions to run once libsec-ril completes a request, any number of
+// requests may carry one
+static pthread_mutex_t s_triggerLock = PTHREAD_MUTEX_INITIALIZER;
+static struct myTrigger *s_triggers = NULL;
+static volatile int s_triggerCount = 0;
 
 const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **argv)
 {
@@ -100,12 +108,16 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
 
     LOGV("RIL_Init()\n");
 
-    onCompleteTrigger.token = NO_TRIGGER;
-
     if(property_get("ro.ril.enable.3gfix", value, ""))
         g3GFixEnable = value[0]-'0';
     if(property_get("ro.ril.enable.smsfix", value, ""))
         gSmsFixEnable = value[0]-'0';
+    if(property_get("persist.ril.h1.verbose", value, ""))
+        gVerbose = value[0]-'0';
+    if(property_get("persist.ril.h1.trace", value, "") && value[0] == '1')
+        trace_start();
+    property_get("persist.ril.h1.unsol_ms", value, "500");
+    unsol_init(atoi(value));
 
     LOGD("3G Fix %s", g3GFixEnable?"enabled":"disabled");
     LOGD("SMS Fix %s", gSmsFixEnable?"enabled":"disabled");
@@ -146,6 +158,39 @@ err:
     return h1RilFuncs; //return wrapped ril functions
 }
 
+// --------------- completion triggers --------------------
+
+// unlinks and returns the trigger installed on token, if any
+static struct myTrigger *takeTrigger(int token)
+{
+    struct myTrigger **pp, *trig = NULL;
+
+    pthread_mutex_lock(&s_triggerLock);
+    for(pp = &s_triggers; *pp; pp = &(*pp)->next)
+    {
+        if((*pp)->token == token)
+        {
+            trig = *pp;
+            *pp = trig->next;
+            s_triggerCount--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_triggerLock);
+    return trig;
+}
+
+// runs on the libril event loop, not on the thread completing the request
+static void runTrigger(void *param)
+{
+    struct myTrigger *trig = (struct myTrigger *)param;
+
+    LOGD("runTrigger(): execute %s trigger, token=%d", trig->message, trig->token);
+    if(trig->action() != 0)
+        LOGE("runTrigger(): %s failed", trig->message);
+    free(trig);
+}
+
 // --------------- env wrapper --------------------
 void RIL_onRequestComplete(RIL_Token t, RIL_Errno e,
                            void *response, size_t responselen)
@@ -154,21 +199,29 @@ void RIL_onRequestComplete(RIL_Token t, RIL_Errno e,
         return;
 
     RequestInfo *pRI = (RequestInfo *)t;
-    int req = *(pRI->requestNumber);
-    int token = pRI->token;
+    int token = pRI->token;     // pRI is gone once libril has the response
 
-    LOGV("RIL_onRequestComplete(): %s (%d), token=%d", requestToString(req),  req, token);
+    VLOGV("RIL_onRequestComplete(): %s (%d), token=%d",
+        requestToString(*(pRI->requestNumber)), *(pRI->requestNumber), token);
+
+    if(trace_enabled)
+        trace_request_complete(token, e);
 
     // not send to libril, if we issued the request
     if(t!=lokalToken)
         secRilEnv->OnRequestComplete(t, e, response, responselen);
 
     //we have a installed trigger on this request ?
-    if(onCompleteTrigger.token == token)
+    if(s_triggerCount)
     {
-        LOGD("RIL_onRequestComplete(): execute %s trigger", onCompleteTrigger.message);
-        onCompleteTrigger.action();    //send ipc command to libsec-ril
-        onCompleteTrigger.token = NO_TRIGGER; //delete trigger
+        struct myTrigger *trig = takeTrigger(token);
+        if(trig && e == RIL_E_CANCELLED)
+        {
+            LOGD("RIL_onRequestComplete(): cancelled, dropping %s trigger", trig->message);
+            free(trig);
+        }
+        else if(trig)
+            RIL_requestTimedCallback(runTrigger, trig, NULL);
     }
 }
 
@@ -178,8 +231,10 @@ void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
     if(!secRilEnv)
         return;
 
-    LOGV("RIL_onUnsolicitedResponse() < %s (%d)", requestToString(unsolResponse), unsolResponse);
-    secRilEnv->OnUnsolicitedResponse(unsolResponse, data, datalen);
+    VLOGV("RIL_onUnsolicitedResponse() < %s (%d)", requestToString(unsolResponse), unsolResponse);
+    if(trace_enabled)
+        trace_unsolicited(unsolResponse);
+    unsol_forward(unsolResponse, data, datalen);
 }
 
 void RIL_requestTimedCallback (RIL_TimedCallback callback,
@@ -188,7 +243,7 @@ void RIL_requestTimedCallback (RIL_TimedCallback callback,
     if(!secRilEnv)
         return;
 
-    LOGV("RIL_requestTimedCallback()");
+    VLOGV("RIL_requestTimedCallback()");
     secRilEnv->RequestTimedCallback(callback, param, relativeTime);
 }
 
@@ -245,18 +300,26 @@ static void requestSMSAcknowledge(void *data, size_t datalen, RIL_Token t)
 error:
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
 }
-// struct myTrigger {
-    // int token;
-    // int (*action)();
-    // char *message;
-// };
 static void installOnReqCompleteTrigger(RIL_Token t, int (*action)(), char *message)
 {
     RequestInfo *pRI = (RequestInfo *)t;
-    LOGV("requestRadioPower():install trigger, token=%d", pRI->token);
-    onCompleteTrigger.token = pRI->token;
-    onCompleteTrigger.action = action;
-    onCompleteTrigger.message = message;
+    struct myTrigger *trig = (struct myTrigger *)malloc(sizeof(*trig));
+
+    if(!trig)
+    {
+        LOGE("installOnReqCompleteTrigger(): no memory for %s trigger", message);
+        return;
+    }
+    VLOGV("installOnReqCompleteTrigger(): %s, token=%d", message, pRI->token);
+    trig->token = pRI->token;
+    trig->action = action;
+    trig->message = message;
+
+    pthread_mutex_lock(&s_triggerLock);
+    trig->next = s_triggers;
+    s_triggers = trig;
+    s_triggerCount++;
+    pthread_mutex_unlock(&s_triggerLock);
 }
 
 void onRequest (int request, void *data, size_t datalen, RIL_Token t)
@@ -267,7 +330,9 @@ void onRequest (int request, void *data, size_t datalen, RIL_Token t)
     int replaceRequest = 0; //if set secril request will no be executed
     RequestInfo *pRI = (RequestInfo *)t;
 
-    LOGV("onRequest() > %s (%d), token=%d", requestToString(request), request, pRI->token);
+    VLOGV("onRequest() > %s (%d), token=%d", requestToString(request), request, pRI->token);
+    if(trace_enabled)
+        trace_request_start(request, pRI->token);
 
     //do pre processing
     switch(request)
@@ -280,6 +345,10 @@ void onRequest (int request, void *data, size_t datalen, RIL_Token t)
             }
             break;
 
+        case RIL_REQUEST_SCREEN_STATE:
+            unsol_screen_state(((int *)data)[0]);
+            break;
+
         case RIL_REQUEST_RADIO_POWER:
             if(g3GFixEnable)
             {
@@ -301,7 +370,7 @@ RIL_RadioState currentState()
     if(!secRilFuncs)
         return RADIO_STATE_UNAVAILABLE;
 
-    LOGV("currentState()");
+    VLOGV("currentState()");
     RIL_RadioState ret = secRilFuncs->onStateRequest();
 
     return ret;
@@ -311,7 +380,7 @@ int onSupports (int requestCode)
 {
     if(!secRilFuncs)
         return 0;
-    LOGV("onSupports() requestCode= %d", requestCode);
+    VLOGV("onSupports() requestCode= %d", requestCode);
     int ret = secRilFuncs->supports(requestCode);
 
     return ret;
@@ -321,7 +390,9 @@ void onCancel (RIL_Token t)
 {
     if(!secRilFuncs)
         return;
-    LOGV("onCancel()");
+    VLOGV("onCancel()");
+    // the request still completes, with RIL_E_CANCELLED if the cancel won:
+    // its trigger stays until then, see RIL_onRequestComplete()
     secRilFuncs->onCancel(t);
 }
 
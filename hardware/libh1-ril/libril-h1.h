@@ -20,9 +20,9 @@
 #ifndef _LIBRIL_H1_
 #define _LIBRIL_H1_
 
-#define NO_TRIGGER  -1
-
+#ifndef LIBSEC_RIL_PATH
 #define LIBSEC_RIL_PATH      "/system/lib/libsec-ril.so"
+#endif
 #define LIBSEC_RILC_IP       "127.0.0.1"
 #define LIBSEC_RILC_PORT     7203
 
@@ -48,6 +48,32 @@ int ipc_disconnect(int hSocket);
 int ipc_send(int hSocket, unsigned char* data, int length);
 int ipc_send_data( unsigned char* data, int length, int dir);
 
+struct ipc_stats {
+    unsigned sent;              // commands written to libsecril-client
+    unsigned dropped;           // queue full or peer unreachable
+    unsigned reconnects;        // connections opened
+    unsigned lat_last_us;       // queued to written
+    unsigned lat_max_us;
+    unsigned long long lat_total_us;
+};
+void ipc_get_stats(struct ipc_stats *stats);
+
+//request tracing, see libril-h1_trace.c
+#define TRACE_SOCKET_NAME    "h1-ril-trace"
+
+extern int trace_enabled;
+void trace_start();
+void trace_request_start(int request, int token);
+void trace_request_complete(int token, RIL_Errno e);
+void trace_unsolicited(int unsolResponse);
+void trace_dump(int fd);
+
+//unsolicited response coalescing, see libril-h1_unsol.c
+void unsol_init(int windowMs);
+void unsol_forward(int unsolResponse, const void *data, size_t datalen);
+void unsol_screen_state(int on);
+void unsol_dump(int fd);
+
 struct RIL_Env {
     void (*OnRequestComplete)(RIL_Token t, RIL_Errno e,
                            void *response, size_t responselen);
@@ -57,6 +83,10 @@ struct RIL_Env {
                                    void *param, const struct timeval *relativeTime);
 };
 
+const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **argv);
+
+extern const struct RIL_Env *secRilEnv;         //callbacks to libril
+
 typedef struct RequestInfo {
     int32_t token;      //this is not RIL_Token
     int *requestNumber;
@@ -66,6 +96,7 @@ struct myTrigger {
     int token;
     int (*action)();
     char *message;
+    struct myTrigger *next;
 };
 
 enum {
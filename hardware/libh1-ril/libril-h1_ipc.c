@@ -26,6 +26,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
 #include <telephony/ril.h>
 
 //#define LOG_NDEBUG 0
@@ -40,6 +43,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
@@ -52,6 +56,34 @@
 
 #define SOCKET_ERROR        -1
 
+#define IPC_HDR_SIZE        12
+#define IPC_FRAME_MAX       (2*IPC_HDR_SIZE + 255)
+#define IPC_QUEUE_LEN       16
+#define IPC_MAX_ATTEMPTS    5       // connects/writes before a frame is dropped
+#define IPC_BACKOFF_MIN_MS  100
+#define IPC_BACKOFF_MAX_MS  3200
+#define IPC_STATS_EVERY     32      // sends between statistics log lines
+
+/* Commands are queued by the RIL request thread and written by a sender
+ * thread over one connection to libsecril-client, which is reopened
+ * when the peer goes away. ro.ril.ipc.persistent=0 connects per
+ * command as before, still off the request thread. */
+struct ipc_frame {
+    int length;
+    long long queued_us;
+    unsigned char data[IPC_FRAME_MAX];
+};
+
+static pthread_once_t s_ipcOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t s_ipcLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_ipcCond = PTHREAD_COND_INITIALIZER;
+static int s_ipcStarted = 0;
+static int s_ipcPersistent = 1;
+static struct ipc_frame s_ipcQueue[IPC_QUEUE_LEN];
+static int s_ipcHead = 0;
+static int s_ipcCount = 0;
+static struct ipc_stats s_ipcStats;
+
 //connect to libsecril-client via socket
 int ipc_connect()
 {
@@ -76,9 +108,14 @@ int ipc_connect()
     if(connect(hSocket,(struct sockaddr*)&Address,sizeof(Address)) == SOCKET_ERROR)
     {
         LOGE("Could not connect to host");
+        close(hSocket);
         return 0;
     }
 
+    /* commands are single small frames, don't let Nagle hold them back */
+    int one = 1;
+    setsockopt(hSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
     LOGV("ipc_connect() connect to %s on port %d",strHostIp,nHostPort);
     return hSocket;
 }
@@ -115,21 +152,172 @@ int ipc_send(int hSocket, unsigned char* data, int length)
 #endif
 
     /* write what we received back to the server */
-    int sz=write(hSocket, data, length);
-    if( sz!= length)
+    int sz = 0;
+    while(sz < length)
     {
-        LOGE("Could not wite all data %d!=%d", sz, length);
+        int n = send(hSocket, data + sz, length - sz, MSG_NOSIGNAL);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            LOGE("Could not wite all data %d!=%d (%s)", sz, length, strerror(errno));
+            break;
+        }
+        sz += n;
     }
 
     return sz;
 }
 
+static long long ipc_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+/* anything the peer sends is not used, drain it and tell whether the
+ * connection is still open */
+static int ipc_alive(int hSocket)
+{
+    unsigned char buf[64];
+
+    for(;;)
+    {
+        int n = recv(hSocket, buf, sizeof(buf), MSG_DONTWAIT);
+        if(n > 0)
+            continue;
+        if(n < 0 && errno == EINTR)
+            continue;
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+static void ipc_log_stats()
+{
+    struct ipc_stats *st = &s_ipcStats;
+
+    LOGD("ipc: %u sent, %u dropped, %u reconnects, latency last %u avg %u max %u us",
+        st->sent, st->dropped, st->reconnects, st->lat_last_us,
+        st->sent ? (unsigned)(st->lat_total_us / st->sent) : 0, st->lat_max_us);
+}
+
+static void *ipc_thread(void *arg)
+{
+    struct ipc_frame frame;
+    int hSocket = 0;
+    int attempts = 0;
+    int backoff = IPC_BACKOFF_MIN_MS;
 
+    pthread_mutex_lock(&s_ipcLock);
+    for(;;)
+    {
+        while(s_ipcCount == 0)
+            pthread_cond_wait(&s_ipcCond, &s_ipcLock);
+        frame = s_ipcQueue[s_ipcHead];
+        pthread_mutex_unlock(&s_ipcLock);
+
+        if(hSocket && !ipc_alive(hSocket))
+        {
+            LOGV("ipc_thread(): peer closed the connection");
+            ipc_disconnect(hSocket);
+            hSocket = 0;
+        }
+
+        int sent = 0;
+        if(!hSocket)
+        {
+            hSocket = ipc_connect();
+            if(hSocket)
+            {
+                pthread_mutex_lock(&s_ipcLock);
+                s_ipcStats.reconnects++;
+                pthread_mutex_unlock(&s_ipcLock);
+            }
+        }
+        if(hSocket)
+        {
+            sent = ipc_send(hSocket, frame.data, frame.length) == frame.length;
+            if(!sent || !s_ipcPersistent)
+            {
+                /* a partly written frame is resent whole on a new connection */
+                ipc_disconnect(hSocket);
+                hSocket = 0;
+            }
+        }
+
+        pthread_mutex_lock(&s_ipcLock);
+        if(sent || ++attempts >= IPC_MAX_ATTEMPTS)
+        {
+            s_ipcHead = (s_ipcHead + 1) % IPC_QUEUE_LEN;
+            s_ipcCount--;
+            if(sent)
+            {
+                unsigned lat = (unsigned)(ipc_now_us() - frame.queued_us);
+                s_ipcStats.sent++;
+                s_ipcStats.lat_last_us = lat;
+                s_ipcStats.lat_total_us += lat;
+                if(lat > s_ipcStats.lat_max_us)
+                    s_ipcStats.lat_max_us = lat;
+            }
+            else
+            {
+                LOGE("ipc_thread(): dropping %d byte command after %d attempts",
+                    frame.length, attempts);
+                s_ipcStats.dropped++;
+            }
+            if((s_ipcStats.sent + s_ipcStats.dropped) % IPC_STATS_EVERY == 0 || !sent)
+                ipc_log_stats();
+            attempts = 0;
+            backoff = IPC_BACKOFF_MIN_MS;
+        }
+        else
+        {
+            pthread_mutex_unlock(&s_ipcLock);
+            usleep(backoff * 1000);
+            if(backoff < IPC_BACKOFF_MAX_MS)
+                backoff *= 2;
+            pthread_mutex_lock(&s_ipcLock);
+        }
+    }
+    return NULL;
+}
+
+static void ipc_start()
+{
+    char value[PROPERTY_VALUE_MAX];
+    pthread_t tid;
+    pthread_attr_t attr;
+
+    if(property_get("ro.ril.ipc.persistent", value, "1"))
+        s_ipcPersistent = value[0] != '0';
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if(pthread_create(&tid, &attr, ipc_thread, NULL) == 0)
+        s_ipcStarted = 1;
+    else
+        LOGE("ipc_start(): cannot create sender thread");
+    pthread_attr_destroy(&attr);
+
+    LOGD("ipc channel %s", s_ipcPersistent ? "persistent" : "per command");
+}
+
+void ipc_get_stats(struct ipc_stats *stats)
+{
+    pthread_mutex_lock(&s_ipcLock);
+    *stats = s_ipcStats;
+    pthread_mutex_unlock(&s_ipcLock);
+}
+
+
+/* queues the command for the sender thread, 0 on success, otherwise
+ * the number of bytes not sent */
 int ipc_send_data( unsigned char* data, int length, int dir)
 {
     unsigned char hdr1[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
     unsigned char hdr2[] = { 0x01, 0x00, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-    int written = 0;
+    struct ipc_frame *frame;
 //ipctool 09 00 35 00 05 01 03 82 00
     if(dir == PDA_TO_MODEM)
     {
@@ -138,17 +326,37 @@ int ipc_send_data( unsigned char* data, int length, int dir)
     }
     hdr2[2] = length;
 
-    int hSocket = ipc_connect();
-    if(hSocket)
+    if(length <= 0 || 2*IPC_HDR_SIZE + length > IPC_FRAME_MAX)
     {
-        data[0] = length;
+        LOGE("ipc_send_data(): bad length %d", length);
+        return length;
+    }
 
-        ipc_send(hSocket, hdr1, sizeof(hdr1));
-        ipc_send(hSocket, hdr2, sizeof(hdr2));
-        written = ipc_send(hSocket, data, length);
+    pthread_once(&s_ipcOnce, ipc_start);
+    if(!s_ipcStarted)
+        return length;
 
-        ipc_disconnect(hSocket);
+    data[0] = length;
+
+    pthread_mutex_lock(&s_ipcLock);
+    if(s_ipcCount == IPC_QUEUE_LEN)
+    {
+        s_ipcStats.dropped++;
+        pthread_mutex_unlock(&s_ipcLock);
+        LOGE("ipc_send_data(): queue full");
+        return length;
     }
 
-    return length - written;
+    /* the headers and the command go out in one write */
+    frame = &s_ipcQueue[(s_ipcHead + s_ipcCount) % IPC_QUEUE_LEN];
+    memcpy(frame->data, hdr1, IPC_HDR_SIZE);
+    memcpy(frame->data + IPC_HDR_SIZE, hdr2, IPC_HDR_SIZE);
+    memcpy(frame->data + 2*IPC_HDR_SIZE, data, length);
+    frame->length = 2*IPC_HDR_SIZE + length;
+    frame->queued_us = ipc_now_us();
+    s_ipcCount++;
+    pthread_cond_signal(&s_ipcCond);
+    pthread_mutex_unlock(&s_ipcLock);
+
+    return 0;
 }
@@ -0,0 +1,346 @@
+/* /device/samsung/nowplus/hardware/libh1-ril/libril-h1_trace.c
+**
+** Copyright 2011, r3d4
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+** request latency and unsolicited rate tracing for the libsec-ril wrapper
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <telephony/ril.h>
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "H1RIL"
+
+#include <utils/Log.h>
+#include <cutils/sockets.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "libril-h1.h"
+
+/*
+ * With persist.ril.h1.trace=1 every request is timed from onRequest() to
+ * its completion and unsolicited responses are counted. The report is
+ * written to whoever connects to the abstract local socket
+ * TRACE_SOCKET_NAME, e.g. "socat ABSTRACT-CONNECT:h1-ril-trace -".
+ */
+
+#define TRACE_REQ_MAX       128     // RIL_REQUEST_* numbers
+#define TRACE_UNSOL_BASE    1000    // RIL_UNSOL_RESPONSE_BASE
+#define TRACE_UNSOL_MAX     64
+#define TRACE_BUCKETS       16      // [0,1) [1,2) [2,4) ... ms, last one open
+#define TRACE_INFLIGHT      64      // outstanding requests tracked, power of 2
+
+struct trace_req {
+    unsigned count;
+    unsigned errors;
+    unsigned inflight;
+    unsigned max_us;
+    unsigned long long total_us;
+    unsigned hist[TRACE_BUCKETS];
+};
+
+struct trace_unsol {
+    unsigned count;
+    unsigned min_gap_us;
+    long long last_us;
+};
+
+struct trace_slot {
+    int token;
+    int request;
+    long long start_us;
+};
+
+int trace_enabled = 0;
+
+static pthread_mutex_t s_traceLock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_req s_req[TRACE_REQ_MAX];
+static struct trace_unsol s_unsol[TRACE_UNSOL_MAX];
+static struct trace_slot s_inflight[TRACE_INFLIGHT];
+static unsigned s_untracked = 0;
+static long long s_start_us = 0;
+
+static long long trace_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static int trace_bucket(unsigned us)
+{
+    unsigned ms = us / 1000;
+    int b = 0;
+
+    while(ms && b < TRACE_BUCKETS-1)
+    {
+        ms >>= 1;
+        b++;
+    }
+    return b;
+}
+
+// upper edge of a bucket in ms, what percentiles are reported as
+static unsigned trace_bucket_ms(int b)
+{
+    return 1u << b;
+}
+
+void trace_request_start(int request, int token)
+{
+    struct trace_slot *slot = NULL;
+    int i, h = token & (TRACE_INFLIGHT-1);
+
+    if(request < 0 || request >= TRACE_REQ_MAX)
+        return;
+
+    pthread_mutex_lock(&s_traceLock);
+    for(i = 0; i < TRACE_INFLIGHT; i++)
+    {
+        struct trace_slot *s = &s_inflight[(h + i) & (TRACE_INFLIGHT-1)];
+        if(s->request == 0)
+        {
+            slot = s;
+            break;
+        }
+    }
+    if(slot)
+    {
+        slot->token = token;
+        slot->request = request;
+        slot->start_us = trace_now_us();
+        s_req[request].inflight++;
+    }
+    else
+    {
+        s_untracked++;
+    }
+    pthread_mutex_unlock(&s_traceLock);
+}
+
+void trace_request_complete(int token, RIL_Errno e)
+{
+    int i, h = token & (TRACE_INFLIGHT-1);
+    long long now = trace_now_us();
+
+    pthread_mutex_lock(&s_traceLock);
+    for(i = 0; i < TRACE_INFLIGHT; i++)
+    {
+        struct trace_slot *s = &s_inflight[(h + i) & (TRACE_INFLIGHT-1)];
+        if(s->request != 0 && s->token == token)
+        {
+            struct trace_req *r = &s_req[s->request];
+            unsigned us = (unsigned)(now - s->start_us);
+
+            r->count++;
+            r->inflight--;
+            if(e != RIL_E_SUCCESS)
+                r->errors++;
+            r->total_us += us;
+            if(us > r->max_us)
+                r->max_us = us;
+            r->hist[trace_bucket(us)]++;
+            s->request = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_traceLock);
+}
+
+void trace_unsolicited(int unsolResponse)
+{
+    int i = unsolResponse - TRACE_UNSOL_BASE;
+    long long now = trace_now_us();
+
+    if(i < 0 || i >= TRACE_UNSOL_MAX)
+        return;
+
+    pthread_mutex_lock(&s_traceLock);
+    struct trace_unsol *u = &s_unsol[i];
+    if(u->count)
+    {
+        unsigned gap = (unsigned)(now - u->last_us);
+        if(u->count == 1 || gap < u->min_gap_us)
+            u->min_gap_us = gap;
+    }
+    u->count++;
+    u->last_us = now;
+    pthread_mutex_unlock(&s_traceLock);
+}
+
+static unsigned trace_percentile(const struct trace_req *r, unsigned pct)
+{
+    unsigned want = (r->count * pct + 99) / 100;
+    unsigned seen = 0;
+    int b;
+
+    for(b = 0; b < TRACE_BUCKETS; b++)
+    {
+        seen += r->hist[b];
+        if(seen >= want)
+            return trace_bucket_ms(b);
+    }
+    return trace_bucket_ms(TRACE_BUCKETS-1);
+}
+
+// what trace_dump() formats, copied out so the lock is not held over
+// write() to a client that may be slow to read
+struct trace_snapshot {
+    struct trace_req req[TRACE_REQ_MAX];
+    struct trace_unsol unsol[TRACE_UNSOL_MAX];
+    unsigned oldest_us[TRACE_REQ_MAX];
+    unsigned untracked;
+};
+
+void trace_dump(int fd)
+{
+    char line[256];
+    int i, b, n;
+    long long now = trace_now_us();
+    double secs;
+    struct trace_snapshot *snap = (struct trace_snapshot *)malloc(sizeof(*snap));
+
+    if(!snap)
+        return;
+
+    pthread_mutex_lock(&s_traceLock);
+    memcpy(snap->req, s_req, sizeof(snap->req));
+    memcpy(snap->unsol, s_unsol, sizeof(snap->unsol));
+    memset(snap->oldest_us, 0, sizeof(snap->oldest_us));
+    for(i = 0; i < TRACE_INFLIGHT; i++)
+    {
+        struct trace_slot *s = &s_inflight[i];
+        if(s->request != 0 && now - s->start_us > snap->oldest_us[s->request])
+            snap->oldest_us[s->request] = (unsigned)(now - s->start_us);
+    }
+    snap->untracked = s_untracked;
+    pthread_mutex_unlock(&s_traceLock);
+
+    secs = (now - s_start_us) / 1e6;
+
+    n = snprintf(line, sizeof(line),
+        "h1-ril trace, %.1f s, latency in ms (p50/p90 are bucket upper edges)\n"
+        "%-36s %7s %5s %5s %8s %5s %5s %8s  histogram 1,2,4..ms\n",
+        secs, "request", "count", "err", "inflt", "avg", "p50", "p90", "max");
+    write(fd, line, n);
+
+    for(i = 0; i < TRACE_REQ_MAX; i++)
+    {
+        struct trace_req *r = &snap->req[i];
+
+        if(!r->count && !r->inflight)
+            continue;
+
+        n = snprintf(line, sizeof(line), "%-36s %7u %5u %5u %8.1f %5u %5u %8.1f ",
+            requestToString(i), r->count, r->errors, r->inflight,
+            r->count ? r->total_us / 1000.0 / r->count : 0.0,
+            r->count ? trace_percentile(r, 50) : 0,
+            r->count ? trace_percentile(r, 90) : 0,
+            r->max_us / 1000.0);
+        for(b = 0; b < TRACE_BUCKETS && n < (int)sizeof(line) - 12; b++)
+            n += snprintf(line + n, sizeof(line) - n, "%s%u", b ? "," : " ", r->hist[b]);
+        if(r->inflight && n < (int)sizeof(line) - 32)
+            n += snprintf(line + n, sizeof(line) - n, "  oldest %.1f", snap->oldest_us[i] / 1000.0);
+        line[n++] = '\n';
+        write(fd, line, n);
+    }
+    if(snap->untracked)
+    {
+        n = snprintf(line, sizeof(line), "%u requests not tracked, too many in flight\n",
+            snap->untracked);
+        write(fd, line, n);
+    }
+
+    n = snprintf(line, sizeof(line), "\n%-36s %7s %8s %12s\n",
+        "unsolicited", "count", "per s", "min gap ms");
+    write(fd, line, n);
+    for(i = 0; i < TRACE_UNSOL_MAX; i++)
+    {
+        struct trace_unsol *u = &snap->unsol[i];
+
+        if(!u->count)
+            continue;
+        n = snprintf(line, sizeof(line), "%-36s %7u %8.2f %12.1f\n",
+            requestToString(TRACE_UNSOL_BASE + i), u->count,
+            secs > 0 ? u->count / secs : 0.0,
+            u->count > 1 ? u->min_gap_us / 1000.0 : 0.0);
+        write(fd, line, n);
+    }
+    free(snap);
+
+    unsol_dump(fd);
+}
+
+static void *trace_thread(void *arg)
+{
+    int hServer = (int)(intptr_t)arg;
+
+    for(;;)
+    {
+        int hClient = accept(hServer, NULL, NULL);
+        if(hClient < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            LOGE("trace_thread(): accept failed (%s)", strerror(errno));
+            break;
+        }
+        trace_dump(hClient);
+        close(hClient);
+    }
+    close(hServer);
+    return NULL;
+}
+
+void trace_start()
+{
+    pthread_t tid;
+    pthread_attr_t attr;
+
+    if(trace_enabled)
+        return;
+
+    s_start_us = trace_now_us();
+    trace_enabled = 1;
+
+    int hServer = socket_local_server(TRACE_SOCKET_NAME,
+        ANDROID_SOCKET_NAMESPACE_ABSTRACT, SOCK_STREAM);
+    if(hServer < 0)
+    {
+        LOGE("trace_start(): cannot listen on %s (%s)", TRACE_SOCKET_NAME, strerror(errno));
+        return;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if(pthread_create(&tid, &attr, trace_thread, (void *)(intptr_t)hServer) != 0)
+    {
+        LOGE("trace_start(): cannot create dump thread");
+        close(hServer);
+    }
+    pthread_attr_destroy(&attr);
+
+    LOGD("request tracing enabled, dump on @%s", TRACE_SOCKET_NAME);
+}
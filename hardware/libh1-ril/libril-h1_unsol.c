@@ -0,0 +1,364 @@
+/* /device/samsung/nowplus/hardware/libh1-ril/libril-h1_unsol.c
+**
+** Copyright 2011, r3d4
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+** coalescing of state-type unsolicited responses for the libsec-ril wrapper
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <telephony/ril.h>
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "H1RIL"
+
+#include <utils/Log.h>
+
+#include "libril-h1.h"
+
+/*
+ * Some unsolicited responses only carry the latest state, and in weak
+ * signal libsec-ril sends them in bursts, each one waking rild and
+ * system_server. For those the first one of a burst is passed on at
+ * once and anything following within the window is merged, the latest
+ * value going out when the window ends. With the screen off signal
+ * strength and network state are held until it comes back on. All
+ * other responses, calls and SMS included, are not touched.
+ */
+
+struct unsol_slot {
+    int id;
+    int holdScreenOff;          // keep back while the screen is off
+    void *(*copy)(const void *data, size_t datalen);
+    int pending;                // data holds the latest undelivered value
+    int timerArmed;
+    void *data;
+    size_t datalen;
+    long long lastSentUs;
+    unsigned received;
+    unsigned delivered;
+    unsigned merged;            // replaced by a newer value before delivery
+};
+
+static void *unsol_copy_flat(const void *data, size_t datalen);
+static void *unsol_copy_data_calls(const void *data, size_t datalen);
+
+static struct unsol_slot s_slots[] = {
+    { RIL_UNSOL_SIGNAL_STRENGTH, 1, unsol_copy_flat },
+    { RIL_UNSOL_RESPONSE_NETWORK_STATE_CHANGED, 1, unsol_copy_flat },
+    { RIL_UNSOL_DATA_CALL_LIST_CHANGED, 0, unsol_copy_data_calls },
+};
+
+#define NUM_SLOTS (int)(sizeof(s_slots)/sizeof(s_slots[0]))
+
+static pthread_mutex_t s_unsolLock = PTHREAD_MUTEX_INITIALIZER;
+static int s_windowMs = 0;
+static int s_screenOn = 1;
+static unsigned s_uncoalesced = 0;  // no memory to keep a value, passed on as is
+
+static long long unsol_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static struct unsol_slot *unsol_slot(int id)
+{
+    int i;
+
+    for(i = 0; i < NUM_SLOTS; i++)
+        if(s_slots[i].id == id)
+            return &s_slots[i];
+    return NULL;
+}
+
+static void unsol_deliver(int id, const void *data, size_t datalen)
+{
+    secRilEnv->OnUnsolicitedResponse(id, data, datalen);
+}
+
+static void *unsol_copy_flat(const void *data, size_t datalen)
+{
+    void *copy = malloc(datalen);
+
+    if(copy)
+        memcpy(copy, data, datalen);
+    return copy;
+}
+
+static char *unsol_copy_string(char **pos, const char *str)
+{
+    char *copy = *pos;
+
+    if(!str)
+        return NULL;
+    strcpy(copy, str);
+    *pos += strlen(str) + 1;
+    return copy;
+}
+
+// the strings are libsec-ril's and gone after the callback, they are
+// kept in the same allocation behind the array
+static void *unsol_copy_data_calls(const void *data, size_t datalen)
+{
+    const RIL_Data_Call_Response *calls = (const RIL_Data_Call_Response *)data;
+    int i, num = datalen / sizeof(RIL_Data_Call_Response);
+    size_t size = datalen;
+    RIL_Data_Call_Response *copy;
+    char *pos;
+
+    for(i = 0; i < num; i++)
+    {
+        size += calls[i].type ? strlen(calls[i].type) + 1 : 0;
+        size += calls[i].apn ? strlen(calls[i].apn) + 1 : 0;
+        size += calls[i].address ? strlen(calls[i].address) + 1 : 0;
+    }
+
+    copy = (RIL_Data_Call_Response *)malloc(size);
+    if(!copy)
+        return NULL;
+    memcpy(copy, calls, datalen);
+    pos = (char *)copy + datalen;
+    for(i = 0; i < num; i++)
+    {
+        copy[i].type = unsol_copy_string(&pos, calls[i].type);
+        copy[i].apn = unsol_copy_string(&pos, calls[i].apn);
+        copy[i].address = unsol_copy_string(&pos, calls[i].address);
+    }
+    return copy;
+}
+
+// keeps a copy of the value, 0 if there is no memory for it
+static int unsol_store(struct unsol_slot *slot, const void *data, size_t datalen)
+{
+    void *copy = NULL;
+
+    if(data && datalen)
+    {
+        copy = slot->copy(data, datalen);
+        if(!copy)
+            return 0;
+    }
+    free(slot->data);
+    slot->data = copy;
+    slot->datalen = datalen;
+    slot->pending = 1;
+    return 1;
+}
+
+static void unsol_flush(void *param);
+
+static void unsol_arm(struct unsol_slot *slot, long long delayUs)
+{
+    struct timeval tv;
+
+    if(slot->timerArmed)
+        return;
+    slot->timerArmed = 1;
+    tv.tv_sec = delayUs / 1000000;
+    tv.tv_usec = delayUs % 1000000;
+    RIL_requestTimedCallback(unsol_flush, slot, &tv);
+}
+
+// takes the pending value out of the slot, called with the lock held
+static void *unsol_take(struct unsol_slot *slot, size_t *datalen)
+{
+    void *data = slot->data;
+
+    *datalen = slot->datalen;
+    slot->data = NULL;
+    slot->datalen = 0;
+    slot->pending = 0;
+    slot->lastSentUs = unsol_now_us();
+    slot->delivered++;
+    return data;
+}
+
+// window end, runs on the libril event loop
+static void unsol_flush(void *param)
+{
+    struct unsol_slot *slot = (struct unsol_slot *)param;
+    void *data;
+    size_t datalen;
+
+    pthread_mutex_lock(&s_unsolLock);
+    slot->timerArmed = 0;
+    if(!slot->pending || (!s_screenOn && slot->holdScreenOff))
+    {
+        pthread_mutex_unlock(&s_unsolLock);
+        return;
+    }
+    data = unsol_take(slot, &datalen);
+    pthread_mutex_unlock(&s_unsolLock);
+
+    unsol_deliver(slot->id, data, datalen);
+    free(data);
+}
+
+// passes on everything pending, e.g. ahead of a radio state change
+static void unsol_flush_all()
+{
+    int i;
+
+    for(i = 0; i < NUM_SLOTS; i++)
+    {
+        struct unsol_slot *slot = &s_slots[i];
+        void *data;
+        size_t datalen;
+
+        pthread_mutex_lock(&s_unsolLock);
+        if(!slot->pending)
+        {
+            pthread_mutex_unlock(&s_unsolLock);
+            continue;
+        }
+        data = unsol_take(slot, &datalen);
+        pthread_mutex_unlock(&s_unsolLock);
+
+        unsol_deliver(slot->id, data, datalen);
+        free(data);
+    }
+}
+
+void unsol_init(int windowMs)
+{
+    s_windowMs = windowMs;
+    LOGD("unsolicited coalescing %s, window %d ms",
+        windowMs > 0 ? "enabled" : "disabled", windowMs);
+}
+
+void unsol_forward(int unsolResponse, const void *data, size_t datalen)
+{
+    struct unsol_slot *slot = s_windowMs > 0 ? unsol_slot(unsolResponse) : NULL;
+    long long now, windowUs = (long long)s_windowMs * 1000;
+
+    if(!slot)
+    {
+        // held state must not arrive after the radio went away
+        if(unsolResponse == RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED && s_windowMs > 0)
+            unsol_flush_all();
+        unsol_deliver(unsolResponse, data, datalen);
+        return;
+    }
+
+    pthread_mutex_lock(&s_unsolLock);
+    slot->received++;
+    now = unsol_now_us();
+
+    if(!slot->pending && !slot->timerArmed && (s_screenOn || !slot->holdScreenOff)
+            && now - slot->lastSentUs >= windowUs)
+    {
+        // first of a burst goes straight out
+        slot->lastSentUs = now;
+        slot->delivered++;
+        pthread_mutex_unlock(&s_unsolLock);
+        unsol_deliver(unsolResponse, data, datalen);
+        return;
+    }
+
+    if(slot->pending)
+        slot->merged++;
+    if(!unsol_store(slot, data, datalen))
+    {
+        s_uncoalesced++;
+        pthread_mutex_unlock(&s_unsolLock);
+        unsol_deliver(unsolResponse, data, datalen);
+        return;
+    }
+    if(s_screenOn || !slot->holdScreenOff)
+    {
+        long long delay = slot->lastSentUs + windowUs - now;
+        unsol_arm(slot, delay > 0 ? delay : 0);
+    }
+    pthread_mutex_unlock(&s_unsolLock);
+}
+
+void unsol_screen_state(int on)
+{
+    int i;
+    unsigned held = 0, merged = 0;
+
+    pthread_mutex_lock(&s_unsolLock);
+    if(on == s_screenOn)
+    {
+        pthread_mutex_unlock(&s_unsolLock);
+        return;
+    }
+    s_screenOn = on;
+    if(on)
+    {
+        // what was held while off goes out now, the latest value only
+        for(i = 0; i < NUM_SLOTS; i++)
+        {
+            struct unsol_slot *slot = &s_slots[i];
+
+            merged += slot->merged;
+            if(slot->pending && slot->holdScreenOff)
+            {
+                held++;
+                unsol_arm(slot, 0);
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_unsolLock);
+
+    if(on && s_windowMs > 0)
+        LOGD("unsol_screen_state(): screen on, %u held responses, %u merged so far",
+            held, merged);
+}
+
+void unsol_dump(int fd)
+{
+    char line[160];
+    int i, n;
+    struct unsol_slot slots[NUM_SLOTS];
+    int windowMs, screenOn;
+    unsigned uncoalesced;
+
+    // copied out, the lock is not held over write() to the client
+    pthread_mutex_lock(&s_unsolLock);
+    memcpy(slots, s_slots, sizeof(slots));
+    windowMs = s_windowMs;
+    screenOn = s_screenOn;
+    uncoalesced = s_uncoalesced;
+    pthread_mutex_unlock(&s_unsolLock);
+
+    n = snprintf(line, sizeof(line), "\ncoalesced, window %d ms, screen %s%s\n"
+        "%-36s %8s %9s %7s %7s\n", windowMs, screenOn ? "on" : "off",
+        windowMs > 0 ? "" : " (disabled)",
+        "unsolicited", "received", "delivered", "merged", "pending");
+    write(fd, line, n);
+    for(i = 0; i < NUM_SLOTS; i++)
+    {
+        struct unsol_slot *slot = &slots[i];
+
+        n = snprintf(line, sizeof(line), "%-36s %8u %9u %7u %7d\n",
+            requestToString(slot->id), slot->received, slot->delivered,
+            slot->merged, slot->pending);
+        write(fd, line, n);
+    }
+    if(uncoalesced)
+    {
+        n = snprintf(line, sizeof(line), "%u passed on uncoalesced, no memory\n", uncoalesced);
+        write(fd, line, n);
+    }
+}
@@ -0,0 +1,374 @@
+/* /device/samsung/nowplus/hardware/libh1-ril/ril_bench.c
+**
+** Copyright 2011, r3d4
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+** host load test for libh1-ril: plays libril in front of the wrapper,
+** with fake-secril.so behind it
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <telephony/ril.h>
+
+#define LOG_TAG "RILBENCH"
+
+#include <utils/Log.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stddef.h>
+
+#include "libril-h1.h"
+#include "fake-secril.h"
+
+/*
+ * usage: ril_bench [-s script] [-d seconds] [-x]
+ *
+ * The script is the one fake-secril reads (see fake-secril.c), plus
+ *
+ *   load <request> <per second>
+ *
+ * lines giving the requests issued, at a fixed rate each, from a single
+ * dispatch thread as libril does. Requests the wrapper handles itself
+ * (SMS_ACKNOWLEDGE) go to fake-secril's libsecril-client socket. At the
+ * end the wrapper's trace is read back over its dump socket. -x turns
+ * the screen off for the run and back on at the end.
+ */
+
+#define BENCH_LOAD_MAX  16
+#define BENCH_TIMED_MAX 64
+
+struct bench_load {
+    int request;
+    double per_s;
+    long long next_us;
+};
+
+struct bench_timed {
+    RIL_TimedCallback callback;
+    void *param;
+    long long due_us;
+};
+
+static struct bench_load s_load[BENCH_LOAD_MAX];
+static int s_loadCount = 0;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static struct bench_timed s_timed[BENCH_TIMED_MAX];
+static int s_timedCount = 0;
+static unsigned s_issued = 0, s_completed = 0, s_unsolicited = 0, s_badUnsol = 0;
+static int s_screenOn = 1;
+
+static long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static void load_script(const char *path)
+{
+    char line[256];
+    FILE *f = fopen(path, "r");
+
+    if(!f)
+    {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    while(fgets(line, sizeof(line), f))
+    {
+        int id;
+        double rate;
+
+        if(sscanf(line, "load %d %lf", &id, &rate) == 2 && rate > 0
+                && s_loadCount < BENCH_LOAD_MAX)
+        {
+            s_load[s_loadCount].request = id;
+            s_load[s_loadCount].per_s = rate;
+            s_loadCount++;
+        }
+    }
+    fclose(f);
+}
+
+// --------------- libril side --------------------
+
+static void benchOnRequestComplete(RIL_Token t, RIL_Errno e,
+                                   void *response, size_t responselen)
+{
+    RequestInfo *pRI = (RequestInfo *)t;
+
+    pthread_mutex_lock(&s_lock);
+    s_completed++;
+    pthread_mutex_unlock(&s_lock);
+    free(pRI->requestNumber);
+    free(pRI);
+}
+
+static void benchOnUnsolicitedResponse(int unsolResponse, const void *data,
+                                       size_t datalen)
+{
+    int bad = 0;
+
+    // what fake-secril sends, seen through any copy the wrapper made
+    if(unsolResponse == RIL_UNSOL_SIGNAL_STRENGTH)
+        bad = datalen != 7*sizeof(int) || ((const int *)data)[1] != 99;
+    else if(unsolResponse == RIL_UNSOL_DATA_CALL_LIST_CHANGED)
+    {
+        const RIL_Data_Call_Response *call = (const RIL_Data_Call_Response *)data;
+        bad = datalen != sizeof(*call) || strcmp(call->type, "IP")
+            || strcmp(call->apn, "internet") || strncmp(call->address, "10.0.0.", 7);
+    }
+
+    pthread_mutex_lock(&s_lock);
+    s_unsolicited++;
+    s_badUnsol += bad;
+    pthread_mutex_unlock(&s_lock);
+}
+
+static void benchRequestTimedCallback(RIL_TimedCallback callback, void *param,
+                                      const struct timeval *relativeTime)
+{
+    long long due = now_us();
+
+    if(relativeTime)
+        due += (long long)relativeTime->tv_sec*1000000 + relativeTime->tv_usec;
+
+    pthread_mutex_lock(&s_lock);
+    if(s_timedCount < BENCH_TIMED_MAX)
+    {
+        s_timed[s_timedCount].callback = callback;
+        s_timed[s_timedCount].param = param;
+        s_timed[s_timedCount].due_us = due;
+        s_timedCount++;
+        pthread_cond_signal(&s_cond);
+    }
+    else
+    {
+        fprintf(stderr, "timed callback queue full\n");
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+static const struct RIL_Env s_benchEnv = {
+    benchOnRequestComplete,
+    benchOnUnsolicitedResponse,
+    benchRequestTimedCallback
+};
+
+// libril's event loop, runs the timed callbacks
+static void *event_thread(void *arg)
+{
+    pthread_mutex_lock(&s_lock);
+    for(;;)
+    {
+        int i, next = 0;
+        long long wait;
+
+        while(s_timedCount == 0)
+            pthread_cond_wait(&s_cond, &s_lock);
+
+        for(i = 1; i < s_timedCount; i++)
+            if(s_timed[i].due_us < s_timed[next].due_us)
+                next = i;
+
+        wait = s_timed[next].due_us - now_us();
+        if(wait > 0)
+        {
+            pthread_mutex_unlock(&s_lock);
+            usleep(wait < 10000 ? wait : 10000);
+            pthread_mutex_lock(&s_lock);
+            continue;
+        }
+
+        struct bench_timed run = s_timed[next];
+        s_timed[next] = s_timed[--s_timedCount];
+        pthread_mutex_unlock(&s_lock);
+        run.callback(run.param);
+        pthread_mutex_lock(&s_lock);
+    }
+    return NULL;
+}
+
+static void issue(const RIL_RadioFunctions *funcs, int request, int token)
+{
+    static int radioOn[1] = { 1 };
+    static int smsAck[2] = { 1, 0 };
+    RequestInfo *pRI = (RequestInfo *)malloc(sizeof(*pRI));
+    void *data = NULL;
+    size_t datalen = 0;
+
+    pRI->token = token;
+    pRI->requestNumber = (int *)malloc(sizeof(int));
+    *pRI->requestNumber = request;
+
+    if(request == RIL_REQUEST_RADIO_POWER)
+    {
+        data = radioOn;
+        datalen = sizeof(radioOn);
+    }
+    else if(request == RIL_REQUEST_SMS_ACKNOWLEDGE)
+    {
+        data = smsAck;
+        datalen = sizeof(smsAck);
+    }
+    else if(request == RIL_REQUEST_SCREEN_STATE)
+    {
+        data = &s_screenOn;
+        datalen = sizeof(s_screenOn);
+    }
+
+    pthread_mutex_lock(&s_lock);
+    s_issued++;
+    pthread_mutex_unlock(&s_lock);
+    funcs->onRequest(request, data, datalen, (RIL_Token)pRI);
+}
+
+static void print_trace()
+{
+    struct sockaddr_un addr;
+    socklen_t len;
+    char buf[1024];
+    int n, fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path + 1, TRACE_SOCKET_NAME);
+    len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(TRACE_SOCKET_NAME);
+
+    if(fd < 0 || connect(fd, (struct sockaddr *)&addr, len) < 0)
+    {
+        fprintf(stderr, "cannot connect to @%s, dumping directly\n", TRACE_SOCKET_NAME);
+        trace_dump(1);
+        if(fd >= 0)
+            close(fd);
+        return;
+    }
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+        fwrite(buf, 1, n, stdout);
+    close(fd);
+}
+
+int main(int argc, char **argv)
+{
+    const char *script = "ril_bench.script";
+    const RIL_RadioFunctions *funcs;
+    void (*getFakeStats)(struct fake_secril_stats *);
+    struct fake_secril_stats fake;
+    struct ipc_stats ipc;
+    pthread_t tid;
+    long long start, end;
+    int duration = 10;
+    int token = 1;
+    int i, opt;
+
+    int screenOff = 0;
+
+    while((opt = getopt(argc, argv, "s:d:x")) != -1)
+    {
+        switch(opt)
+        {
+            case 's': script = optarg; break;
+            case 'd': duration = atoi(optarg); break;
+            case 'x': screenOff = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-s script] [-d seconds] [-x]\n", argv[0]);
+                return 1;
+        }
+    }
+    load_script(script);
+
+    trace_start();
+    pthread_create(&tid, NULL, event_thread, NULL);
+
+    char *rilArgv[] = { "ril_bench", "-s", (char *)script, NULL };
+    funcs = RIL_Init(&s_benchEnv, 3, rilArgv);
+    if(!funcs || !funcs->version)
+    {
+        fprintf(stderr, "wrapper could not load %s\n", LIBSEC_RIL_PATH);
+        return 1;
+    }
+    getFakeStats = (void (*)(struct fake_secril_stats *))
+        dlsym(dlopen(LIBSEC_RIL_PATH, RTLD_NOW), "fake_secril_get_stats");
+
+    if(screenOff)
+    {
+        s_screenOn = 0;
+        issue(funcs, RIL_REQUEST_SCREEN_STATE, token++);
+    }
+
+    start = now_us();
+    end = start + (long long)duration*1000000;
+    for(i = 0; i < s_loadCount; i++)
+        s_load[i].next_us = start;
+
+    // the dispatch thread: one request at a time, whichever is due first
+    while(s_loadCount)
+    {
+        struct bench_load *next = &s_load[0];
+        long long wait;
+
+        for(i = 1; i < s_loadCount; i++)
+            if(s_load[i].next_us < next->next_us)
+                next = &s_load[i];
+        if(next->next_us >= end)
+            break;
+
+        wait = next->next_us - now_us();
+        if(wait > 0)
+            usleep(wait);
+        issue(funcs, next->request, token++);
+        next->next_us += (long long)(1e6 / next->per_s);
+    }
+
+    if(screenOff)
+    {
+        s_screenOn = 1;
+        issue(funcs, RIL_REQUEST_SCREEN_STATE, token++);
+    }
+
+    // give what is queued in the fake modem a moment to drain
+    for(i = 0; i < 20 && s_completed < s_issued; i++)
+        usleep(100000);
+    usleep(200000);
+
+    print_trace();
+
+    ipc_get_stats(&ipc);
+    printf("\nbench: %u issued, %u completed, %u unsolicited (%u with a bad payload) in %d s\n",
+        s_issued, s_completed, s_unsolicited, s_badUnsol, duration);
+    printf("ipc channel: %u sent, %u dropped, %u connections, latency avg %u max %u us\n",
+        ipc.sent, ipc.dropped, ipc.reconnects,
+        ipc.sent ? (unsigned)(ipc.lat_total_us / ipc.sent) : 0, ipc.lat_max_us);
+    if(getFakeStats)
+    {
+        getFakeStats(&fake);
+        printf("fake secril: %u requests, %u unsolicited, %u ipc frames (%u bad) on %u connections\n",
+            fake.requests, fake.unsolicited, fake.ipc_frames, fake.ipc_bad_frames,
+            fake.ipc_connections);
+    }
+    return 0;
+}
@@ -20,7 +20,10 @@
 #include <cutils/log.h>
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -37,8 +40,24 @@ static pthread_once_t g_init = PTHREAD_ONCE_INIT;
 static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
 static int g_backlight = 255;
 static int g_buttons = 0;
+
+/* Backlight ramps from the power manager come faster than the panel can
+ * show them: after a write, further changes are held back and only the
+ * latest one is written once the interval has passed. */
+#define BACKLIGHT_INTERVAL_MS 16
+
+static pthread_cond_t g_backlight_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t g_backlight_thread;
+static int g_backlight_thread_started = 0;
+static int g_backlight_pending = 0;
+static int64_t g_backlight_written_ms = -BACKLIGHT_INTERVAL_MS;
+
+/* the node stays open for the life of the process, value is what was
+ * last written to it, "" when unknown */
 struct led_prop {
     const char *filename;
+    int fd;
+    char value[12];
 };
 
 struct led {
@@ -72,9 +91,28 @@ struct led leds[NUM_LEDS] = {
  * device methods
  */
 
+static void
+forget_prop(struct led_prop *prop)
+{
+    if (prop->fd >= 0)
+        close(prop->fd);
+    prop->fd = -1;
+    prop->value[0] = 0;
+}
+
 void init_globals(void)
 {
+    int i;
+
     pthread_mutex_init(&g_lock, NULL);
+
+    for (i = 0; i < NUM_LEDS; i++) {
+        leds[i].trigger.fd = -1;
+        leds[i].brightness.fd = -1;
+        leds[i].delay_on.fd = -1;
+        leds[i].delay_off.fd = -1;
+        leds[i].blank.fd = -1;
+    }
 }
 
 static int
@@ -83,39 +121,42 @@ write_string(struct led_prop *prop, const char *value)
     char buffer[20];
     int bytes;
     int amt;
+    int err;
 
     if (!prop->filename)
         return 0;
-        
-    int fd = open(prop->filename, O_RDWR);
-    if (fd < 0) {
-        LOGE("init_prop: %s cannot be opened (%s)\n", prop->filename,
-             strerror(errno));
-        return -errno;
-    }
-  
-    if (fd < 0)
+
+    if (!strcmp(prop->value, value))
         return 0;
 
+    if (prop->fd < 0) {
+        prop->fd = open(prop->filename, O_RDWR);
+        if (prop->fd < 0) {
+            err = errno;
+            LOGE("write_string: %s cannot be opened (%s)\n", prop->filename,
+                 strerror(err));
+            return -err;
+        }
+    }
+
     //LOGV("%s %s: 0x%s\n", __func__, prop->filename, value);
 
+    /* sysfs takes an attribute in a single write, from offset 0 */
     bytes = snprintf(buffer, sizeof(buffer), "%s\n", value);
-    while (bytes > 0) {
-        amt = write(fd, buffer, bytes);
-        if (amt < 0) {
-            if (errno == EINTR)
-                continue;
-            return -errno;
-        }
-        bytes -= amt;
+    do {
+        amt = pwrite(prop->fd, buffer, bytes, 0);
+    } while (amt < 0 && errno == EINTR);
+
+    if (amt < 0) {
+        err = errno;
+        LOGE("write_string: %s: %s\n", prop->filename, strerror(err));
+        /* the node may have gone away with its trigger, reopen next time */
+        forget_prop(prop);
+        return -err;
     }
 
-success:        
+    snprintf(prop->value, sizeof(prop->value), "%s", value);
     return 0;
-failed:
-    if (fd > 0)
-        close(fd);
-    return -errno;
 }
 
 static int
@@ -126,6 +167,39 @@ write_int(struct led_prop *prop, int value)
     return  write_string(prop, buffer);
 }
 
+static int64_t
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+set_led_off_locked(struct led *led)
+{
+    write_int(&led->brightness, 0);
+    /* the kernel drops the trigger along with the brightness and the
+     * timer's delay_on/delay_off nodes go with it */
+    forget_prop(&led->trigger);
+    forget_prop(&led->delay_on);
+    forget_prop(&led->delay_off);
+}
+
+static void
+set_led_blink_locked(struct led *led, int on_ms, int off_ms)
+{
+    write_int(&led->brightness, 255);
+    if (strcmp(led->trigger.value, "timer")) {
+        /* a fresh timer trigger creates its nodes with default delays */
+        forget_prop(&led->delay_on);
+        forget_prop(&led->delay_off);
+        write_string(&led->trigger, "timer");
+    }
+    write_int(&led->delay_on, on_ms);
+    write_int(&led->delay_off, off_ms);
+}
+
 static int
 is_lit(struct light_state_t const* state)
 {
@@ -141,6 +215,37 @@ rgb_to_brightness(struct light_state_t const* state)
             + (150*((color>>8)&0x00ff)) + (29*(color&0x00ff))) >> 8;
 }
 
+static int
+write_backlight_locked(void)
+{
+    g_backlight_written_ms = now_ms();
+    return write_int(&leds[LCD_BACKLIGHT].brightness, g_backlight);
+}
+
+static void *
+backlight_thread(void *arg)
+{
+    int64_t wait;
+
+    pthread_mutex_lock(&g_lock);
+    for (;;) {
+        while (!g_backlight_pending)
+            pthread_cond_wait(&g_backlight_cond, &g_lock);
+
+        wait = g_backlight_written_ms + BACKLIGHT_INTERVAL_MS - now_ms();
+        if (wait > 0) {
+            /* changes arriving meanwhile only update g_backlight */
+            pthread_mutex_unlock(&g_lock);
+            usleep(wait * 1000);
+            pthread_mutex_lock(&g_lock);
+        }
+
+        g_backlight_pending = 0;
+        write_backlight_locked();
+    }
+    return NULL;
+}
+
 static int
 set_light_backlight(struct light_device_t* dev,
         struct light_state_t const* state)
@@ -150,9 +255,28 @@ set_light_backlight(struct light_device_t* dev,
     //LOGD("%s brightness=%d color=0x%08x",__func__,brightness, state->color);
     pthread_mutex_lock(&g_lock);
     g_backlight = brightness;
-    
-    err = write_int(&leds[LCD_BACKLIGHT].brightness, brightness);
-	
+
+    if (!g_backlight_pending &&
+            now_ms() - g_backlight_written_ms >= BACKLIGHT_INTERVAL_MS) {
+        /* a lone change goes straight out */
+        err = write_backlight_locked();
+    } else {
+        if (!g_backlight_thread_started) {
+            if (pthread_create(&g_backlight_thread, NULL,
+                        backlight_thread, NULL) == 0) {
+                g_backlight_thread_started = 1;
+            } else {
+                LOGE("%s: cannot start backlight thread\n", __func__);
+            }
+        }
+        if (g_backlight_thread_started) {
+            g_backlight_pending = 1;
+            pthread_cond_signal(&g_backlight_cond);
+        } else {
+            err = write_backlight_locked();
+        }
+    }
+
     pthread_mutex_unlock(&g_lock);
     return err;
 }
@@ -198,19 +322,16 @@ set_light_notifications(struct light_device_t* dev,
         case LIGHT_FLASH_HARDWARE:
         case LIGHT_FLASH_TIMED:
             if (colorRGB == 0) {
-                write_int(&leds[AMBER_LED].brightness, 0);
+                set_led_off_locked(&leds[AMBER_LED]);
             }
             else {
-                write_int(&leds[AMBER_LED].brightness, 255);
-                write_string(&leds[AMBER_LED].trigger, "timer");
-                write_int(&leds[AMBER_LED].delay_on, 500);
-                write_int(&leds[AMBER_LED].delay_off, 2000);
+                set_led_blink_locked(&leds[AMBER_LED], 500, 2000);
             }
 
             break;
         case LIGHT_FLASH_NONE:
             //LOGV("set_led_state colorRGB=%08X, on\n", state->color);
-            write_int(&leds[AMBER_LED].brightness, 0);
+            set_led_off_locked(&leds[AMBER_LED]);
             break;
         default:
             LOGE("set_led_state colorRGB=%08X, unknown mode %d\n",
@@ -235,18 +356,15 @@ set_light_attention(struct light_device_t* dev,
         case LIGHT_FLASH_HARDWARE:
         case LIGHT_FLASH_TIMED:
             if (colorRGB == 0) {
-                write_int(&leds[AMBER_LED].brightness, 0);
+                set_led_off_locked(&leds[AMBER_LED]);
             }
             else {
-                write_int(&leds[AMBER_LED].brightness, 255);
-                write_string(&leds[AMBER_LED].trigger, "timer");
-                write_int(&leds[AMBER_LED].delay_on, 250);
-                write_int(&leds[AMBER_LED].delay_off, 10);
+                set_led_blink_locked(&leds[AMBER_LED], 250, 10);
             }
 
             break;
         case LIGHT_FLASH_NONE:
-            write_int(&leds[AMBER_LED].brightness, 0);
+            set_led_off_locked(&leds[AMBER_LED]);
             break;
         default:
             LOGE("set_led_state colorRGB=%08X, unknown mode %d\n",
@@ -46,3 +46,15 @@ LOCAL_MODULE := overlay_test_h1
 LOCAL_MODULE_TAGS:= optional
 include $(BUILD_EXECUTABLE)
 endif
+
+# overlay throughput/latency benchmark, runs the HAL against fake_v4l2.c
+ifeq ($(HOST_OS),linux)
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := TIOverlay.cpp v4l2_utils.c fake_v4l2.c overlay_bench.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/host
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS += -lpthread -lrt -ldl
+LOCAL_MODULE := overlay_bench
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_HOST_EXECUTABLE)
+endif
@@ -489,11 +489,11 @@ int overlay_data_context_t::enable_streaming_locked(overlay_object* overlayobj,
         LOGE("Stream Enable Failed!/%d\n", rc);
         overlayobj->streamEn = 0;
     }
-    if (linkfd > 0) {
-        rc = v4l2_overlay_stream_on(linkfd);
-        if (rc) {
-            LOGE("link device Stream Enable Failed!/%d\n", rc);
-            overlayobj->streamEn = 0;
+    // the data side starts the link itself once it has handed it a buffer,
+    // and a link that will not start does not stop the primary
+    if (!isDatapath && linkfd > 0) {
+        if (v4l2_overlay_stream_on(linkfd)) {
+            LOGE("link device Stream Enable Failed!\n");
         }
     }
     LOG_FUNCTION_NAME_EXIT
@@ -539,7 +539,10 @@ int overlay_data_context_t::disable_streaming_locked(overlay_object* overlayobj,
             linkfd = overlayobj->getctrl_linkvideofd();
         }
         ret = v4l2_overlay_stream_off( fd );
-        if (linkfd > 0 ) {
+        if (isDatapath) {
+            reset_clone_locked(overlayobj);
+        }
+        else if (linkfd > 0 ) {
             v4l2_overlay_stream_off( linkfd );
         }
 
@@ -548,6 +551,8 @@ int overlay_data_context_t::disable_streaming_locked(overlay_object* overlayobj,
         } else {
             overlayobj->streamEn = 0;
             overlayobj->qd_buf_count = 0;
+            // the producer takes every buffer back after a stream off
+            overlayobj->linkHeldBack = 0;
         }
     }
     LOG_FUNCTION_NAME_EXIT
@@ -570,6 +575,135 @@ int overlay_data_context_t::disable_streaming(overlay_object* overlayobj, bool i
     return ret;
 }
 
+/* The link (clone) device shows the same buffers as the primary, queued as
+ * USERPTR, but at its own pace: it is offered the frame just queued to the
+ * primary, takes it only if it is due one (linkMaxFps) and has room for it
+ * (CLONE_MAX_QUEUED), and its finished buffers are collected without
+ * waiting. Whatever it cannot take is dropped for the link alone, so a slow
+ * or stuck TV-out never holds up the primary queue/dequeue. The one thing the
+ * primary waits for is the link letting go of a buffer the producer would
+ * otherwise draw into while it is on the TV, see overlay_dequeueBuffer().
+ */
+void overlay_data_context_t::clone_buffer_locked(overlay_object* overlayobj, int index)
+{
+    int linkfd = overlayobj->getdata_linkvideofd();
+    struct timespec ts;
+    int64_t now, period = 0;
+
+    if (linkfd <= 0) {
+        return;
+    }
+
+    reap_clone_locked(overlayobj, false);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    if (overlayobj->linkMaxFps > 0) {
+        period = 1000000000LL / overlayobj->linkMaxFps;
+    }
+
+    // a quarter period of slack, so a source at the cap is not halved by jitter
+    if ((overlayobj->linkHeld & (1 << index)) ||
+        overlayobj->linkQdCount >= CLONE_MAX_QUEUED ||
+        now < overlayobj->linkNextDue - period / 4) {
+        overlayobj->linkDropped++;
+    }
+    else if (v4l2_overlay_q_buf(linkfd, index, EMEMORY_USRPTR, overlayobj->buffers[index],
+                                overlayobj->buffers_len[index]) < 0) {
+        LOGE("link queueBuffer failed");
+        overlayobj->linkDropped++;
+    }
+    else {
+        overlayobj->linkHeld |= 1 << index;
+        overlayobj->linkQdCount++;
+        overlayobj->linkQueued++;
+        overlayobj->linkNextDue = MAX(overlayobj->linkNextDue + period, now);
+    }
+
+    if (!overlayobj->linkStreamEn && overlayobj->linkQdCount > 0) {
+        if (v4l2_overlay_stream_on(linkfd)) {
+            LOGE("link device Stream Enable Failed!\n");
+        } else {
+            overlayobj->linkStreamEn = 1;
+        }
+    }
+}
+
+/* Collects what the link device has finished with. With wait set it blocks
+ * for one buffer first, and a link that gives nothing back within the dq
+ * timeout is stopped, so the caller always gets at least one buffer freed.
+ */
+void overlay_data_context_t::reap_clone_locked(overlay_object* overlayobj, bool wait)
+{
+    int linkfd = overlayobj->getdata_linkvideofd();
+    int i;
+
+    if (linkfd <= 0 || overlayobj->linkQdCount == 0) {
+        return;
+    }
+
+    if (wait && v4l2_overlay_dq_buf(linkfd, &i, EMEMORY_USRPTR, NULL, 0) != 0) {
+        LOGE("link device stuck, stopping it");
+        reset_clone_locked(overlayobj);
+        return;
+    }
+    else if (wait && i >= 0 && i < NUM_OVERLAY_BUFFERS_MAX && (overlayobj->linkHeld & (1 << i))) {
+        overlayobj->linkHeld &= ~(1 << i);
+        overlayobj->linkQdCount--;
+    }
+
+    while (overlayobj->linkQdCount > 0 &&
+           v4l2_overlay_try_dq_buf(linkfd, &i, EMEMORY_USRPTR, NULL, 0) == 0) {
+        if (i >= 0 && i < NUM_OVERLAY_BUFFERS_MAX && (overlayobj->linkHeld & (1 << i))) {
+            overlayobj->linkHeld &= ~(1 << i);
+            overlayobj->linkQdCount--;
+        }
+    }
+}
+
+int overlay_data_context_t::count_held_back_locked(overlay_object* overlayobj)
+{
+    int i, n = 0;
+
+    for (i = 0; i < NUM_OVERLAY_BUFFERS_MAX; i++) {
+        if (overlayobj->linkHeldBack & (1 << i)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+/* A buffer the primary gave back while the link still showed it, now that the
+ * link has let go of it too; -1 if there is none.
+ */
+int overlay_data_context_t::held_back_locked(overlay_object* overlayobj)
+{
+    uint32_t ready = overlayobj->linkHeldBack & ~overlayobj->linkHeld;
+    int i;
+
+    for (i = 0; i < NUM_OVERLAY_BUFFERS_MAX; i++) {
+        if (ready & (1 << i)) {
+            overlayobj->linkHeldBack &= ~(1 << i);
+            return i;
+        }
+    }
+    return -1;
+}
+
+void overlay_data_context_t::reset_clone_locked(overlay_object* overlayobj)
+{
+    int linkfd = overlayobj->getdata_linkvideofd();
+
+    // stream off hands back everything the link device had
+    if (linkfd > 0 && (overlayobj->linkStreamEn || overlayobj->linkQdCount)) {
+        v4l2_overlay_stream_off(linkfd);
+    }
+    overlayobj->linkStreamEn = 0;
+    overlayobj->linkHeld = 0;
+    overlayobj->linkQdCount = 0;
+    overlayobj->linkNextDue = 0;
+}
+
 // ****************************************************************************
 // Control module context: used only in the control context
 // ****************************************************************************
@@ -1890,15 +2024,30 @@ int overlay_data_context_t::overlay_data_setParameter(struct overlay_data_device
         break;
 #endif
     case SET_CLONE_FD:
+        pthread_mutex_lock(&ctx->omap_overlay->lock);
+        reset_clone_locked(ctx->omap_overlay);
         if (value <= 0) {
             int linkfd = ctx->omap_overlay->getdata_linkvideofd();
             if (linkfd >= 0) {
                 ctx->omap_overlay->setdata_linkvideofd(-1);
                 close(linkfd);
             }
+            pthread_mutex_unlock(&ctx->omap_overlay->lock);
             return 0;
         }
         ctx->omap_overlay->setdata_linkvideofd(value);
+        pthread_mutex_unlock(&ctx->omap_overlay->lock);
+        break;
+    case SET_CLONE_MAX_FPS:
+        // 0 lets the link take every frame it has room for
+        if (value < 0) {
+            LOGE("InValid clone frame rate requested[%d]", value);
+            return -1;
+        }
+        pthread_mutex_lock(&ctx->omap_overlay->lock);
+        ctx->omap_overlay->linkMaxFps = value;
+        pthread_mutex_unlock(&ctx->omap_overlay->lock);
+        break;
     }
 
     LOG_FUNCTION_NAME_EXIT;
@@ -2066,11 +2215,8 @@ int overlay_data_context_t::overlay_dequeueBuffer(struct overlay_data_device_t *
 
     struct overlay_data_context_t* ctx = (struct overlay_data_context_t*)dev;
     int fd = ctx->omap_overlay->getdata_videofd();
-    int linkfd = ctx->omap_overlay->getdata_linkvideofd();
     int rc;
-    int rc1;
     int i = -1;
-    int ii = -1;
 
     pthread_mutex_lock(&ctx->omap_overlay->lock);
     if (ctx->omap_overlay->streamEn == 0) {
@@ -2078,35 +2224,64 @@ int overlay_data_context_t::overlay_dequeueBuffer(struct overlay_data_device_t *
         rc = -EPERM;
     }
 
-    else if ( ctx->omap_overlay->qd_buf_count < ctx->omap_overlay->optimalQBufCnt ) {
-        LOGV("Queue more buffers before attempting to dequeue!");
-        rc = -EPERM;
-    }
+    /* A buffer the link device still shows is never handed to the producer,
+     * it would be drawn into while on the TV. The primary's copy is held back
+     * and returned by a later dequeue, once the link has let go of it; until
+     * then it still counts as queued.
+     */
+    else for (;;) {
+        reap_clone_locked(ctx->omap_overlay, false);
+        if ((i = held_back_locked(ctx->omap_overlay)) >= 0) {
+            *((int *)buffer) = i;
+            ctx->omap_overlay->qd_buf_count --;
+            rc = 0;
+            break;
+        }
+
+        if ( ctx->omap_overlay->qd_buf_count < ctx->omap_overlay->optimalQBufCnt ) {
+            LOGV("Queue more buffers before attempting to dequeue!");
+            rc = -EPERM;
+            break;
+        }
+
+        /* The primary keeps one on screen, so if that is all it has, the rest
+         * is with the link: the producer queues another if it has one left,
+         * else we wait for the link.
+         */
+        if ( ctx->omap_overlay->qd_buf_count - count_held_back_locked(ctx->omap_overlay) < 2 ) {
+            if ( ctx->omap_overlay->qd_buf_count < ctx->omap_overlay->num_buffers ) {
+                LOGV("Queue more buffers, the link device still has the others");
+                rc = -EPERM;
+                break;
+            }
+            reap_clone_locked(ctx->omap_overlay, true);
+            continue;
+        }
+
+        if ( (rc = v4l2_overlay_dq_buf(fd, &i, EMEMORY_MMAP, NULL, 0 )) != 0 ) {
+            LOGE("Failed to DQ/%d\n", rc);
+           //in order to recover from DQ failure scenario, let's disable the stream.
+           //the stream gets re-enabled in the subsequent Q buffer call
+           //if streamoff also fails!!! just return the errorcode to the client
+           rc = disable_streaming_locked(ctx->omap_overlay, true);
+           if (rc == 0) { rc = -1; } //this is required for TIHardwareRenderer
+           break;
+        }
+        if ( i < 0 || i > ctx->omap_overlay->num_buffers ) {
+            LOGE("dqbuffer i=%d",i);
+            rc = -EPERM;
+            break;
+        }
+        if (ctx->omap_overlay->linkHeld & (1 << i)) {
+            ctx->omap_overlay->linkHeldBack |= 1 << i;
+            continue;
+        }
 
-    else if ( (rc = v4l2_overlay_dq_buf(fd, &i, EMEMORY_MMAP, NULL, 0 )) != 0 ) {
-        LOGE("Failed to DQ/%d\n", rc);
-       //in order to recover from DQ failure scenario, let's disable the stream.
-       //the stream gets re-enabled in the subsequent Q buffer call
-       //if streamoff also fails!!! just return the errorcode to the client
-       rc = disable_streaming_locked(ctx->omap_overlay, true);
-       if (rc == 0) { rc = -1; } //this is required for TIHardwareRenderer
-    }
-    else if ( i < 0 || i > ctx->omap_overlay->num_buffers ) {
-        LOGE("dqbuffer i=%d",i);
-        rc = -EPERM;
-    }
-    else {
         *((int *)buffer) = i;
         ctx->omap_overlay->qd_buf_count --;
        // LOGV("INDEX DEQUEUE = %d", i);//me close
        // LOGV("qd_buf_count --");//me close
-    }
-
-    if (linkfd > 0) {
-        if ( (rc1 = v4l2_overlay_dq_buf(linkfd, &ii, EMEMORY_USRPTR, ctx->omap_overlay->buffers[i],
-            ctx->omap_overlay->mapping_data->length)) != 0 ) {
-            LOGE("Failed to DQ link/%d\n", rc1);
-        }
+        break;
     }
 
     //LOGV("qd_buf_count = %d", ctx->omap_overlay->qd_buf_count);//me close
@@ -2133,7 +2308,6 @@ int overlay_data_context_t::overlay_queueBuffer(struct overlay_data_device_t *de
         return -1;
     }
     int fd = ctx->omap_overlay->getdata_videofd();
-    int linkfd = ctx->omap_overlay->getdata_linkvideofd();
 
     if ( !ctx->omap_overlay->controlReady ) {
         LOGI("Control not ready but queue buffer requested!!!\n");
@@ -2158,15 +2332,6 @@ int overlay_data_context_t::overlay_queueBuffer(struct overlay_data_device_t *de
         goto EXIT;
     }
 
-    if (linkfd > 0) {
-        rc = v4l2_overlay_q_buf(linkfd, (int)buffer, EMEMORY_USRPTR, ctx->omap_overlay->buffers[(int)buffer],
-                  ctx->omap_overlay->mapping_data->length);
-        if (rc < 0) {
-            LOGE("link queueBuffer failed. rc = %d", rc);
-            rc = 0;
-        }
-    }
-
     if (ctx->omap_overlay->qd_buf_count < ctx->omap_overlay->num_buffers && rc == 0) {
         ctx->omap_overlay->qd_buf_count ++;
     }
@@ -2176,6 +2341,10 @@ int overlay_data_context_t::overlay_queueBuffer(struct overlay_data_device_t *de
         ctx->omap_overlay->dataReady = 1;
         ctx->enable_streaming_locked(ctx->omap_overlay);
     }
+
+    if (ctx->omap_overlay->streamEn) {
+        ctx->clone_buffer_locked(ctx->omap_overlay, (int)buffer);
+    }
     
     rc = ctx->omap_overlay->qd_buf_count;
 	
@@ -2218,7 +2387,9 @@ void* overlay_data_context_t::overlay_getBufferAddress(struct overlay_data_devic
     ctx->omap_overlay->mapping_data->ptr = NULL;
     
     //[[ OVL_DE-Q_PATCH
-    if((buf.flags & V4L2_BUF_FLAG_QUEUED) || (buf.flags & V4L2_BUF_FLAG_DONE))
+    // held back for the link: not the producer's yet, whatever the primary says
+    if((buf.flags & V4L2_BUF_FLAG_QUEUED) || (buf.flags & V4L2_BUF_FLAG_DONE) ||
+       (ctx->omap_overlay->linkHeldBack & (1 << (int)buffer)))
     {
         ctx->omap_overlay->mapping_data->nQueueToOverlay = 1;   //OVL_DE-Q_PATCH //VIK_DBG  0 Not Q to Ovl, 1 Q to Ovl, -1 Query returned Error.
     }
@@ -2285,6 +2456,8 @@ int overlay_data_context_t::overlay_data_close(struct hw_device_t *dev) {
 
 	int linkfd = ctx->omap_overlay->getdata_linkvideofd();
         if (linkfd >= 0) {
+            LOGD("link device: %u frames queued, %u dropped", ctx->omap_overlay->linkQueued,
+                 ctx->omap_overlay->linkDropped);
             close(linkfd);
         }
 
@@ -111,6 +111,15 @@ public:
     handle_t mDataHandle;
     int mLinkVideoCtrlfd; //fd for the video device getting linked
     int mLinkVideoDatafd; //fd for the video device getting linked
+    // data side state of the link device, it runs behind the primary
+    uint32_t linkStreamEn;
+    uint32_t linkHeld;      // bit per buffer index the link device still has
+    uint32_t linkHeldBack;  // dequeued from the primary, owed to the producer once the link lets go
+    int linkQdCount;
+    int linkMaxFps;
+    int64_t linkNextDue;    // ns, CLOCK_MONOTONIC, when the link wants its next frame
+    uint32_t linkQueued;
+    uint32_t linkDropped;
     uint32_t marker;
     volatile int32_t refCnt;
 
@@ -174,6 +183,14 @@ public:
         this->num_buffers = numbuffers;
         this->mLinkVideoCtrlfd = -1;
         this->mLinkVideoDatafd = -1;
+        this->linkStreamEn = 0;
+        this->linkHeld = 0;
+        this->linkHeldBack = 0;
+        this->linkQdCount = 0;
+        this->linkMaxFps = CLONE_DEFAULT_MAX_FPS;
+        this->linkNextDue = 0;
+        this->linkQueued = 0;
+        this->linkDropped = 0;
         memset( &mCtl, 0, sizeof( mCtl ) );
         memset( &mCtlStage, 0, sizeof( mCtlStage ) );
     }
@@ -277,6 +294,11 @@ public:
     static int  enable_streaming_locked(overlay_object* ovly, bool isDatapath = true);
     static int  disable_streaming(overlay_object* ovly, bool isDatapath = true);
     static int  disable_streaming_locked(overlay_object* ovly, bool isDatapath = true);
+    static void clone_buffer_locked(overlay_object* ovly, int index);
+    static void reap_clone_locked(overlay_object* ovly, bool wait);
+    static int  held_back_locked(overlay_object* ovly);
+    static int  count_held_back_locked(overlay_object* ovly);
+    static void reset_clone_locked(overlay_object* ovly);
 
     overlay_object* omap_overlay;
 
@@ -0,0 +1,822 @@
+/*
+ * Copyright (C) 2011 r3d4
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Behaves like omap_vout as far as TIOverlay.cpp and v4l2_utils.c can
+ * tell: buffers live in an unlinked file so mmap() of the device fd just
+ * works, a queued buffer goes on screen at the next vsync and the one it
+ * replaces becomes dequeueable, STREAMON wants a buffer queued and
+ * STREAMOFF hands every buffer back.
+ */
+
+// open() and open64() must stay two different symbols here
+#undef _FILE_OFFSET_BITS
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <ftw.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../include/videodev.h"
+#include "fake_v4l2.h"
+
+#define FAKE_DEVICES        FAKE_V4L2_DEVICES
+#define FAKE_BUFFERS        16
+#define FAKE_DEFAULT_WIDTH  480         // the panel
+#define FAKE_DEFAULT_HEIGHT 800
+#define FAKE_MAX_SIZE       2048
+#define FAKE_SYSFS          "/sys/devices/platform/omapdss/"
+
+enum {
+    BUF_IDLE,
+    BUF_QUEUED,
+    BUF_ON_SCREEN,
+    BUF_DONE
+};
+
+struct fake_buffer {
+    int state;
+    unsigned long userptr;
+    uint32_t sequence;
+    struct timeval timestamp;
+};
+
+struct fake_device {
+    int fd;                     // backing file, what open() returned; -1 when closed
+    int flags;
+    int streaming;
+
+    struct v4l2_pix_format pix;
+    struct v4l2_window win;
+    struct v4l2_rect crop;
+    int rotation;
+    uint32_t fbuf_flags;
+
+    enum v4l2_memory memory;
+    unsigned count;
+    size_t size;
+    struct fake_buffer buffers[FAKE_BUFFERS];
+
+    int queued[FAKE_BUFFERS];   // waiting for a vsync, in order
+    unsigned queued_head, queued_count;
+    int done[FAKE_BUFFERS];     // off screen again, in order
+    unsigned done_head, done_count;
+    int on_screen;
+
+    uint32_t sequence;
+    long long last_display_us;
+};
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_open64)(const char *, int, ...);
+static int (*real_close)(int);
+static int (*real_ioctl)(int, unsigned long, ...);
+static int (*real_poll)(struct pollfd *, nfds_t, int);
+static int (*real_mutex_lock)(pthread_mutex_t *);
+static pthread_once_t s_resolved = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static struct fake_device s_devices[FAKE_DEVICES];
+static struct fake_v4l2_config s_config;
+static struct fake_v4l2_stats s_stats;
+static char s_root[PATH_MAX];
+static pthread_t s_vsync;
+static int s_running = 0;
+static pthread_mutex_t *s_watched[2];
+
+static void resolve()
+{
+    real_open = (int (*)(const char *, int, ...))dlsym(RTLD_NEXT, "open");
+    real_open64 = (int (*)(const char *, int, ...))dlsym(RTLD_NEXT, "open64");
+    real_close = (int (*)(int))dlsym(RTLD_NEXT, "close");
+    real_ioctl = (int (*)(int, unsigned long, ...))dlsym(RTLD_NEXT, "ioctl");
+    real_poll = (int (*)(struct pollfd *, nfds_t, int))dlsym(RTLD_NEXT, "poll");
+    real_mutex_lock = (int (*)(pthread_mutex_t *))dlsym(RTLD_NEXT, "pthread_mutex_lock");
+}
+
+static long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// s_lock held
+static struct fake_device *find_device(int fd)
+{
+    int i;
+
+    for (i = 0; fd >= 0 && i < FAKE_DEVICES; i++)
+        if (s_devices[i].fd == fd)
+            return &s_devices[i];
+    return NULL;
+}
+
+static int bytes_per_pixel(uint32_t pixelformat)
+{
+    switch (pixelformat) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_UYVY:
+    case V4L2_PIX_FMT_RGB565:
+        return 2;
+    case V4L2_PIX_FMT_RGB32:
+        return 4;
+    }
+    return 0;
+}
+
+static void set_pix(struct fake_device *dev, uint32_t pixelformat, uint32_t w, uint32_t h)
+{
+    dev->pix.width = w;
+    dev->pix.height = h;
+    dev->pix.pixelformat = pixelformat;
+    dev->pix.field = V4L2_FIELD_NONE;
+    dev->pix.bytesperline = w * bytes_per_pixel(pixelformat);
+    dev->pix.sizeimage = dev->pix.bytesperline * h;
+    dev->crop.left = 0;
+    dev->crop.top = 0;
+    dev->crop.width = w;
+    dev->crop.height = h;
+}
+
+// s_lock held; every buffer back to the application, as STREAMOFF does
+static void release_buffers(struct fake_device *dev)
+{
+    unsigned i;
+
+    for (i = 0; i < dev->count; i++)
+        dev->buffers[i].state = BUF_IDLE;
+    dev->queued_head = dev->queued_count = 0;
+    dev->done_head = dev->done_count = 0;
+    dev->on_screen = -1;
+}
+
+// s_lock held
+static void show_next(struct fake_device *dev, long long now)
+{
+    struct fake_v4l2_display *display = &s_stats.display[dev - s_devices];
+    int index = dev->queued[dev->queued_head];
+
+    dev->queued_head = (dev->queued_head + 1) % FAKE_BUFFERS;
+    dev->queued_count--;
+
+    if (dev->on_screen >= 0) {
+        dev->buffers[dev->on_screen].state = BUF_DONE;
+        dev->done[(dev->done_head + dev->done_count) % FAKE_BUFFERS] = dev->on_screen;
+        dev->done_count++;
+    }
+    dev->on_screen = index;
+    dev->buffers[index].state = BUF_ON_SCREEN;
+    dev->buffers[index].sequence = dev->sequence++;
+    dev->buffers[index].timestamp.tv_sec = now / 1000000;
+    dev->buffers[index].timestamp.tv_usec = now % 1000000;
+    display->displayed++;
+
+    if (dev->last_display_us) {
+        unsigned interval = (unsigned)(now - dev->last_display_us);
+        display->interval_us_sum += interval;
+        display->interval_us_sq_sum += (uint64_t)interval * interval;
+        if (interval > display->interval_us_max)
+            display->interval_us_max = interval;
+        display->intervals++;
+    }
+    dev->last_display_us = now;
+}
+
+// each device keeps its own vsync schedule, the LCD and TV-out need not agree
+static void *vsync_thread(void *arg)
+{
+    long long next[FAKE_DEVICES], period[FAKE_DEVICES];
+    long long start = now_us();
+    int i;
+
+    for (i = 0; i < FAKE_DEVICES; i++) {
+        int hz = s_config.device_refresh_hz[i] > 0 ? s_config.device_refresh_hz[i] : s_config.refresh_hz;
+        period[i] = 1000000 / hz;
+        next[i] = start + period[i];
+    }
+
+    pthread_mutex_lock(&s_lock);
+    while (s_running) {
+        long long wake = next[0], now;
+        struct timespec ts;
+        int shown = 0;
+
+        for (i = 1; i < FAKE_DEVICES; i++)
+            if (next[i] < wake)
+                wake = next[i];
+        pthread_mutex_unlock(&s_lock);
+        ts.tv_sec = wake / 1000000;
+        ts.tv_nsec = (wake % 1000000) * 1000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        pthread_mutex_lock(&s_lock);
+
+        now = now_us();
+        for (i = 0; i < FAKE_DEVICES; i++) {
+            struct fake_device *dev = &s_devices[i];
+
+            if (next[i] > wake)
+                continue;
+            next[i] += period[i];
+            if (dev->fd < 0 || !dev->streaming)
+                continue;
+            s_stats.display[i].vsyncs++;
+            shown = 1;
+            if (dev->queued_count)
+                show_next(dev, now);
+            else
+                s_stats.display[i].repeated++;
+        }
+        if (shown)
+            pthread_cond_broadcast(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return NULL;
+}
+
+// s_lock held; 0 or an errno
+static int device_ioctl(struct fake_device *dev, unsigned int request, void *arg)
+{
+    switch (request) {
+    case VIDIOC_QUERYCAP: {
+        struct v4l2_capability *cap = (struct v4l2_capability *)arg;
+        memset(cap, 0, sizeof(*cap));
+        strcpy((char *)cap->driver, "omap_vout");
+        strcpy((char *)cap->card, "fake_v4l2");
+        cap->capabilities = V4L2_CAP_STREAMING | V4L2_CAP_VIDEO_OUTPUT | V4L2_CAP_VIDEO_OVERLAY;
+        return 0;
+    }
+
+    case VIDIOC_G_FMT: {
+        struct v4l2_format *f = (struct v4l2_format *)arg;
+        if (f->type == V4L2_BUF_TYPE_VIDEO_OUTPUT)
+            f->fmt.pix = dev->pix;
+        else if (f->type == V4L2_BUF_TYPE_VIDEO_OVERLAY)
+            f->fmt.win = dev->win;
+        else
+            return EINVAL;
+        return 0;
+    }
+
+    case VIDIOC_S_FMT: {
+        struct v4l2_format *f = (struct v4l2_format *)arg;
+        if (f->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+            if (dev->streaming)
+                return EBUSY;
+            if (!bytes_per_pixel(f->fmt.pix.pixelformat) || f->fmt.pix.width == 0 ||
+                f->fmt.pix.height == 0 || f->fmt.pix.width > FAKE_MAX_SIZE ||
+                f->fmt.pix.height > FAKE_MAX_SIZE)
+                return EINVAL;
+            set_pix(dev, f->fmt.pix.pixelformat, f->fmt.pix.width, f->fmt.pix.height);
+            f->fmt.pix = dev->pix;
+        } else if (f->type == V4L2_BUF_TYPE_VIDEO_OVERLAY) {
+            dev->win.w = f->fmt.win.w;
+            dev->win.chromakey = f->fmt.win.chromakey;
+            dev->win.global_alpha = f->fmt.win.global_alpha;
+        } else {
+            return EINVAL;
+        }
+        return 0;
+    }
+
+    case VIDIOC_G_CROP:
+    case VIDIOC_S_CROP: {
+        struct v4l2_crop *crop = (struct v4l2_crop *)arg;
+        if (crop->type != V4L2_BUF_TYPE_VIDEO_OUTPUT)
+            return EINVAL;
+        if (request == VIDIOC_G_CROP) {
+            crop->c = dev->crop;
+            return 0;
+        }
+        // omap_vout trims the window to the image rather than refusing it
+        if (crop->c.width == 0 || crop->c.height == 0)
+            return EINVAL;
+        if (crop->c.left < 0)
+            crop->c.left = 0;
+        if (crop->c.top < 0)
+            crop->c.top = 0;
+        if ((uint32_t)crop->c.left >= dev->pix.width || (uint32_t)crop->c.top >= dev->pix.height)
+            return EINVAL;
+        if ((uint32_t)crop->c.left + crop->c.width > dev->pix.width)
+            crop->c.width = dev->pix.width - crop->c.left;
+        if ((uint32_t)crop->c.top + crop->c.height > dev->pix.height)
+            crop->c.height = dev->pix.height - crop->c.top;
+        dev->crop = crop->c;
+        return 0;
+    }
+
+    case VIDIOC_G_CTRL:
+    case VIDIOC_S_CTRL: {
+        struct v4l2_control *ctrl = (struct v4l2_control *)arg;
+        if (ctrl->id == V4L2_CID_ROTATE) {
+            if (request == VIDIOC_G_CTRL) {
+                ctrl->value = dev->rotation;
+                return 0;
+            }
+            if (ctrl->value != 0 && ctrl->value != 90 && ctrl->value != 180 && ctrl->value != 270)
+                return EINVAL;
+            dev->rotation = ctrl->value;
+            return 0;
+        }
+        if (ctrl->id == V4L2_CID_TI_DISPC_OVERLAY && request == VIDIOC_G_CTRL) {
+            // video1 and video2 sit on overlay1 and overlay2, overlay0 is graphics
+            ctrl->value = (int)(dev - s_devices) + 1;
+            return 0;
+        }
+        return EINVAL;
+    }
+
+    case VIDIOC_G_FBUF:
+    case VIDIOC_S_FBUF: {
+        struct v4l2_framebuffer *fbuf = (struct v4l2_framebuffer *)arg;
+        if (request == VIDIOC_G_FBUF) {
+            memset(fbuf, 0, sizeof(*fbuf));
+            fbuf->flags = dev->fbuf_flags;
+        } else {
+            dev->fbuf_flags = fbuf->flags;
+        }
+        return 0;
+    }
+
+    case VIDIOC_REQBUFS: {
+        struct v4l2_requestbuffers *req = (struct v4l2_requestbuffers *)arg;
+        if (req->type != V4L2_BUF_TYPE_VIDEO_OUTPUT ||
+            (req->memory != V4L2_MEMORY_MMAP && req->memory != V4L2_MEMORY_USERPTR))
+            return EINVAL;
+        if (dev->streaming)
+            return EBUSY;
+        dev->memory = (enum v4l2_memory)req->memory;
+        dev->count = req->count < FAKE_BUFFERS ? req->count : FAKE_BUFFERS;
+        dev->size = dev->pix.sizeimage;
+        if (dev->memory == V4L2_MEMORY_MMAP) {
+            dev->size = (dev->size + getpagesize() - 1) & ~(size_t)(getpagesize() - 1);
+            if (ftruncate(dev->fd, (off_t)(dev->size * dev->count)) < 0)
+                return ENOMEM;
+        }
+        memset(dev->buffers, 0, sizeof(dev->buffers));
+        release_buffers(dev);
+        req->count = dev->count;
+        s_stats.reqbufs++;
+        return 0;
+    }
+
+    case VIDIOC_QUERYBUF:
+    case VIDIOC_QBUF:
+    case VIDIOC_DQBUF: {
+        struct v4l2_buffer *buf = (struct v4l2_buffer *)arg;
+        struct fake_buffer *fb;
+
+        if (buf->type != V4L2_BUF_TYPE_VIDEO_OUTPUT)
+            return EINVAL;
+
+        if (request == VIDIOC_DQBUF) {
+            while (!dev->done_count) {
+                if (!dev->streaming)
+                    return EINVAL;
+                if (dev->flags & O_NONBLOCK)
+                    return EAGAIN;
+                pthread_cond_wait(&s_cond, &s_lock);
+            }
+            buf->index = dev->done[dev->done_head];
+            dev->done_head = (dev->done_head + 1) % FAKE_BUFFERS;
+            dev->done_count--;
+            fb = &dev->buffers[buf->index];
+            fb->state = BUF_IDLE;
+            buf->memory = dev->memory;
+            buf->sequence = fb->sequence;
+            buf->timestamp = fb->timestamp;
+            buf->flags = 0;
+            buf->length = dev->size;
+            if (dev->memory == V4L2_MEMORY_USERPTR)
+                buf->m.userptr = fb->userptr;
+            return 0;
+        }
+
+        if (buf->index >= dev->count)
+            return EINVAL;
+        fb = &dev->buffers[buf->index];
+
+        if (request == VIDIOC_QUERYBUF) {
+            buf->memory = dev->memory;
+            buf->length = dev->size;
+            buf->m.offset = buf->index * dev->size;
+            buf->sequence = fb->sequence;
+            buf->flags = fb->state == BUF_DONE ? V4L2_BUF_FLAG_DONE :
+                         fb->state != BUF_IDLE ? V4L2_BUF_FLAG_QUEUED : 0;
+            return 0;
+        }
+
+        if (buf->memory != dev->memory || fb->state != BUF_IDLE)
+            return EINVAL;
+        if (dev->memory == V4L2_MEMORY_USERPTR) {
+            if (!buf->m.userptr)
+                return EINVAL;
+            fb->userptr = buf->m.userptr;
+        }
+        fb->state = BUF_QUEUED;
+        dev->queued[(dev->queued_head + dev->queued_count) % FAKE_BUFFERS] = buf->index;
+        dev->queued_count++;
+        return 0;
+    }
+
+    case VIDIOC_STREAMON:
+        if (dev->streaming)
+            return 0;
+        if (!dev->queued_count)
+            return EIO;
+        dev->streaming = 1;
+        show_next(dev, now_us());
+        s_stats.stream_ons++;
+        return 0;
+
+    case VIDIOC_STREAMOFF:
+        if (dev->streaming) {
+            dev->streaming = 0;
+            s_stats.stream_offs++;
+        }
+        release_buffers(dev);
+        pthread_cond_broadcast(&s_cond);
+        return 0;
+    }
+
+    return EINVAL;
+}
+
+static int is_slow_ioctl(unsigned int request)
+{
+    return request == VIDIOC_S_FMT || request == VIDIOC_S_CROP || request == VIDIOC_S_CTRL ||
+           request == VIDIOC_S_FBUF || request == VIDIOC_REQBUFS ||
+           request == VIDIOC_STREAMON || request == VIDIOC_STREAMOFF;
+}
+
+static int open_device(int id, int flags)
+{
+    struct fake_device *dev = &s_devices[id - 1];
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/video%d.buffers", s_root, id);
+    fd = real_open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+
+    pthread_mutex_lock(&s_lock);
+    if (dev->fd >= 0) {
+        pthread_mutex_unlock(&s_lock);
+        real_close(fd);
+        errno = EBUSY;
+        return -1;
+    }
+    memset(dev, 0, sizeof(*dev));
+    dev->fd = fd;
+    dev->flags = flags;
+    dev->on_screen = -1;
+    set_pix(dev, V4L2_PIX_FMT_UYVY, FAKE_DEFAULT_WIDTH, FAKE_DEFAULT_HEIGHT);
+    dev->win.w.width = FAKE_DEFAULT_WIDTH;
+    dev->win.w.height = FAKE_DEFAULT_HEIGHT;
+    pthread_mutex_unlock(&s_lock);
+    return fd;
+}
+
+static int fake_open(int (*next)(const char *, int, ...), const char *path, int flags, mode_t mode)
+{
+    char redirected[PATH_MAX];
+
+    if (s_root[0] && path) {
+        if (!strncmp(path, "/dev/video", 10)) {
+            int id = atoi(path + 10);
+            if (id >= 1 && id <= FAKE_DEVICES)
+                return open_device(id, flags);
+        }
+        if (!strncmp(path, FAKE_SYSFS, sizeof(FAKE_SYSFS) - 1)) {
+            snprintf(redirected, sizeof(redirected), "%s/%s", s_root, path + sizeof(FAKE_SYSFS) - 1);
+            path = redirected;
+        }
+    }
+    return next(path, flags, mode);
+}
+
+int open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+
+    pthread_once(&s_resolved, resolve);
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = (mode_t)va_arg(ap, int);
+        va_end(ap);
+    }
+    return fake_open(real_open, path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+
+    pthread_once(&s_resolved, resolve);
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = (mode_t)va_arg(ap, int);
+        va_end(ap);
+    }
+    return fake_open(real_open64, path, flags, mode);
+}
+
+int close(int fd)
+{
+    struct fake_device *dev;
+
+    pthread_once(&s_resolved, resolve);
+    pthread_mutex_lock(&s_lock);
+    if ((dev = find_device(fd)) != NULL) {
+        if (dev->streaming)
+            s_stats.stream_offs++;
+        dev->streaming = 0;
+        release_buffers(dev);
+        dev->fd = -1;
+        pthread_cond_broadcast(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return real_close(fd);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    struct fake_device *dev;
+    va_list ap;
+    void *arg;
+    int err;
+
+    pthread_once(&s_resolved, resolve);
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    pthread_mutex_lock(&s_lock);
+    dev = find_device(fd);
+    pthread_mutex_unlock(&s_lock);
+    if (!dev)
+        return real_ioctl(fd, request, arg);
+
+    // the driver waits on the display controller for these
+    if (s_config.ioctl_us && is_slow_ioctl((unsigned int)request))
+        usleep(s_config.ioctl_us);
+
+    // v4l2_overlay_ioctl() passes the request as an int, the kernel only looks at 32 bits
+    pthread_mutex_lock(&s_lock);
+    s_stats.ioctls++;
+    err = dev->fd == fd ? device_ioctl(dev, (unsigned int)request, arg) : EBADF;
+    pthread_mutex_unlock(&s_lock);
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+// s_lock held
+static int poll_events(struct pollfd *fds, nfds_t nfds)
+{
+    nfds_t i;
+    int ready = 0;
+
+    for (i = 0; i < nfds; i++) {
+        struct fake_device *dev = find_device(fds[i].fd);
+
+        fds[i].revents = 0;
+        if (!dev)
+            continue;
+        if (dev->done_count)
+            fds[i].revents = fds[i].events & (POLLOUT | POLLWRNORM);
+        else if (!dev->streaming)
+            fds[i].revents = POLLERR;
+        if (fds[i].revents)
+            ready++;
+    }
+    return ready;
+}
+
+// only the fake devices are waited on when the set mixes both
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    struct timespec deadline;
+    nfds_t i;
+    int ready, any = 0;
+
+    pthread_once(&s_resolved, resolve);
+    pthread_mutex_lock(&s_lock);
+    for (i = 0; i < nfds && !any; i++)
+        any = find_device(fds[i].fd) != NULL;
+    if (!any) {
+        pthread_mutex_unlock(&s_lock);
+        return real_poll(fds, nfds, timeout);
+    }
+
+    if (timeout > 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    while (!(ready = poll_events(fds, nfds)) && timeout != 0) {
+        if (timeout < 0)
+            pthread_cond_wait(&s_cond, &s_lock);
+        else if (pthread_cond_timedwait(&s_cond, &s_lock, &deadline) == ETIMEDOUT)
+            timeout = 0;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ready;
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    long long start;
+    unsigned wait;
+    int rc;
+
+    pthread_once(&s_resolved, resolve);
+    if (mutex != s_watched[0] && mutex != s_watched[1])
+        return real_mutex_lock(mutex);
+
+    if (pthread_mutex_trylock(mutex) == 0) {
+        s_stats.lock_acquired++;
+        return 0;
+    }
+    start = now_us();
+    if ((rc = real_mutex_lock(mutex)) != 0)
+        return rc;
+    wait = (unsigned)(now_us() - start);
+
+    // the counters are only touched with the watched mutex held
+    s_stats.lock_acquired++;
+    s_stats.lock_contended++;
+    s_stats.lock_wait_us_sum += wait;
+    if (wait > s_stats.lock_wait_us_max)
+        s_stats.lock_wait_us_max = wait;
+    return 0;
+}
+
+void fake_v4l2_watch_lock(pthread_mutex_t *first, pthread_mutex_t *second)
+{
+    s_watched[0] = first;
+    s_watched[1] = second;
+}
+
+static int write_sysfs(const char *name, const char *value)
+{
+    char path[PATH_MAX];
+    char *slash;
+    int fd, len = strlen(value);
+
+    snprintf(path, sizeof(path), "%s/%s", s_root, name);
+    slash = strrchr(path, '/');
+    *slash = '\0';
+    mkdir(path, 0700);
+    *slash = '/';
+
+    fd = real_open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return -1;
+    if (write(fd, value, len) != len) {
+        real_close(fd);
+        return -1;
+    }
+    return real_close(fd);
+}
+
+int fake_v4l2_init(const struct fake_v4l2_config *config)
+{
+    static const char *files[][2] = {
+        { "display0/name", "lcd\n" },
+        { "display0/enabled", "1\n" },
+        // pixel clock, xres/hfp/hbp/hsw, yres/vfp/vbp/vsw
+        { "display0/timings", "24000,480/8/8/4,800/2/2/2\n" },
+        { "manager0/name", "lcd\n" },
+        { "manager0/display", "lcd\n" },
+        { "manager0/trans_key_enabled", "0\n" },
+        { "manager0/trans_key_type", "gfx-destination\n" },
+        { "manager0/trans_key_value", "0\n" },
+        { "manager1/name", "tv\n" },
+        { "manager1/display", "\n" },
+        { "manager1/trans_key_enabled", "0\n" },
+        { "manager1/trans_key_type", "gfx-destination\n" },
+        { "manager1/trans_key_value", "0\n" },
+        { "overlay0/manager", "lcd\n" },
+        { "overlay0/enabled", "1\n" },
+        { "overlay0/zorder", "0\n" },
+        { "overlay1/manager", "lcd\n" },
+        { "overlay1/enabled", "0\n" },
+        { "overlay1/zorder", "1\n" },
+        { "overlay2/manager", "lcd\n" },
+        { "overlay2/enabled", "0\n" },
+        { "overlay2/zorder", "2\n" },
+    };
+    unsigned i;
+
+    pthread_once(&s_resolved, resolve);
+    if (s_root[0])
+        return -1;
+
+    s_config = *config;
+    if (s_config.refresh_hz <= 0)
+        s_config.refresh_hz = 60;
+    memset(&s_stats, 0, sizeof(s_stats));
+    for (i = 0; i < FAKE_DEVICES; i++)
+        s_devices[i].fd = -1;
+
+    strcpy(s_root, "/tmp/fake_v4l2.XXXXXX");
+    if (!mkdtemp(s_root)) {
+        s_root[0] = '\0';
+        return -1;
+    }
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        if (write_sysfs(files[i][0], files[i][1]) < 0) {
+            fake_v4l2_exit();
+            return -1;
+        }
+    }
+
+    s_running = 1;
+    if (pthread_create(&s_vsync, NULL, vsync_thread, NULL)) {
+        s_running = 0;
+        fake_v4l2_exit();
+        return -1;
+    }
+    return 0;
+}
+
+void fake_v4l2_get_stats(struct fake_v4l2_stats *stats)
+{
+    pthread_mutex_lock(&s_lock);
+    *stats = s_stats;
+    pthread_mutex_unlock(&s_lock);
+}
+
+int fake_v4l2_reading(int device, int index)
+{
+    const struct fake_device *dev = &s_devices[device];
+    int reading;
+
+    pthread_mutex_lock(&s_lock);
+    reading = index >= 0 && (unsigned)index < dev->count &&
+        (dev->buffers[index].state == BUF_QUEUED || dev->buffers[index].state == BUF_ON_SCREEN);
+    pthread_mutex_unlock(&s_lock);
+    return reading;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    return remove(path);
+}
+
+void fake_v4l2_exit(void)
+{
+    if (s_running) {
+        pthread_mutex_lock(&s_lock);
+        s_running = 0;
+        pthread_mutex_unlock(&s_lock);
+        pthread_join(s_vsync, NULL);
+    }
+    if (s_root[0]) {
+        nftw(s_root, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+        s_root[0] = '\0';
+    }
+}
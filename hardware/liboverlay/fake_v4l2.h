@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2011 r3d4
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Fake omap_vout video output devices and omapdss sysfs, for running the
+ * overlay HAL on a Linux host. Linked into the program, it takes over
+ * open(), close(), ioctl() and poll() for /dev/video1../dev/video3 and
+ * sends /sys/devices/platform/omapdss/ to a scratch directory; anything
+ * else goes to libc. It also takes over pthread_mutex_lock() to count
+ * contention on the mutex given to fake_v4l2_watch_lock().
+ */
+
+#ifndef FAKE_V4L2_H_
+#define FAKE_V4L2_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FAKE_V4L2_DEVICES 3     // /dev/video1../dev/video3
+
+struct fake_v4l2_config {
+    int refresh_hz;             // display refresh, a queued frame goes on screen per vsync
+    int device_refresh_hz[FAKE_V4L2_DEVICES];  // where set, this device's own refresh (TV-out)
+    int ioctl_us;               // time the driver takes for format, crop, stream and buffer setup
+};
+
+struct fake_v4l2_display {
+    unsigned vsyncs;            // while the device was streaming
+    unsigned displayed;         // new frames put on screen
+    unsigned repeated;          // vsyncs that showed the previous frame again
+    uint64_t interval_us_sum;   // between frames put on screen
+    uint64_t interval_us_sq_sum;
+    unsigned interval_us_max;
+    unsigned intervals;
+};
+
+struct fake_v4l2_stats {
+    struct fake_v4l2_display display[FAKE_V4L2_DEVICES];
+    unsigned stream_ons;
+    unsigned stream_offs;
+    unsigned reqbufs;
+    unsigned ioctls;
+    unsigned lock_acquired;     // of the watched mutex
+    unsigned lock_contended;    // had to wait for it
+    uint64_t lock_wait_us_sum;
+    unsigned lock_wait_us_max;
+};
+
+// before the HAL opens anything; 0 or -1
+int fake_v4l2_init(const struct fake_v4l2_config *config);
+void fake_v4l2_get_stats(struct fake_v4l2_stats *stats);
+// the device still has buffer index queued or on screen, and reads it
+int fake_v4l2_reading(int device, int index);
+// one mutex, seen through up to two mappings of the memory it lives in
+void fake_v4l2_watch_lock(pthread_mutex_t *first, pthread_mutex_t *second);
+// stops the vsync thread and removes the sysfs directory
+void fake_v4l2_exit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // FAKE_V4L2_H_
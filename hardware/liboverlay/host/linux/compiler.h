@@ -0,0 +1,21 @@
+/*
+ * Host build of overlay_bench only: the bionic kernel headers provide
+ * this, and with it the size_t, PATH_MAX and PAGE_SIZE that videodev2.h
+ * and v4l2_utils.c take for granted.
+ */
+
+#ifndef _OVERLAY_HOST_LINUX_COMPILER_H
+#define _OVERLAY_HOST_LINUX_COMPILER_H
+
+#include <stddef.h>
+#include <limits.h>
+
+#ifndef __user
+#define __user
+#endif
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 4096
+#endif
+
+#endif
@@ -0,0 +1,533 @@
+/*
+ * Copyright (C) 2011 r3d4
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * usage: overlay_bench [-d seconds] [-f fps] [-w width] [-h height]
+ *                      [-c frames] [-z frames] [-p per second] [-R]
+ *                      [-v refresh hz] [-t tv refresh hz] [-T fps]
+ *                      [-k us] [-o file]
+ *
+ * Host throughput and latency benchmark for the overlay HAL, run against
+ * fake_v4l2.c. TIOverlay_test needs SurfaceFlinger, so this opens the
+ * control and data devices itself, the way Overlay and the camera do.
+ *
+ * One thread feeds frames at a fixed rate with nextPreview()'s
+ * queueBuffer/dequeueBuffer pattern, including its recovery when the
+ * stream restarts underneath it:
+ *   -f  frames per second (30)
+ *   -c  setCrop every this many frames, full frame and centre half in turn
+ *   -z  resizeInput every this many frames, full size and half in turn
+ * A second thread plays SurfaceFlinger:
+ *   -p  setPosition and commit this many times a second, moving the window
+ *   -R  also flip the rotation 0/180, so every commit restarts the stream
+ * and the fake display:
+ *   -v  refresh rate (60)
+ *   -t  also clone the overlay to a TV-out link device with this refresh
+ *   -T  cap the clone at this many frames a second (SET_CLONE_MAX_FPS)
+ *   -k  time the driver spends in format, crop, stream and buffer ioctls
+ *
+ * Prints one JSON object: per call latency percentiles, frame accounting,
+ * producer and display jitter, and contention on the overlay mutex.
+ */
+
+#define BENCH_PRIMARY   0       // /dev/video1, where the first overlay goes
+#define BENCH_CLONE     1       // /dev/video2, as requestOverlayClone() would pick
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+
+#include <hardware/overlay.h>
+
+extern "C" {
+#include "v4l2_utils.h"
+}
+
+#include "overlay_common.h"
+#include "TIOverlay.h"
+#include "fake_v4l2.h"
+
+extern struct overlay_module_t HAL_MODULE_INFO_SYM;
+
+struct bench_op {
+    const char* name;
+    unsigned* us;
+    unsigned count;
+    unsigned size;
+    unsigned failed;
+};
+
+// each op is only ever timed from one thread
+enum {
+    OP_QUEUE,
+    OP_DEQUEUE,
+    OP_SET_CROP,
+    OP_RESIZE_INPUT,
+    OP_SET_POSITION,
+    OP_COMMIT,
+    OP_LATE,        // producer wake up past the frame's slot
+    OP_COUNT
+};
+
+static bench_op s_ops[OP_COUNT] = {
+    { "queueBuffer" },
+    { "dequeueBuffer" },
+    { "setCrop" },
+    { "resizeInput" },
+    { "setPosition" },
+    { "commit" },
+    { "producer_late" },
+};
+
+struct bench_frames {
+    unsigned scheduled;
+    unsigned queued;
+    unsigned dequeued;
+    unsigned skipped_late;      // woke up a whole period late, frame skipped
+    unsigned no_buffer;         // every buffer was with the display
+    unsigned queue_failed;
+    unsigned dequeue_failed;
+    unsigned reclaimed;         // given back by a stream restart
+    unsigned torn;              // dequeued while the clone still showed it
+};
+
+static struct overlay_control_device_t* s_control;
+static struct overlay_data_device_t* s_data;
+static overlay_t* s_overlay;
+static volatile int s_stop = 0;
+static int s_controlRate = 0;
+static int s_rotate = 0;
+static int s_cloneFps = -1;
+
+static long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_until(long long us)
+{
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static void record(int op, long long start, int rc)
+{
+    bench_op* o = &s_ops[op];
+
+    if (o->count == o->size) {
+        o->size = o->size ? o->size * 2 : 1024;
+        o->us = (unsigned*)realloc(o->us, o->size * sizeof(unsigned));
+    }
+    o->us[o->count++] = (unsigned)(now_us() - start);
+    if (rc < 0)
+        o->failed++;
+}
+
+static int compare_us(const void* a, const void* b)
+{
+    unsigned x = *(const unsigned*)a, y = *(const unsigned*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_op(FILE* out, const bench_op* o, const char* sep)
+{
+    unsigned long long sum = 0;
+    unsigned i, n = o->count;
+
+    if (!n) {
+        fprintf(out, "    \"%s\": { \"n\": 0 }%s\n", o->name, sep);
+        return;
+    }
+    qsort(o->us, n, sizeof(unsigned), compare_us);
+    for (i = 0; i < n; i++)
+        sum += o->us[i];
+    fprintf(out, "    \"%s\": { \"n\": %u, \"failed\": %u, \"mean\": %llu, \"p50\": %u, \"p90\": %u, "
+            "\"p99\": %u, \"max\": %u }%s\n", o->name, n, o->failed, sum / n,
+            o->us[n * 50 / 100], o->us[n * 90 / 100], o->us[n * 99 / 100], o->us[n - 1], sep);
+}
+
+// SurfaceFlinger moving the window around
+static void* control_thread(void* arg)
+{
+    long long period = 1000000 / s_controlRate;
+    long long next = now_us();
+    int flip = 0;
+
+    while (!s_stop) {
+        long long start;
+        int rc;
+
+        next += period;
+        sleep_until(next);
+        flip = !flip;
+
+        start = now_us();
+        rc = s_control->setPosition(s_control, s_overlay, 0, flip ? 40 : 0, LCD_WIDTH, LCD_WIDTH * 3 / 4);
+        record(OP_SET_POSITION, start, rc);
+
+        if (s_rotate)
+            s_control->setParameter(s_control, s_overlay, OVERLAY_TRANSFORM, flip ? OVERLAY_TRANSFORM_ROT_180 : 0);
+
+        start = now_us();
+        rc = s_control->commit(s_control, s_overlay);
+        record(OP_COMMIT, start, rc);
+    }
+    return NULL;
+}
+
+// what requestOverlayClone() does for SurfaceFlinger, then hand it to the data side
+static int open_clone(uint32_t width, uint32_t height)
+{
+    uint32_t count = NUM_OVERLAY_BUFFERS_REQUESTED;
+    int fd = v4l2_overlay_open(BENCH_CLONE);
+
+    if (fd < 0)
+        return -1;
+    if (v4l2_overlay_init(fd, width, height, OVERLAY_FORMAT_CbYCrY_422_I) ||
+        v4l2_overlay_set_rotation(fd, 0, 0) ||
+        v4l2_overlay_set_crop(fd, 0, 0, width, height) ||
+        v4l2_overlay_req_buf(fd, &count, 0, 0, EMEMORY_USRPTR) ||
+        s_data->setParameter(s_data, SET_CLONE_FD, fd)) {
+        close(fd);
+        return -1;
+    }
+    if (s_cloneFps >= 0 && s_data->setParameter(s_data, SET_CLONE_MAX_FPS, s_cloneFps))
+        return -1;
+    return 0;
+}
+
+static void print_display(FILE* out, const char* name, const struct fake_v4l2_display* d, const char* sep)
+{
+    double mean = 0, stdev = 0;
+
+    if (d->intervals) {
+        mean = (double)d->interval_us_sum / d->intervals;
+        stdev = (double)d->interval_us_sq_sum / d->intervals - mean * mean;
+        stdev = stdev > 0 ? sqrt(stdev) : 0;
+    }
+    fprintf(out, "    \"%s\": { \"vsyncs\": %u, \"displayed\": %u, \"repeated\": %u, "
+            "\"interval_us\": { \"n\": %u, \"mean\": %.0f, \"stdev\": %.0f, \"max\": %u } }%s\n",
+            name, d->vsyncs, d->displayed, d->repeated, d->intervals, mean, stdev, d->interval_us_max, sep);
+}
+
+static int map_buffers(void** buffers)
+{
+    int i, count = s_data->getBufferCount(s_data);
+
+    for (i = 0; i < count; i++) {
+        mapping_data_t* data = (mapping_data_t*)s_data->getBufferAddress(s_data, (void*)i);
+        if (data == NULL || data->ptr == NULL)
+            return -1;
+        buffers[i] = data->ptr;
+    }
+    return count;
+}
+
+// nextPreview(): give back what the overlay no longer holds after a stream off
+static void reclaim(int* inDss, int* nQueued, int count, bench_frames* frames)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        mapping_data_t* data;
+
+        if (!inDss[i])
+            continue;
+        data = (mapping_data_t*)s_data->getBufferAddress(s_data, (void*)i);
+        if (data != NULL && !data->nQueueToOverlay) {
+            inDss[i] = 0;
+            (*nQueued)--;
+            frames->reclaimed++;
+        }
+    }
+}
+
+static void produce(int seconds, int fps, uint32_t width, uint32_t height,
+                    int cropEvery, int resizeEvery, bench_frames* frames)
+{
+    void* buffers[NUM_OVERLAY_BUFFERS_MAX];
+    int inDss[NUM_OVERLAY_BUFFERS_MAX];
+    int count, nQueued = 0, next = 0;
+    uint32_t w = width, h = height;
+    long long period = 1000000 / fps;
+    long long start = now_us(), end = start + (long long)seconds * 1000000;
+    int cropped = 0, frame;
+
+    memset(inDss, 0, sizeof(inDss));
+    if ((count = map_buffers(buffers)) <= 0) {
+        fprintf(stderr, "no overlay buffers\n");
+        return;
+    }
+
+    for (frame = 0; ; frame++) {
+        long long due = start + frame * period, t;
+        overlay_buffer_t buffer;
+        int index = -1, i, rc;
+
+        if (due >= end)
+            break;
+        frames->scheduled++;
+        sleep_until(due);
+        t = now_us();
+        if (t - due >= period) {
+            frames->skipped_late++;
+            continue;
+        }
+        record(OP_LATE, due, 0);
+
+        if (cropEvery && frame && frame % cropEvery == 0) {
+            cropped = !cropped;
+            t = now_us();
+            if (cropped)
+                rc = s_data->setCrop(s_data, w / 4, h / 4, w / 2, h / 2);
+            else
+                rc = s_data->setCrop(s_data, 0, 0, w, h);
+            record(OP_SET_CROP, t, rc);
+        }
+
+        if (resizeEvery && frame && frame % resizeEvery == 0) {
+            uint32_t newW = w == width ? width / 2 : width;
+            uint32_t newH = h == height ? height / 2 : height;
+
+            t = now_us();
+            rc = s_data->resizeInput(s_data, newW, newH);
+            record(OP_RESIZE_INPUT, t, rc);
+            if (rc == 0) {
+                w = newW;
+                h = newH;
+                cropped = 0;
+            }
+            // resizeInput() stops the stream and maps the buffers again
+            frames->reclaimed += nQueued;
+            memset(inDss, 0, sizeof(inDss));
+            nQueued = 0;
+            if ((count = map_buffers(buffers)) <= 0) {
+                fprintf(stderr, "no overlay buffers after resizeInput\n");
+                return;
+            }
+        }
+
+        for (i = 0; i < count && index < 0; i++)
+            if (!inDss[(next + i) % count])
+                index = (next + i) % count;
+        if (index < 0) {
+            frames->no_buffer++;
+            continue;
+        }
+        next = index + 1;
+        memcpy(buffers[index], &frame, sizeof(frame));
+
+        t = now_us();
+        rc = s_data->queueBuffer(s_data, (void*)index);
+        record(OP_QUEUE, t, rc);
+        if (rc < 0) {
+            frames->queue_failed++;
+        } else {
+            frames->queued++;
+            inDss[index] = 1;
+            nQueued++;
+            if (rc != nQueued) {
+                // the stream was restarted, only this one is with the display
+                for (i = 0; i < count; i++) {
+                    if (inDss[i] && i != index) {
+                        inDss[i] = 0;
+                        nQueued--;
+                        frames->reclaimed++;
+                    }
+                }
+            }
+        }
+
+        if (nQueued >= NUM_BUFFERS_TO_BE_QUEUED_FOR_OPTIMAL_PERFORMANCE) {
+            t = now_us();
+            rc = s_data->dequeueBuffer(s_data, &buffer);
+            record(OP_DEQUEUE, t, rc);
+            if (rc == 0 && (int)buffer >= 0 && (int)buffer < count) {
+                frames->dequeued++;
+                if (fake_v4l2_reading(BENCH_CLONE, (int)buffer))
+                    frames->torn++;
+                inDss[(int)buffer] = 0;
+                nQueued--;
+            } else {
+                frames->dequeue_failed++;
+                reclaim(inDss, &nQueued, count, frames);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    struct fake_v4l2_config config;
+    struct fake_v4l2_stats stats;
+    struct hw_device_t* device;
+    bench_frames frames;
+    pthread_t controlThread;
+    const char* outPath = NULL;
+    FILE* out = stdout;
+    int seconds = 10, fps = 30, width = 640, height = 480;
+    int cropEvery = 0, resizeEvery = 0, tvRefresh = 0;
+    int i, opt;
+
+    memset(&config, 0, sizeof(config));
+    config.refresh_hz = 60;
+
+    while ((opt = getopt(argc, argv, "d:f:w:h:c:z:p:Rv:t:T:k:o:")) != -1) {
+        switch (opt) {
+        case 'd': seconds = atoi(optarg); break;
+        case 'f': fps = atoi(optarg); break;
+        case 'w': width = atoi(optarg); break;
+        case 'h': height = atoi(optarg); break;
+        case 'c': cropEvery = atoi(optarg); break;
+        case 'z': resizeEvery = atoi(optarg); break;
+        case 'p': s_controlRate = atoi(optarg); break;
+        case 'R': s_rotate = 1; break;
+        case 'v': config.refresh_hz = atoi(optarg); break;
+        case 't': tvRefresh = atoi(optarg); break;
+        case 'T': s_cloneFps = atoi(optarg); break;
+        case 'k': config.ioctl_us = atoi(optarg); break;
+        case 'o': outPath = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-d seconds] [-f fps] [-w width] [-h height] [-c frames] [-z frames]"
+                    " [-p per second] [-R] [-v refresh hz] [-t tv refresh hz] [-T fps] [-k us] [-o file]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (seconds < 1 || fps < 1 || width < 2 || height < 2 || config.refresh_hz < 1 || tvRefresh < 0) {
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+    config.device_refresh_hz[BENCH_CLONE] = tvRefresh;
+
+    if (fake_v4l2_init(&config) < 0) {
+        fprintf(stderr, "cannot set up the fake video devices\n");
+        return 1;
+    }
+
+    hw_module_t* module = &HAL_MODULE_INFO_SYM.common;
+    if (module->methods->open(module, OVERLAY_HARDWARE_CONTROL, &device)) {
+        fprintf(stderr, "cannot open the overlay control device\n");
+        fake_v4l2_exit();
+        return 1;
+    }
+    s_control = (struct overlay_control_device_t*)device;
+
+    s_overlay = s_control->createOverlay(s_control, width, height, OVERLAY_FORMAT_CbYCrY_422_I);
+    if (s_overlay == NULL) {
+        fprintf(stderr, "createOverlay(%d, %d) failed\n", width, height);
+        s_control->common.close(&s_control->common);
+        fake_v4l2_exit();
+        return 1;
+    }
+    s_control->setPosition(s_control, s_overlay, 0, 0, LCD_WIDTH, LCD_WIDTH * 3 / 4);
+    s_control->commit(s_control, s_overlay);
+
+    if (module->methods->open(module, OVERLAY_HARDWARE_DATA, &device) ||
+        ((struct overlay_data_device_t*)device)->initialize((struct overlay_data_device_t*)device,
+                                                            s_overlay->getHandleRef(s_overlay))) {
+        fprintf(stderr, "cannot open the overlay data device\n");
+        s_control->destroyOverlay(s_control, s_overlay);
+        s_control->common.close(&s_control->common);
+        fake_v4l2_exit();
+        return 1;
+    }
+    s_data = (struct overlay_data_device_t*)device;
+
+    if (tvRefresh && open_clone(width, height) < 0) {
+        fprintf(stderr, "cannot clone the overlay to /dev/video%d\n", BENCH_CLONE + 1);
+        s_data->common.close(&s_data->common);
+        s_control->destroyOverlay(s_control, s_overlay);
+        s_control->common.close(&s_control->common);
+        fake_v4l2_exit();
+        return 1;
+    }
+
+    // the control and data sides map the shared object at different addresses
+    fake_v4l2_watch_lock(&static_cast<overlay_object*>(s_overlay)->lock,
+                         &((overlay_data_context_t*)s_data)->omap_overlay->lock);
+
+    memset(&frames, 0, sizeof(frames));
+    if (s_controlRate > 0)
+        pthread_create(&controlThread, NULL, control_thread, NULL);
+
+    produce(seconds, fps, width, height, cropEvery, resizeEvery, &frames);
+
+    s_stop = 1;
+    if (s_controlRate > 0)
+        pthread_join(controlThread, NULL);
+    fake_v4l2_get_stats(&stats);
+    fake_v4l2_watch_lock(NULL, NULL);
+
+    s_data->common.close(&s_data->common);
+    s_control->destroyOverlay(s_control, s_overlay);
+    s_control->common.close(&s_control->common);
+    fake_v4l2_exit();
+
+    if (outPath && (out = fopen(outPath, "w")) == NULL) {
+        fprintf(stderr, "cannot write %s: %s\n", outPath, strerror(errno));
+        return 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"config\": { \"seconds\": %d, \"fps\": %d, \"width\": %d, \"height\": %d, "
+            "\"crop_every\": %d, \"resize_every\": %d, \"control_per_s\": %d, \"rotate\": %d, "
+            "\"refresh_hz\": %d, \"tv_refresh_hz\": %d, \"clone_max_fps\": %d, \"ioctl_us\": %d },\n",
+            seconds, fps, width, height, cropEvery, resizeEvery, s_controlRate, s_rotate,
+            config.refresh_hz, tvRefresh, s_cloneFps, config.ioctl_us);
+    fprintf(out, "  \"frames\": { \"scheduled\": %u, \"queued\": %u, \"dequeued\": %u, \"dropped\": %u, "
+            "\"skipped_late\": %u, \"no_buffer\": %u, \"queue_failed\": %u, \"dequeue_failed\": %u, "
+            "\"reclaimed\": %u, \"torn\": %u },\n", frames.scheduled, frames.queued, frames.dequeued,
+            frames.skipped_late + frames.no_buffer + frames.queue_failed,
+            frames.skipped_late, frames.no_buffer, frames.queue_failed, frames.dequeue_failed,
+            frames.reclaimed, frames.torn);
+    fprintf(out, "  \"latency_us\": {\n");
+    for (i = 0; i < OP_LATE; i++)
+        print_op(out, &s_ops[i], i + 1 < OP_LATE ? "," : "");
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"jitter_us\": {\n");
+    print_op(out, &s_ops[OP_LATE], "");
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"display\": {\n");
+    print_display(out, "lcd", &stats.display[BENCH_PRIMARY], tvRefresh ? "," : "");
+    if (tvRefresh)
+        print_display(out, "tv", &stats.display[BENCH_CLONE], "");
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"driver\": { \"stream_ons\": %u, \"stream_offs\": %u, \"reqbufs\": %u, \"ioctls\": %u },\n",
+            stats.stream_ons, stats.stream_offs, stats.reqbufs, stats.ioctls);
+    fprintf(out, "  \"lock\": { \"acquired\": %u, \"contended\": %u, \"wait_us_total\": %llu, "
+            "\"wait_us_max\": %u }\n", stats.lock_acquired, stats.lock_contended,
+            (unsigned long long)stats.lock_wait_us_sum, stats.lock_wait_us_max);
+    fprintf(out, "}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
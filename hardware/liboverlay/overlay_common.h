@@ -46,6 +46,14 @@
 #define MAINTAIN_COHERENCY 0x2
 #define OPTIMAL_QBUF_CNT    0x4
 #define SET_CLONE_FD 0x8
+#define SET_CLONE_MAX_FPS 0x10
+
+/* The clone (TV-out) device gets at most this many frames a second, and
+ * never more than CLONE_MAX_QUEUED buffers pending: anything beyond that
+ * is dropped for the clone only, the primary display is not held up.
+ */
+#define CLONE_DEFAULT_MAX_FPS 30
+#define CLONE_MAX_QUEUED 2
 
 #ifdef TARGET_OMAP4
 /* The following defines are used to set the maximum values supported
@@ -724,7 +724,7 @@ int v4l2_overlay_q_buf(int fd, int index, int memtype, void* buffer, size_t leng
     return v4l2_overlay_ioctl(fd, VIDIOC_QBUF, &buf, "qbuf");
 }
 
-int v4l2_overlay_dq_buf(int fd, int *index, int memtype, void* buffer, size_t length)
+static int dq_buf(int fd, int *index, int memtype, void* buffer, size_t length, int timeout)
 {
     struct v4l2_buffer buf;
     int ret;
@@ -746,10 +746,9 @@ int v4l2_overlay_dq_buf(int fd, int *index, int memtype, void* buffer, size_t le
     p.fd     = fd;
     p.events = POLLOUT;
 
-    /* for now use 1/15s for timeout */
-    ret = poll(&p, 1, 67);
+    ret = poll(&p, 1, timeout);
     if (ret <= 0)
-        return ret ? -errno : -EIO;
+        return ret ? -errno : (timeout ? -EIO : -EAGAIN);
 
     buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
     buf.memory = V4L2_MEMORY_MMAP;
@@ -766,6 +765,18 @@ int v4l2_overlay_dq_buf(int fd, int *index, int memtype, void* buffer, size_t le
     return 0;
 }
 
+int v4l2_overlay_dq_buf(int fd, int *index, int memtype, void* buffer, size_t length)
+{
+    /* for now use 1/15s for timeout */
+    return dq_buf(fd, index, memtype, buffer, length, 67);
+}
+
+/* -EAGAIN straight away if the driver has nothing to give back */
+int v4l2_overlay_try_dq_buf(int fd, int *index, int memtype, void* buffer, size_t length)
+{
+    return dq_buf(fd, index, memtype, buffer, length, 0);
+}
+
 int v4l2_overlay_getId(int fd, int* id)
 {
     LOG_FUNCTION_NAME
@@ -25,7 +25,6 @@
 #include <math.h>
 #include <poll.h>
 #include <pthread.h>
-#include <sys/select.h>
 
 #include <linux/input.h>
 
@@ -152,9 +151,21 @@ struct sensors_control_context_t {
     uint32_t active_sensors;
 };
 
+/* events pulled from one input device by a single read(), decoded in place */
+#define INPUT_BATCH_EVENTS 32
+
+struct input_batch {
+    struct input_event events[INPUT_BATCH_EVENTS];
+    int count;
+    int pos;
+    uint32_t new_sensors;   /* decoded since the last EV_SYN */
+};
+
 struct sensors_data_context_t {
     struct sensors_data_device_t device; // must be first
     int events_fd[3];
+    struct input_batch batch[3];
+    uint32_t gone_fds;      /* events_fd[] bits that hung up or failed */
     sensors_data_t sensors[MAX_NUM_SENSORS];
     uint32_t pendingSensors;
 };
@@ -749,6 +760,8 @@ static int data__data_open(struct sensors_data_context_t *dev, native_handle_t*
     // Framework will close the handle
     native_handle_delete(handle);
 
+    memset(dev->batch, 0, sizeof(dev->batch));
+    dev->gone_fds = 0;
     dev->pendingSensors = 0;
     if (!ioctl(dev->events_fd[1], EVIOCGABS(ABS_DISTANCE), &absinfo)) {
         LOGV("proximity sensor initial value %d\n", absinfo.value);
@@ -976,6 +989,16 @@ static void data__poll_process_syn(struct sensors_data_context_t *dev,
     }
 }
 
+typedef uint32_t (*process_abs_t)(struct sensors_data_context_t *dev,
+                                  int fd, struct input_event *event);
+
+/* indexed like events_fd[] */
+static const process_abs_t process_abs[3] = {
+    data__poll_process_akm_abs,
+    data__poll_process_cm_abs,
+    data__poll_process_ls_abs,
+};
+
 static int data__poll(struct sensors_data_context_t *dev, sensors_data_t* values)
 {
     int akm_fd = dev->events_fd[0];
@@ -1004,93 +1027,83 @@ static int data__poll(struct sensors_data_context_t *dev, sensors_data_t* values
     }
 
     // wait until we get a complete event for an enabled sensor
-    uint32_t new_sensors = 0;
     while (1) {
-        /* read the next event; first, read the compass event, then the
-           proximity event */
-        struct input_event event;
-        int got_syn = 0;
-        int exit = 0;
-        int nread;
-        fd_set rfds;
-        int n;
-
-        FD_ZERO(&rfds);
-        FD_SET(akm_fd, &rfds);
-        FD_SET(cm_fd, &rfds);
-        FD_SET(ls_fd, &rfds);
-        n = select(__MAX(akm_fd, __MAX(cm_fd, ls_fd)) + 1, &rfds,
-                   NULL, NULL, NULL);
-        LOGV("return from select: %d\n", n);
-        if (n < 0) {
-            LOGE("%s: error from select(%d, %d): %s",
-                 __FUNCTION__,
-                 akm_fd, cm_fd, strerror(errno));
-            return -1;
-        }
-
-        if (FD_ISSET(akm_fd, &rfds)) {
-            nread = read(akm_fd, &event, sizeof(event));
-            if (nread == sizeof(event)) {
-                new_sensors |= data__poll_process_akm_abs(dev, akm_fd, &event);
-                LOGV("akm abs %08x", new_sensors);
-                got_syn = event.type == EV_SYN;
-                exit = got_syn && event.code == SYN_CONFIG;
-                if (got_syn) {
-                    LOGV("akm syn %08x", new_sensors);
-                    data__poll_process_syn(dev, &event, new_sensors);
-                    new_sensors = 0;
+        struct pollfd fds[3];
+        int i, n;
+
+        /* decode what the last reads left, up to the first complete event */
+        for (i = 0; i < 3; i++) {
+            struct input_batch *b = &dev->batch[i];
+            while (b->pos < b->count) {
+                struct input_event *event = &b->events[b->pos++];
+                b->new_sensors |= process_abs[i](dev, dev->events_fd[i], event);
+                if (event->type != EV_SYN)
+                    continue;
+                if (event->code == SYN_CONFIG) {
+                    // we use SYN_CONFIG to signal that we need to exit the
+                    // main loop.
+                    LOGV("exit");
+                    return 0x7FFFFFFF;
                 }
-            }
-            else LOGE("akm read too small %d", nread);
-        }
-        else LOGV("akm fd is not set");
-
-        if (FD_ISSET(cm_fd, &rfds)) {
-            nread = read(cm_fd, &event, sizeof(event));
-            if (nread == sizeof(event)) {
-                new_sensors |= data__poll_process_cm_abs(dev, cm_fd, &event);
-                LOGV("cm abs %08x", new_sensors);
-                got_syn |= event.type == EV_SYN;
-                exit |= got_syn && event.code == SYN_CONFIG;
-                if (got_syn) {
-                    LOGV("cm syn %08x", new_sensors);
-                    data__poll_process_syn(dev, &event, new_sensors);
-                    new_sensors = 0;
+                LOGV("syn %d %08x", i, b->new_sensors);
+                data__poll_process_syn(dev, event, b->new_sensors);
+                b->new_sensors = 0;
+                if (dev->pendingSensors) {
+                    LOGV("got syn, picking sensor");
+                    return pick_sensor(dev, values);
                 }
             }
-            else LOGE("cm read too small %d", nread);
         }
-        else LOGV("cm fd is not set");
-
-        if (FD_ISSET(ls_fd, &rfds)) {
-            nread = read(ls_fd, &event, sizeof(event));
-            if (nread == sizeof(event)) {
-                new_sensors |= data__poll_process_ls_abs(dev, ls_fd, &event);
-                LOGV("ls abs %08x", new_sensors);
-                got_syn |= event.type == EV_SYN;
-                exit |= got_syn && event.code == SYN_CONFIG;
-                if (got_syn) {
-                    LOGV("ls syn %08x", new_sensors);
-                    data__poll_process_syn(dev, &event, new_sensors);
-                    new_sensors = 0;
-                }
-            }
-            else LOGE("ls read too small %d", nread);
+
+        /* all decoded: wait, then take everything queued on each ready
+           device with one read. poll() skips the negative fds of devices
+           that went away. */
+        if (dev->gone_fds == 7) {
+            LOGE("all sensor input devices are gone");
+            return -1;
         }
-        else LOGV("ls fd is not set");
-
-        if (exit) {
-            // we use SYN_CONFIG to signal that we need to exit the
-            // main loop.
-            //LOGV("got empty message: value=%d", event->value);
-            LOGV("exit");
-            return 0x7FFFFFFF;
+        for (i = 0; i < 3; i++) {
+            fds[i].fd = (dev->gone_fds & (1 << i)) ? -1 : dev->events_fd[i];
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        n = poll(fds, 3, -1);
+        LOGV("return from poll: %d\n", n);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            LOGE("%s: error from poll(%d, %d, %d): %s",
+                 __FUNCTION__, akm_fd, cm_fd, ls_fd, strerror(errno));
+            return -1;
         }
 
-        if (got_syn && dev->pendingSensors) {
-            LOGV("got syn, picking sensor");
-            return pick_sensor(dev, values);
+        for (i = 0; i < 3; i++) {
+            struct input_batch *b = &dev->batch[i];
+            ssize_t nread;
+
+            if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                /* poll() returns at once for a vanished device: stop
+                   polling it rather than spin, after taking what it
+                   still holds */
+                LOGE("input device fd %d went away (revents 0x%x), dropping it",
+                     fds[i].fd, fds[i].revents);
+                dev->gone_fds |= 1 << i;
+            }
+            if (!(fds[i].revents & POLLIN))
+                continue;
+            nread = read(fds[i].fd, b->events, sizeof(b->events));
+            if (nread < 0 && (errno == EINTR || errno == EAGAIN))
+                continue;
+            if (nread <= 0) {
+                LOGE("read from fd %d failed: %s", fds[i].fd,
+                     nread ? strerror(errno) : "end of file");
+                dev->gone_fds |= 1 << i;
+                continue;
+            }
+            LOGE_IF(nread % sizeof(struct input_event),
+                    "partial input event from fd %d (%d)", fds[i].fd, (int)nread);
+            b->count = nread / sizeof(struct input_event);
+            b->pos = 0;
         }
     }
 }
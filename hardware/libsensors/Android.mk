@@ -35,11 +35,57 @@ LOCAL_SRC_FILES := 						\
 				SensorBase.cpp			\
 				LightSensor.cpp			\
 				ProximitySensor.cpp		\
-				kxsd9.cpp
+				kxsd9.cpp				\
+				fusion.c
 				
 LOCAL_SHARED_LIBRARIES := liblog libcutils
 LOCAL_PRELINK_MODULE := false
 
 include $(BUILD_SHARED_LIBRARY)
 
+# sensor input record (on the phone) and replay (on a Linux host) around the
+# unmodified HAL sources; only the host build carries the kernel stand-ins
+# of sreplay_host.c
+sreplay_src_files := \
+				sreplay.cpp				\
+				sensors.c 				\
+				nusensors.cpp 			\
+				InputEventReader.cpp	\
+				SensorBase.cpp			\
+				LightSensor.cpp			\
+				ProximitySensor.cpp		\
+				kxsd9.cpp				\
+				fusion.c
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := sreplay
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES := $(sreplay_src_files)
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := sreplay
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES := $(sreplay_src_files) sreplay_host.c
+LOCAL_CFLAGS := -DSREPLAY_HOST
+LOCAL_C_INCLUDES := hardware/libhardware/include
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt -lm -ldl
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# accuracy check of the fixed point fusion against a double precision model
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := fusion_check
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES := fusion_check.c fusion.c
+LOCAL_LDLIBS := -lm
+
+include $(BUILD_HOST_EXECUTABLE)
+
 #endif # !TARGET_SIMULATOR
@@ -21,6 +21,7 @@
 
 #include <sys/cdefs.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <linux/input.h>
 
@@ -33,7 +34,7 @@
 struct input_event;
 
 InputEventCircularReader::InputEventCircularReader(size_t numEvents)
-    : mBuffer(new input_event[numEvents * 2]),
+    : mBuffer(new input_event[numEvents]),
       mBufferEnd(mBuffer + numEvents),
       mHead(mBuffer),
       mCurr(mBuffer),
@@ -50,20 +51,31 @@ ssize_t InputEventCircularReader::fill(int fd)
 {
     size_t numEventsRead = 0;
     if (mFreeSpace) {
-        const ssize_t nread = read(fd, mHead, mFreeSpace * sizeof(input_event));
-        if (nread<0 || nread % sizeof(input_event)) {
+        struct iovec iov[2];
+        size_t first = mBufferEnd - mHead;
+        if (first > size_t(mFreeSpace))
+            first = mFreeSpace;
+        iov[0].iov_base = mHead;
+        iov[0].iov_len = first * sizeof(input_event);
+        iov[1].iov_base = mBuffer;
+        iov[1].iov_len = (mFreeSpace - first) * sizeof(input_event);
+
+        const ssize_t nread = readv(fd, iov, iov[1].iov_len ? 2 : 1);
+        if (nread < 0) {
+            // nothing queued since the last fill
+            return errno == EAGAIN ? 0 : -errno;
+        }
+        if (nread % sizeof(input_event)) {
             // we got a partial event!!
-            return nread<0 ? -errno : -EINVAL;
+            return -EINVAL;
         }
 
         numEventsRead = nread / sizeof(input_event);
         if (numEventsRead) {
             mHead += numEventsRead;
             mFreeSpace -= numEventsRead;
-            if (mHead > mBufferEnd) {
-                size_t s = mHead - mBufferEnd;
-                memcpy(mBuffer, mBufferEnd, s * sizeof(input_event));
-                mHead = mBuffer + s;
+            if (mHead >= mBufferEnd) {
+                mHead -= mBufferEnd - mBuffer;
             }
         }
     }
@@ -78,11 +90,19 @@ ssize_t InputEventCircularReader::readEvent(input_event const** events)
     return available ? 1 : 0;
 }
 
-void InputEventCircularReader::next()
+ssize_t InputEventCircularReader::readEvents(input_event const** events)
+{
+    *events = mCurr;
+    ssize_t available = (mBufferEnd - mBuffer) - mFreeSpace;
+    ssize_t contiguous = mBufferEnd - mCurr;
+    return available < contiguous ? available : contiguous;
+}
+
+void InputEventCircularReader::next(size_t count)
 {
-    mCurr++;
-    mFreeSpace++;
+    mCurr += count;
+    mFreeSpace += count;
     if (mCurr >= mBufferEnd) {
-        mCurr = mBuffer;
+        mCurr -= mBufferEnd - mBuffer;
     }
 }
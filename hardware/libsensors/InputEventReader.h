@@ -26,6 +26,12 @@
 
 struct input_event;
 
+/*
+ * fill() pulls everything the driver has queued, up to the free space, with
+ * a single readv() that spans the wrap point; the fd must be non-blocking.
+ * readEvents() then hands out the unread events in place, as contiguous
+ * runs, and next() consumes them.
+ */
 class InputEventCircularReader
 {
     struct input_event* const mBuffer;
@@ -39,7 +45,8 @@ public:
     ~InputEventCircularReader();
     ssize_t fill(int fd);
     ssize_t readEvent(input_event const** events);
-    void next();
+    ssize_t readEvents(input_event const** events);
+    void next(size_t count = 1);
 };
 
 /*****************************************************************************/
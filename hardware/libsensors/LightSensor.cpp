@@ -16,25 +16,52 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <poll.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/select.h>
 
-#include <linux/lightsensor.h>
-
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include "LightSensor.h"
 
 /*****************************************************************************/
 
+/* Driver gives a rolling average adc value.  We convert it lux levels. */
+static const struct adcToLux {
+    int   adc_value;
+    float lux_value;
+} sAdcToLux[] = {
+    {  150,   10.0 },  /* from    0 -  150 adc, we map to    10.0 lux */
+    {  800,  160.0 },  /* from  151 -  800 adc, we map to   160.0 lux */
+    {  900,  225.0 },  /* from  801 -  900 adc, we map to   225.0 lux */
+    { 1000,  320.0 },  /* from  901 - 1000 adc, we map to   320.0 lux */
+    { 1200,  640.0 },  /* from 1001 - 1200 adc, we map to   640.0 lux */
+    { 1400, 1280.0 },  /* from 1201 - 1400 adc, we map to  1280.0 lux */
+    { 1600, 2600.0 },  /* from 1401 - 1600 adc, we map to  2600.0 lux */
+    { 4095, 10240.0 }, /* from 1601 - 4095 adc, we map to 10240.0 lux */
+};
+
+#define NUM_BUCKETS int(ARRAY_SIZE(sAdcToLux))
+
 LightSensor::LightSensor()
     : SensorBase(LS_DEVICE_NAME, "light sensor"),
       mEnabled(0),
       mInputReader(4),
-      mHasPendingEvent(false)
+      mHasPendingEvent(false),
+      mSmoothing(0),
+      mHysteresis(0),
+      mMinInterval(0),
+      mSample(0),
+      mFiltered(0),
+      mBucket(-1),
+      mLastReport(0),
+      mNumSamples(0),
+      mNumReports(0)
 {
     mPendingEvent.version = sizeof(sensors_event_t);
     mPendingEvent.sensor = ID_L;
@@ -53,13 +80,87 @@ LightSensor::~LightSensor() {
 
 int LightSensor::setInitialState() {
     struct input_absinfo absinfo;
+    // the first report after enable goes out whatever the tuning
+    mBucket = -1;
     if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_LIGHT), &absinfo)) {
-        mPendingEvent.light = absinfo.value;
+        // the minimum interval is kept in evdev time, which starts with
+        // the first sample; getTimestamp() is on another clock
+        update(absinfo.value, -1);
         mHasPendingEvent = true;
     }
     return 0;
 }
 
+void LightSensor::loadTuning() {
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get(LIGHT_SMOOTHING_PROPERTY, value, LIGHT_DEFAULT_SMOOTHING);
+    mSmoothing = atoi(value);
+    if (mSmoothing < 0 || mSmoothing > 8)
+        mSmoothing = atoi(LIGHT_DEFAULT_SMOOTHING);
+    property_get(LIGHT_HYSTERESIS_PROPERTY, value, LIGHT_DEFAULT_HYSTERESIS);
+    mHysteresis = atoi(value);
+    if (mHysteresis < 0 || mHysteresis > 50)
+        mHysteresis = atoi(LIGHT_DEFAULT_HYSTERESIS);
+    property_get(LIGHT_MIN_INTERVAL_PROPERTY, value, LIGHT_DEFAULT_MIN_INTERVAL);
+    mMinInterval = atoll(value) * 1000000LL;
+    if (mMinInterval < 0)
+        mMinInterval = 0;
+}
+
+int LightSensor::bucketOf(int adc) {
+    int lo = 0, hi = NUM_BUCKETS - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (adc < sAdcToLux[mid].adc_value)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// feed one ADC sample, true when a new lux value is to be reported
+bool LightSensor::update(int adc, int64_t timestamp) {
+    mNumSamples++;
+    if (mBucket < 0 || !mSmoothing) {
+        mFiltered = adc << 8;
+    } else {
+        mFiltered += ((adc << 8) - mFiltered) >> mSmoothing;
+    }
+
+    // the first sample after the initial state starts the interval
+    if (mLastReport < 0)
+        mLastReport = timestamp;
+
+    const int level = mFiltered >> 8;
+    const int bucket = bucketOf(level);
+    if (mBucket >= 0) {
+        if (bucket == mBucket)
+            return false;
+        // stay until the edge that was crossed is passed by the hysteresis
+        if (bucket > mBucket) {
+            const int edge = sAdcToLux[mBucket].adc_value;
+            if (level < edge + edge * mHysteresis / 100)
+                return false;
+        } else {
+            const int edge = sAdcToLux[mBucket - 1].adc_value;
+            if (level >= edge - edge * mHysteresis / 100)
+                return false;
+        }
+        // a change held back here goes out with the first sample after
+        // the interval, the driver keeps sampling
+        if (timestamp - mLastReport < mMinInterval)
+            return false;
+    }
+
+    mBucket = bucket;
+    mLastReport = timestamp;
+    mPendingEvent.light = sAdcToLux[bucket].lux_value;
+    mNumReports++;
+    return true;
+}
+
 int LightSensor::enable(int32_t, int en) {
     int newState = en ? 1 : 0;
     int err = 0;
@@ -69,7 +170,9 @@ int LightSensor::enable(int32_t, int en) {
         }
             mEnabled = newState;
             if (en) {
-                
+                loadTuning();
+                mNumSamples = mNumReports = 0;
+
                 err = ioctl(dev_fd, L_IOC_POLLING_TIMER_SET);
         if (err < 0)
             LOGE("L_IOC_POLLING_TIMER_SET error (%s)", strerror(errno));
@@ -77,6 +180,7 @@ int LightSensor::enable(int32_t, int en) {
                 setInitialState();
            }
            else {
+        LOGV("LightSensor: %u samples, %u reported", mNumSamples, mNumReports);
         err = ioctl(dev_fd, L_IOC_POLLING_TIMER_CANCEL);
         if (err < 0)
             LOGE("L_IOC_POLLING_TIMER_SET error (%s)", strerror(errno));
@@ -93,6 +197,13 @@ bool LightSensor::hasPendingEvents() const {
     return mHasPendingEvent;
 }
 
+int LightSensor::getHandles(int32_t* handles, int max) const {
+    if (max < 1)
+        return 0;
+    handles[0] = ID_L;
+    return 1;
+}
+
 int LightSensor::readEvents(sensors_event_t* data, int count)
 {
     if (count < 1)
@@ -116,15 +227,18 @@ int LightSensor::readEvents(sensors_event_t* data, int count)
         int type = event->type;
         if (type == EV_ABS) { // light sensor 1
             if (event->code == EVENT_TYPE_LIGHT) {
-                //mPendingEvent.light = event->value;
-                mPendingEvent.light = indexToValue(event->value);
+                mSample = event->value;
             }
 
         } else if (type == EV_SYN) {
-            mPendingEvent.timestamp = timevalToNano(event->time);
-            *data++ = mPendingEvent;
-            count--;
-            numEventReceived++;
+            // only changes of the reported lux bucket reach the framework
+            int64_t time = timevalToNano(event->time);
+            if (update(mSample, time)) {
+                mPendingEvent.timestamp = time;
+                *data++ = mPendingEvent;
+                count--;
+                numEventReceived++;
+            }
         } else {
             LOGE("LightSensor: unknown event (type=%d, code=%d)",
                     type, event->code);
@@ -134,28 +248,3 @@ int LightSensor::readEvents(sensors_event_t* data, int count)
 
     return numEventReceived;
 }
-
-float LightSensor::indexToValue(size_t index) const
-{
-    /* Driver gives a rolling average adc value.  We convert it lux levels. */
-    static const struct adcToLux {
-        size_t adc_value;
-        float  lux_value;
-    } adcToLux[] = {
-        {  150,   10.0 },  /* from    0 -  150 adc, we map to    10.0 lux */
-        {  800,  160.0 },  /* from  151 -  800 adc, we map to   160.0 lux */
-        {  900,  225.0 },  /* from  801 -  900 adc, we map to   225.0 lux */
-        { 1000,  320.0 },  /* from  901 - 1000 adc, we map to   320.0 lux */
-        { 1200,  640.0 },  /* from 1001 - 1200 adc, we map to   640.0 lux */
-        { 1400, 1280.0 },  /* from 1201 - 1400 adc, we map to  1280.0 lux */
-        { 1600, 2600.0 },  /* from 1401 - 1600 adc, we map to  2600.0 lux */
-        { 4095, 10240.0 }, /* from 1601 - 4095 adc, we map to 10240.0 lux */
-    };
-    size_t i;
-    for (i = 0; i < ARRAY_SIZE(adcToLux); i++) {
-        if (index < adcToLux[i].adc_value) {
-            return adcToLux[i].lux_value;
-        }
-    }
-    return adcToLux[ARRAY_SIZE(adcToLux)-1].lux_value;
-}
@@ -52,6 +52,21 @@
 
 /*****************************************************************************/
 
+/*
+ * Reporting is tuned with properties, read whenever the sensor is enabled:
+ * the weight of a new ADC sample in the running average is
+ * 1/2^smoothing, a bucket edge has to be passed by hysteresis percent
+ * before the reported lux changes, and two changes are reported at least
+ * min_interval_ms apart.
+ */
+#define LIGHT_SMOOTHING_PROPERTY        "sensors.light.smoothing"
+#define LIGHT_HYSTERESIS_PROPERTY       "sensors.light.hysteresis"
+#define LIGHT_MIN_INTERVAL_PROPERTY     "sensors.light.min_interval_ms"
+
+#define LIGHT_DEFAULT_SMOOTHING         "2"
+#define LIGHT_DEFAULT_HYSTERESIS        "10"
+#define LIGHT_DEFAULT_MIN_INTERVAL      "1000"
+
 /*****************************************************************************/
 
 struct input_event;
@@ -62,7 +77,19 @@ class LightSensor : public SensorBase {
     sensors_event_t mPendingEvent;
     bool mHasPendingEvent;
 
-    float indexToValue(size_t index) const;
+    int mSmoothing;
+    int mHysteresis;
+    int64_t mMinInterval;
+    int mSample;            // last ADC value from the driver
+    int32_t mFiltered;      // running average of the ADC, Q8
+    int mBucket;            // reported lux bucket, -1 until the first report
+    int64_t mLastReport;    // evdev time of the last report, -1 for none yet
+    uint32_t mNumSamples;
+    uint32_t mNumReports;
+
+    void loadTuning();
+    static int bucketOf(int adc);
+    bool update(int adc, int64_t timestamp);
     int setInitialState();
 
 public:
@@ -71,6 +98,7 @@ public:
     virtual int readEvents(sensors_event_t* data, int count);
     virtual bool hasPendingEvents() const;
     virtual int enable(int32_t handle, int enabled);
+    virtual int getHandles(int32_t* handles, int max) const;
 };
 
 /*****************************************************************************/
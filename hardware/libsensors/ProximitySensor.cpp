@@ -16,6 +16,7 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 #include <math.h>
 #include <poll.h>
 #include <unistd.h>
@@ -95,6 +96,13 @@ bool ProximitySensor::hasPendingEvents() const {
     return mHasPendingEvent;
 }
 
+int ProximitySensor::getHandles(int32_t* handles, int max) const {
+    if (max < 1)
+        return 0;
+    handles[0] = ID_P;
+    return 1;
+}
+
 int ProximitySensor::readEvents(sensors_event_t* data, int count)
 {
     if (count < 1)
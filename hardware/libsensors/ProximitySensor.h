@@ -72,6 +72,7 @@ public:
     virtual int readEvents(sensors_event_t* data, int count);
     virtual bool hasPendingEvents() const;
     virtual int enable(int32_t handle, int enabled);
+    virtual int getHandles(int32_t* handles, int max) const;
 };
 
 /*****************************************************************************/
@@ -16,11 +16,13 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 #include <math.h>
 #include <poll.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/select.h>
+#include <time.h>
 
 #include <cutils/log.h>
 
@@ -102,7 +104,8 @@ int SensorBase::openInput(const char* inputName) {
                         (de->d_name[1] == '.' && de->d_name[2] == '\0')))
             continue;
         strcpy(filename, de->d_name);
-        fd = open(devname, O_RDONLY);
+        // non-blocking: readers drain everything queued in one read
+        fd = open(devname, O_RDONLY | O_NONBLOCK);
         if (fd>=0) {
             char name[80];
             if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1) {
@@ -55,6 +55,8 @@ public:
     virtual int readEvents(sensors_event_t* data, int count) = 0;
     virtual bool hasPendingEvents() const;
     virtual int getFd() const;
+    // the handles this driver serves, at most max of them
+    virtual int getHandles(int32_t* handles, int max) const = 0;
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int enable(int32_t handle, int enabled) = 0;
 };
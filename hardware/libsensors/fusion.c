@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "fusion.h"
+
+/*****************************************************************************/
+
+void fusion_init(struct fusion_state* s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+void fusion_update(struct fusion_state* s, const int32_t acc[3], int64_t timestamp)
+{
+    int64_t dt;
+    int32_t alpha;
+    int i;
+
+    if (!s->primed) {
+        for (i = 0; i < 3; i++) {
+            s->acc[i] = acc[i];
+            s->gravity[i] = acc[i];
+        }
+        s->timestamp = timestamp;
+        s->primed = 1;
+        return;
+    }
+
+    dt = timestamp - s->timestamp;
+    if (dt <= 0)
+        return;
+    /* a gap longer than the time constant: start over from this sample */
+    if (dt > FUSION_GRAVITY_TAU_NS * 4) {
+        s->primed = 0;
+        fusion_update(s, acc, timestamp);
+        return;
+    }
+
+    /* alpha = dt / (tau + dt), Q16 */
+    alpha = (int32_t)((dt << FUSION_Q) / (FUSION_GRAVITY_TAU_NS + dt));
+    for (i = 0; i < 3; i++) {
+        int64_t diff = (int64_t)acc[i] - s->gravity[i];
+        s->acc[i] = acc[i];
+        s->gravity[i] += (int32_t)((diff * alpha) >> FUSION_Q);
+    }
+    s->timestamp = timestamp;
+}
+
+void fusion_gravity(const struct fusion_state* s, int32_t out[3])
+{
+    out[0] = s->gravity[0];
+    out[1] = s->gravity[1];
+    out[2] = s->gravity[2];
+}
+
+void fusion_linear_acceleration(const struct fusion_state* s, int32_t out[3])
+{
+    out[0] = s->acc[0] - s->gravity[0];
+    out[1] = s->acc[1] - s->gravity[1];
+    out[2] = s->acc[2] - s->gravity[2];
+}
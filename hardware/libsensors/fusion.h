@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_FUSION_H
+#define ANDROID_SENSOR_FUSION_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*****************************************************************************/
+
+/*
+ * Virtual sensors derived from the accelerometer, in Q16 fixed point:
+ * gravity is a time constant aware low-pass of the acceleration and linear
+ * acceleration what is left.  There is no compass on this board, so no
+ * orientation sensor is derived: without an azimuth, compass and map apps
+ * would bind to it and show a frozen heading.
+ */
+
+#define FUSION_Q            16
+#define FUSION_ONE          (1 << FUSION_Q)
+
+/* low-pass time constant of the gravity estimate */
+#define FUSION_GRAVITY_TAU_NS   200000000LL
+
+struct fusion_state {
+    int32_t acc[3];         /* m/s^2, Q16 */
+    int32_t gravity[3];     /* m/s^2, Q16 */
+    int64_t timestamp;
+    int primed;
+};
+
+void fusion_init(struct fusion_state* s);
+
+/* Feed one acceleration sample (m/s^2, Q16).  Samples with a timestamp
+ * not newer than the last one are ignored, so several virtual sensors
+ * can share the state. */
+void fusion_update(struct fusion_state* s, const int32_t acc[3], int64_t timestamp);
+
+void fusion_gravity(const struct fusion_state* s, int32_t out[3]);
+void fusion_linear_acceleration(const struct fusion_state* s, int32_t out[3]);
+
+/*****************************************************************************/
+
+__END_DECLS
+
+#endif  // ANDROID_SENSOR_FUSION_H
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check of the fixed point fusion against a double precision model.
+ *
+ * usage: fusion_check [trace]
+ *
+ * A trace has one accelerometer sample per line, "<timestamp ns> <x> <y> <z>"
+ * in m/s^2; lines starting with '#' are skipped.  Without a trace a
+ * synthetic one is used (slow rotations plus shaking and sensor noise).
+ * Exits non-zero if an output drifts from the model by more than
+ * 0.02 m/s^2.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "fusion.h"
+
+#define MAX_ERR_ACC     0.02
+
+struct model {
+    double acc[3];
+    double gravity[3];
+    int64_t timestamp;
+    int primed;
+};
+
+static void model_update(struct model* m, const double acc[3], int64_t t)
+{
+    double alpha;
+    int64_t dt;
+    int i;
+
+    if (m->primed) {
+        dt = t - m->timestamp;
+        if (dt <= 0)
+            return;
+        if (dt > FUSION_GRAVITY_TAU_NS * 4)
+            m->primed = 0;
+    }
+    if (!m->primed) {
+        for (i = 0; i < 3; i++)
+            m->acc[i] = m->gravity[i] = acc[i];
+        m->timestamp = t;
+        m->primed = 1;
+        return;
+    }
+    alpha = (double)dt / (FUSION_GRAVITY_TAU_NS + dt);
+    for (i = 0; i < 3; i++) {
+        m->acc[i] = acc[i];
+        m->gravity[i] += alpha * (acc[i] - m->gravity[i]);
+    }
+    m->timestamp = t;
+}
+
+static double q16(int32_t v)
+{
+    return v / (double)FUSION_ONE;
+}
+
+static double err_gravity, err_linear;
+static unsigned samples;
+
+static void check(struct fusion_state* s, struct model* m, int64_t t,
+                  const double acc[3])
+{
+    int32_t a[3], g[3], l[3];
+    int i;
+
+    for (i = 0; i < 3; i++)
+        a[i] = (int32_t)lrint(acc[i] * FUSION_ONE);
+    fusion_update(s, a, t);
+    model_update(m, acc, t);
+
+    fusion_gravity(s, g);
+    fusion_linear_acceleration(s, l);
+
+    for (i = 0; i < 3; i++) {
+        double e = fabs(q16(g[i]) - m->gravity[i]);
+        if (e > err_gravity)
+            err_gravity = e;
+        e = fabs(q16(l[i]) - (m->acc[i] - m->gravity[i]));
+        if (e > err_linear)
+            err_linear = e;
+    }
+    samples++;
+}
+
+int main(int argc, char** argv)
+{
+    struct fusion_state s;
+    struct model m;
+    double acc[3];
+    int64_t t;
+    int fail = 0;
+
+    fusion_init(&s);
+    memset(&m, 0, sizeof(m));
+
+    if (argc > 1) {
+        char line[256];
+        FILE* f = fopen(argv[1], "r");
+        if (!f) {
+            perror(argv[1]);
+            return 2;
+        }
+        while (fgets(line, sizeof(line), f)) {
+            long long ts;
+            if (line[0] == '#')
+                continue;
+            if (sscanf(line, "%lld %lf %lf %lf", &ts, &acc[0], &acc[1], &acc[2]) != 4)
+                continue;
+            check(&s, &m, ts, acc);
+        }
+        fclose(f);
+    } else {
+        /* 60 s at 50 Hz: the device turns through all attitudes while being
+         * shaken, with a 1 s pause to exercise the restart path */
+        unsigned seed = 1;
+        int i;
+        for (i = 0, t = 0; i < 3000; i++, t += 20000000) {
+            double a = i * 0.004, b = i * 0.0023;
+            double shake = (i / 250) % 2 ? 3.0 * sin(i * 0.9) : 0;
+            int k;
+            if (i == 1500)
+                t += 1000000000;
+            acc[0] = 9.80665 * sin(b) + shake;
+            acc[1] = 9.80665 * cos(b) * sin(a);
+            acc[2] = 9.80665 * cos(b) * cos(a) - shake;
+            for (k = 0; k < 3; k++) {
+                seed = seed * 1103515245 + 12345;
+                acc[k] += ((int)((seed >> 16) % 1000) - 500) / 2500.0;
+            }
+            check(&s, &m, t, acc);
+        }
+    }
+
+    printf("samples %u\n", samples);
+    printf("gravity.max_err %.5f\n", err_gravity);
+    printf("linear_acceleration.max_err %.5f\n", err_linear);
+
+    fail |= err_gravity > MAX_ERR_ACC || err_linear > MAX_ERR_ACC;
+    printf("%s\n", fail ? "FAIL" : "PASS");
+    return fail;
+}
@@ -16,6 +16,7 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 #include <math.h>
 #include <poll.h>
 #include <unistd.h>
@@ -28,22 +29,36 @@
 
 /*****************************************************************************/
 
+// rate of a client that never called setDelay() (SENSOR_DELAY_NORMAL)
+static const int64_t kDefaultDelay = 200000000;
+// fastest rate of the chip, minDelay in the sensor list
+static const int64_t kMinDelay = 20000000;
+
 kxsd9Sensor::kxsd9Sensor()
 : SensorBase(KXSD9_DEVICE_NAME, "accel"),
       mEnabled(0),
-      mInputReader(32)
+      mDelay(0),
+      mInputReader(32),
+      mHasPendingEvent(false)
 {
+    for (int i = 0; i < KXSD9_MAX_CLIENTS; i++) {
+        mClients[i].enabled = false;
+        mClients[i].delay = kDefaultDelay;
+        mClients[i].lastTimestamp = 0;
+    }
+
     mPendingEvent.version = sizeof(sensors_event_t);
     mPendingEvent.sensor = ID_A;
     mPendingEvent.type = SENSOR_TYPE_ACCELEROMETER;
     memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
     mPendingEvent.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+    fusion_init(&mFusion);
 
     struct input_absinfo absinfo;
 //    int flags = 0;
 
 
-        enable(0, 1);
+        enable(ID_A, 1);
 
             if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_ACCEL_X), &absinfo)) {
                 mPendingEvent.acceleration.x = absinfo.value * CONVERT_A_X;
@@ -62,17 +77,35 @@ kxsd9Sensor::kxsd9Sensor()
 }
 
 kxsd9Sensor::~kxsd9Sensor() {
-    if (mEnabled) {
-        enable(0, 0);
+    for (int i = 0; i < KXSD9_MAX_CLIENTS; i++) {
+        if (mClients[i].enabled) {
+            enable(i, 0);
+        }
     }
 
 }
 
 int kxsd9Sensor::enable(int32_t handle, int en)
 {
-    int newState  = en ? 1 : 0;
+    if (handle < 0 || handle >= KXSD9_MAX_CLIENTS)
+        return -EINVAL;
+
+    bool wasEnabled = mClients[handle].enabled;
+    bool wasFusing = fusionEnabled();
+    uint32_t newState = 0;
     int err = 0;
 
+    mClients[handle].enabled = en ? true : false;
+    if (!wasFusing && fusionEnabled()) {
+        // don't filter from a stale gravity estimate
+        fusion_init(&mFusion);
+    }
+    mClients[handle].lastTimestamp = 0;
+    for (int i = 0; i < KXSD9_MAX_CLIENTS; i++) {
+        if (mClients[i].enabled)
+            newState = 1;
+    }
+
     if(mEnabled != newState) {
         if (!mEnabled) {
             open_device();
@@ -85,56 +118,181 @@ int kxsd9Sensor::enable(int32_t handle, int en)
 
         if (!err) {
             mEnabled = newState;
-            setDelay(0, 200000000);
+            // the driver restarts with its own period
+            mDelay = 0;
+        } else {
+            mClients[handle].enabled = wasEnabled;
         }
 
         if (!mEnabled) {
             close_device();
         }
     }
+    if (!err && mEnabled) {
+        err = updateDelay();
+    }
     return err;
 }
 
 int kxsd9Sensor::setDelay(int32_t handle, int64_t ns)
 {
+    if (handle < 0 || handle >= KXSD9_MAX_CLIENTS)
+        return -EINVAL;
+    if (ns < 0)
+        return -EINVAL;
+
+    // remembered while disabled, enable() keeps the client's rate
+    mClients[handle].delay = ns < kMinDelay ? kMinDelay : ns;
     if (mEnabled) {
-        if (ns < 0)
-            return -EINVAL;
+        return updateDelay();
+    }
+    return 0;
+}
 
-        int delay = ns / 1000000;
-        if (ioctl(dev_fd, KXSD9_IOC_SET_DELAY, &delay)) {
-            return -errno;
-        }
+// run the chip at the fastest rate any enabled client needs
+int kxsd9Sensor::updateDelay()
+{
+    int64_t ns = 0;
+
+    for (int i = 0; i < KXSD9_MAX_CLIENTS; i++) {
+        if (mClients[i].enabled && (!ns || mClients[i].delay < ns))
+            ns = mClients[i].delay;
     }
+    if (!ns || ns == mDelay)
+        return 0;
+
+    int delay = ns / 1000000;
+    if (ioctl(dev_fd, KXSD9_IOC_SET_DELAY, &delay)) {
+        LOGE("KXSD9_IOC_SET_DELAY failed (%s)", strerror(errno));
+        return -errno;
+    }
+    LOGV("kxsd9Sensor: hardware period %d ms", delay);
+    mDelay = ns;
     return 0;
 }
 
+// clients whose next sample is due; half a hardware period of slack absorbs
+// the jitter of the chip timer
+int kxsd9Sensor::dueClients(int64_t timestamp, int32_t* handles) const
+{
+    const int64_t slack = mDelay / 2;
+    int n = 0;
+
+    for (int i = 0; i < KXSD9_MAX_CLIENTS; i++) {
+        const Client& c(mClients[i]);
+        if (c.enabled && timestamp - c.lastTimestamp >= c.delay - slack)
+            handles[n++] = i;
+    }
+    return n;
+}
+
+bool kxsd9Sensor::hasPendingEvents() const
+{
+    return mHasPendingEvent;
+}
+
+int kxsd9Sensor::getHandles(int32_t* handles, int max) const
+{
+    static const int32_t served[] = { ID_A, ID_G, ID_LA };
+    int n = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(served) && n < max; i++)
+        handles[n++] = served[i];
+    return n;
+}
+
+bool kxsd9Sensor::fusionEnabled() const
+{
+    return mClients[ID_G].enabled || mClients[ID_LA].enabled;
+}
+
+static inline int32_t toFixed(float v)
+{
+    return int32_t(lrintf(v * FUSION_ONE));
+}
+
+static inline float fromFixed(int32_t v)
+{
+    return v * (1.0f / FUSION_ONE);
+}
+
+// the event of one client for the current sample
+void kxsd9Sensor::fillEvent(int32_t handle, sensors_event_t* data) const
+{
+    int32_t v[3];
+
+    *data = mPendingEvent;
+    data->sensor = handle;
+    switch (handle) {
+        case ID_G:
+            fusion_gravity(&mFusion, v);
+            data->type = SENSOR_TYPE_GRAVITY;
+            break;
+        case ID_LA:
+            fusion_linear_acceleration(&mFusion, v);
+            data->type = SENSOR_TYPE_LINEAR_ACCELERATION;
+            break;
+        default:
+            return;
+    }
+    data->acceleration.x = fromFixed(v[0]);
+    data->acceleration.y = fromFixed(v[1]);
+    data->acceleration.z = fromFixed(v[2]);
+}
+
 int kxsd9Sensor::readEvents(sensors_event_t* data, int count)
 {
     if (count < 1)
         return -EINVAL;
 
+    mHasPendingEvent = false;
+
     ssize_t n = mInputReader.fill(data_fd);
     if (n < 0)
         return n;
 
     int numEventReceived = 0;
     input_event const* event;
+    ssize_t avail;
 
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-            processEvent(event->code, event->value);
-        } else if (type == EV_SYN) {
-            mPendingEvent.timestamp = timevalToNano(event->time);
-            *data++ = mPendingEvent;
-            count--;
-            numEventReceived++;
-        } else {
-            LOGE("kxsd9Sensor: unknown event (type=%d, code=%d)",
-                    type, event->code);
+    // walk the events in place, one contiguous run of the ring at a time
+    while (count && !mHasPendingEvent &&
+            (avail = mInputReader.readEvents(&event)) > 0) {
+        ssize_t used;
+        for (used = 0; count && used < avail; used++, event++) {
+            int type = event->type;
+            if (type == EV_ABS) {
+                processEvent(event->code, event->value);
+            } else if (type == EV_SYN) {
+                int64_t time = timevalToNano(event->time);
+                int32_t due[KXSD9_MAX_CLIENTS];
+                int numDue = dueClients(time, due);
+                if (numDue > count && numEventReceived) {
+                    // no room for every client, keep the sample for next time
+                    mHasPendingEvent = true;
+                    break;
+                }
+                mPendingEvent.timestamp = time;
+                if (fusionEnabled()) {
+                    const int32_t acc[3] = {
+                        toFixed(mPendingEvent.acceleration.x),
+                        toFixed(mPendingEvent.acceleration.y),
+                        toFixed(mPendingEvent.acceleration.z),
+                    };
+                    fusion_update(&mFusion, acc, time);
+                }
+                for (int i = 0; i < numDue && count; i++) {
+                    mClients[due[i]].lastTimestamp = time;
+                    fillEvent(due[i], data++);
+                    count--;
+                    numEventReceived++;
+                }
+            } else {
+                LOGE("kxsd9Sensor: unknown event (type=%d, code=%d)",
+                        type, event->code);
+            }
         }
-        mInputReader.next();
+        mInputReader.next(used);
     }
 
     return numEventReceived;
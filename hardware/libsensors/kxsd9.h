@@ -26,6 +26,7 @@
 #include "nusensors.h"
 #include "SensorBase.h"
 #include "InputEventReader.h"
+#include "fusion.h"
 
 
 #define __MAX(a,b) ((a)>=(b)?(a):(b))
@@ -51,6 +52,9 @@
 #define KXSD9_IOC_GET_INITIAL_VALUE _IOWR( KXSD9_IOC_MAGIC, 11, kxsd9_convert_t )
 #define KXSD9_IOC_SET_DELAY         _IOWR( KXSD9_IOC_MAGIC, 12, int )
 
+/* handles fed by the accelerometer, indexed by handle */
+#define KXSD9_MAX_CLIENTS 8
+
 
 /*****************************************************************************/
 
@@ -64,12 +68,34 @@ public:
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int enable(int32_t handle, int en);
     virtual int readEvents(sensors_event_t* data, int count);
+    virtual bool hasPendingEvents() const;
+    virtual int getHandles(int32_t* handles, int max) const;
     void processEvent(int code, int value);
 
 private:
+    /* Every handle fed by the accelerometer is a client with its own rate:
+     * the chip runs at the fastest rate an enabled client asked for and each
+     * client only gets the samples that are due at its own rate. */
+    struct Client {
+        bool enabled;
+        int64_t delay;
+        int64_t lastTimestamp;
+    };
+
+    int updateDelay();
+    int dueClients(int64_t timestamp, int32_t* handles) const;
+    bool fusionEnabled() const;
+    void fillEvent(int32_t handle, sensors_event_t* data) const;
+
     uint32_t mEnabled;
+    int64_t mDelay;
+    Client mClients[KXSD9_MAX_CLIENTS];
     InputEventCircularReader mInputReader;
     sensors_event_t mPendingEvent;
+    bool mHasPendingEvent;
+    /* gravity and linear acceleration are computed here from every chip
+     * sample while one of them is enabled */
+    struct fusion_state mFusion;
 };
 
 /*****************************************************************************/
@@ -17,10 +17,12 @@
 #include <hardware/sensors.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 #include <dirent.h>
 #include <math.h>
 
 #include <poll.h>
+#include <sys/epoll.h>
 #include <pthread.h>
 
 #include <linux/input.h>
@@ -35,6 +37,12 @@
 
 /*****************************************************************************/
 
+/*
+ * Every driver registers the handles it serves and its input fd; the fds
+ * share one epoll set, so a wakeup only services the drivers that are
+ * ready or were left with events they could not hand out.  Adding a
+ * sensor is a matter of calling addSensor().
+ */
 struct sensors_poll_context_t {
     struct sensors_poll_device_t device; // must be first
 
@@ -46,53 +54,40 @@ struct sensors_poll_context_t {
 
 private:
     enum {
-        light           = 0,
-        proximity       = 1,
-        kxsd9           = 2,
-        numSensorDrivers,
-        numFds,
+        maxSensorDrivers    = 8,
+        maxHandles          = 16,
     };
 
-    static const size_t wake = numFds - 1;
+    static const uint32_t wake = maxSensorDrivers;
     static const char WAKE_MESSAGE = 'W';
-    struct pollfd mPollFds[numFds];
+    int mEpollFd;
     int mWritePipeFd;
-    SensorBase* mSensors[numSensorDrivers];
-
-    int handleToDriver(int handle) const {
-        switch (handle) {
-            case ID_A:
-            	return kxsd9;
-            case ID_P:
-                return proximity;
-            case ID_L:
-                return light;
-        }
-        return -EINVAL;
-    }
+    int mReadPipeFd;
+    int mNumSensorDrivers;
+    SensorBase* mSensors[maxSensorDrivers];
+    int8_t mHandleToDriver[maxHandles];
+    // drivers to service: ready fd or events left over, also set by
+    // activate() from the service's binder threads
+    volatile int32_t mReady;
+
+    int addSensor(SensorBase* sensor);
+    int handleToDriver(int handle) const;
 };
 
 /*****************************************************************************/
 
 sensors_poll_context_t::sensors_poll_context_t()
+    : mNumSensorDrivers(0),
+      mReady(0)
 {
-    mSensors[light] = new LightSensor();
-    mPollFds[light].fd = mSensors[light]->getFd();
-    mPollFds[light].events = POLLIN;
-    mPollFds[light].revents = 0;
-
-    mSensors[proximity] = new ProximitySensor();
-    mPollFds[proximity].fd = mSensors[proximity]->getFd();
-    mPollFds[proximity].events = POLLIN;
-    mPollFds[proximity].revents = 0;
-
+    memset(mHandleToDriver, -1, sizeof(mHandleToDriver));
 
+    mEpollFd = epoll_create(maxSensorDrivers + 1);
+    LOGE_IF(mEpollFd<0, "error creating epoll fd (%s)", strerror(errno));
 
-    mSensors[kxsd9] = new kxsd9Sensor();
-    mPollFds[kxsd9].fd = mSensors[kxsd9]->getFd();
-    mPollFds[kxsd9].events = POLLIN;
-    mPollFds[kxsd9].revents = 0;
-
+    addSensor(new LightSensor());
+    addSensor(new ProximitySensor());
+    addSensor(new kxsd9Sensor());
 
     int wakeFds[2];
     int result = pipe(wakeFds);
@@ -100,25 +95,75 @@ sensors_poll_context_t::sensors_poll_context_t()
     fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
     fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
     mWritePipeFd = wakeFds[1];
+    mReadPipeFd = wakeFds[0];
 
-    mPollFds[wake].fd = wakeFds[0];
-    mPollFds[wake].events = POLLIN;
-    mPollFds[wake].revents = 0;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = wake;
+    result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mReadPipeFd, &ev);
+    LOGE_IF(result<0, "error adding wake pipe to epoll (%s)", strerror(errno));
 }
 
 sensors_poll_context_t::~sensors_poll_context_t() {
-    for (int i=0 ; i<numSensorDrivers ; i++) {
+    for (int i=0 ; i<mNumSensorDrivers ; i++) {
         delete mSensors[i];
     }
-    close(mPollFds[wake].fd);
+    close(mEpollFd);
+    close(mReadPipeFd);
     close(mWritePipeFd);
 }
 
+int sensors_poll_context_t::addSensor(SensorBase* sensor) {
+    if (mNumSensorDrivers == maxSensorDrivers) {
+        LOGE("too many sensor drivers");
+        delete sensor;
+        return -ENOSPC;
+    }
+    const int index = mNumSensorDrivers++;
+    mSensors[index] = sensor;
+
+    int32_t handles[maxHandles];
+    int n = sensor->getHandles(handles, maxHandles);
+    for (int i=0 ; i<n ; i++) {
+        if (handles[i] < 0 || handles[i] >= maxHandles ||
+                mHandleToDriver[handles[i]] >= 0) {
+            LOGE("sensor handle %d can't be registered", handles[i]);
+            continue;
+        }
+        mHandleToDriver[handles[i]] = index;
+    }
+
+    // a driver without its input device still answers for its handles
+    int fd = sensor->getFd();
+    if (fd >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = index;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            LOGE("error adding sensor fd %d to epoll (%s)", fd, strerror(errno));
+        }
+    }
+    if (sensor->hasPendingEvents()) {
+        mReady |= 1 << index;
+    }
+    return index;
+}
+
+int sensors_poll_context_t::handleToDriver(int handle) const {
+    if (handle < 0 || handle >= maxHandles || mHandleToDriver[handle] < 0)
+        return -EINVAL;
+    return mHandleToDriver[handle];
+}
+
 int sensors_poll_context_t::activate(int handle, int enabled) {
     int index = handleToDriver(handle);
     if (index < 0) return index;
     int err =  mSensors[index]->enable(handle, enabled);
     if (enabled && !err) {
+        // the poll thread picks up an initial state on its next pass
+        if (mSensors[index]->hasPendingEvents()) {
+            android_atomic_or(1 << index, &mReady);
+        }
         const char wakeMessage(WAKE_MESSAGE);
         int result = write(mWritePipeFd, &wakeMessage, 1);
         LOGE_IF(result<0, "error sending wake message (%s)", strerror(errno));
@@ -139,37 +184,64 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
     int n = 0;
 
     do {
-        // see if we have some leftover from the last poll()
-        for (int i=0 ; count && i<numSensorDrivers ; i++) {
+        // service the drivers that are ready or have some leftover from
+        // the last pass
+        uint32_t ready = android_atomic_and(0, &mReady);
+        uint32_t again = 0;
+        for (int i=0 ; ready && i<mNumSensorDrivers ; i++) {
+            if (!(ready & (1 << i)))
+                continue;
+            if (!count) {
+                again |= 1 << i;
+                continue;
+            }
             SensorBase* const sensor(mSensors[i]);
-            if ((mPollFds[i].revents & POLLIN) || (sensor->hasPendingEvents())) {
-                int nb = sensor->readEvents(data, count);
-                if (nb < count) {
-                    // no more data for this sensor
-                    mPollFds[i].revents = 0;
-                }
-                count -= nb;
-                nbEvents += nb;
-                data += nb;
+            int nb = sensor->readEvents(data, count);
+            if (nb < 0) {
+                continue;
+            }
+            if (nb == count || sensor->hasPendingEvents()) {
+                // there may be more, come back to it
+                again |= 1 << i;
             }
+            count -= nb;
+            nbEvents += nb;
+            data += nb;
+        }
+        if (again) {
+            android_atomic_or(again, &mReady);
         }
 
         if (count) {
             // we still have some room, so try to see if we can get
             // some events immediately or just wait if we don't have
             // anything to return
-            n = poll(mPollFds, numFds, nbEvents ? 0 : -1);
+            struct epoll_event events[maxSensorDrivers + 1];
+            n = epoll_wait(mEpollFd, events, maxSensorDrivers + 1,
+                    (nbEvents || mReady) ? 0 : -1);
             if (n<0) {
-                LOGE("poll() failed (%s)", strerror(errno));
+                if (errno == EINTR)
+                    continue;
+                LOGE("epoll_wait() failed (%s)", strerror(errno));
                 return -errno;
             }
-            if (mPollFds[wake].revents & POLLIN) {
-                char msg;
-                int result = read(mPollFds[wake].fd, &msg, 1);
-                LOGE_IF(result<0, "error reading from wake pipe (%s)", strerror(errno));
-                LOGE_IF(msg != WAKE_MESSAGE, "unknown message on wake queue (0x%02x)", int(msg));
-                mPollFds[wake].revents = 0;
+            ready = 0;
+            for (int i=0 ; i<n ; i++) {
+                if (events[i].data.u32 == wake) {
+                    char msg;
+                    int result = read(mReadPipeFd, &msg, 1);
+                    LOGE_IF(result<0, "error reading from wake pipe (%s)", strerror(errno));
+                    LOGE_IF(msg != WAKE_MESSAGE, "unknown message on wake queue (0x%02x)", int(msg));
+                } else {
+                    ready |= 1 << events[i].data.u32;
+                }
+            }
+            if (ready) {
+                android_atomic_or(ready, &mReady);
             }
+            // pending events flagged by activate() count as progress
+            if (!n && mReady)
+                n = 1;
         }
         // if we have events and space, go read them
     } while (n && count);
@@ -43,6 +43,8 @@ int init_nusensors(hw_module_t const* module, hw_device_t** device);
 #define ID_P  (3)
 #define ID_L  (4)
 #define ID_T  (5)
+#define ID_G  (6)
+#define ID_LA (7)
 
 /*****************************************************************************/
 
@@ -15,7 +15,7 @@
  */
 
 #include <hardware/sensors.h>
-#include <sys/limits.h>
+#include <limits.h>
 
 #include "nusensors.h"
 
@@ -42,6 +42,27 @@ static const struct sensor_t sSensorList[] = {
 				0.2f, 
 				20000,
 				{ } },
+        /* derived from the accelerometer inside the HAL, see fusion.h */
+        { "KXSD9 Gravity sensor",
+                "GT-I8320",
+                1, 
+				SENSORS_HANDLE_BASE+ID_G,
+                SENSOR_TYPE_GRAVITY, 
+				GRAVITY_EARTH, 
+				(4.0f*9.81f)/256.0f, 
+				0.2f, 
+				20000,
+				{ } },
+        { "KXSD9 Linear acceleration sensor",
+                "GT-I8320",
+                1, 
+				SENSORS_HANDLE_BASE+ID_LA,
+                SENSOR_TYPE_LINEAR_ACCELERATION, 
+				4.0f*9.81f, 
+				(4.0f*9.81f)/256.0f, 
+				0.2f, 
+				20000,
+				{ } },
 /*
         { "KXSD9 Magnetic field sensor",
                 "GT-I8320",
@@ -0,0 +1,742 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Record and replay of the sensor input devices.
+ *
+ * usage: sreplay -r <trace> [-t seconds]
+ *        sreplay [-x speed] [-d delay_ms] [-s handle,...] [-o <trace>] <trace>
+ *
+ * -r records what the "accel", "light sensor" and "proximity sensor" input
+ * devices report while the HAL keeps every sensor enabled (run it on the
+ * phone).  A trace line is "<usec> <device> <type> <code> <value>".
+ *
+ * Without -r the trace is replayed through uinput devices carrying the same
+ * names, so the HAL finds them exactly as it finds the drivers, and the HAL
+ * is driven through its poll() entry point the way the sensor service does.
+ * -x scales the replay speed (0 replays as fast as possible), -d is the
+ * delay requested for every sensor and -s restricts the enabled handles.
+ * -o records the replayed devices while replaying and checks that they
+ * reported what the input core forwards of the trace (unchanged values and
+ * empty frames dropped); a mismatch fails the run.
+ *
+ * Replay only exists in the host build: the control nodes (/dev/accel, ...)
+ * do not exist there and sreplay_host.c accepts their ioctls, and where the
+ * host has no uinput it provides the input devices as well.  The phone
+ * build only records and keeps libc untouched.
+ *
+ * Reported per handle: events delivered; per device: frames injected and
+ * frames that never reached the device's own handle (a sensor delayed
+ * slower than the trace counts its decimation here); overall: latency from
+ * the kernel timestamp of a frame to its delivery by poll(), and CPU time
+ * of the polling thread per delivered event.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+
+#include <linux/input.h>
+#ifdef SREPLAY_HOST
+#include <linux/uinput.h>
+#endif
+
+#include <hardware/sensors.h>
+
+#include "nusensors.h"
+#ifdef SREPLAY_HOST
+#include "sreplay.h"
+#endif
+
+extern "C" const struct sensors_module_t HAL_MODULE_INFO_SYM;
+
+/*****************************************************************************/
+
+struct axis {
+    int code;
+    int min;
+    int max;
+};
+
+static const struct replay_device {
+    const char* name;       // input device name the drivers look for
+    const char* tag;        // name in the trace
+    int handle;             // handle fed by the device
+    struct axis axes[4];
+    int numAxes;
+} sDevices[] = {
+    { "accel", "accel", ID_A,
+            { { EVENT_TYPE_ACCEL_X, 0, 4095 }, { EVENT_TYPE_ACCEL_Y, 0, 4095 },
+              { EVENT_TYPE_ACCEL_Z, 0, 4095 }, { EVENT_TYPE_ACCEL_STATUS, 0, 3 } }, 4 },
+    { "light sensor", "light", ID_L,
+            { { EVENT_TYPE_LIGHT, 0, 4095 } }, 1 },
+    { "proximity sensor", "proximity", ID_P,
+            { { EVENT_TYPE_PROXIMITY, 0, 1 } }, 1 },
+};
+
+#define NUM_DEVICES     int(ARRAY_SIZE(sDevices))
+#define MAX_HANDLES     16
+
+struct trace_event {
+    int64_t usec;
+    int device;
+    int type;
+    int code;
+    int value;
+};
+
+static volatile int sStop;
+
+static int64_t now(clockid_t clock)
+{
+    struct timespec t;
+    clock_gettime(clock, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
+static int openInput(const char* inputName)
+{
+    char devname[PATH_MAX];
+    struct dirent* de;
+    int fd = -1;
+    DIR* dir = opendir("/dev/input");
+
+    if (!dir)
+        return -1;
+    while (fd < 0 && (de = readdir(dir))) {
+        char name[80];
+        if (strncmp(de->d_name, "event", 5))
+            continue;
+        snprintf(devname, sizeof(devname), "/dev/input/%s", de->d_name);
+        fd = open(devname, O_RDONLY | O_NONBLOCK);
+        if (fd < 0)
+            continue;
+        if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) < 1)
+            name[0] = '\0';
+        if (strcmp(name, inputName)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    closedir(dir);
+    return fd;
+}
+
+static sensors_poll_device_t* openHal(sensor_t const** list, int* count)
+{
+    sensors_poll_device_t* dev;
+    int err = sensors_open(&HAL_MODULE_INFO_SYM.common, &dev);
+
+    if (err) {
+        fprintf(stderr, "cannot open the sensors HAL (%s)\n", strerror(-err));
+        return NULL;
+    }
+    *count = HAL_MODULE_INFO_SYM.get_sensors_list(
+            const_cast<sensors_module_t*>(&HAL_MODULE_INFO_SYM), list);
+    return dev;
+}
+
+static void onSignal(int)
+{
+    sStop = 1;
+}
+
+/*****************************************************************************/
+
+// Copy what the devices report to a trace until *stop is set or the
+// CLOCK_MONOTONIC deadline passes; returns the number of events written.
+static unsigned recordInputs(struct pollfd* fds, FILE* out, int64_t end, volatile int* stop)
+{
+    int64_t first = -1;
+    unsigned lines = 0;
+
+    fprintf(out, "# sreplay trace: <usec> <device> <type> <code> <value>\n");
+    while (!*stop && now(CLOCK_MONOTONIC) < end) {
+        if (poll(fds, NUM_DEVICES, 100) <= 0)
+            continue;
+        for (int i = 0; i < NUM_DEVICES; i++) {
+            struct input_event ev[64];
+            if (!(fds[i].revents & POLLIN))
+                continue;
+            ssize_t n = read(fds[i].fd, ev, sizeof(ev));
+            for (ssize_t j = 0; j < n / ssize_t(sizeof(ev[0])); j++) {
+                int64_t usec = ev[j].time.tv_sec * 1000000LL + ev[j].time.tv_usec;
+                if (first < 0)
+                    first = usec;
+                fprintf(out, "%lld %s %d %d %d\n", (long long)(usec - first),
+                        sDevices[i].tag, ev[j].type, ev[j].code, ev[j].value);
+                lines++;
+            }
+        }
+    }
+    return lines;
+}
+
+static void openInputs(struct pollfd* fds)
+{
+    for (int i = 0; i < NUM_DEVICES; i++) {
+        fds[i].fd = openInput(sDevices[i].name);
+        fds[i].events = POLLIN;
+        if (fds[i].fd < 0)
+            fprintf(stderr, "no '%s' input device\n", sDevices[i].name);
+    }
+}
+
+static int record(const char* path, int seconds)
+{
+    sensor_t const* list;
+    int count;
+    struct pollfd fds[NUM_DEVICES];
+    FILE* out;
+    unsigned lines;
+
+    sensors_poll_device_t* dev = openHal(&list, &count);
+    if (!dev)
+        return 1;
+    // keep every sensor running at its fastest rate while recording
+    for (int i = 0; i < count; i++) {
+        dev->setDelay(dev, list[i].handle, 0);
+        dev->activate(dev, list[i].handle, 1);
+    }
+    openInputs(fds);
+
+    out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    lines = recordInputs(fds, out, now(CLOCK_MONOTONIC) + seconds * 1000000000LL, &sStop);
+    fclose(out);
+
+    for (int i = 0; i < count; i++)
+        dev->activate(dev, list[i].handle, 0);
+    dev->common.close(&dev->common);
+    printf("recorded %u events to %s\n", lines, path);
+    return 0;
+}
+
+/*****************************************************************************/
+
+#ifdef SREPLAY_HOST
+
+static const char* handleName(sensor_t const* list, int count, int handle)
+{
+    for (int i = 0; i < count; i++) {
+        if (list[i].handle == handle)
+            return list[i].name;
+    }
+    return "?";
+}
+
+static int loadTrace(const char* path, trace_event** events)
+{
+    char line[256];
+    int n = 0, size = 0;
+    FILE* f = fopen(path, "r");
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    *events = NULL;
+    while (fgets(line, sizeof(line), f)) {
+        long long usec;
+        char tag[32];
+        trace_event e;
+        int i;
+
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%lld %31s %d %d %d", &usec, tag, &e.type, &e.code, &e.value) != 5)
+            continue;
+        for (i = 0; i < NUM_DEVICES && strcmp(tag, sDevices[i].tag); i++)
+            ;
+        if (i == NUM_DEVICES)
+            continue;
+        e.usec = usec;
+        e.device = i;
+        if (n == size) {
+            size = size ? size * 2 : 1024;
+            *events = (trace_event*)realloc(*events, size * sizeof(trace_event));
+        }
+        (*events)[n++] = e;
+    }
+    fclose(f);
+    return n;
+}
+
+// where replayed events go: a uinput device or, on hosts without uinput,
+// one of sreplay_host.c's
+struct replay_sink {
+    int fd;
+    int fake;
+};
+
+static int createDevice(const replay_device& d, replay_sink* sink)
+{
+    struct uinput_user_dev u;
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+
+    if (fd < 0)
+        fd = open("/dev/input/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0) {
+        sink->fd = -1;
+        sink->fake = sreplay_fake_input_create(d.name);
+        if (sink->fake < 0) {
+            fprintf(stderr, "cannot create '%s' (%s)\n", d.name, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+    memset(&u, 0, sizeof(u));
+    strncpy(u.name, d.name, UINPUT_MAX_NAME_SIZE - 1);
+    u.id.bustype = BUS_VIRTUAL;
+    ioctl(fd, UI_SET_EVBIT, EV_SYN);
+    ioctl(fd, UI_SET_EVBIT, EV_ABS);
+    for (int i = 0; i < d.numAxes; i++) {
+        ioctl(fd, UI_SET_ABSBIT, d.axes[i].code);
+        u.absmin[d.axes[i].code] = d.axes[i].min;
+        u.absmax[d.axes[i].code] = d.axes[i].max;
+    }
+    if (write(fd, &u, sizeof(u)) != sizeof(u) || ioctl(fd, UI_DEV_CREATE)) {
+        fprintf(stderr, "cannot create '%s' (%s)\n", d.name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    sink->fd = fd;
+    sink->fake = -1;
+    return 0;
+}
+
+static int inject(const replay_sink& sink, const struct input_event* ev)
+{
+    if (sink.fd < 0)
+        return sreplay_fake_input_write(sink.fake, ev);
+    return write(sink.fd, ev, sizeof(*ev)) == sizeof(*ev) ? 0 : -1;
+}
+
+static void destroyDevice(const replay_sink& sink)
+{
+    if (sink.fd < 0)
+        return;
+    ioctl(sink.fd, UI_DEV_DESTROY);
+    close(sink.fd);
+}
+
+struct poll_stats {
+    sensors_poll_device_t* dev;
+    int64_t start;                  // CLOCK_REALTIME, as the evdev timestamps
+    unsigned delivered[MAX_HANDLES];
+    unsigned other;                 // not stamped by the replay (initial states)
+    int64_t* latency;
+    unsigned numLatency;
+    unsigned maxLatency;
+    int64_t cpu;
+};
+
+static void* pollThread(void* arg)
+{
+    poll_stats* s = (poll_stats*)arg;
+    sensors_event_t buffer[16];
+    struct rusage ru;
+
+    while (!sStop) {
+        int n = s->dev->poll(s->dev, buffer, ARRAY_SIZE(buffer));
+        int64_t t = now(CLOCK_REALTIME);
+        if (n < 0) {
+            fprintf(stderr, "poll() failed (%s)\n", strerror(-n));
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            const sensors_event_t& e(buffer[i]);
+            if (e.sensor >= 0 && e.sensor < MAX_HANDLES)
+                s->delivered[e.sensor]++;
+            if (e.timestamp < s->start || e.timestamp > t) {
+                s->other++;
+                continue;
+            }
+            if (s->numLatency == s->maxLatency) {
+                s->maxLatency = s->maxLatency ? s->maxLatency * 2 : 4096;
+                s->latency = (int64_t*)realloc(s->latency, s->maxLatency * sizeof(int64_t));
+            }
+            s->latency[s->numLatency++] = t - e.timestamp;
+        }
+    }
+
+    getrusage(RUSAGE_THREAD, &ru);
+    s->cpu = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000LL +
+            (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000LL;
+    return NULL;
+}
+
+static int compareLatency(const void* a, const void* b)
+{
+    int64_t d = *(const int64_t*)a - *(const int64_t*)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+struct recorder {
+    struct pollfd fds[NUM_DEVICES];
+    FILE* out;
+    volatile int stop;
+    unsigned lines;
+};
+
+static void* recordThread(void* arg)
+{
+    recorder* r = (recorder*)arg;
+    r->lines = recordInputs(r->fds, r->out, INT64_MAX, &r->stop);
+    return NULL;
+}
+
+// Drop what the input core would not forward: unchanged values and frames
+// without a change.  Returns the number of events kept.
+static int filterTrace(const trace_event* in, int n, trace_event* out)
+{
+    int last[NUM_DEVICES][ABS_CNT];
+    int pending[NUM_DEVICES];
+    int kept = 0;
+
+    memset(last, 0, sizeof(last));
+    memset(pending, 0, sizeof(pending));
+    for (int i = 0; i < n; i++) {
+        const trace_event& e(in[i]);
+        if (e.type == EV_ABS && e.code >= 0 && e.code < ABS_CNT) {
+            if (last[e.device][e.code] == e.value)
+                continue;
+            last[e.device][e.code] = e.value;
+            pending[e.device] = 1;
+        } else if (e.type == EV_SYN && e.code == SYN_REPORT) {
+            if (!pending[e.device])
+                continue;
+            pending[e.device] = 0;
+        }
+        out[kept++] = e;
+    }
+    return kept;
+}
+
+// Compare, device by device, the events recorded during the replay with the
+// ones the trace should have produced.  Returns the number of devices that
+// differ.
+static int checkRoundTrip(const trace_event* events, int numEvents, const char* path)
+{
+    trace_event* recorded;
+    trace_event* expected = (trace_event*)malloc(numEvents * sizeof(trace_event));
+    int numExpected = filterTrace(events, numEvents, expected);
+    int numRecorded = loadTrace(path, &recorded);
+    int bad = 0;
+
+    if (numRecorded < 0)
+        numRecorded = 0;
+    for (int d = 0; d < NUM_DEVICES; d++) {
+        int i = 0, j = 0, n = 0, nr = 0;
+        const trace_event* diff = NULL;
+
+        for (;;) {
+            while (i < numExpected && expected[i].device != d)
+                i++;
+            while (j < numRecorded && recorded[j].device != d)
+                j++;
+            if (i == numExpected || j == numRecorded)
+                break;
+            if (!diff && (expected[i].type != recorded[j].type ||
+                    expected[i].code != recorded[j].code ||
+                    expected[i].value != recorded[j].value))
+                diff = &expected[i];
+            i++, j++, n++, nr++;
+        }
+        for (; i < numExpected; i++)
+            n += expected[i].device == d;
+        for (; j < numRecorded; j++)
+            nr += recorded[j].device == d;
+
+        if (diff || n != nr) {
+            bad++;
+            printf("round trip %s: FAIL, %d events expected, %d recorded", sDevices[d].tag, n, nr);
+            if (diff)
+                printf(", first difference at %lld us", (long long)diff->usec);
+            printf("\n");
+        } else {
+            printf("round trip %s: %d events match\n", sDevices[d].tag, n);
+        }
+    }
+    free(expected);
+    free(recorded);
+    return bad;
+}
+
+static int replay(const char* path, double speed, int64_t delay, uint32_t handles,
+        const char* checkPath)
+{
+    trace_event* events;
+    replay_sink sinks[NUM_DEVICES];
+    int last[NUM_DEVICES][ABS_CNT];
+    bool changed[NUM_DEVICES];
+    unsigned injected[NUM_DEVICES];
+    sensor_t const* list;
+    int count;
+    poll_stats stats;
+    pthread_t thread;
+    recorder rec;
+    pthread_t recThread;
+    int bad = 0;
+
+    int numEvents = loadTrace(path, &events);
+    if (numEvents <= 0) {
+        fprintf(stderr, "%s: empty trace\n", path);
+        return 1;
+    }
+
+    for (int i = 0; i < NUM_DEVICES; i++) {
+        if (createDevice(sDevices[i], &sinks[i]))
+            return 1;
+    }
+    // wait for the nodes to show up the way the drivers would find them
+    for (int i = 0; i < NUM_DEVICES; i++) {
+        int fd = -1;
+        for (int tries = 0; fd < 0 && tries < 200; tries++) {
+            fd = openInput(sDevices[i].name);
+            if (fd < 0)
+                usleep(10000);
+        }
+        if (fd < 0) {
+            fprintf(stderr, "'%s' did not appear in /dev/input\n", sDevices[i].name);
+            return 1;
+        }
+        close(fd);
+    }
+
+    if (checkPath) {
+        memset(&rec, 0, sizeof(rec));
+        rec.out = fopen(checkPath, "w");
+        if (!rec.out) {
+            perror(checkPath);
+            return 1;
+        }
+        openInputs(rec.fds);
+        pthread_create(&recThread, NULL, recordThread, &rec);
+    }
+
+    sreplay_fake_control = 1;
+    sensors_poll_device_t* dev = openHal(&list, &count);
+    if (!dev)
+        return 1;
+    for (int i = 0; i < count; i++) {
+        if (!(handles & (1 << list[i].handle)))
+            continue;
+        dev->setDelay(dev, list[i].handle, delay);
+        dev->activate(dev, list[i].handle, 1);
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    stats.dev = dev;
+    stats.start = now(CLOCK_REALTIME);
+    pthread_create(&thread, NULL, pollThread, &stats);
+
+    memset(last, 0, sizeof(last));
+    memset(changed, 0, sizeof(changed));
+    memset(injected, 0, sizeof(injected));
+
+    const int64_t t0 = now(CLOCK_MONOTONIC);
+    for (int i = 0; i < numEvents && !sStop; i++) {
+        const trace_event& e(events[i]);
+        struct input_event ev;
+
+        if (speed > 0) {
+            int64_t due = t0 + int64_t(e.usec * 1000 / speed);
+            struct timespec ts;
+            ts.tv_sec = due / 1000000000LL;
+            ts.tv_nsec = due % 1000000000LL;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+
+        // the input core drops unchanged values and empty frames: only
+        // count the frames it forwards
+        if (e.type == EV_ABS && e.code >= 0 && e.code < ABS_CNT) {
+            if (last[e.device][e.code] != e.value)
+                changed[e.device] = true;
+            last[e.device][e.code] = e.value;
+        } else if (e.type == EV_SYN && e.code == SYN_REPORT) {
+            if (changed[e.device])
+                injected[e.device]++;
+            changed[e.device] = false;
+        }
+
+        memset(&ev, 0, sizeof(ev));
+        ev.type = e.type;
+        ev.code = e.code;
+        ev.value = e.value;
+        if (inject(sinks[e.device], &ev))
+            fprintf(stderr, "uinput write failed (%s)\n", strerror(errno));
+    }
+    const int64_t elapsed = now(CLOCK_MONOTONIC) - t0;
+
+    // let the HAL drain, then wake poll() up: re-enabling the light sensor
+    // queues its initial state, an enable alone goes back to sleep
+    usleep(200000);
+    sStop = 1;
+    dev->activate(dev, ID_L, 0);
+    dev->activate(dev, ID_L, 1);
+    pthread_join(thread, NULL);
+    if (checkPath) {
+        rec.stop = 1;
+        pthread_join(recThread, NULL);
+        fclose(rec.out);
+        for (int i = 0; i < NUM_DEVICES; i++) {
+            if (rec.fds[i].fd >= 0)
+                close(rec.fds[i].fd);
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+        dev->activate(dev, list[i].handle, 0);
+    dev->common.close(&dev->common);
+    for (int i = 0; i < NUM_DEVICES; i++) {
+        if (sinks[i].fd < 0 && sreplay_fake_input_dropped(sinks[i].fake))
+            printf("%s: %u events lost to full readers\n", sDevices[i].tag,
+                    sreplay_fake_input_dropped(sinks[i].fake));
+        destroyDevice(sinks[i]);
+    }
+
+    unsigned total = 0;
+    printf("replayed %d events in %.3f s, %u control requests\n", numEvents,
+            elapsed / 1e9, sreplay_control_requests);
+    for (int h = 0; h < MAX_HANDLES; h++) {
+        if (!stats.delivered[h])
+            continue;
+        printf("handle %d (%s): %u events\n", h, handleName(list, count, h),
+                stats.delivered[h]);
+        total += stats.delivered[h];
+    }
+    for (int i = 0; i < NUM_DEVICES; i++) {
+        unsigned got = stats.delivered[sDevices[i].handle];
+        printf("%s: %u frames injected, %u dropped\n", sDevices[i].tag,
+                injected[i], got < injected[i] ? injected[i] - got : 0);
+    }
+    if (stats.numLatency) {
+        qsort(stats.latency, stats.numLatency, sizeof(int64_t), compareLatency);
+        int64_t sum = 0;
+        for (unsigned i = 0; i < stats.numLatency; i++)
+            sum += stats.latency[i];
+        printf("latency us: min %lld avg %lld p50 %lld p99 %lld max %lld\n",
+                (long long)(stats.latency[0] / 1000),
+                (long long)(sum / stats.numLatency / 1000),
+                (long long)(stats.latency[stats.numLatency / 2] / 1000),
+                (long long)(stats.latency[stats.numLatency * 99 / 100] / 1000),
+                (long long)(stats.latency[stats.numLatency - 1] / 1000));
+    }
+    if (total) {
+        printf("cpu: %.3f ms in poll(), %.2f us per event (%u initial)\n",
+                stats.cpu / 1e6, stats.cpu / 1e3 / total, stats.other);
+    }
+    if (checkPath) {
+        printf("recorded %u events to %s\n", rec.lines, checkPath);
+        bad = checkRoundTrip(events, numEvents, checkPath);
+    }
+
+    sreplay_fake_input_destroy();
+    free(stats.latency);
+    free(events);
+    return bad ? 1 : 0;
+}
+
+#endif // SREPLAY_HOST
+
+/*****************************************************************************/
+
+static void usage(const char* name)
+{
+#ifdef SREPLAY_HOST
+    fprintf(stderr,
+            "usage: %s -r <trace> [-t seconds]\n"
+            "       %s [-x speed] [-d delay_ms] [-s handle,...] [-o <trace>] <trace>\n",
+            name, name);
+#else
+    fprintf(stderr, "usage: %s -r <trace> [-t seconds]\n", name);
+#endif
+}
+
+int main(int argc, char** argv)
+{
+    const char* recordPath = NULL;
+    const char* checkPath = NULL;
+    int seconds = 10;
+    double speed = 1.0;
+    int64_t delay = 0;
+    uint32_t handles = ~0u;
+    int c;
+
+    while ((c = getopt(argc, argv, "r:t:x:d:s:o:")) != -1) {
+        switch (c) {
+            case 'r':
+                recordPath = optarg;
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                break;
+            case 'x':
+                speed = atof(optarg);
+                break;
+            case 'd':
+                delay = atoll(optarg) * 1000000LL;
+                break;
+            case 'o':
+                checkPath = optarg;
+                break;
+            case 's': {
+                char* p = optarg;
+                handles = 0;
+                while (*p) {
+                    handles |= 1 << strtol(p, &p, 0);
+                    if (*p == ',')
+                        p++;
+                    else if (*p)
+                        break;
+                }
+                break;
+            }
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (recordPath)
+        return record(recordPath, seconds);
+#ifdef SREPLAY_HOST
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    return replay(argv[optind], speed, delay, handles, checkPath);
+#else
+    (void)checkPath; (void)speed; (void)delay; (void)handles;
+    usage(argv[0]);
+    return 1;
+#endif
+}
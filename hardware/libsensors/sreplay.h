@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORS_REPLAY_H
+#define ANDROID_SENSORS_REPLAY_H
+
+#include <sys/cdefs.h>
+
+#include <linux/input.h>
+
+/* Kernel stand-ins of the host build, see sreplay_host.c */
+
+__BEGIN_DECLS
+
+/* set while replaying: ioctl() on a missing control node succeeds */
+extern int sreplay_fake_control;
+/* number of control node requests accepted that way */
+extern unsigned sreplay_control_requests;
+
+/* in-process input device listed under /dev/input, for hosts without
+ * uinput; returns the device index or -1 */
+int sreplay_fake_input_create(const char* name);
+/* emit an event on a device the way the input core would */
+int sreplay_fake_input_write(int device, const struct input_event* event);
+/* events that did not fit a reader's queue */
+unsigned sreplay_fake_input_dropped(int device);
+void sreplay_fake_input_destroy(void);
+
+__END_DECLS
+
+#endif  // ANDROID_SENSORS_REPLAY_H
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Kernel stand-ins for the host build of sreplay only; the target build
+ * never links this file, so nothing on the phone sees these overrides.
+ *
+ * Control nodes: the drivers compiled into sreplay talk to /dev/accel,
+ * /dev/light_sensor, ... with ioctl(); under replay those nodes do not
+ * exist and dev_fd is -1, so the requests are accepted and counted instead
+ * of failing.
+ *
+ * Input devices: where /dev/uinput is missing (containers, build servers)
+ * the replayed devices live in this process.  /dev/input is listed from a
+ * scratch directory, every open() of one of its nodes gets its own pipe and
+ * every event written is copied to all readers, stamped and filtered the
+ * way the input core does it.  EVIOCGNAME and EVIOCGABS are answered from
+ * the device table.
+ *
+ * Everything else goes to the kernel.
+ */
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+
+#include <linux/input.h>
+
+#include "sreplay.h"
+
+#define INPUT_DIR       "/dev/input"
+#define MAX_DEVICES     8
+#define MAX_READERS     64
+
+int sreplay_fake_control;
+unsigned sreplay_control_requests;
+
+struct fake_device {
+    char name[80];
+    int abs[ABS_CNT];
+    int changed;            /* an ABS value changed since the last SYN_REPORT */
+    unsigned dropped;       /* events lost to full reader pipes */
+};
+
+struct fake_reader {
+    int fd;                 /* handed to the caller */
+    int wfd;                /* our end */
+    int device;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fake_device s_devices[MAX_DEVICES];
+static int s_numDevices;
+static struct fake_reader s_readers[MAX_READERS];
+static int s_numReaders;
+static char s_dir[64];
+
+/* device index for a path under /dev/input, or -1 */
+static int fake_node(const char* path)
+{
+    int n;
+
+    if (!s_numDevices || strncmp(path, INPUT_DIR "/event", sizeof(INPUT_DIR "/event") - 1))
+        return -1;
+    n = atoi(path + sizeof(INPUT_DIR "/event") - 1);
+    return n < s_numDevices ? n : -1;
+}
+
+static struct fake_reader* fake_reader(int fd)
+{
+    int i;
+
+    for (i = 0; i < s_numReaders; i++) {
+        if (s_readers[i].fd == fd)
+            return &s_readers[i];
+    }
+    return NULL;
+}
+
+int sreplay_fake_input_create(const char* name)
+{
+    char node[PATH_MAX];
+    int n, fd;
+
+    pthread_mutex_lock(&s_lock);
+    if (!s_dir[0]) {
+        snprintf(s_dir, sizeof(s_dir), "/tmp/sreplay-input-XXXXXX");
+        if (!mkdtemp(s_dir)) {
+            s_dir[0] = '\0';
+            pthread_mutex_unlock(&s_lock);
+            return -1;
+        }
+    }
+    n = s_numDevices;
+    if (n == MAX_DEVICES) {
+        pthread_mutex_unlock(&s_lock);
+        return -1;
+    }
+    /* an empty file only, so that readdir() lists the node */
+    snprintf(node, sizeof(node), "%s/event%d", s_dir, n);
+    fd = syscall(SYS_openat, AT_FDCWD, node, O_WRONLY | O_CREAT, 0600);
+    if (fd >= 0)
+        syscall(SYS_close, fd);
+    memset(&s_devices[n], 0, sizeof(s_devices[n]));
+    strncpy(s_devices[n].name, name, sizeof(s_devices[n].name) - 1);
+    s_numDevices++;
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+int sreplay_fake_input_write(int device, const struct input_event* event)
+{
+    struct fake_device* d = &s_devices[device];
+    struct input_event ev = *event;
+    int i;
+
+    pthread_mutex_lock(&s_lock);
+    /* the input core forwards value changes and the frames that hold them */
+    if (ev.type == EV_ABS && ev.code < ABS_CNT) {
+        if (d->abs[ev.code] == ev.value) {
+            pthread_mutex_unlock(&s_lock);
+            return 0;
+        }
+        d->abs[ev.code] = ev.value;
+        d->changed = 1;
+    } else if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
+        if (!d->changed) {
+            pthread_mutex_unlock(&s_lock);
+            return 0;
+        }
+        d->changed = 0;
+    }
+    gettimeofday(&ev.time, NULL);
+    for (i = 0; i < s_numReaders; i++) {
+        if (s_readers[i].device != device)
+            continue;
+        if (write(s_readers[i].wfd, &ev, sizeof(ev)) != sizeof(ev))
+            d->dropped++;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return 0;
+}
+
+unsigned sreplay_fake_input_dropped(int device)
+{
+    return s_devices[device].dropped;
+}
+
+void sreplay_fake_input_destroy(void)
+{
+    char node[PATH_MAX];
+    int i;
+
+    pthread_mutex_lock(&s_lock);
+    for (i = 0; i < s_numDevices; i++) {
+        snprintf(node, sizeof(node), "%s/event%d", s_dir, i);
+        unlink(node);
+    }
+    if (s_dir[0])
+        rmdir(s_dir);
+    s_dir[0] = '\0';
+    s_numDevices = 0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+/*****************************************************************************/
+
+int open(const char* path, int flags, ...)
+{
+    mode_t mode = 0;
+    int device, fds[2];
+
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+
+    pthread_mutex_lock(&s_lock);
+    device = fake_node(path);
+    if (device < 0) {
+        pthread_mutex_unlock(&s_lock);
+        return syscall(SYS_openat, AT_FDCWD, path, flags, mode);
+    }
+    if (s_numReaders == MAX_READERS || pipe(fds) < 0) {
+        pthread_mutex_unlock(&s_lock);
+        errno = EMFILE;
+        return -1;
+    }
+    /* evdev drops what a slow client cannot take, never blocks the device */
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    if (flags & O_NONBLOCK)
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    s_readers[s_numReaders].fd = fds[0];
+    s_readers[s_numReaders].wfd = fds[1];
+    s_readers[s_numReaders].device = device;
+    s_numReaders++;
+    pthread_mutex_unlock(&s_lock);
+    return fds[0];
+}
+
+int close(int fd)
+{
+    struct fake_reader* r;
+
+    pthread_mutex_lock(&s_lock);
+    r = fake_reader(fd);
+    if (r) {
+        syscall(SYS_close, r->wfd);
+        *r = s_readers[--s_numReaders];
+    }
+    pthread_mutex_unlock(&s_lock);
+    return syscall(SYS_close, fd);
+}
+
+DIR* opendir(const char* name)
+{
+    static DIR* (*real_opendir)(const char*);
+
+    if (!real_opendir)
+        real_opendir = (DIR* (*)(const char*))dlsym(RTLD_NEXT, "opendir");
+    if (s_numDevices && !strcmp(name, INPUT_DIR))
+        name = s_dir;
+    return real_opendir(name);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    struct fake_reader* r;
+    va_list ap;
+    void* arg;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void*);
+    va_end(ap);
+
+    if (fd < 0 && sreplay_fake_control) {
+        sreplay_control_requests++;
+        return 0;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    r = fake_reader(fd);
+    if (r) {
+        const struct fake_device* d = &s_devices[r->device];
+        int ret = -1;
+
+        if (_IOC_TYPE(request) == 'E' && _IOC_NR(request) == _IOC_NR(EVIOCGNAME(0))) {
+            size_t len = _IOC_SIZE(request);
+            strncpy((char*)arg, d->name, len);
+            ((char*)arg)[len - 1] = '\0';
+            ret = (int)strlen((char*)arg) + 1;
+        } else if (_IOC_TYPE(request) == 'E' &&
+                   (_IOC_NR(request) & ~(ABS_CNT - 1)) == _IOC_NR(EVIOCGABS(0))) {
+            struct input_absinfo* info = (struct input_absinfo*)arg;
+            memset(info, 0, sizeof(*info));
+            info->value = d->abs[_IOC_NR(request) & (ABS_CNT - 1)];
+            ret = 0;
+        } else {
+            errno = EINVAL;
+        }
+        pthread_mutex_unlock(&s_lock);
+        return ret;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return syscall(SYS_ioctl, fd, request, arg);
+}